@@ -0,0 +1,150 @@
+/**
+ * @file bench/embed_bench.cpp
+ * @brief Benchmark of many small downloads, spawning tftp-client for every file is compared
+ * with in-process transfers of libtftp AsyncClient
+ * @author Lukas Vecerka (xvecer30)
+*/
+#include "client/async_client.hpp"
+#include "common/logger.hpp"
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <thread>
+#include <csignal>
+#include <filesystem>
+#include <cstring>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <netinet/in.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#define SMALL_FILE_SIZE 1000
+
+/**
+ * @brief Function for finding free UDP port on loopback
+ * @return port number
+*/
+int freePort(){
+    int sock = socket(AF_INET, SOCK_DGRAM, 0);
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    bind(sock, (struct sockaddr*)&addr, sizeof(addr));
+    socklen_t len = sizeof(addr);
+    getsockname(sock, (struct sockaddr*)&addr, &len);
+    close(sock);
+    return ntohs(addr.sin_port);
+}
+
+/**
+ * @brief Function for running program with its output discarded
+ * @param args Program and its arguments
+ * @param wait true if function should wait for program to exit
+ * @return pid of program, exit status if wait is true
+*/
+int spawn(const std::vector<std::string>& args, bool wait){
+    pid_t pid = fork();
+    if (pid == 0) {
+        int devNull = open("/dev/null", O_WRONLY);
+        dup2(devNull, STDOUT_FILENO);
+        dup2(devNull, STDERR_FILENO);
+        std::vector<char*> argv;
+        for (const auto& arg : args) {
+            argv.push_back(const_cast<char*>(arg.c_str()));
+        }
+        argv.push_back(nullptr);
+        execv(argv[0], argv.data());
+        _exit(127);
+    }
+    if (!wait) {
+        return pid;
+    }
+    int status;
+    waitpid(pid, &status, 0);
+    return WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+}
+
+/**
+ * @brief Function for printing result of one case
+ * @param mode Name of mode
+ * @param transfers Number of transfers
+ * @param failures Number of failed transfers
+ * @param seconds Wall time
+*/
+void report(const std::string& mode, int transfers, int failures, double seconds){
+    std::cerr << "embed_bench mode=" << mode
+              << " transfers=" << transfers
+              << " failures=" << failures
+              << " transfers_per_s=" << transfers / seconds
+              << " us_per_transfer=" << seconds * 1e6 / transfers << "\n";
+}
+
+int main(int argc, char* argv[]){
+    int transfers = argc > 1 ? std::stoi(argv[1]) : 500;
+    std::string clientPath = argc > 2 ? argv[2] : "./tftp-client";
+    std::string serverPath = argc > 3 ? argv[3] : "./tftp-server";
+    Logger::instance().setEnabled(false);
+
+    char rootDir[] = "/tmp/tftp-embed-XXXXXX";
+    if (mkdtemp(rootDir) == nullptr) {
+        std::cerr << "Failed to create root directory\n";
+        return 1;
+    }
+    std::string small = std::string(rootDir) + "/small";
+    std::ofstream(small) << std::string(SMALL_FILE_SIZE, 'x');
+
+    int port = freePort();
+    pid_t server = spawn({serverPath, "-p", std::to_string(port), rootDir}, false);
+
+    AsyncClient client("127.0.0.1", port);
+
+    // Wait until server is ready, memory upload and download check the library round trip
+    bool ready = false;
+    for (int i = 0; i < 50 && !ready; i++) {
+        auto sink = std::make_shared<MemorySink>();
+        auto future = client.get("small", sink);
+        client.run();
+        ready = future.get().ok && sink->data.size() == SMALL_FILE_SIZE;
+        if (!ready) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        }
+    }
+    auto uploaded = client.put("uploaded", std::make_unique<MemorySource>(std::vector<char>(SMALL_FILE_SIZE, 'y')), SMALL_FILE_SIZE);
+    client.run();
+    if (!ready || !uploaded.get().ok) {
+        std::cerr << "embed_bench failed to reach server\n";
+        kill(server, SIGINT);
+        waitpid(server, nullptr, 0);
+        return 1;
+    }
+
+    // Process per transfer, as orchestration did before
+    std::string destination = std::string(rootDir) + "/downloaded";
+    int failures = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < transfers; i++) {
+        failures += spawn({clientPath, "-h", "127.0.0.1", "-p", std::to_string(port), "-f", "small", "-t", destination}, true) != 0;
+    }
+    report("spawn", transfers, failures, std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+
+    // All transfers queued at once into one in-process loop, data are written into descriptor
+    failures = 0;
+    int fd = open(destination.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    start = std::chrono::steady_clock::now();
+    for (int i = 0; i < transfers; i++) {
+        client.get("small", std::make_shared<FdSink>(fd, false, 0), [&failures](const TransferResult& result) {
+            failures += !result.ok;
+        });
+    }
+    client.run();
+    report("libtftp", transfers, failures, std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+    close(fd);
+
+    kill(server, SIGINT);
+    waitpid(server, nullptr, 0);
+    std::filesystem::remove_all(rootDir);
+    return 0;
+}
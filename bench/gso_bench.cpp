@@ -0,0 +1,110 @@
+/**
+ * @file bench/gso_bench.cpp
+ * @brief Benchmark of sending windows of DATA packets over loopback with and without UDP GSO
+ * @author Lukas Vecerka (xvecer30)
+*/
+#include "common/packets.hpp"
+#include "common/session.hpp"
+#include "common/logger.hpp"
+#include <iostream>
+#include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <sys/socket.h>
+#include <sys/resource.h>
+#include <netinet/in.h>
+#include <unistd.h>
+
+/**
+ * @brief Function for getting CPU time consumed by calling thread
+ * @return CPU time in seconds
+*/
+double threadCpuTime(){
+    struct rusage usage;
+    getrusage(RUSAGE_THREAD, &usage);
+    return usage.ru_utime.tv_sec + usage.ru_stime.tv_sec + (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1e6;
+}
+
+/**
+ * @brief Function for sending bursts of DATA packets to receiver and measuring sender cost
+ * @param gso true if GSO should be used
+ * @param blockSize Size of data block
+ * @param windowSize Number of blocks in one burst
+ * @param totalBlocks Number of blocks to send
+*/
+void runCase(bool gso, uint16_t blockSize, uint16_t windowSize, size_t totalBlocks){
+    int receiver = socket(AF_INET, SOCK_DGRAM, 0);
+    int sender = socket(AF_INET, SOCK_DGRAM, 0);
+    int bufferSize = 8 * 1024 * 1024;
+    setsockopt(receiver, SOL_SOCKET, SO_RCVBUF, &bufferSize, sizeof(bufferSize));
+    setsockopt(sender, SOL_SOCKET, SO_SNDBUF, &bufferSize, sizeof(bufferSize));
+
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = 0;
+    bind(receiver, (struct sockaddr*)&addr, sizeof(addr));
+    socklen_t len = sizeof(addr);
+    getsockname(receiver, (struct sockaddr*)&addr, &len);
+
+    struct timeval tv = {0, 200000};
+    setsockopt(receiver, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+
+    // Receiver only drains socket and counts frames
+    std::atomic<size_t> received(0);
+    std::thread drain([&]() {
+        std::vector<char> buffer(BUFFER_SIZE);
+        while (recv(receiver, buffer.data(), buffer.size(), 0) > 0) {
+            received++;
+        }
+    });
+
+    BlockWindow window;
+    for (uint16_t i = 0; i < windowSize; i++) {
+        window.push().assign(blockSize, 'x');
+    }
+    std::vector<char> burst;
+    DataPacket::gsoEnabled.store(gso);
+
+    double cpuStart = threadCpuTime();
+    auto start = std::chrono::steady_clock::now();
+    uint16_t block = 1;
+    for (size_t sent = 0; sent < totalBlocks; sent += windowSize) {
+        DataPacket::sendBurst(sender, addr, block, window, burst);
+        block += windowSize;
+    }
+    auto end = std::chrono::steady_clock::now();
+    double cpu = threadCpuTime() - cpuStart;
+
+    drain.join();
+    close(sender);
+    close(receiver);
+
+    double seconds = std::chrono::duration<double>(end - start).count();
+    double megabytes = (double)totalBlocks * blockSize / 1e6;
+    std::cerr << "gso_bench mode=" << (gso && DataPacket::gsoEnabled.load() ? "gso" : "sendto")
+              << " blksize=" << blockSize
+              << " windowsize=" << windowSize
+              << " blocks=" << totalBlocks
+              << " received=" << received.load()
+              << " MBps=" << megabytes / seconds
+              << " cpu_ns_per_block=" << cpu * 1e9 / totalBlocks << "\n";
+}
+
+int main(int argc, char* argv[]){
+    size_t totalBlocks = argc > 1 ? std::stoul(argv[1]) : 200000;
+
+    // Every sent DATA packet is logged, silence it so only sending is measured
+    Logger::instance().setEnabled(false);
+
+    for (uint16_t blockSize : {1428, 8192}) {
+        for (uint16_t windowSize : {8, 32}) {
+            runCase(false, blockSize, windowSize, totalBlocks);
+            runCase(true, blockSize, windowSize, totalBlocks);
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,177 @@
+/**
+ * @file bench/latency_bench.cpp
+ * @brief Benchmark of request-to-completion latency of small file downloads, default blocking
+ * server sessions are compared with low latency mode (busy polling and spinning)
+ * @author Lukas Vecerka (xvecer30)
+*/
+#include "common/packets.hpp"
+#include "common/session.hpp"
+#include "common/logger.hpp"
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <chrono>
+#include <thread>
+#include <csignal>
+#include <cstring>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <netinet/in.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#define SMALL_FILE_SIZE 1000
+
+/**
+ * @brief Function for finding free UDP port on loopback
+ * @return port number
+*/
+int freePort(){
+    int sock = socket(AF_INET, SOCK_DGRAM, 0);
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    bind(sock, (struct sockaddr*)&addr, sizeof(addr));
+    socklen_t len = sizeof(addr);
+    getsockname(sock, (struct sockaddr*)&addr, &len);
+    close(sock);
+    return ntohs(addr.sin_port);
+}
+
+/**
+ * @brief Function for starting server process with its output discarded
+ * @param serverPath Path to tftp-server binary
+ * @param args Arguments of server
+ * @return pid of server
+*/
+pid_t startServer(const std::string& serverPath, const std::vector<std::string>& args){
+    pid_t pid = fork();
+    if (pid == 0) {
+        int devNull = open("/dev/null", O_WRONLY);
+        dup2(devNull, STDOUT_FILENO);
+        dup2(devNull, STDERR_FILENO);
+        std::vector<char*> argv;
+        argv.push_back(const_cast<char*>(serverPath.c_str()));
+        for (const auto& arg : args) {
+            argv.push_back(const_cast<char*>(arg.c_str()));
+        }
+        argv.push_back(nullptr);
+        execv(serverPath.c_str(), argv.data());
+        _exit(127);
+    }
+    return pid;
+}
+
+/**
+ * @brief Function for downloading file over TFTP with lock-step ACKs
+ * @param server The server address
+ * @param filename The file to download
+ * @return true if file was downloaded, false otherwise
+*/
+bool download(const sockaddr_in& server, const std::string& filename){
+    int sock = socket(AF_INET, SOCK_DGRAM, 0);
+    struct timeval tv = {1, 0};
+    setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+
+    std::vector<char> request = ReadRequestPacket(filename, DataMode::OCTET, {}, server).serialize();
+    sendto(sock, request.data(), request.size(), 0, (struct sockaddr*)&server, sizeof(server));
+
+    char buffer[BUFFER_SIZE];
+    bool done = false;
+    while (!done) {
+        sockaddr_in from;
+        socklen_t len = sizeof(from);
+        ssize_t received = recvfrom(sock, buffer, sizeof(buffer), 0, (struct sockaddr*)&from, &len);
+        if (received < 4 || buffer[1] != Opcode::DATA) {
+            break;
+        }
+        uint16_t block = (static_cast<uint8_t>(buffer[2]) << 8) | static_cast<uint8_t>(buffer[3]);
+        std::vector<char> ack = ACKPacket(block, from).serialize();
+        sendto(sock, ack.data(), ack.size(), 0, (struct sockaddr*)&from, sizeof(from));
+        done = received - 4 < INITIAL_BLOCK_SIZE;
+    }
+    close(sock);
+    return done;
+}
+
+/**
+ * @brief Function for measuring latencies of downloads against server started with given arguments
+ * @param mode Name of mode
+ * @param serverPath Path to tftp-server binary
+ * @param serverArgs Extra server arguments
+ * @param rootDir Root directory of server
+ * @param requests Number of downloads
+*/
+void runCase(const std::string& mode, const std::string& serverPath, std::vector<std::string> serverArgs, const std::string& rootDir, int requests){
+    int port = freePort();
+    serverArgs.insert(serverArgs.begin(), {"-p", std::to_string(port)});
+    serverArgs.push_back(rootDir);
+    pid_t server = startServer(serverPath, serverArgs);
+
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = htons(port);
+
+    // Wait until server is ready
+    for (int i = 0; i < 50 && !download(addr, "small"); i++) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    }
+
+    std::vector<double> latencies;
+    int failures = 0;
+    for (int i = 0; i < requests; i++) {
+        auto start = std::chrono::steady_clock::now();
+        bool ok = download(addr, "small");
+        auto end = std::chrono::steady_clock::now();
+        if (!ok) {
+            failures++;
+            continue;
+        }
+        latencies.push_back(std::chrono::duration<double, std::micro>(end - start).count());
+    }
+
+    kill(server, SIGINT);
+    waitpid(server, nullptr, 0);
+
+    if (latencies.empty()) {
+        std::cerr << "latency_bench mode=" << mode << " requests=" << requests << " failures=" << failures << "\n";
+        return;
+    }
+    std::sort(latencies.begin(), latencies.end());
+    double mean = 0;
+    for (double latency : latencies) {
+        mean += latency;
+    }
+    mean /= latencies.size();
+    std::cerr << "latency_bench mode=" << mode
+              << " requests=" << requests
+              << " failures=" << failures
+              << " p50_us=" << latencies[latencies.size() / 2]
+              << " p99_us=" << latencies[latencies.size() * 99 / 100]
+              << " mean_us=" << mean << "\n";
+}
+
+int main(int argc, char* argv[]){
+    int requests = argc > 1 ? std::stoi(argv[1]) : 2000;
+    std::string serverPath = argc > 2 ? argv[2] : "./tftp-server";
+
+    // Every packet is logged, silence it so only transfers are measured
+    Logger::instance().setEnabled(false);
+
+    char rootDir[] = "/tmp/tftp-latency-XXXXXX";
+    if (mkdtemp(rootDir) == nullptr) {
+        std::cerr << "Failed to create root directory\n";
+        return 1;
+    }
+    std::ofstream(std::string(rootDir) + "/small") << std::string(SMALL_FILE_SIZE, 'x');
+
+    runCase("default", serverPath, {}, rootDir, requests);
+    runCase("low-latency", serverPath, {"-l", "50"}, rootDir, requests);
+
+    std::remove((std::string(rootDir) + "/small").c_str());
+    rmdir(rootDir);
+    return 0;
+}
@@ -0,0 +1,216 @@
+/**
+ * @file bench/packet_bench.cpp
+ * @brief Microbenchmarks of hot path, parsing and serialization of packets, netascii decoding,
+ * filtering of options and reading/writing of session blocks
+ * @author Lukas Vecerka (xvecer30)
+*/
+#include "common/packets.hpp"
+#include "common/packet_view.hpp"
+#include "common/options.hpp"
+#include "common/session_policies.hpp"
+#include "common/logger.hpp"
+#include <iostream>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <arpa/inet.h>
+
+#define BENCH_MIN_SECONDS 0.2
+
+/**
+ * @brief Number of heap allocations made by whole program, counted by replaced operator new
+*/
+static std::atomic<uint64_t> allocations(0);
+
+void* operator new(size_t size){
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    if (void* pointer = std::malloc(size == 0 ? 1 : size)) {
+        return pointer;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void* pointer) noexcept {
+    std::free(pointer);
+}
+
+void operator delete(void* pointer, size_t) noexcept {
+    std::free(pointer);
+}
+
+/**
+ * @brief Sink for results of measured operations, so compiler can't drop them
+*/
+static volatile uint64_t sink;
+
+/**
+ * @brief Function for running operation until it runs at least BENCH_MIN_SECONDS and printing one result line
+ * @param name Name of case
+ * @param bytesPerOp Number of bytes processed by one operation
+ * @param operation Measured operation, it returns value which is kept in sink
+*/
+template <typename F>
+void run(const std::string& name, size_t bytesPerOp, F operation){
+    // warm up caches and lazily allocated buffers
+    for (int i = 0; i < 1000; i++) {
+        sink = sink + operation();
+    }
+
+    uint64_t iterations = 0;
+    uint64_t batch = 1000;
+    uint64_t allocationsStart = allocations.load();
+    auto start = std::chrono::steady_clock::now();
+    double seconds = 0;
+    while (seconds < BENCH_MIN_SECONDS) {
+        for (uint64_t i = 0; i < batch; i++) {
+            sink = sink + operation();
+        }
+        iterations += batch;
+        seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+    uint64_t allocated = allocations.load() - allocationsStart;
+
+    std::cerr << "packet_bench case=" << name
+              << " ops=" << iterations
+              << " ns_per_op=" << seconds * 1e9 / iterations
+              << " bytes_per_s=" << (double)bytesPerOp * iterations / seconds
+              << " allocs_per_op=" << (double)allocated / iterations << "\n";
+}
+
+/**
+ * @brief Function for building raw packet
+ * @param opcode Opcode of packet
+ * @param body Bytes after opcode
+ * @return Packet
+*/
+std::vector<char> rawPacket(Opcode opcode, const std::string& body){
+    std::vector<char> packet = {0, static_cast<char>(opcode)};
+    packet.insert(packet.end(), body.begin(), body.end());
+    return packet;
+}
+
+/**
+ * @brief File backend which endlessly repeats one buffer, file is never exhausted
+*/
+class RepeatReader {
+public:
+    explicit RepeatReader(const std::vector<char>& data) : data(data) {}
+    size_t read(char* block, size_t size) {
+        size_t count = std::min(size, data.size());
+        std::memcpy(block, data.data(), count);
+        return count;
+    }
+
+private:
+    const std::vector<char>& data;
+};
+
+/**
+ * @brief File backend which drops written data
+*/
+class NullWriter {
+public:
+    void write(const char*, size_t size) { sink = sink + size; }
+};
+
+int main(){
+    // Parsers log every packet, only parsing itself is measured
+    Logger::instance().setEnabled(false);
+
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(6969);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    const char request[] = "images/firmware.bin\0octet\0blksize\0001428\0tsize\0000\0windowsize\08";
+    std::vector<char> rrq = rawPacket(Opcode::RRQ, std::string(request, sizeof(request)));
+    std::vector<char> ack = rawPacket(Opcode::ACK, std::string("\0\1", 2));
+    std::vector<char> data512 = rawPacket(Opcode::DATA, std::string("\0\1", 2) + std::string(512, 'x'));
+    std::vector<char> data1428 = rawPacket(Opcode::DATA, std::string("\0\1", 2) + std::string(1428, 'x'));
+
+    // Server sees one request per transfer and then ACKs of whole file, client sees DATA
+    std::vector<const std::vector<char>*> mix = {&rrq};
+    for (int i = 0; i < 16; i++) {
+        mix.push_back(&ack);
+        mix.push_back(&data1428);
+    }
+    size_t mixBytes = 0;
+    for (const auto* packet : mix) {
+        mixBytes += packet->size();
+    }
+
+    run("parse_rrq", rrq.size(), [&]() { return Packet::parse(addr, rrq.data(), rrq.size()).index(); });
+    run("parse_ack", ack.size(), [&]() { return Packet::parse(addr, ack.data(), ack.size()).index(); });
+    run("parse_data_512", data512.size(), [&]() { return Packet::parse(addr, data512.data(), data512.size()).index(); });
+    run("parse_data_1428", data1428.size(), [&]() { return Packet::parse(addr, data1428.data(), data1428.size()).index(); });
+    run("parse_mix", mixBytes, [&]() {
+        size_t result = 0;
+        for (const auto* packet : mix) {
+            result += Packet::parse(addr, packet->data(), packet->size()).index();
+        }
+        return result;
+    });
+    run("view_ack", ack.size(), [&]() { return PacketView::parse(ack.data(), ack.size()).blockNumber; });
+    run("view_data_1428", data1428.size(), [&]() { return PacketView::parse(data1428.data(), data1428.size()).payload.size(); });
+    run("view_mix", mixBytes, [&]() {
+        size_t result = 0;
+        for (const auto* packet : mix) {
+            result += PacketView::parse(packet->data(), packet->size()).opcode;
+        }
+        return result;
+    });
+
+    OptionTable options;
+    options.set(OptionId::BLKSIZE, 1428);
+    options.set(OptionId::TSIZE, 1048576);
+    options.set(OptionId::WINDOWSIZE, 8);
+    ReadRequestPacket rrqPacket("images/firmware.bin", DataMode::OCTET, options, addr);
+    DataPacket dataPacket(1, std::vector<char>(1428, 'x'), addr);
+    ACKPacket ackPacket(1, addr);
+    ErrorPacket errorPacket(ErrorCode::FILE_NOT_FOUND, "File not found", addr);
+    OACKPacket oackPacket(options, addr);
+    std::vector<char> buffer(BUFFER_SIZE);
+
+    run("serialize_into_rrq", rrqPacket.serialize().size(), [&]() { return rrqPacket.serializeInto(buffer); });
+    run("serialize_into_data_1428", dataPacket.serialize().size(), [&]() { return dataPacket.serializeInto(buffer); });
+    run("serialize_into_ack", ackPacket.serialize().size(), [&]() { return ackPacket.serializeInto(buffer); });
+    run("serialize_into_error", errorPacket.serialize().size(), [&]() { return errorPacket.serializeInto(buffer); });
+    run("serialize_into_oack", oackPacket.serialize().size(), [&]() { return oackPacket.serializeInto(buffer); });
+    run("serialize_rrq", rrqPacket.serialize().size(), [&]() { return rrqPacket.serialize().size(); });
+    run("serialize_data_1428", dataPacket.serialize().size(), [&]() { return dataPacket.serialize().size(); });
+    run("serialize_ack", ackPacket.serialize().size(), [&]() { return ackPacket.serialize().size(); });
+    run("serialize_error", errorPacket.serialize().size(), [&]() { return errorPacket.serialize().size(); });
+    run("serialize_oack", oackPacket.serialize().size(), [&]() { return oackPacket.serialize().size(); });
+
+    // Text with line ends every 64 characters and some carriage returns
+    std::string netascii;
+    while (netascii.size() < 1428) {
+        netascii += std::string(62, 'a') + "\r\n";
+        netascii += std::string(30, 'b') + std::string("\r\0", 2);
+    }
+    run("parse_netascii_string", netascii.size(), [&]() {
+        return parseNetasciiString(netascii.data(), netascii.data(), netascii.data() + netascii.size()).first.size();
+    });
+
+    OptionTable requested = options;
+    requested.set(OptionId::BLKSIZE, 70000);
+    requested.set(OptionId::TIMEOUT, 0);
+    run("filter_options", sizeof(OptionTable), [&]() { return filterOptions(requested).get(OptionId::BLKSIZE); });
+
+    std::vector<char> file(1428, 'x');
+    std::vector<char> text(netascii.begin(), netascii.end());
+    std::vector<char> block(1428);
+    auto octetReader = makeBlockReader(DataMode::OCTET, RepeatReader(file));
+    auto netasciiReader = makeBlockReader(DataMode::NETASCII, RepeatReader(text));
+    auto octetWriter = makeBlockWriter(DataMode::OCTET, NullWriter());
+    auto netasciiWriter = makeBlockWriter(DataMode::NETASCII, NullWriter());
+    run("block_read_octet_1428", block.size(), [&]() { return octetReader->read(block.data(), block.size()); });
+    run("block_read_netascii_1428", block.size(), [&]() { return netasciiReader->read(block.data(), block.size()); });
+    run("block_write_octet_1428", file.size(), [&]() { octetWriter->write(file.data(), file.size()); return file.size(); });
+    run("block_write_netascii_1428", text.size(), [&]() { netasciiWriter->write(text.data(), text.size()); return text.size(); });
+    return 0;
+}
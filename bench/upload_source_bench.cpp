@@ -0,0 +1,145 @@
+/**
+ * @file bench/upload_source_bench.cpp
+ * @brief Benchmark of reading upload blocks, per block stream reads are compared with
+ * memory mapped file and prefetched pipe
+ * @author Lukas Vecerka (xvecer30)
+*/
+#include "common/upload_source.hpp"
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <thread>
+#include <cstdlib>
+#include <sys/resource.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#define BENCH_FILE_SIZE (64 * 1024 * 1024)
+
+/**
+ * @brief Function for getting CPU time consumed by calling thread
+ * @return CPU time in seconds
+*/
+double threadCpuTime(){
+    struct rusage usage;
+    getrusage(RUSAGE_THREAD, &usage);
+    return usage.ru_utime.tv_sec + usage.ru_stime.tv_sec + (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1e6;
+}
+
+/**
+ * @brief Function for printing result of one case
+ * @param mode Name of mode
+ * @param blockSize Size of block
+ * @param blocks Number of blocks read
+ * @param seconds Wall time
+ * @param cpu CPU time of reading thread
+*/
+void report(const std::string& mode, size_t blockSize, size_t blocks, double seconds, double cpu){
+    std::cerr << "upload_source_bench mode=" << mode
+              << " blksize=" << blockSize
+              << " blocks=" << blocks
+              << " MBps=" << (double)blocks * blockSize / 1e6 / seconds
+              << " cpu_ns_per_block=" << cpu * 1e9 / blocks << "\n";
+}
+
+/**
+ * @brief Function for reading file block by block with std::ifstream like client did before
+ * @param path Path to file
+ * @param blockSize Size of block
+*/
+void runStream(const std::string& path, size_t blockSize){
+    std::ifstream stream(path, std::ios::binary);
+    size_t blocks = 0;
+    double cpuStart = threadCpuTime();
+    auto start = std::chrono::steady_clock::now();
+    while (true) {
+        std::vector<char> data(blockSize);
+        stream.read(data.data(), blockSize);
+        data.resize(stream.gcount());
+        blocks++;
+        if (data.size() < blockSize) {
+            break;
+        }
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    report("ifstream", blockSize, blocks, seconds, threadCpuTime() - cpuStart);
+}
+
+/**
+ * @brief Function for reading blocks from upload source
+ * @param mode Name of mode
+ * @param source Source to read
+ * @param blockSize Size of block
+*/
+void runSource(const std::string& mode, UploadSource& source, size_t blockSize){
+    size_t blocks = 0;
+    double cpuStart = threadCpuTime();
+    auto start = std::chrono::steady_clock::now();
+    while (true) {
+        std::vector<char> data(blockSize);
+        data.resize(source.read(data.data(), blockSize));
+        blocks++;
+        if (data.size() < blockSize) {
+            break;
+        }
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    report(mode, blockSize, blocks, seconds, threadCpuTime() - cpuStart);
+}
+
+int main(int argc, char* argv[]){
+    size_t fileSize = argc > 1 ? std::stoul(argv[1]) : BENCH_FILE_SIZE;
+
+    char path[] = "/tmp/tftp-upload-XXXXXX";
+    int fd = mkstemp(path);
+    if (fd < 0) {
+        std::cerr << "Failed to create file\n";
+        return 1;
+    }
+    std::vector<char> chunk(PREFETCH_CHUNK_SIZE, 'x');
+    for (size_t written = 0; written < fileSize; written += chunk.size()) {
+        if (write(fd, chunk.data(), std::min(chunk.size(), fileSize - written)) < 0) {
+            std::cerr << "Failed to write file\n";
+            return 1;
+        }
+    }
+    close(fd);
+
+    for (size_t blockSize : {512, 1428, 8192}) {
+        runStream(path, blockSize);
+        runSource("mmap", *UploadSource::open(path), blockSize);
+
+        // Pipe is filled by writer thread, reader sees it the same way as client sees redirected stdin
+        int pipefd[2];
+        if (pipe(pipefd) < 0) {
+            std::cerr << "Failed to create pipe\n";
+            return 1;
+        }
+        std::thread writer([&]() {
+            int file = open(path, O_RDONLY);
+            std::vector<char> buffer(PREFETCH_CHUNK_SIZE);
+            ssize_t count;
+            while ((count = read(file, buffer.data(), buffer.size())) > 0) {
+                for (ssize_t offset = 0; offset < count;) {
+                    ssize_t written = write(pipefd[1], buffer.data() + offset, count - offset);
+                    if (written < 0) {
+                        break;
+                    }
+                    offset += written;
+                }
+            }
+            close(file);
+            close(pipefd[1]);
+        });
+        {
+            PrefetchSource source(pipefd[0], true);
+            runSource("prefetch-pipe", source, blockSize);
+        }
+        writer.join();
+    }
+
+    std::remove(path);
+    return 0;
+}
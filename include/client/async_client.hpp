@@ -0,0 +1,147 @@
+/**
+ * @file client/async_client.hpp
+ * @brief Header file with declaration of non-blocking TFTP client for embedding into other programs
+ * @author Lukas Vecerka (xvecer30)
+*/
+#ifndef ASYNC_CLIENT_HPP
+#define ASYNC_CLIENT_HPP
+
+#include <string>
+#include <deque>
+#include <mutex>
+#include <future>
+#include <functional>
+#include <poll.h>
+#include "client/tftp_client.hpp"
+#include "client/transfer_loop.hpp"
+#include "client/socket_pool.hpp"
+#include "common/upload_source.hpp"
+#include "common/download_sink.hpp"
+
+/**
+ * @class AsyncClient
+ * @brief Client running any number of transfers in one event loop, transfers are only queued by
+ * get/put and progress when loop is driven by run/runOnce or by external event loop through
+ * pollFds/timeoutMs/process
+ * @note get/put can be called from any thread, loop has to be driven from one thread
+*/
+class AsyncClient {
+public:
+    /**
+     * @brief Callback invoked in loop thread when transfer is finished
+    */
+    using Callback = std::function<void(const TransferResult&)>;
+
+    /**
+     * @brief Constructor resolves server address once for all transfers
+     * @param hostname Hostname or IP address of server
+     * @param port Port of server
+     * @throw std::runtime_error if hostname can't be resolved
+    */
+    AsyncClient(const std::string& hostname, int port);
+    ~AsyncClient();
+    /**
+     * @brief Function for setting options requested by all following transfers, queued transfers keep their options
+     * @param options Options (blksize, timeout, windowsize, tsize)
+    */
+    void setOptions(OptionTable options);
+    /**
+     * @brief Function for setting transfer mode of all following transfers
+     * @param mode Transfer mode, octet by default
+    */
+    void setMode(DataMode mode);
+    /**
+     * @brief Function for setting pool from which sockets of transfers are taken, pool can be
+     * shared by more clients
+     * @param pool Pool of sockets, nullptr to bind new socket for every transfer
+    */
+    void setSocketPool(std::shared_ptr<SocketPool> pool);
+    /**
+     * @brief Function for queueing download
+     * @param remotePath The filepath on server
+     * @param sink Destination of data, caller can keep reference to read data of MemorySink
+     * @param callback Optional callback invoked when transfer is finished
+     * @return Future with result of transfer
+    */
+    std::future<TransferResult> get(const std::string& remotePath, std::shared_ptr<DownloadSink> sink, Callback callback = nullptr);
+    /**
+     * @brief Function for queueing upload
+     * @param remotePath The destination filepath on server
+     * @param source Source of data
+     * @param size Size of uploaded data for tsize, -1 if it is unknown
+     * @param callback Optional callback invoked when transfer is finished
+     * @return Future with result of transfer
+    */
+    std::future<TransferResult> put(const std::string& remotePath, std::unique_ptr<UploadSource> source, int64_t size = -1, Callback callback = nullptr);
+    /**
+     * @brief Function for checking if there is no running or queued transfer
+     * @return true if client is idle, false otherwise
+    */
+    bool idle();
+    /**
+     * @brief Function for getting descriptors which have to be watched by external event loop,
+     * last descriptor wakes loop up when transfer is queued from other thread
+     * @return Descriptors in order expected by process
+    */
+    std::vector<pollfd> pollFds() const;
+    /**
+     * @brief Function for getting maximum time external event loop can wait before calling process
+     * @return Time in milliseconds, -1 if there is nothing to wait for
+    */
+    int timeoutMs();
+    /**
+     * @brief Function for starting queued transfers and dispatching events to running ones
+     * @param fds Descriptors returned by pollFds with filled revents
+    */
+    void process(const std::vector<pollfd>& fds);
+    /**
+     * @brief Function for waiting for one round of events and processing them
+     * @param maxWaitMs Maximum time to wait in milliseconds, -1 for no limit
+    */
+    void runOnce(int maxWaitMs = -1);
+    /**
+     * @brief Function for running loop until all queued transfers are finished
+    */
+    void run();
+
+private:
+    /**
+     * @brief Queued transfer
+     * @note options, mode - options and mode set when transfer was queued
+    */
+    struct Pending {
+        Transfer transfer;
+        OptionTable options;
+        DataMode mode;
+        std::shared_ptr<DownloadSink> sink;
+        std::unique_ptr<UploadSource> source;
+        int64_t size;
+        Callback callback;
+        std::promise<TransferResult> promise;
+    };
+    sockaddr_in server_addr;
+    OptionTable options;
+    DataMode mode;
+    std::shared_ptr<SocketPool> pool;
+    TransferLoop loop;
+    std::mutex pendingMutex;
+    std::deque<Pending> pending;
+    int wakeFd;
+    /**
+     * @brief Function for queueing transfer and waking up loop
+     * @param transfer Transfer to queue
+     * @return Future with result of transfer
+    */
+    std::future<TransferResult> enqueue(Pending transfer);
+    /**
+     * @brief Function for starting all queued transfers
+    */
+    void startPending();
+    /**
+     * @brief Function for starting one transfer, failed start is reported immediately
+     * @param transfer Transfer to start
+    */
+    void start(Pending transfer);
+};
+
+#endif
@@ -0,0 +1,97 @@
+/**
+ * @file client/fetch_daemon.hpp
+ * @brief Header file with declaration of long-running client daemon accepting transfers over Unix domain socket
+ * @author Lukas Vecerka (xvecer30)
+*/
+#ifndef FETCH_DAEMON_HPP
+#define FETCH_DAEMON_HPP
+#define DAEMON_SOCKET_POOL_SIZE 16
+#define DAEMON_IDLE_POLL_MS 500
+
+#include <string>
+#include <map>
+#include <memory>
+#include <vector>
+#include "client/async_client.hpp"
+#include "client/socket_pool.hpp"
+
+/**
+ * @class FetchDaemon
+ * @brief Daemon running transfers of all connected tools in one event loop
+ * @note Protocol is line based, request is "get <host> <port> <remote> <local>" or
+ * "put <host> <port> <local> <remote>" with absolute local paths, paths are quoted as by std::quoted
+ * so they can contain spaces, daemon answers
+ * "queued <id>" or "error <message>" and later streams "done <id> ok|failed <bytes> <seconds>"
+ * on the same connection
+*/
+class FetchDaemon {
+public:
+    /**
+     * @brief Constructor creates listening socket with mode 0600, stale socket file is replaced
+     * @param socketPath Path of Unix domain socket
+     * @param options Options requested by all transfers
+     * @throw std::runtime_error if socket can't be created or other file than socket exists at path
+    */
+    FetchDaemon(const std::string& socketPath, OptionTable options);
+    ~FetchDaemon();
+    /**
+     * @brief Function for running daemon until SIGINT
+    */
+    void run();
+
+private:
+    struct Connection {
+        int fd;
+        std::string input;
+        std::string output;
+        bool closed;
+    };
+    std::string socketPath;
+    int listenFd;
+    OptionTable options;
+    std::shared_ptr<SocketPool> pool;
+    std::map<std::string, std::unique_ptr<AsyncClient>> clients;
+    std::map<uint64_t, Connection> connections;
+    uint64_t nextConnectionId;
+    uint64_t nextTransferId;
+    /**
+     * @brief Function for getting client of server, server address is resolved only first time
+     * @param host Hostname of server
+     * @param port Port of server
+     * @return Client of server
+     * @throw std::runtime_error if hostname can't be resolved
+    */
+    AsyncClient& clientFor(const std::string& host, int port);
+    /**
+     * @brief Function for accepting all pending connections
+    */
+    void acceptConnections();
+    /**
+     * @brief Function for reading requests from connection
+     * @param id Id of connection
+    */
+    void readConnection(uint64_t id);
+    /**
+     * @brief Function for handling one request line
+     * @param id Id of connection
+     * @param line Request
+    */
+    void handleRequest(uint64_t id, const std::string& line);
+    /**
+     * @brief Function for sending buffered events of connection
+     * @param connection Connection
+    */
+    void flush(Connection& connection);
+};
+
+/**
+ * @brief Function for enqueueing transfers into running daemon and waiting for their completion
+ * @param socketPath Path of Unix domain socket of daemon
+ * @param hostname Hostname of server
+ * @param port Port of server
+ * @param transfers Transfers to enqueue
+ * @return Number of failed transfers, -1 if daemon isn't reachable
+*/
+int enqueueTransfers(const std::string& socketPath, const std::string& hostname, int port, const std::vector<Transfer>& transfers);
+
+#endif
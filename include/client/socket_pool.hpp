@@ -0,0 +1,41 @@
+/**
+ * @file client/socket_pool.hpp
+ * @brief Header file with declaration of pool of pre-bound client sockets
+ * @author Lukas Vecerka (xvecer30)
+*/
+#ifndef SOCKET_POOL_HPP
+#define SOCKET_POOL_HPP
+
+#include <vector>
+#include <cstddef>
+
+/**
+ * @class SocketPool
+ * @brief Pool of sockets bound ahead of time, so starting transfer doesn't pay socket creation
+ * @note Socket is used by one session only, it is closed by session and never returned, otherwise
+ * late packet of previous transfer could be taken as first packet of new one and set wrong TID
+*/
+class SocketPool {
+public:
+    /**
+     * @param size Number of sockets kept ready
+    */
+    SocketPool(size_t size);
+    ~SocketPool();
+    /**
+     * @brief Function for taking socket from pool, new socket is bound if pool is empty
+     * @return socket file descriptor
+     * @throw std::runtime_error if socket can't be created or bound
+    */
+    int acquire();
+    /**
+     * @brief Function for binding sockets until pool is full, it is called when there is nothing else to do
+    */
+    void refill();
+
+private:
+    std::vector<int> sockets;
+    size_t size;
+};
+
+#endif
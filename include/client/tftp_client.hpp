@@ -6,9 +6,37 @@
 #ifndef TFTPCLIENT_HPP
 #define TFTPCLIENT_HPP
 #define BUFFER_SIZE 65507
+#define AUTO_TIMEOUT 1
+#define IP_HEADER_SIZE 20
+#define UDP_HEADER_SIZE 8
+#define TFTP_DATA_HEADER_SIZE 4
+#define DEFAULT_PARALLEL_TRANSFERS 4
+#define MAX_STRIPES 64
 
 #include <string>
+#include <vector>
+#include <netinet/in.h>
 #include "common/session.hpp"
+#include "common/options.hpp"
+
+/**
+ * @brief One transfer of batch, localPath is source of upload or destination of download
+*/
+struct Transfer {
+    SessionType type;
+    std::string localPath;
+    std::string remotePath;
+};
+
+/**
+ * @brief Result of one transfer of batch
+*/
+struct TransferResult {
+    Transfer transfer;
+    bool ok;
+    uint64_t bytes;
+    double seconds;
+};
 
 /**
  * @class TFTPClient
@@ -19,19 +47,92 @@ public:
     /**
      * @brief Function for sending WRQ packet to server and handle uploading of file
      * @param dest_filepath The destination filepath on server
+     * @param src_filepath The uploaded file on client, "stdin" for standard input
     */
-    void upload(std::string dest_filepath);
+    void upload(std::string dest_filepath, std::string src_filepath = "stdin");
     /**
      * @brief Function for sending RRQ packet to server and handle downloading of file
      * @param filepath The filepath on server
      * @param dest_filepath The destination filepath on client
     */
     void download(std::string filepath, std::string dest_filepath);
+    /**
+     * @brief Function for downloading one file over multiple concurrent sessions, size of file is
+     * obtained from tsize reply and every session downloads one byte range into preallocated file
+     * @param filepath The filepath on server
+     * @param dest_filepath The destination filepath on client
+     * @param stripes Number of sessions
+     * @return true if file was downloaded, false otherwise
+    */
+    bool downloadStriped(std::string filepath, std::string dest_filepath, size_t stripes);
+    /**
+     * @brief Function for setting options which will be requested in RRQ/WRQ packet
+     * @param options Options explicitly requested by user (blksize, timeout, tsize)
+    */
+    void setOptions(OptionTable options);
+    /**
+     * @brief Function for enabling automatic option selection, blksize is derived from path MTU
+     * and tsize with timeout are requested too, explicitly set options have priority
+    */
+    void enableAutoOptions();
+    /**
+     * @brief Function for running transfers concurrently in one event loop, server address is resolved once
+     * @param transfers Transfers to run
+     * @param parallel Maximum number of transfers running at the same time
+     * @return Results of transfers in order of transfers
+    */
+    std::vector<TransferResult> runBatch(const std::vector<Transfer>& transfers, size_t parallel);
 
 private:
     std::string hostname;
     int port;
     int sockfd;
+    OptionTable options;
+    bool autoOptions;
+    /**
+     * @brief Function for resolving hostname of server
+     * @param server_addr The resolved address of server
+     * @return true if hostname was resolved, false otherwise
+    */
+    bool resolveServer(sockaddr_in& server_addr);
+    /**
+     * @brief Function for building options for request packet
+     * @param server_addr The address of server, used for path MTU probe
+     * @param sessionType Type of transfer
+     * @param uploadSize Size of uploaded data used for tsize, -1 if it is unknown
+     * @return Table of options which will be sent in request packet
+    */
+    OptionTable requestOptions(const sockaddr_in& server_addr, SessionType sessionType, int64_t uploadSize);
 };
 
-#endif 
\ No newline at end of file
+/**
+ * @brief Function for creating UDP socket bound to port chosen by OS
+ * @return socket file descriptor
+ * @throw std::runtime_error if socket can't be created or bound
+*/
+int bindClientSocket();
+
+/**
+ * @brief Function for reading batch manifest, every line is either "get <remote> <local>"
+ * or "put <local> <remote>", empty lines and lines starting with # are skipped
+ * @param path Path to manifest
+ * @return Transfers in order of manifest
+ * @throw std::runtime_error if manifest can't be read or contains invalid line
+*/
+std::vector<Transfer> readManifest(const std::string& path);
+
+/**
+ * @brief Function for determining path MTU to server, it connects probe UDP socket and reads IP_MTU
+ * @param server_addr The address of server
+ * @return path MTU in bytes, 0 if it can't be determined
+*/
+int probePathMTU(const sockaddr_in& server_addr);
+
+/**
+ * @brief Function for computing largest block size which doesn't cause IP fragmentation
+ * @param mtu Path MTU
+ * @return block size clamped to allowed range
+*/
+uint16_t blockSizeForMTU(int mtu);
+
+#endif
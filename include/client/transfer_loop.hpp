@@ -0,0 +1,88 @@
+/**
+ * @file client/transfer_loop.hpp
+ * @brief Header file with declaration of event loop driving multiple client sessions at once
+ * @author Lukas Vecerka (xvecer30)
+*/
+#ifndef TRANSFER_LOOP_HPP
+#define TRANSFER_LOOP_HPP
+
+#include <memory>
+#include <vector>
+#include <chrono>
+#include <functional>
+#include <poll.h>
+#include "common/session.hpp"
+
+/**
+ * @class TransferLoop
+ * @brief Single threaded poll loop, every started client session is waited on by its socket
+ * and its own retransmission deadline
+*/
+class TransferLoop {
+public:
+    /**
+     * @brief Callback invoked when session is finished, session is exited before callback
+    */
+    using DoneCallback = std::function<void(ClientSession&)>;
+
+    /**
+     * @brief Function for adding started session to loop
+     * @param session Session which already sent its request packet
+     * @param onDone Callback invoked when session is finished
+    */
+    void add(std::unique_ptr<ClientSession> session, DoneCallback onDone);
+    /**
+     * @brief Function for checking if there is any session in loop
+     * @return true if there is no session, false otherwise
+    */
+    bool empty() const;
+    /**
+     * @brief Function for getting descriptors which have to be watched by external event loop
+     * @return Descriptors of sessions in order expected by process
+    */
+    std::vector<pollfd> pollFds() const;
+    /**
+     * @brief Function for getting time until nearest retransmission deadline
+     * @return Time in milliseconds, -1 if there is no session
+    */
+    int timeoutMs() const;
+    /**
+     * @brief Function for dispatching events of external event loop to sessions, sessions
+     * with expired deadline retransmit, finished sessions are removed
+     * @param fds Descriptors returned by pollFds with filled revents
+    */
+    void process(const std::vector<pollfd>& fds);
+    /**
+     * @brief Function for waiting for one round of events and dispatching them to sessions
+     * @param maxWaitMs Maximum time to wait for events in milliseconds, -1 for no limit
+    */
+    void runOnce(int maxWaitMs = -1);
+    /**
+     * @brief Function for running loop until all sessions are finished
+    */
+    void run();
+
+private:
+    struct Entry {
+        std::unique_ptr<ClientSession> session;
+        DoneCallback onDone;
+        std::chrono::steady_clock::time_point deadline;
+        bool finished;
+    };
+    std::vector<Entry> entries;
+    /**
+     * @brief Function for arming retransmission deadline of session from its current timeout
+     * @param entry Entry of session
+    */
+    void armDeadline(Entry& entry);
+    /**
+     * @brief Function for removing finished sessions and invoking their callbacks
+    */
+    void reap();
+    /**
+     * @brief Function for finishing all sessions with error
+    */
+    void abortAll();
+};
+
+#endif
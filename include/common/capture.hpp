@@ -0,0 +1,119 @@
+/**
+ * @file common/capture.hpp
+ * @brief Header file for capture of workload, server records every request and end of its session
+ * into text file, so real mix of files, options and arrivals can be replayed later
+ * @author Lukas Vecerka (xvecer30)
+*/
+#ifndef CAPTURE_HPP
+#define CAPTURE_HPP
+#define CAPTURE_HEADER "# tftp-capture 1"
+
+#include <string>
+#include <vector>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdint>
+#include <netinet/in.h>
+#include "common/session.hpp"
+#include "common/options.hpp"
+
+/**
+ * @brief One recorded session of workload
+ * @note offsetUs - arrival of first request relative to start of capture
+ * @note client - address of client as ip:port, repeated request from it is retransmission, not new session
+ * @note requests - number of received requests, more than 1 means client retransmitted request
+ * @note finished - end of session was recorded, ok, bytes and durationUs are valid only then
+ * @note durationUs - time from first request to end of session
+*/
+struct CapturedSession {
+    uint64_t id = 0;
+    uint64_t offsetUs = 0;
+    std::string client;
+    SessionType type = SessionType::READ;
+    std::string filename;
+    DataMode mode = DataMode::OCTET;
+    OptionTable options;
+    unsigned requests = 1;
+    bool finished = false;
+    bool ok = false;
+    uint64_t bytes = 0;
+    uint64_t durationUs = 0;
+};
+
+/**
+ * @brief Singleton class for capture, it is disabled until file is opened
+ * @note Every line is one record, request "R id offset_us client RRQ|WRQ mode options filename"
+ * and end of session "E id offset_us ok|fail bytes duration_us", fields are separated by tabs
+*/
+class Capture {
+public:
+    static Capture& instance() {
+        // Capture is never destroyed, sessions still running at exit can record their end
+        static Capture* capture = new Capture();
+        return *capture;
+    }
+
+    /**
+     * @brief Function for enabling capture, existing file is overwritten
+     * @param path Path of capture file
+     * @return true if file was created and capture was enabled
+    */
+    bool open(const std::string& path);
+
+    bool isEnabled() const {
+        return enabled.load(std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief Function for recording received request, other packets are ignored
+     * @param client Address of client
+     * @param request The request
+     * @param size Size of request
+     * @param received Time when request was received
+     * @return Id of record for recordEnd, 0 if packet isn't valid RRQ/WRQ
+    */
+    uint64_t recordRequest(const sockaddr_in& client, const char* request, size_t size, std::chrono::steady_clock::time_point received);
+
+    /**
+     * @brief Function for recording end of session, refused request ends without session
+     * @param id Id returned by recordRequest
+     * @param ok true if transfer was completed
+     * @param bytes Number of transferred bytes
+     * @param received Time when request was received
+    */
+    void recordEnd(uint64_t id, bool ok, uint64_t bytes, std::chrono::steady_clock::time_point received);
+
+private:
+    // Private constructor to prevent instantiation
+    Capture() : enabled(false), file(nullptr), nextId(1) {}
+    /**
+     * @brief Function for writing one line, lines of concurrent sessions are not mixed
+     * @param line Line without newline
+    */
+    void write(const std::string& line);
+
+    std::atomic<bool> enabled;
+    std::mutex mutex;
+    FILE* file;
+    std::atomic<uint64_t> nextId;
+    std::chrono::steady_clock::time_point start;
+};
+
+/**
+ * @brief Function for converting options into text of capture
+ * @param options Options
+ * @return Options as name=value separated by commas, "-" if there is no option
+*/
+std::string formatCaptureOptions(const OptionTable& options);
+
+/**
+ * @brief Function for loading capture file, requests retransmitted by client are merged into first one
+ * @param path Path of capture file
+ * @return Recorded sessions ordered by arrival
+ * @throw std::runtime_error if file can't be read or isn't capture
+*/
+std::vector<CapturedSession> loadCapture(const std::string& path);
+
+#endif
@@ -0,0 +1,67 @@
+/**
+ * @file common/download_sink.hpp
+ * @brief Header file with declaration of destinations of downloaded data
+ * @author Lukas Vecerka (xvecer30)
+*/
+#ifndef DOWNLOAD_SINK_HPP
+#define DOWNLOAD_SINK_HPP
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+/**
+ * @brief Base class for destinations of download, data are written sequentially
+*/
+class DownloadSink {
+public:
+    virtual ~DownloadSink() = default;
+    /**
+     * @brief Function for writing next data into sink
+     * @param buffer The buffer with data
+     * @param size Number of bytes to write
+     * @throw std::runtime_error if failed to write data
+    */
+    virtual void write(const char* buffer, size_t size) = 0;
+};
+
+/**
+ * @brief Sink collecting downloaded data in memory
+*/
+class MemorySink : public DownloadSink {
+public:
+    std::vector<char> data;
+    void write(const char* buffer, size_t size) override;
+};
+
+/**
+ * @brief Sink which only counts downloaded data, so memory doesn't grow with number of transfers
+*/
+class DiscardSink : public DownloadSink {
+public:
+    uint64_t written = 0;
+    void write(const char* buffer, size_t size) override;
+};
+
+/**
+ * @brief Sink writing into file descriptor, with offset data are written with pwrite
+ * so more sinks can share one descriptor (stripes of one download)
+*/
+class FdSink : public DownloadSink {
+public:
+    /**
+     * @param fd File descriptor
+     * @param ownsFd true if file descriptor is closed by sink
+     * @param offset Position of first written byte, -1 for sequential write (pipes, sockets)
+    */
+    FdSink(int fd, bool ownsFd, int64_t offset = -1);
+    ~FdSink() override;
+    void write(const char* buffer, size_t size) override;
+
+private:
+    int fd;
+    bool ownsFd;
+    int64_t offset;
+};
+
+#endif
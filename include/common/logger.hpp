@@ -1,13 +1,54 @@
 /**
  * @file common/logger.hpp
- * @brief Header file for logger singleton class
+ * @brief Header file for logger singleton class, messages are put into lock-free ring of calling
+ * thread and formatted and written by background thread, so transfers never wait for output
  * @author Lukas Vecerka (xvecer30)
 */
 
 #ifndef LOGGER_HPP
 #define LOGGER_HPP
+#define LOG_RING_SIZE (64 * 1024)
+#define LOG_MAX_MESSAGE_SIZE 4096
+#define LOG_FLUSH_INTERVAL_MS 5
+// Messages below this level are removed at compile time (0 - DEBUG, 1 - INFO, 2 - ERROR)
+#ifndef LOG_MIN_LEVEL
+#define LOG_MIN_LEVEL 0
+#endif
 
-#include <iostream>
+#include <string>
+#include <string_view>
+#include <optional>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <condition_variable>
+#include <cstdint>
+#include <netinet/in.h>
+
+/**
+ * @brief Enum for levels of messages
+ * @note DEBUG - every sent and received packet
+ * @note INFO - progress of transfers and sessions
+ * @note ERROR - failures
+*/
+enum class LogLevel : uint8_t {
+    DEBUG,
+    INFO,
+    ERROR
+};
+
+/**
+ * @brief Enum for direction of logged packet, sent packets are written on std::cout, received on std::cerr
+*/
+enum class LogDirection : uint8_t {
+    SENT,
+    RECEIVED
+};
+
+class LogRing;
+struct LogRecord;
 
 /**
  * @brief Singleton class for logging
@@ -15,8 +56,9 @@
 class Logger {
 public:
     static Logger& instance() {
-        static Logger logger;
-        return logger;
+        // Logger is never destroyed, threads which are still running at exit can log safely
+        static Logger* logger = new Logger();
+        return *logger;
     }
 
     /**
@@ -24,7 +66,18 @@ public:
      * @param message The message to log
     */
     void log(const std::string& message) {
-        std::cout << message + "\n";
+        log(LogLevel::INFO, message);
+    }
+
+    /**
+     * @brief Log a message of level on std::cout
+     * @param level Level of message
+     * @param message The message to log
+    */
+    void log(LogLevel level, std::string_view message) {
+        if (isEnabled(level)) {
+            text(level, false, message);
+        }
     }
 
     /**
@@ -32,12 +85,107 @@ public:
      * @param message The error message to log
     */
     void error(const std::string& message) {
-        std::cerr << message + "\n";
+        if (isEnabled(LogLevel::INFO)) {
+            text(LogLevel::INFO, true, message);
+        }
+    }
+
+    /**
+     * @brief Log sent or received packet, only binary fields are stored and line is formatted by background thread
+     * @param direction Direction of packet
+     * @param opcode Opcode of packet
+     * @param addr Address of other side
+     * @param localPort Local port shown after address, 0 if it isn't shown
+     * @param number Block number or error code, shown only for DATA, ACK and ERROR
+     * @param detail Rest of line (filename, options, error message), empty for DATA and ACK
+    */
+    void packet(LogDirection direction, uint8_t opcode, const sockaddr_in& addr, uint16_t localPort, uint16_t number, std::string_view detail = {});
+
+    /**
+     * @brief Check if messages of level are logged, callers can skip building of message when they aren't
+     * @param level Level of message
+     * @return true if messages of level are logged
+    */
+    bool isEnabled(LogLevel level = LogLevel::INFO) const {
+#if LOG_MIN_LEVEL > 0
+        // comparison is left out for default level, it would be always true and -Wextra warns about it
+        if (static_cast<int>(level) < LOG_MIN_LEVEL) {
+            return false;
+        }
+#endif
+        return enabled.load(std::memory_order_relaxed) && level >= minLevel.load(std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief Enable or disable logging, programs embedding libtftp usually don't want
+     * messages of every packet on their standard outputs
+     * @param enabled true if messages should be logged
+    */
+    void setEnabled(bool enabled) {
+        this->enabled = enabled;
+    }
+
+    /**
+     * @brief Set lowest level of logged messages, DEBUG by default
+     * @param level The level
+    */
+    void setLevel(LogLevel level) {
+        minLevel = level;
     }
 
+    /**
+     * @brief Function for parsing level given on command line
+     * @param name Name of level, "error", "info" or "debug"
+     * @return The level, std::nullopt if name is unknown
+    */
+    static std::optional<LogLevel> parseLevel(std::string_view name);
+
+    /**
+     * @brief Write all queued messages and stop background thread, it is called at exit
+    */
+    void shutdown();
+
 private:
     // Private constructor to prevent instantiation
-    Logger() {}
+    Logger() : enabled(true), minLevel(LogLevel::DEBUG), sequence(0), stopping(false) {}
+    /**
+     * @brief Function for queueing text message
+     * @param level Level of message
+     * @param toStderr true if message is written on std::cerr
+     * @param message The message
+    */
+    void text(LogLevel level, bool toStderr, std::string_view message);
+    /**
+     * @brief Function for putting record into ring of calling thread, record is dropped when ring is full
+     * @param record The record
+     * @param detail Text stored after record
+    */
+    void push(LogRecord& record, std::string_view detail);
+    /**
+     * @brief Function for getting ring of calling thread, ring is registered and background thread
+     * started when thread logs first time
+     * @return The ring, nullptr after shutdown
+    */
+    LogRing* threadRing();
+    /**
+     * @brief Function for formatting and writing queued records of all threads in order in which they were logged
+    */
+    void drain();
+    /**
+     * @brief Function of background thread
+    */
+    void run();
+
+    std::atomic<bool> enabled;
+    std::atomic<LogLevel> minLevel;
+    std::atomic<uint64_t> sequence;
+    std::mutex ringsMutex;
+    std::vector<std::shared_ptr<LogRing>> rings;
+    std::mutex drainMutex;
+    std::mutex wakeMutex;
+    std::condition_variable wake;
+    std::thread writer;
+    bool stopping;
 };
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,159 @@
+/**
+ * @file common/metrics.hpp
+ * @brief Header file for metrics of sessions, every thread updates only its own shard of counters,
+ * so sessions never wait for each other and shards are summed only when metrics are read
+ * @author Lukas Vecerka (xvecer30)
+*/
+#ifndef METRICS_HPP
+#define METRICS_HPP
+// Histogram buckets are log-linear in microseconds, every power of two is split into sub buckets,
+// so relative error of recorded value is at most 1 / METRICS_SUB_BUCKETS
+#define METRICS_SUB_BUCKETS 8
+#define METRICS_MAX_EXPONENT 40 // about 12 days in microseconds, longer values fall into last bucket
+#define METRICS_HISTOGRAM_BUCKETS ((METRICS_MAX_EXPONENT - 1) * METRICS_SUB_BUCKETS)
+// Exported histogram has one bound for every power of two microseconds up to this one (about 72 minutes),
+// fine buckets are only summed into them, so scrape stays small
+#define METRICS_EXPORTED_MAX_EXPONENT 32
+#define METRICS_ERROR_CODES 9
+
+#include <string>
+#include <array>
+#include <atomic>
+#include <mutex>
+#include <vector>
+#include <chrono>
+#include <cstdint>
+
+/**
+ * @brief Enum for counters, active sessions are gauges which are increased and decreased
+ * @note BLOCKS_SENT - every sent DATA packet, including retransmitted ones
+ * @note BYTES_SENT - data read from files and sent for the first time
+ * @note RETRANSMISSIONS - retransmissions of last packet or window after timeout
+ * @note TIMEOUTS - receive timeouts, including the last one after which session gives up
+ * @note REQUESTS_* - datagrams of listener which didn't start session, malformed ones were answered by ERROR
+*/
+enum class Counter : uint8_t {
+    READ_SESSIONS_ACTIVE,
+    WRITE_SESSIONS_ACTIVE,
+    READ_SESSIONS_COMPLETED,
+    READ_SESSIONS_FAILED,
+    WRITE_SESSIONS_COMPLETED,
+    WRITE_SESSIONS_FAILED,
+    BLOCKS_SENT,
+    BLOCKS_RECEIVED,
+    BYTES_SENT,
+    BYTES_RECEIVED,
+    RETRANSMISSIONS,
+    TIMEOUTS,
+    REQUESTS_MALFORMED,
+    REQUESTS_DUPLICATE,
+    REQUESTS_RATE_LIMITED,
+    COUNT
+};
+
+/**
+ * @brief Enum for latency histograms
+ * @note TIME_TO_FIRST_BLOCK - from request to first DATA sent (RRQ) or received (WRQ)
+ * @note TRANSFER_DURATION - from request to end of completed transfer
+ * @note WINDOW_RTT - from sending window to its first ACK, windows which were retransmitted are skipped
+*/
+enum class Histogram : uint8_t {
+    TIME_TO_FIRST_BLOCK,
+    TRANSFER_DURATION,
+    WINDOW_RTT,
+    COUNT
+};
+
+/**
+ * @brief Counters of one thread, only owning thread writes them
+*/
+struct MetricsShard {
+    std::array<std::atomic<uint64_t>, static_cast<size_t>(Counter::COUNT)> counters{};
+    std::array<std::atomic<uint64_t>, METRICS_ERROR_CODES> errorsSent{};
+    std::array<std::array<std::atomic<uint64_t>, METRICS_HISTOGRAM_BUCKETS>, static_cast<size_t>(Histogram::COUNT)> buckets{};
+    std::array<std::atomic<uint64_t>, static_cast<size_t>(Histogram::COUNT)> sumsUsec{};
+};
+
+/**
+ * @brief Singleton class for metrics
+*/
+class Metrics {
+public:
+    static Metrics& instance() {
+        // Metrics are never destroyed, threads which are still running at exit can update them safely
+        static Metrics* metrics = new Metrics();
+        return *metrics;
+    }
+
+    /**
+     * @brief Add value to counter, gauges are decreased by adding -1
+     * @param counter The counter
+     * @param value Value to add
+    */
+    void add(Counter counter, uint64_t value = 1) {
+        increase(threadShard()->counters[static_cast<size_t>(counter)], value);
+    }
+
+    /**
+     * @brief Count ERROR packet which was sent
+     * @param code Error code, unknown codes are counted as NOT_DEFINED
+    */
+    void errorSent(uint16_t code) {
+        increase(threadShard()->errorsSent[code < METRICS_ERROR_CODES ? code : 0], 1);
+    }
+
+    /**
+     * @brief Record duration into histogram
+     * @param histogram The histogram
+     * @param duration The duration
+    */
+    void observe(Histogram histogram, std::chrono::steady_clock::duration duration);
+
+    /**
+     * @brief Sum shards of all threads and format them
+     * @return Metrics in Prometheus text format
+    */
+    std::string render();
+
+    /**
+     * @brief Function for getting bucket of value
+     * @param usec Value in microseconds
+     * @return Index of bucket
+    */
+    static size_t bucketIndex(uint64_t usec);
+
+    /**
+     * @brief Function for getting largest value which falls into bucket
+     * @param index Index of bucket
+     * @return Value in microseconds
+    */
+    static uint64_t bucketUpperBound(size_t index);
+
+    /**
+     * @brief Return shard of finished thread, so next thread continues with its counters
+     * @param shard The shard
+    */
+    void release(MetricsShard* shard);
+
+private:
+    // Private constructor to prevent instantiation
+    Metrics() = default;
+    /**
+     * @brief Function for increasing counter of own shard, plain load and store are enough
+     * because no other thread writes it
+    */
+    static void increase(std::atomic<uint64_t>& counter, uint64_t value) {
+        counter.store(counter.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+    }
+    /**
+     * @brief Function for getting shard of calling thread, free shard is reused or new one is created
+     * @return The shard
+    */
+    MetricsShard* threadShard();
+
+    std::mutex shardsMutex;
+    std::vector<MetricsShard*> shards;
+    std::vector<MetricsShard*> freeShards;
+};
+
+#endif
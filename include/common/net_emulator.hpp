@@ -0,0 +1,172 @@
+/**
+ * @file common/net_emulator.hpp
+ * @brief Header file for network emulator, sent datagrams are dropped, delayed, duplicated
+ * or reordered in user space, so loss handling can be tested without netem
+ * @author Lukas Vecerka (xvecer30)
+*/
+#ifndef NET_EMULATOR_HPP
+#define NET_EMULATOR_HPP
+#define EMULATOR_DEFAULT_REORDER_GAP_MS 10
+#define EMULATOR_DEFAULT_SEED 1
+
+#include <string>
+#include <vector>
+#include <queue>
+#include <random>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include "common/transport.hpp"
+
+/**
+ * @brief Impairments applied to every sent datagram
+ * @note loss, duplicate, reorder - probabilities in percent
+ * @note delayMs, jitterMs - datagram is sent after delay, jitter is spread uniformly around it
+ * @note reorderGapMs - reordered datagram is held back this much longer than others
+ * @note seed - seed of random generators, every transport derives its own stream from seed and number
+ * of stream, so same seed gives same decisions for same datagrams of session whatever other sessions send
+*/
+struct EmulatorConfig {
+    double loss = 0;
+    double duplicate = 0;
+    double reorder = 0;
+    uint32_t delayMs = 0;
+    uint32_t jitterMs = 0;
+    uint32_t reorderGapMs = EMULATOR_DEFAULT_REORDER_GAP_MS;
+    uint64_t seed = EMULATOR_DEFAULT_SEED;
+    /**
+     * @brief Function for deciding what happens with one sent datagram
+     * @param random Random generator seeded by seed
+     * @param delaysMs Delays of delivered copies are stored here
+     * @return Number of delivered copies, 0 if datagram is lost, 2 if it is duplicated
+    */
+    int fate(std::mt19937_64& random, int64_t delaysMs[2]) const;
+};
+
+/**
+ * @brief Function for parsing emulation spec
+ * @param spec Comma separated key=value list, keys are loss, duplicate, reorder (percent),
+ * delay, jitter, gap (milliseconds) and seed, e.g. "loss=5,delay=20,jitter=5,seed=7"
+ * @param config Parsed impairments are stored here
+ * @return false if spec is invalid
+*/
+bool parseEmulatorSpec(const std::string& spec, EmulatorConfig& config);
+
+/**
+ * @brief Transport of kernel sockets whose sent datagrams are impaired by emulator, it is used
+ * by one session (or listener) at a time, so its random stream needs no lock
+*/
+class EmulatedTransport : public SocketTransport {
+public:
+    /**
+     * @brief Constructor seeds random stream of transport
+     * @param config Impairments of emulator
+     * @param stream Number of stream, it is mixed with seed of config
+    */
+    EmulatedTransport(const EmulatorConfig& config, uint64_t stream);
+    ssize_t send(int socket, const char* data, size_t size, const sockaddr_in& addr) override;
+    /**
+     * @brief Emulator has to see every frame, so bursts are always sent separately
+    */
+    bool sendSegmented(int socket, const char* burst, size_t size, uint16_t segmentSize, const sockaddr_in& addr) override {
+        (void)socket; (void)burst; (void)size; (void)segmentSize; (void)addr;
+        return false;
+    }
+
+private:
+    EmulatorConfig config;
+    std::mt19937_64 random;
+};
+
+/**
+ * @brief Singleton class for network emulator, it applies to egress of process like netem
+ * applies to egress of interface, so both peers have to enable it to impair both directions;
+ * decisions are made by transports of sessions, emulator only holds delayed datagrams
+*/
+class NetworkEmulator {
+public:
+    static NetworkEmulator& instance() {
+        // Emulator is never destroyed, delayed datagrams still queued at exit are lost like in network
+        static NetworkEmulator* emulator = new NetworkEmulator();
+        return *emulator;
+    }
+
+    /**
+     * @brief Function for enabling emulator
+     * @param spec Emulation spec, see parseEmulatorSpec
+     * @return false if spec is invalid
+    */
+    bool configure(const std::string& spec);
+
+    /**
+     * @brief Function for checking if datagrams go through emulator
+     * @return true if emulator is enabled
+    */
+    bool isEnabled() const { return enabled.load(std::memory_order_relaxed); }
+
+    /**
+     * @brief Function for creating transport of session with its own random stream
+     * @param stream Number of stream, e.g. order of session, same number gives same decisions
+     * @return The transport, nullptr if emulator isn't enabled
+    */
+    std::unique_ptr<Transport> openTransport(uint64_t stream);
+    /**
+     * @brief Function for creating transport with next number of stream, numbers are assigned
+     * in order of calls, so it suits sessions created by one thread
+     * @return The transport, nullptr if emulator isn't enabled
+    */
+    std::unique_ptr<Transport> openTransport();
+
+    /**
+     * @brief Function for sending one copy of datagram now or queueing it
+     * @param socket The socket to send with, delayed datagram is sent with its duplicate,
+     * so it leaves even if session closes socket meanwhile
+     * @param data Serialized datagram
+     * @param size Size of datagram
+     * @param addr The destination address
+     * @param delayMs Delay of copy decided by fate
+     * @return size if datagram was sent or queued, -1 if sending failed
+    */
+    ssize_t emit(int socket, const char* data, size_t size, const sockaddr_in& addr, int64_t delayMs);
+
+private:
+    // Private constructor to prevent instantiation
+    NetworkEmulator() = default;
+
+    /**
+     * @brief Datagram waiting for its time
+     * @note sequence - keeps order of datagrams which are due at the same time
+    */
+    struct Delayed {
+        std::chrono::steady_clock::time_point due;
+        uint64_t sequence;
+        int socket;
+        sockaddr_in addr;
+        std::vector<char> data;
+        bool operator>(const Delayed& other) const {
+            return due != other.due ? due > other.due : sequence > other.sequence;
+        }
+    };
+
+    /**
+     * @brief Function of thread which sends delayed datagrams when they are due
+    */
+    void run();
+
+    std::atomic<bool> enabled{false};
+    EmulatorConfig config;
+    std::atomic<uint64_t> nextStream{0};
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::priority_queue<Delayed, std::vector<Delayed>, std::greater<Delayed>> delayed;
+    uint64_t sequence = 0;
+    std::thread sender;
+};
+
+#endif
@@ -0,0 +1,105 @@
+/**
+ * @file common/options.hpp
+ * @brief Header file with table of TFTP options, every supported option has fixed slot
+ * and presence of options is kept in bitmask
+ * @author Lukas Vecerka (xvecer30)
+*/
+#ifndef OPTIONS_HPP
+#define OPTIONS_HPP
+#define OPTION_COUNT 6
+
+#include <array>
+#include <optional>
+#include <string_view>
+#include <cstdint>
+
+/**
+ * @brief Enum for supported options, value is index of slot in option table
+ * @note BLKSIZE - size of block (RFC 2348)
+ * @note TIMEOUT - retransmission timeout in seconds (RFC 2349)
+ * @note TSIZE - size of transferred file (RFC 2349)
+ * @note WINDOWSIZE - number of blocks sent before ACK (RFC 7440)
+ * @note RANGESTART, RANGESIZE - byte range of file in RRQ
+*/
+enum class OptionId : uint8_t {
+    BLKSIZE,
+    TIMEOUT,
+    TSIZE,
+    WINDOWSIZE,
+    RANGESTART,
+    RANGESIZE
+};
+
+/**
+ * @brief Names of options in packets, indexed by OptionId
+*/
+inline constexpr std::array<std::string_view, OPTION_COUNT> optionNames = {"blksize", "timeout", "tsize", "windowsize", "rangestart", "rangesize"};
+
+/**
+ * @brief Function for getting name of option
+ * @param id Id of option
+ * @return Name of option in packets
+*/
+constexpr std::string_view optionName(OptionId id){
+    return optionNames[static_cast<size_t>(id)];
+}
+
+/**
+ * @brief Function for finding option by name, names are compared case-insensitively without copying
+ * @param name Name of option from packet
+ * @return Id of option, std::nullopt if option isn't supported
+*/
+std::optional<OptionId> findOption(std::string_view name);
+
+/**
+ * @brief Function for parsing value of option, whole value has to be decimal number
+ * @param value Value of option from packet
+ * @return Value of option, std::nullopt if value is not a number or it overflows
+*/
+std::optional<uint64_t> parseOptionValue(std::string_view value);
+
+/**
+ * @brief Class for options of request, OACK or session, value of every option has its own slot
+ * @note unknownOptions - extension slot, number of received options which aren't supported,
+ * they are ignored (RFC 2347) so only their count is kept, every option takes at least 3 bytes
+ * of datagram, so count of one packet fits into 16 bits
+*/
+class OptionTable {
+public:
+    uint16_t unknownOptions = 0;
+    bool has(OptionId id) const { return present & bit(id); }
+    uint64_t get(OptionId id) const { return values[static_cast<size_t>(id)]; }
+    void set(OptionId id, uint64_t value) {
+        values[static_cast<size_t>(id)] = value;
+        present |= bit(id);
+    }
+    void erase(OptionId id) { present &= ~bit(id); }
+    bool empty() const { return present == 0; }
+    /**
+     * @brief Function for checking that every option of other table is set in this table
+     * @param other The other table
+     * @return true if options of other table are subset of options of this table
+    */
+    bool includes(const OptionTable& other) const { return (other.present & ~present) == 0; }
+    /**
+     * @brief Function for calling f(OptionId, value) for every set option in order of OptionId
+     * @param f The function
+    */
+    template <typename F>
+    void forEach(F f) const {
+        for (size_t i = 0; i < OPTION_COUNT; i++) {
+            if (present & (1u << i)) {
+                f(static_cast<OptionId>(i), values[i]);
+            }
+        }
+    }
+
+private:
+    static constexpr uint8_t bit(OptionId id) { return 1u << static_cast<uint8_t>(id); }
+    std::array<uint64_t, OPTION_COUNT> values{};
+    uint8_t present = 0;
+};
+
+static_assert(OPTION_COUNT <= 8, "Presence of options doesn't fit into bitmask");
+
+#endif
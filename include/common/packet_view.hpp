@@ -0,0 +1,87 @@
+/**
+ * @file common/packet_view.hpp
+ * @brief Header file with declaration of non-owning view of received packet
+ * @author Lukas Vecerka (xvecer30)
+*/
+#ifndef PACKET_VIEW_HPP
+#define PACKET_VIEW_HPP
+
+#include <span>
+#include <string_view>
+#include <optional>
+#include <cstdint>
+#include <cstddef>
+#include "common/session.hpp"
+
+/**
+ * @brief Structure for one option of RRQ/WRQ/OACK packet, both parts point into received buffer
+*/
+struct OptionView {
+    std::string_view name;
+    std::string_view value;
+};
+
+/**
+ * @brief Structure for reason why request was rejected, message is static string
+*/
+struct RequestRejection {
+    ErrorCode code;
+    const char* message;
+};
+
+/**
+ * @class PacketView
+ * @brief Packet validated in place, all fields point into received buffer, so view is valid only
+ * as long as buffer isn't reused and parsing doesn't allocate anything
+ * @note opcode - opcode of packet
+ * @note blockNumber - block number of DATA/ACK, error code of ERROR, 0 otherwise
+ * @note payload - data of DATA, message of ERROR without terminating zero, empty otherwise
+ * @note filename - filename of RRQ/WRQ
+ * @note mode - mode of RRQ/WRQ as it was sent
+ * @note options - raw options of RRQ/WRQ/OACK, they are iterated by forEachOption
+*/
+class PacketView {
+public:
+    Opcode opcode;
+    uint16_t blockNumber;
+    std::span<const char> payload;
+    std::string_view filename;
+    std::string_view mode;
+    std::span<const char> options;
+    /**
+     * @brief Function for validating structure of packet, checks are same as in Packet::parse,
+     * only values of options are left to owning parsers
+     * @param buffer The buffer received from socket
+     * @param size The size of buffer
+     * @return View of packet
+     * @throws ParsingError if packet is not valid, OptionError if options are not terminated
+    */
+    static PacketView parse(const char* buffer, size_t size);
+    /**
+     * @brief Function for validating structure of RRQ/WRQ without exceptions and allocations, so
+     * listener can answer malformed request itself, values of options are left to session
+     * @param buffer The buffer received from socket
+     * @param size The size of buffer
+     * @return Error which has to be sent to client, std::nullopt if request is structurally valid
+    */
+    static std::optional<RequestRejection> validateRequest(const char* buffer, size_t size);
+    /**
+     * @brief Function for calling function for every option, names are not lowercased
+     * @param function Function called with OptionView
+    */
+    template <typename Function>
+    void forEachOption(Function function) const {
+        const char* current = options.data();
+        const char* end = options.data() + options.size();
+        while (current < end) {
+            // terminators were checked by parse
+            std::string_view name(current);
+            current += name.size() + 1;
+            std::string_view value(current);
+            current += value.size() + 1;
+            function(OptionView{name, value});
+        }
+    }
+};
+
+#endif
@@ -8,11 +8,32 @@
 #define PACKETS_HPP
 
 #include <vector>
-#include <map>
-#include <set>
+#include <span>
 #include <string>
+#include <atomic>
+#include <variant>
 #include <netinet/in.h>
 #include "common/session.hpp"
+#include "common/options.hpp"
+#include "common/transport.hpp"
+
+#define GSO_MAX_SEGMENTS 64
+#define GSO_MAX_BURST_SIZE BUFFER_SIZE
+// ERROR is serialized on stack, longer message is truncated to size of packet with default block size
+#define ERROR_PACKET_BUFFER_SIZE (INITIAL_BLOCK_SIZE + 4)
+
+class PacketView;
+class ReadRequestPacket;
+class WriteRequestPacket;
+class DataPacket;
+class ACKPacket;
+class ErrorPacket;
+class OACKPacket;
+
+/**
+ * @brief Any received packet, packets are handled by session transition table, not by packet classes
+*/
+using PacketVariant = std::variant<ReadRequestPacket, WriteRequestPacket, DataPacket, ACKPacket, ErrorPacket, OACKPacket>;
 
 /**
  * Function for convert netascii from packet to normal string
@@ -23,6 +44,13 @@
 */
 std::pair<std::string, const char*> parseNetasciiString(const char* buffer, const char* start, const char* end);
 
+/**
+ * @brief Function for filter options, remove options with invalid values
+ * @param options The table of options
+ * @return The table of options without invalid values, too big block size is lowered to maximum
+*/
+OptionTable filterOptions(OptionTable options);
+
 /**
  * @class Packet
  * @brief This class is an abstract base class for all packet classes, declare vertiual functions which should be implemented
@@ -33,34 +61,48 @@ public:
     sockaddr_in addr;
     virtual ~Packet() = default;
     /**
-     * @brief Function for serialize packet to vector of char before sending
-     * @return Vector of char
+     * @brief Function for serialize packet into caller's buffer, nothing is allocated
+     * @param buffer The buffer to write packet into
+     * @return Size of serialized packet
+     * @throws std::length_error if packet doesn't fit into buffer
     */
-    virtual std::vector<char> serialize() const = 0;
+    virtual size_t serializeInto(std::span<char> buffer) const = 0;
     /**
-     * @brief Function to get opcode of packet
+     * @brief Function for serialize packet to newly allocated vector of char
+     * @return Vector of char
     */
-    virtual Opcode getOpcode() const = 0;
+    std::vector<char> serialize() const;
     /**
-     * @brief Function to handle packet logic on client side
-     * @param session The session to handle
+     * @brief Function for logging sent packet, called only when packets are logged
     */
-    virtual void handleClient(ClientSession* session) const {}
+    virtual void logSent() const = 0;
     /**
-     * @brief Function to handle packet logic on server side
-     * @param session The session to handle
+     * @brief Function to get opcode of packet
     */
-    virtual void handleServer(ServerSession* session) const {}
+    virtual Opcode getOpcode() const = 0;
     /**
-     * @brief Function which retruns unique pointer on pocket based on opcode of the packet
+     * @brief Function which returns packet of type based on opcode of the packet
      * @param addr The address of source
      * @param buffer The buffer received from socket
      * @param bufferSize The size of buffer
-     * @return Unique pointer to packet
+     * @return Variant holding the packet
      * @throws ParsingError if packet is not valid, OptionError if option is not valid
     */
-    static std::unique_ptr<Packet> parse(sockaddr_in addr, const char* buffer, size_t bufferSize);
-    void send(Session* session, int socket);
+    static PacketVariant parse(sockaddr_in addr, const char* buffer, size_t bufferSize);
+    /**
+     * @brief Function for sending packet, packet is serialized into session buffer and kept for retransmission unless it is ERROR,
+     * ERROR is serialized into buffer on stack
+     * @param session The session sending packet, nullptr if packet isn't sent by session
+     * @param socket The socket to send with
+    */
+    void send(Session* session, int socket) { send(session, socket, session != nullptr ? *session->transport : Transport::system()); }
+    /**
+     * @brief Function for sending packet through given transport, packets sent without session by simulated server need it
+     * @param session The session sending packet, nullptr if packet isn't sent by session
+     * @param socket The socket to send with
+     * @param transport Transport of socket
+    */
+    void send(Session* session, int socket, Transport& transport);
 };
 
 /**
@@ -68,18 +110,17 @@ public:
  * @note This class inherits from Packet class and implements all its methods
  * @note filename - path to file on server
  * @note mode - mode of transfer (netascii, octet)
- * @note options - map of options
- * @note supportedOptions - set of supported options
+ * @note options - table of supported options, unknown options are only counted
 */
 class RequestPacket : public Packet {
 public:
     std::string filename;
     DataMode mode;
-    std::map<std::string, uint64_t> options;
-    static const std::set<std::string> supportedOptions;
-    RequestPacket(const std::string& filename, DataMode mode, std::map<std::string, uint64_t> options, sockaddr_in addr);
-    std::vector<char> serialize() const override;
-    static std::unique_ptr<RequestPacket> parse(sockaddr_in addr, const char* buffer, size_t size);
+    OptionTable options;
+    RequestPacket(const std::string& filename, DataMode mode, OptionTable options, sockaddr_in addr);
+    size_t serializeInto(std::span<char> buffer) const override;
+    void logSent() const override;
+    static PacketVariant parse(sockaddr_in addr, const char* buffer, size_t size);
 };
 
 /**
@@ -87,10 +128,8 @@ public:
 */
 class ReadRequestPacket : public RequestPacket {
 public:
-    ReadRequestPacket(const std::string& filename, DataMode mode, std::map<std::string, uint64_t> options, sockaddr_in addr);
+    ReadRequestPacket(const std::string& filename, DataMode mode, OptionTable options, sockaddr_in addr);
     Opcode getOpcode() const override { return Opcode::RRQ; }
-    void handleClient(ClientSession* session) const override;
-    void handleServer(ServerSession* session) const override;
 };
 
 /**
@@ -98,10 +137,8 @@ public:
 */
 class WriteRequestPacket : public RequestPacket {
 public:
-    WriteRequestPacket(const std::string& filename, DataMode mode, std::map<std::string, uint64_t> options, sockaddr_in addr);
+    WriteRequestPacket(const std::string& filename, DataMode mode, OptionTable options, sockaddr_in addr);
     Opcode getOpcode() const override { return Opcode::WRQ; }
-    void handleClient(ClientSession* session) const override;
-    void handleServer(ServerSession* session) const override;
 };
 
 /**
@@ -115,11 +152,25 @@ public:
     uint16_t blockNumber;
     std::vector<char> data;
     DataPacket(uint16_t blockNumber, const std::vector<char>& data, sockaddr_in addr);
-    std::vector<char> serialize() const override;
+    size_t serializeInto(std::span<char> buffer) const override;
+    void logSent() const override;
     static DataPacket parse(sockaddr_in addr, const char* buffer, size_t size);
     Opcode getOpcode() const override { return Opcode::DATA; } // DATA opcode
-    void handleClient(ClientSession* session) const override;
-    void handleServer(ServerSession* session) const override;
+    /**
+     * @brief Function for sending consecutive data blocks as burst, equal sized frames are packed into one
+     * buffer and segmented by transport (UDP GSO of kernel sockets), otherwise each frame is sent separately
+     * @param socket The socket to send with
+     * @param addr The destination address
+     * @param firstBlock Block number of first block
+     * @param blocks Data blocks to send
+     * @param burst Scratch buffer of session which frames are serialized into, it is allocated only once
+     * @param transport Transport of session
+    */
+    static void sendBurst(int socket, const sockaddr_in& addr, uint16_t firstBlock, const BlockWindow& blocks, std::vector<char>& burst, Transport& transport = Transport::system());
+    /**
+     * @brief Flag if GSO is used for bursts, it is cleared when kernel doesn't support UDP_SEGMENT
+    */
+    static std::atomic<bool> gsoEnabled;
 };
 
 /**
@@ -131,11 +182,10 @@ class ACKPacket : public Packet {
 public:
     uint16_t blockNumber;
     ACKPacket(uint16_t blockNumber, sockaddr_in addr);
-    std::vector<char> serialize() const override;
+    size_t serializeInto(std::span<char> buffer) const override;
+    void logSent() const override;
     static ACKPacket parse(sockaddr_in addr, const char* buffer, size_t size);
     Opcode getOpcode() const override { return Opcode::ACK; } // ACK opcode
-    void handleClient(ClientSession* session) const override;
-    void handleServer(ServerSession* session) const override;
 };
 
 /**
@@ -149,27 +199,39 @@ public:
     ErrorCode errorCode;
     std::string errorMessage;
     ErrorPacket(ErrorCode errorCode, const std::string& errorMessage, sockaddr_in addr);
-    std::vector<char> serialize() const override;
+    /**
+     * @brief Function for serialize packet into caller's buffer, message which doesn't fit is truncated
+     * @param buffer The buffer, it has to hold at least header and terminating zero
+     * @return Size of serialized packet
+     * @throws std::length_error if buffer can't hold even empty message
+    */
+    size_t serializeInto(std::span<char> buffer) const override;
+    void logSent() const override;
     static ErrorPacket parse(sockaddr_in addr, const char* buffer, size_t size);
     Opcode getOpcode() const override { return Opcode::ERROR; } // ERROR opcode
-    void handleClient(ClientSession* session) const override;
-    void handleServer(ServerSession* session) const override;
 };
 
 /**
  * @brief Class for represent OACK packets
  * @note This class inherits from Packet class and implements all its methods
- * @note options - map of options
+ * @note options - table of options
 */
 class OACKPacket : public Packet {
 public:
-    std::map<std::string, uint64_t> options;
-    OACKPacket(std::map<std::string, uint64_t> options, sockaddr_in addr);
-    std::vector<char> serialize() const override;
+    OptionTable options;
+    OACKPacket(OptionTable options, sockaddr_in addr);
+    size_t serializeInto(std::span<char> buffer) const override;
+    void logSent() const override;
     static OACKPacket parse(sockaddr_in addr, const char* buffer, size_t size);
+    /**
+     * @brief Function for building OACK from packet validated by PacketView::parse
+     * @param addr The address of source
+     * @param packet View of OACK packet
+     * @return OACK packet with supported options
+     * @throws OptionError if option occurs multiple times or its value is not a number
+    */
+    static OACKPacket fromView(sockaddr_in addr, const PacketView& packet);
     Opcode getOpcode() const override { return Opcode::OACK; } // OACK opcode
-    void handleClient(ClientSession* session) const override;
-    void handleServer(ServerSession* session) const override;
 };
 
 #endif // PACKETS_HPP
\ No newline at end of file
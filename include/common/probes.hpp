@@ -0,0 +1,39 @@
+/**
+ * @file common/probes.hpp
+ * @brief Header file with USDT probes of sessions and packets, probe is a single nop instruction with
+ * note in ELF, so it costs nothing until perf or bpftrace attaches to it (usdt:tftp-server:tftp:<name>)
+ * @author Lukas Vecerka (xvecer30)
+*/
+#ifndef PROBES_HPP
+#define PROBES_HPP
+
+// Probes need <sys/sdt.h> from systemtap-sdt-dev, without it or with TFTP_NO_PROBES they are compiled out
+#if defined(__has_include) && !defined(TFTP_NO_PROBES)
+#if __has_include(<sys/sdt.h>)
+#include <sys/sdt.h>
+#define TFTP_PROBES_ENABLED 1
+#endif
+#endif
+
+#ifdef TFTP_PROBES_ENABLED
+#define TFTP_PROBE3(name, a, b, c) DTRACE_PROBE3(tftp, name, a, b, c)
+#define TFTP_PROBE4(name, a, b, c, d) DTRACE_PROBE4(tftp, name, a, b, c, d)
+#else
+// arguments are not evaluated, they are only marked as used
+#define TFTP_PROBE3(name, a, b, c) do { (void)sizeof(a); (void)sizeof(b); (void)sizeof(c); } while (0)
+#define TFTP_PROBE4(name, a, b, c, d) do { (void)sizeof(a); (void)sizeof(b); (void)sizeof(c); (void)sizeof(d); } while (0)
+#endif
+
+/**
+ * @brief Probes of provider tftp, id is Session::sessionId, 0 for packets sent without session
+ * @note session_create(id, type, client ip, client port) - server created session for RRQ (type 0) or WRQ (type 1)
+ * @note packet_receive(id, opcode, block, bytes) - packet is going to be handled by session
+ * @note packet_send(id, opcode, block, bytes) - packet was sent, every DATA of window separately
+ * @note state_change(id, from, to) - received packet moved session into another SessionState
+ * @note retransmit(id, retries, block) - last packet or window is sent again after timeout
+ * @note session_exit(id, type, state, bytes) - session is destroyed, state is its final SessionState
+ * and bytes is size of transferred data
+ * @note block is block number of DATA/ACK and error code of ERROR, bytes is size of data in DATA, 0 otherwise
+*/
+
+#endif
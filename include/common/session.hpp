@@ -15,6 +15,10 @@
 #define INITIAL_TIMEOUT 5
 #define INITIAL_BLOCK_SIZE 512
 #define INITIAL_TSIZE 0
+#define INITIAL_WINDOW_SIZE 1
+#define MIN_WINDOW_SIZE 1
+#define MAX_WINDOW_SIZE 65535
+#define SERVER_MAX_WINDOW_SIZE 64
 #define MAX_RETRIES 3
 #define BACKOFF_FACTOR 2
 
@@ -27,7 +31,14 @@
 #include <memory>
 #include <atomic>
 #include <vector>
+#include <chrono>
+#include <functional>
 #include <iostream>
+#include "common/upload_source.hpp"
+#include "common/download_sink.hpp"
+#include "common/options.hpp"
+#include "common/trace.hpp"
+#include "common/transport.hpp"
 
 /**
  * @brief Flag for handling SIGINT on server
@@ -120,19 +131,94 @@ DataMode stringToMode(std::string value);
 bool hasEnoughSpace(uint64_t size, std::string rootDir);
 
 
-class Packet;
+/**
+ * @brief Structure with configuration of server sessions
+ * @note udpGro - WRQ sessions accept coalesced DATA packets (UDP_GRO) and split them by segment size
+ * @note busyPollUsec - SO_BUSY_POLL time set on session sockets, 0 disables busy polling
+ * @note spinUsec - time for which session polls socket without blocking before it blocks in recvfrom
+ * @note cpus - CPUs on which session threads are pinned in round robin, empty means no pinning
+ * @note maxWindowSize - largest windowsize confirmed in OACK, whole window is buffered by session
+*/
+struct SessionConfig {
+    bool udpGro = false;
+    int busyPollUsec = 0;
+    int spinUsec = 0;
+    std::vector<int> cpus;
+    uint16_t maxWindowSize = SERVER_MAX_WINDOW_SIZE;
+};
+
+/**
+ * @brief Structure with counters of duplicate and out of order packets handled by session
+ * @note staleAcks - ACKs of already acknowledged blocks, they are ignored so no block is sent twice
+ * @note duplicateData - DATA blocks which were already received, first one of burst is acknowledged again
+ * @note outOfOrderData - DATA blocks ahead of expected block in window, first one of burst acknowledges
+ * last block received in order
+ * @note earlyRetransmits - windows sent again because ACK repeated start of window before timeout
+*/
+struct DuplicateStats {
+    uint64_t staleAcks = 0;
+    uint64_t duplicateData = 0;
+    uint64_t outOfOrderData = 0;
+    uint64_t earlyRetransmits = 0;
+};
+
+class BlockWriter;
+class BlockReader;
+
+/**
+ * @brief Ring of data blocks which were sent but not acknowledged yet, buffers of acknowledged
+ * blocks stay in ring and are reused for next blocks, so full window doesn't allocate
+*/
+class BlockWindow {
+public:
+    /**
+     * @brief Function for appending block at the end of window
+     * @return Buffer for new block, it can hold data of older block
+    */
+    std::vector<char>& push();
+    /**
+     * @brief Function for removing acknowledged blocks from the start of window
+     * @param count Number of blocks to remove, at most size of window
+    */
+    void popFront(size_t count);
+    const std::vector<char>& operator[](size_t index) const { return slots[(head + index) % slots.size()]; }
+    size_t size() const { return count; }
+    bool empty() const { return count == 0; }
+
+private:
+    std::vector<std::vector<char>> slots;
+    size_t head = 0;
+    size_t count = 0;
+};
 
 /**
  * @brief Class for representing Session
  * @note This class is base class for ClientSession and ServerSession
+ * @note transport, clock - all I/O and time of session, kernel sockets and steady clock unless session is simulated
+ * @note maxRetries, backoffFactor - retransmission policy, MAX_RETRIES and BACKOFF_FACTOR by default
+ * @note strayAcknowledged, lastStrayBlock - receiver acknowledged current burst of duplicate or out of order
+ * blocks, burst ends with block received in order or with block which is not after previous stray one
+ * @note windowResent, repeatedAckExpected - sender sent current window more than once, so ACK of start of
+ * next window can come twice and its first repetition isn't loss of block
 */
 class Session {
 public:
-    Session(int socket, const sockaddr_in& dst_addr, const std::string src_filename, const std::string dst_filename, DataMode dataMode, SessionType sessionType, std::string rootDir);
+    Session(int socket, const sockaddr_in& dst_addr, const std::string src_filename, const std::string dst_filename, DataMode dataMode, SessionType sessionType, std::string rootDir,
+        Transport& transport = Transport::system(), const Clock& clock = Clock::system());
     /**
      * @brief Function for handling session
     */
     virtual void handleSession() {}
+    /**
+     * @brief Destructor, session is counted as completed or failed by its final state
+    */
+    virtual ~Session();
+    /**
+     * @brief Function for reading next data block which will be sent, block is encoded by codec of transfer mode
+     * @param data Buffer for block, it is resized to size of read block
+     * @throw std::runtime_error if failed to read from file or source
+    */
+    void readDataBlock(std::vector<char>& data);
     sockaddr_in dst_addr;
     sockaddr_in src_addr;
     int srcTID;
@@ -150,18 +236,44 @@ public:
     SessionState sessionState;
     std::ofstream writeStream;
     bool fileOpen;
-    std::map<std::string, uint64_t> options;
+    OptionTable options;
     int retries;
-    std::unique_ptr<Packet> lastPacket;
+    int maxRetries;
+    int backoffFactor;
+    Transport* transport;
+    const Clock* clock;
+    std::vector<char> lastMessage;
+    size_t lastMessageSize;
+    sockaddr_in lastAddr;
+    std::vector<char> burstBuffer;
+    uint16_t windowSize;
+    BlockWindow unackedBlocks;
+    bool lastBlockRead;
+    uint16_t blocksSinceAck;
+    bool strayAcknowledged;
+    uint16_t lastStrayBlock;
+    bool windowResent;
+    bool repeatedAckExpected;
+    DuplicateStats duplicateStats;
+    uint64_t bytesTransferred;
+    uint32_t sessionId;
+    std::chrono::steady_clock::time_point startTime;
+    std::chrono::steady_clock::time_point windowSentTime;
+    bool windowTimed;
+    bool firstBlockDone;
+    std::unique_ptr<BlockWriter> blockWriter;
+    std::unique_ptr<BlockReader> blockReader;
     /**
-     * @brief Function for writing data block to file
+     * @brief Function for writing received data block, block is decoded by codec of transfer mode
+     * and written into file, or into sink on client when it is set
      * @param data Data to write
+     * @param size Size of data
+     * @param lastBlock true if block ends transfer, data held back by codec are flushed
      * @throw std::runtime_error if failed to write into file
     */
-    void writeDataBlock(std::vector<char> data);
+    void writeDataBlock(const char* data, size_t size, bool lastBlock);
     /**
-     * @brief Function for setting timeout on socket
-     * 
+     * @brief Function for setting receive timeout of socket to current timeout of session
     */
     void setTimeout();
     /**
@@ -169,25 +281,128 @@ public:
      * @return true if file was opened, false otherwise
     */
     bool openFileForWrite();
+    /**
+     * @brief Function for filling send window with new data blocks and sending all unacknowledged blocks
+     * @note blockNumber is number of last block which was read, state is set to WAITING_ACK or WAITING_LAST_ACK
+     * @throw std::runtime_error if failed to read data block
+    */
+    void sendWindow();
+    /**
+     * @brief Function for removing acknowledged blocks from send window
+     * @param ackBlock Block number from ACK packet
+     * @return number of newly acknowledged blocks, 0 for duplicate or stale ACK, -1 if block was not sent yet
+    */
+    int acknowledgeBlocks(uint16_t ackBlock);
+    /**
+     * @brief Function for sending window again when ACK repeats block before start of window, receiver
+     * acknowledges this way block received out of order, so first block of window was lost
+     * @param ackBlock Block number from ACK packet
+     * @return true if window was sent again, at most once for each window and only when window is larger than 1
+     * @throw std::runtime_error if failed to read data block
+    */
+    bool retransmitOnRepeatedAck(uint16_t ackBlock);
+    /**
+     * @brief Function for checking if received data block was already received
+     * @param dataBlock Block number from DATA packet
+     * @return true if block is behind next expected block
+    */
+    bool isDuplicateData(uint16_t dataBlock) const;
+    /**
+     * @brief Function for logging duplicate counters when some duplicates were handled
+    */
+    void logDuplicateStats() const;
+    /**
+     * @brief Function for acknowledging received data block, ACK is sent when whole window was received or on last block
+     * @param lastBlock true if received block is last block of transfer
+    */
+    void acknowledgeData(bool lastBlock);
+    /**
+     * @brief Function for sending ACK of last block received in order, used when window is broken
+    */
+    void reacknowledgeData();
+    /**
+     * @brief Function for acknowledging duplicate or out of order block, only first block of burst is
+     * acknowledged, so broken window of N blocks doesn't produce N same ACKs
+     * @param dataBlock Block number from DATA packet
+    */
+    void reacknowledgeStrayData(uint16_t dataBlock);
+    /**
+     * @brief Function for retransmitting after timeout, sender resends whole window, receiver
+     * with window acknowledges last block received in order, otherwise last packet is resent
+    */
+    void retransmit();
+    /**
+     * @brief Function for recording event of session into trace, it does nothing when tracing is disabled
+     * @param event The event
+     * @param opcode Opcode of packet, 0 for events without packet
+     * @param block Block number of packet or current block
+     * @param bytes Size of data in DATA packet
+     * @param from State before event, current state is recorded as state after event
+     * @param timestampNs Time of event, 0 for current time
+    */
+    void trace(TraceEvent event, uint8_t opcode, uint16_t block, size_t bytes, SessionState from, uint64_t timestampNs = 0) const {
+        if (Tracer::instance().isEnabled()) {
+            traceRecord(event, opcode, block, bytes, from, timestampNs);
+        }
+    }
+    /**
+     * @brief Function for recording sent packet into trace, opcode and block number are read from serialized packet
+     * @param message Serialized packet
+     * @param size Size of packet
+     * @param timestampNs Time before packet was sent, other side can answer before send call returns
+    */
+    void traceSent(const char* message, size_t size, uint64_t timestampNs) const;
+
+private:
+    void traceRecord(TraceEvent event, uint8_t opcode, uint16_t block, size_t bytes, SessionState from, uint64_t timestampNs) const;
 };
 
+class RequestPacket;
+
 class ClientSession : public Session {
 public:
     bool TIDisSet;
-    ClientSession(int socket, const sockaddr_in& dst_addr, const std::string src_filename, const std::string dst_filename, DataMode dataMode, SessionType sessionType, std::map<std::string, uint64_t> options, std::string rootDir);
+    std::unique_ptr<UploadSource> source;
+    std::shared_ptr<DownloadSink> sink;
+    // Own stream of network emulator, set when session uses kernel sockets and emulator is enabled
+    std::unique_ptr<Transport> emulatedTransport;
+    ClientSession(int socket, const sockaddr_in& dst_addr, const std::string src_filename, const std::string dst_filename, DataMode dataMode, SessionType sessionType, OptionTable options, std::string rootDir,
+        Transport& transport = Transport::system(), const Clock& clock = Clock::system());
+    /**
+     * @brief Function for preparing session and sending request packet, source or sink
+     * set before start is used instead of file
+     * @param request RRQ/WRQ packet to send
+     * @return true if request was sent, false if session failed to start
+    */
+    bool start(RequestPacket& request);
+    /**
+     * @brief Function for handling session until it is finished, session has to be started
+    */
     void handleSession() override;
     /**
-     * @brief Function for reading data block from stdin
-     * @return vector of chars
-     * @throw std::runtime_error if failed to read from stdin
+     * @brief Function for handling one datagram received from server
+     * @param buffer The buffer with datagram
+     * @param size The size of datagram
+     * @return true if session continues, false if it is finished
+    */
+    bool handleDatagram(const char* buffer, size_t size);
+    /**
+     * @brief Function for handling timeout, last packet is retransmitted with exponential backoff
+     * @return true if session continues, false if number of retries was exceeded
     */
-    std::vector<char> readDataBlock();
+    bool handleTimeout();
+    /**
+     * @brief Function for opening source of upload, file when src_filename is set, stdin otherwise,
+     * regular files are mapped to memory and pipes are read ahead by prefetch thread
+     * @return true if source was opened, false otherwise
+    */
+    bool openSource();
     /**
      * @brief Function for setting options on client when OACK is received
      * @param options Options to set
      * 
     */
-    void setOptions(std::map<std::string, uint64_t> options);
+    void setOptions(OptionTable options);
     /**
      * @brief Function for cleaning the session
     */
@@ -197,14 +412,36 @@ public:
 class ServerSession : public Session {
 public:
     std::ifstream readStream;
-    ServerSession(int socket, const sockaddr_in& dst_addr, const std::string src_filename, const std::string dst_filename, DataMode dataMode, SessionType sessionType,  std::map<std::string, uint64_t> options, std::string rootDir);
+    SessionConfig config;
+    // called once right after first packet of session was sent, before any other packet is received
+    std::function<void()> onStarted;
+    bool groEnabled;
+    uint64_t receiveCalls;
+    uint64_t packetsReceived;
+    ServerSession(int socket, const sockaddr_in& dst_addr, const std::string src_filename, const std::string dst_filename, DataMode dataMode, SessionType sessionType,  OptionTable options, std::string rootDir,
+        Transport& transport = Transport::system(), const Clock& clock = Clock::system());
+    /**
+     * @brief Function for handling session until it is finished, it blocks on socket of session
+    */
     void handleSession() override;
     /**
-     * @brief Function for reading data block from file
-     * @return vector of 
-     * @throw std::runtime_error if failed to read from file
+     * @brief Function for answering request, first DATA, ACK or OACK is sent and onStarted is called
+     * @return true if session continues, false if it is finished
+    */
+    bool start();
+    /**
+     * @brief Function for handling datagram received from client, coalesced datagram is split into packets
+     * @param buffer The buffer with datagram, sender is expected in dst_addr
+     * @param size The size of datagram
+     * @param segmentSize Size of each coalesced packet, size of whole datagram if it wasn't coalesced
+     * @return true if session continues, false if it is finished
     */
-    std::vector<char> readDataBlock();
+    bool handleReceived(const char* buffer, size_t size, size_t segmentSize);
+    /**
+     * @brief Function for handling timeout, last packet or window is retransmitted with exponential backoff
+     * @return true if session continues, false if number of retries was exceeded
+    */
+    bool handleTimeout();
     /**
      * @brief Function for cleaning session
     */
@@ -228,6 +465,39 @@ public:
      * @return true if file was opened, false otherwise
     */
     bool openFileForRead();
+    /**
+     * @brief Function for enabling UDP_GRO on session socket when it is configured, used by write session
+    */
+    void enableGro();
+    /**
+     * @brief Function for enabling busy polling on session socket when it is configured
+    */
+    void enableBusyPoll();
+    /**
+     * @brief Function for receiving datagram, with GRO enabled one buffer can hold multiple coalesced packets
+     * @param buffer The buffer to receive into
+     * @param size The size of buffer
+     * @param segmentSize Size of each coalesced packet, size of whole datagram if it wasn't coalesced
+     * @return number of received bytes, -1 on error
+     * @note when spinning is configured socket is polled without blocking first
+    */
+    ssize_t receiveDatagram(char* buffer, size_t size, size_t& segmentSize);
+    /**
+     * @brief Function for one receive call on session socket
+     * @param buffer The buffer to receive into
+     * @param size The size of buffer
+     * @param segmentSize Size of each coalesced packet
+     * @param flags Flags for recvfrom/recvmsg
+     * @return number of received bytes, -1 on error
+    */
+    ssize_t receiveOnce(char* buffer, size_t size, size_t& segmentSize, int flags);
+    /**
+     * @brief Function for parsing and handling one packet received from client
+     * @param buffer The buffer with packet
+     * @param size The size of packet
+     * @return true if session continues, false if it is finished
+    */
+    bool handleDatagram(const char* buffer, size_t size);
 };
 
 #endif 
\ No newline at end of file
@@ -0,0 +1,112 @@
+/**
+ * @file common/session_fsm.hpp
+ * @brief Header file with transition table of sessions, one table drives client and server
+ * @author Lukas Vecerka (xvecer30)
+*/
+#ifndef SESSION_FSM_HPP
+#define SESSION_FSM_HPP
+#define SESSION_STATE_COUNT 9
+#define OPCODE_COUNT 7
+
+#include <array>
+#include <cstdint>
+#include "common/session.hpp"
+#include "common/packet_view.hpp"
+
+/**
+ * @brief Enum for side of transfer which session runs on
+*/
+enum class Role {
+    CLIENT,
+    SERVER
+};
+
+/**
+ * @brief Enum for actions taken when packet is received in some state
+ * @note ILLEGAL - ILLEGAL_OPERATION is sent and session fails
+ * @note FIRST_DATA - first DATA of download, only expected block is accepted
+ * @note DATA - DATA inside transfer, duplicates and broken window are acknowledged again
+ * @note DATA_AFTER_OACK - negotiated options are applied, then as DATA
+ * @note FIRST_ACK - ACK of block 0, first window is sent
+ * @note ACK_AFTER_OACK - negotiated options are applied, then as FIRST_ACK
+ * @note ACK - acknowledged blocks are dropped from window and next window is sent
+ * @note OACK - options confirmed by server are checked and applied
+ * @note OPTIONS_REJECTED - ERROR answering request with options, request is sent again without them
+ * if server refused options (INVALID_OPTIONS), other error codes end transfer as PEER_ERROR
+ * @note PEER_ERROR - other side ended transfer with ERROR
+*/
+enum class Action : uint8_t {
+    ILLEGAL,
+    FIRST_DATA,
+    DATA,
+    DATA_AFTER_OACK,
+    FIRST_ACK,
+    ACK_AFTER_OACK,
+    ACK,
+    OACK,
+    OPTIONS_REJECTED,
+    PEER_ERROR
+};
+
+using TransitionTable = std::array<std::array<Action, OPCODE_COUNT>, SESSION_STATE_COUNT>;
+
+/**
+ * @brief Function for building transition table of role, every pair which isn't listed is illegal
+ * @param role Role of session
+ * @return Table indexed by state and opcode
+*/
+constexpr TransitionTable makeTransitions(Role role){
+    TransitionTable table{};
+    auto set = [&table](SessionState state, Opcode opcode, Action action) {
+        table[static_cast<size_t>(state)][opcode] = action;
+    };
+    for (size_t state = 0; state < SESSION_STATE_COUNT; state++) {
+        table[state][Opcode::ERROR] = Action::PEER_ERROR;
+    }
+    set(SessionState::WAITING_DATA, Opcode::DATA, Action::DATA);
+    set(SessionState::WAITING_ACK, Opcode::ACK, Action::ACK);
+    set(SessionState::WAITING_LAST_ACK, Opcode::ACK, Action::ACK);
+    if (role == Role::CLIENT) {
+        // Request without options is answered by DATA 1 or ACK 0, with options by OACK,
+        // server which doesn't support options answers as if there were none
+        set(SessionState::INITIAL, Opcode::DATA, Action::FIRST_DATA);
+        set(SessionState::INITIAL, Opcode::ACK, Action::FIRST_ACK);
+        set(SessionState::WAITING_OACK, Opcode::DATA, Action::FIRST_DATA);
+        set(SessionState::WAITING_OACK, Opcode::ACK, Action::FIRST_ACK);
+        set(SessionState::WAITING_OACK, Opcode::OACK, Action::OACK);
+        set(SessionState::WAITING_OACK, Opcode::ERROR, Action::OPTIONS_REJECTED);
+    } else {
+        set(SessionState::WAITING_AFTER_OACK, Opcode::DATA, Action::DATA_AFTER_OACK);
+        set(SessionState::WAITING_AFTER_OACK, Opcode::ACK, Action::ACK_AFTER_OACK);
+    }
+    return table;
+}
+
+/**
+ * @brief Transition tables of client and server sessions
+*/
+inline constexpr TransitionTable clientTransitions = makeTransitions(Role::CLIENT);
+inline constexpr TransitionTable serverTransitions = makeTransitions(Role::SERVER);
+
+static_assert(static_cast<size_t>(SessionState::ERROR) + 1 == SESSION_STATE_COUNT, "Transition table doesn't cover all states");
+static_assert(clientTransitions[static_cast<size_t>(SessionState::WAITING_DATA)][Opcode::DATA] == Action::DATA);
+static_assert(serverTransitions[static_cast<size_t>(SessionState::WAITING_OACK)][Opcode::OACK] == Action::ILLEGAL);
+
+/**
+ * @brief Function for handling packet received by client session, action is looked up in client table
+ * @param session The session to handle
+ * @param packet Packet validated by PacketView::parse
+ * @throw std::runtime_error if reading of upload source fails
+ * @throw OptionError if OACK contains invalid option
+*/
+void handlePacket(ClientSession* session, const PacketView& packet);
+
+/**
+ * @brief Function for handling packet received by server session, action is looked up in server table
+ * @param session The session to handle
+ * @param packet Packet validated by PacketView::parse
+ * @throw std::runtime_error if reading of file fails
+*/
+void handlePacket(ServerSession* session, const PacketView& packet);
+
+#endif
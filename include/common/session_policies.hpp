@@ -0,0 +1,287 @@
+/**
+ * @file common/session_policies.hpp
+ * @brief Header file with file backends and codecs of session data path, combination is chosen
+ * once when file is opened, so writing and reading of block doesn't check transfer mode
+ * @author Lukas Vecerka (xvecer30)
+*/
+#ifndef SESSION_POLICIES_HPP
+#define SESSION_POLICIES_HPP
+#define NETASCII_CHUNK_SIZE 4096
+
+#include <array>
+#include <memory>
+#include <fstream>
+#include <cstdint>
+#include <cstddef>
+#include "common/upload_source.hpp"
+#include "common/download_sink.hpp"
+#include "common/session.hpp"
+
+/**
+ * @brief File backend writing into std::ofstream of session
+*/
+class StreamWriter {
+public:
+    explicit StreamWriter(std::ofstream& stream) : stream(stream) {}
+    /**
+     * @throw std::runtime_error if failed to write into file
+    */
+    void write(const char* data, size_t size);
+
+private:
+    std::ofstream& stream;
+};
+
+/**
+ * @brief File backend writing into download sink (memory, descriptor, stripe of shared destination)
+*/
+class SinkWriter {
+public:
+    explicit SinkWriter(DownloadSink& sink) : sink(sink) {}
+    void write(const char* data, size_t size) { sink.write(data, size); }
+
+private:
+    DownloadSink& sink;
+};
+
+/**
+ * @brief File backend reading from std::ifstream of session, at most limit bytes are read (byte range)
+*/
+class StreamReader {
+public:
+    StreamReader(std::ifstream& stream, uint64_t limit) : stream(stream), remaining(limit) {}
+    /**
+     * @return number of read bytes, 0 at the end of file or range
+     * @throw std::runtime_error if failed to read from file
+    */
+    size_t read(char* data, size_t size);
+
+private:
+    std::ifstream& stream;
+    uint64_t remaining;
+};
+
+/**
+ * @brief File backend reading from upload source (mapped file, prefetched pipe, memory)
+*/
+class SourceReader {
+public:
+    explicit SourceReader(UploadSource& source) : source(source) {}
+    size_t read(char* data, size_t size) { return source.read(data, size); }
+
+private:
+    UploadSource& source;
+};
+
+/**
+ * @brief Codec of octet mode, data are passed without change
+*/
+class OctetCodec {
+public:
+    template <typename Writer>
+    void decode(const char* data, size_t size, Writer& writer) {
+        writer.write(data, size);
+    }
+    template <typename Writer>
+    void finish(Writer&) {}
+    template <typename Reader>
+    size_t encode(Reader& reader, char* block, size_t size) {
+        size_t filled = 0;
+        while (filled < size) {
+            size_t count = reader.read(block + filled, size - filled);
+            if (count == 0) {
+                break;
+            }
+            filled += count;
+        }
+        return filled;
+    }
+};
+
+/**
+ * @brief Codec of netascii mode, CR LF is line end and CR NUL is carriage return (RFC 764),
+ * pair split by end of block is completed in next block
+*/
+class NetasciiCodec {
+public:
+    template <typename Writer>
+    void decode(const char* data, size_t size, Writer& writer) {
+        size_t filled = 0;
+        for (size_t i = 0; i < size; i++) {
+            // character can add two bytes
+            if (filled >= chunk.size() - 1) {
+                writer.write(chunk.data(), filled);
+                filled = 0;
+            }
+            char ch = data[i];
+            if (pendingCR) {
+                pendingCR = false;
+                if (ch == '\n') {
+                    chunk[filled++] = '\n';
+                    continue;
+                }
+                chunk[filled++] = '\r';
+                if (ch == '\0') {
+                    continue;
+                }
+            }
+            if (ch == '\r') {
+                pendingCR = true;
+            } else {
+                chunk[filled++] = ch;
+            }
+        }
+        if (filled > 0) {
+            writer.write(chunk.data(), filled);
+        }
+    }
+    /**
+     * @brief CR at the very end of data has no pair, it is written as it is
+    */
+    template <typename Writer>
+    void finish(Writer& writer) {
+        if (pendingCR) {
+            pendingCR = false;
+            writer.write("\r", 1);
+        }
+    }
+    template <typename Reader>
+    size_t encode(Reader& reader, char* block, size_t size) {
+        size_t filled = 0;
+        if (carry != NO_CARRY && size > 0) {
+            block[filled++] = static_cast<char>(carry);
+            carry = NO_CARRY;
+        }
+        while (filled < size) {
+            if (chunkPosition == chunkSize) {
+                chunkSize = reader.read(chunk.data(), chunk.size());
+                chunkPosition = 0;
+                if (chunkSize == 0) {
+                    break;
+                }
+            }
+            char ch = chunk[chunkPosition++];
+            if (ch != '\n' && ch != '\r') {
+                block[filled++] = ch;
+                continue;
+            }
+            block[filled++] = '\r';
+            char second = ch == '\n' ? '\n' : '\0';
+            if (filled < size) {
+                block[filled++] = second;
+            } else {
+                carry = static_cast<unsigned char>(second);
+            }
+        }
+        return filled;
+    }
+
+private:
+    static constexpr int NO_CARRY = -1;
+    std::array<char, NETASCII_CHUNK_SIZE> chunk;
+    bool pendingCR = false;
+    size_t chunkPosition = 0;
+    size_t chunkSize = 0;
+    int carry = NO_CARRY;
+};
+
+/**
+ * @brief Base class for writing received blocks into file backend
+*/
+class BlockWriter {
+public:
+    virtual ~BlockWriter() = default;
+    /**
+     * @brief Function for writing data of received block
+     * @param data Data of block
+     * @param size Size of data
+     * @throw std::runtime_error if failed to write data
+    */
+    virtual void write(const char* data, size_t size) = 0;
+    /**
+     * @brief Function for flushing data held back by codec after last block
+     * @throw std::runtime_error if failed to write data
+    */
+    virtual void finish() = 0;
+};
+
+/**
+ * @brief Block writer with file backend and codec known at compile time
+*/
+template <typename Writer, typename Codec>
+class PolicyBlockWriter final : public BlockWriter {
+public:
+    explicit PolicyBlockWriter(Writer writer) : writer(writer) {}
+    void write(const char* data, size_t size) override {
+        codec.decode(data, size, writer);
+    }
+    void finish() override {
+        codec.finish(writer);
+    }
+
+private:
+    Writer writer;
+    Codec codec;
+};
+
+/**
+ * @brief Base class for reading blocks which will be sent from file backend
+*/
+class BlockReader {
+public:
+    virtual ~BlockReader() = default;
+    /**
+     * @brief Function for reading next block
+     * @param block The buffer for block
+     * @param size Size of block
+     * @return Size of read block, it is smaller than size only for last block
+     * @throw std::runtime_error if failed to read data
+    */
+    virtual size_t read(char* block, size_t size) = 0;
+};
+
+/**
+ * @brief Block reader with file backend and codec known at compile time
+*/
+template <typename Reader, typename Codec>
+class PolicyBlockReader final : public BlockReader {
+public:
+    explicit PolicyBlockReader(Reader reader) : reader(reader) {}
+    size_t read(char* block, size_t size) override {
+        return codec.encode(reader, block, size);
+    }
+
+private:
+    Reader reader;
+    Codec codec;
+};
+
+/**
+ * @brief Function for choosing codec of block writer
+ * @param mode Mode of transfer
+ * @param writer File backend
+ * @return Block writer
+*/
+template <typename Writer>
+std::unique_ptr<BlockWriter> makeBlockWriter(DataMode mode, Writer writer){
+    if (mode == DataMode::NETASCII) {
+        return std::make_unique<PolicyBlockWriter<Writer, NetasciiCodec>>(writer);
+    }
+    return std::make_unique<PolicyBlockWriter<Writer, OctetCodec>>(writer);
+}
+
+/**
+ * @brief Function for choosing codec of block reader
+ * @param mode Mode of transfer
+ * @param reader File backend
+ * @return Block reader
+*/
+template <typename Reader>
+std::unique_ptr<BlockReader> makeBlockReader(DataMode mode, Reader reader){
+    if (mode == DataMode::NETASCII) {
+        return std::make_unique<PolicyBlockReader<Reader, NetasciiCodec>>(reader);
+    }
+    return std::make_unique<PolicyBlockReader<Reader, OctetCodec>>(reader);
+}
+
+#endif
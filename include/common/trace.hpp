@@ -0,0 +1,150 @@
+/**
+ * @file common/trace.hpp
+ * @brief Header file for binary trace of session events, every thread writes fixed-size records
+ * into its own ring mapped from file, so trace survives crash of process and costs only a copy of record
+ * @author Lukas Vecerka (xvecer30)
+*/
+#ifndef TRACE_HPP
+#define TRACE_HPP
+#define TRACE_MAGIC 0x3143525450544654ULL // "TFTPTRC1"
+#define TRACE_VERSION 1
+#define TRACE_RING_RECORDS 65536
+
+#include <string>
+#include <atomic>
+#include <mutex>
+#include <vector>
+#include <cstdint>
+
+/**
+ * @brief Enum for kinds of traced events
+ * @note SENT - packet was sent, every DATA of window has its own record
+ * @note RECEIVED - packet was handled by session, states before and after handling are recorded
+ * @note TIMEOUT - nothing was received in time and last packet or window is retransmitted
+ * @note END - session ended, final state is recorded
+*/
+enum class TraceEvent : uint8_t {
+    SENT,
+    RECEIVED,
+    TIMEOUT,
+    END
+};
+
+/**
+ * @brief One record of trace
+ * @note timestampNs - CLOCK_MONOTONIC time of event
+ * @note sessionId - id of session unique in process
+ * @note bytes - size of data in DATA packet, 0 for other packets
+ * @note block - block number of DATA/ACK, error code of ERROR, current block for TIMEOUT and END
+ * @note fromState, toState - SessionState before and after event
+ * @note retries - number of retransmissions of current packet
+*/
+struct TraceRecord {
+    uint64_t timestampNs;
+    uint32_t sessionId;
+    uint32_t bytes;
+    uint16_t block;
+    uint8_t opcode;
+    TraceEvent event;
+    uint8_t fromState;
+    uint8_t toState;
+    uint8_t retries;
+    uint8_t reserved[9];
+};
+
+/**
+ * @brief Header at the start of every trace file, records follow it
+ * @note monotonicNs, realtimeNs - both clocks read when file was created, decoder uses them to show wall time
+ * @note head - number of records ever written, record i is stored at slot i % capacity
+*/
+struct TraceFileHeader {
+    uint64_t magic;
+    uint32_t version;
+    uint32_t recordSize;
+    uint64_t capacity;
+    uint64_t monotonicNs;
+    uint64_t realtimeNs;
+    uint32_t pid;
+    uint32_t ring;
+    std::atomic<uint64_t> head;
+    uint64_t reserved;
+};
+
+static_assert(sizeof(TraceRecord) == 32, "Trace record has to keep its size, it is read by decoder");
+static_assert(sizeof(TraceFileHeader) == 64, "Trace header has to keep its size, it is read by decoder");
+
+struct TraceRing;
+
+/**
+ * @brief Singleton class for tracing, it is disabled until directory for trace files is set
+*/
+class Tracer {
+public:
+    static Tracer& instance() {
+        // Tracer is never destroyed, rings stay mapped until exit
+        static Tracer* tracer = new Tracer();
+        return *tracer;
+    }
+
+    /**
+     * @brief Enable tracing, every thread which records event creates file tftp-<pid>-<ring>.trace
+     * in directory, file of finished thread is reused by next thread
+     * @param directory Directory for trace files
+     * @return true if directory is writable and tracing was enabled
+    */
+    bool open(const std::string& directory);
+
+    bool isEnabled() const {
+        return enabled.load(std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief Get id for new session
+     * @return The id, ids start at 1
+    */
+    uint32_t nextSessionId() {
+        return sessionIds.fetch_add(1, std::memory_order_relaxed) + 1;
+    }
+
+    /**
+     * @brief Get time used in records
+     * @return CLOCK_MONOTONIC time in nanoseconds
+    */
+    static uint64_t now();
+
+    /**
+     * @brief Put record into ring of calling thread, oldest record is overwritten when ring is full,
+     * timestamp is filled in when it isn't set
+     * @param record The record
+    */
+    void record(TraceRecord& record);
+
+    /**
+     * @brief Return ring of finished thread, so next thread writes into it
+     * @param ring The ring
+    */
+    void release(TraceRing* ring);
+
+private:
+    // Private constructor to prevent instantiation
+    Tracer() : enabled(false), sessionIds(0), ringCount(0) {}
+    /**
+     * @brief Function for getting ring of calling thread, free ring is reused or new file is created
+     * @return The ring, nullptr if file couldn't be created
+    */
+    TraceRing* threadRing();
+    /**
+     * @brief Function for creating and mapping new trace file
+     * @return The ring, nullptr if file couldn't be created
+    */
+    TraceRing* createRing();
+
+    std::atomic<bool> enabled;
+    std::atomic<uint32_t> sessionIds;
+    std::string directory;
+    std::mutex ringsMutex;
+    std::vector<TraceRing*> freeRings;
+    uint32_t ringCount;
+};
+
+#endif
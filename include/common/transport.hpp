@@ -0,0 +1,144 @@
+/**
+ * @file common/transport.hpp
+ * @brief Header file for transport and clock used by sessions, by default sessions use kernel sockets
+ * and steady clock, simulator replaces both so sessions run on virtual time without sockets
+ * @author Lukas Vecerka (xvecer30)
+*/
+#ifndef TRANSPORT_HPP
+#define TRANSPORT_HPP
+
+#include <chrono>
+#include <cstdint>
+#include <cstddef>
+#include <cerrno>
+#include <sys/types.h>
+#include <netinet/in.h>
+
+/**
+ * @brief Source of time for sessions, all timestamps of session (metrics, window RTT) are taken from it
+*/
+class Clock {
+public:
+    virtual ~Clock() = default;
+    /**
+     * @brief Function for getting current time
+     * @return Current time
+    */
+    virtual std::chrono::steady_clock::time_point now() const { return std::chrono::steady_clock::now(); }
+    /**
+     * @brief Function for getting clock of real time
+     * @return Steady clock
+    */
+    static Clock& system();
+};
+
+/**
+ * @brief Interface for sending and receiving datagrams of session, sockets are identified by numbers
+ * which are file descriptors for kernel sockets
+*/
+class Transport {
+public:
+    virtual ~Transport() = default;
+    /**
+     * @brief Function for sending one datagram
+     * @param socket The socket to send with
+     * @param data Serialized datagram
+     * @param size Size of datagram
+     * @param addr The destination address
+     * @return Number of sent bytes, -1 on error with errno set
+    */
+    virtual ssize_t send(int socket, const char* data, size_t size, const sockaddr_in& addr) = 0;
+    /**
+     * @brief Function for sending frames of equal size as one burst segmented by transport
+     * @param socket The socket to send with
+     * @param burst Buffer with frames
+     * @param size Size of all frames in buffer
+     * @param segmentSize Size of each frame, last frame can be shorter
+     * @param addr The destination address
+     * @return true if burst was sent, false if frames have to be sent separately
+    */
+    virtual bool sendSegmented(int socket, const char* burst, size_t size, uint16_t segmentSize, const sockaddr_in& addr) {
+        (void)socket; (void)burst; (void)size; (void)segmentSize; (void)addr;
+        return false;
+    }
+    /**
+     * @brief Function for receiving one datagram, it blocks at most for receive timeout of socket
+     * @param socket The socket to receive from
+     * @param buffer The buffer for datagram
+     * @param size Size of buffer
+     * @param from Address of sender is stored here
+     * @param flags Flags of recvfrom, MSG_DONTWAIT for receiving without blocking
+     * @return Number of received bytes, -1 with errno EAGAIN on timeout or other errno on error
+    */
+    virtual ssize_t receive(int socket, char* buffer, size_t size, sockaddr_in& from, int flags) = 0;
+    /**
+     * @brief Function for receiving datagram which can hold several coalesced datagrams of same sender (UDP GRO),
+     * transport without coalescing receives one datagram
+     * @param socket The socket to receive from
+     * @param buffer The buffer for datagrams
+     * @param size Size of buffer
+     * @param from Address of sender is stored here
+     * @param flags Flags of receive, MSG_DONTWAIT for receiving without blocking
+     * @param segmentSize Size of each coalesced datagram is stored here, last one can be shorter
+     * @return Number of received bytes, -1 with errno EAGAIN on timeout or other errno on error
+    */
+    virtual ssize_t receiveSegmented(int socket, char* buffer, size_t size, sockaddr_in& from, int flags, size_t& segmentSize) {
+        ssize_t received = receive(socket, buffer, size, from, flags);
+        segmentSize = received >= 0 ? received : 0;
+        return received;
+    }
+    /**
+     * @brief Function for setting integer option of socket (UDP_GRO, SO_BUSY_POLL, ...)
+     * @param socket The socket
+     * @param level Level of option, SOL_SOCKET or protocol
+     * @param name Name of option
+     * @param value Value of option
+     * @return false with errno set if option isn't supported by socket or transport
+    */
+    virtual bool setOption(int socket, int level, int name, int value) {
+        (void)socket; (void)level; (void)name; (void)value;
+        errno = ENOPROTOOPT;
+        return false;
+    }
+    /**
+     * @brief Function for setting how long receive waits for datagram
+     * @param socket The socket
+     * @param seconds Timeout in seconds
+     * @return false if timeout can't be set
+    */
+    virtual bool setReceiveTimeout(int socket, int seconds) = 0;
+    /**
+     * @brief Function for getting address socket is bound to
+     * @param socket The socket
+     * @param addr Address is stored here
+     * @return false if address can't be read
+    */
+    virtual bool localAddress(int socket, sockaddr_in& addr) = 0;
+    /**
+     * @brief Function for closing socket
+     * @param socket The socket
+    */
+    virtual void close(int socket) = 0;
+    /**
+     * @brief Function for getting transport of kernel sockets
+     * @return Transport of kernel sockets
+    */
+    static Transport& system();
+};
+
+/**
+ * @brief Transport of kernel UDP sockets, bursts are segmented by kernel (UDP GSO) when it is supported
+*/
+class SocketTransport : public Transport {
+public:
+    ssize_t send(int socket, const char* data, size_t size, const sockaddr_in& addr) override;
+    bool sendSegmented(int socket, const char* burst, size_t size, uint16_t segmentSize, const sockaddr_in& addr) override;
+    ssize_t receive(int socket, char* buffer, size_t size, sockaddr_in& from, int flags) override;
+    ssize_t receiveSegmented(int socket, char* buffer, size_t size, sockaddr_in& from, int flags, size_t& segmentSize) override;
+    bool setOption(int socket, int level, int name, int value) override;
+    bool setReceiveTimeout(int socket, int seconds) override;
+    bool localAddress(int socket, sockaddr_in& addr) override;
+    void close(int socket) override;
+};
+
+#endif
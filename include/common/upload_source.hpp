@@ -0,0 +1,132 @@
+/**
+ * @file common/upload_source.hpp
+ * @brief Header file with declaration of sources of uploaded data
+ * @author Lukas Vecerka (xvecer30)
+*/
+#ifndef UPLOAD_SOURCE_HPP
+#define UPLOAD_SOURCE_HPP
+#define PREFETCH_CHUNK_SIZE (1024 * 1024)
+#define PREFETCH_MAX_CHUNKS 8
+#define PREFETCH_POLL_MS 100
+
+#include <string>
+#include <memory>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+/**
+ * @brief Base class for sources of upload, data are read sequentially
+*/
+class UploadSource {
+public:
+    virtual ~UploadSource() = default;
+    /**
+     * @brief Function for reading next data from source
+     * @param buffer The buffer for data
+     * @param size Number of bytes to read
+     * @return Number of bytes read, less than size only at the end of source
+     * @throw std::runtime_error if failed to read from source
+    */
+    virtual size_t read(char* buffer, size_t size) = 0;
+    /**
+     * @brief Function for opening source, regular files are mapped to memory, other files
+     * (pipes, terminals) are read ahead by prefetch thread
+     * @param path Path to file, "stdin" for standard input
+     * @return Opened source, nullptr if file can't be opened
+    */
+    static std::unique_ptr<UploadSource> open(const std::string& path);
+    /**
+     * @brief Function for creating source of opened file descriptor, regular files are mapped
+     * to memory and other files are read ahead by prefetch thread
+     * @param fd File descriptor
+     * @param ownsFd true if file descriptor is closed by source
+     * @return Source of descriptor
+    */
+    static std::unique_ptr<UploadSource> fromFd(int fd, bool ownsFd);
+};
+
+/**
+ * @brief Source of data in memory owned by source
+*/
+class MemorySource : public UploadSource {
+public:
+    MemorySource(std::vector<char> data);
+    size_t read(char* buffer, size_t size) override;
+
+private:
+    std::vector<char> data;
+    size_t offset;
+};
+
+/**
+ * @brief Source reading data shared with other sources, every source has its own position,
+ * so many uploads of same payload don't copy it
+*/
+class SharedSource : public UploadSource {
+public:
+    SharedSource(std::shared_ptr<const std::vector<char>> data);
+    size_t read(char* buffer, size_t size) override;
+
+private:
+    std::shared_ptr<const std::vector<char>> data;
+    size_t offset;
+};
+
+/**
+ * @brief Source of regular file mapped to memory, reading is only copy from mapping
+*/
+class MappedSource : public UploadSource {
+public:
+    /**
+     * @brief Constructor maps whole file
+     * @param fd File descriptor of regular file
+     * @param size Size of file
+     * @throw std::runtime_error if file can't be mapped
+    */
+    MappedSource(int fd, size_t size);
+    ~MappedSource() override;
+    size_t read(char* buffer, size_t size) override;
+
+private:
+    char* mapping;
+    size_t size;
+    size_t offset;
+};
+
+/**
+ * @brief Source read ahead in large chunks by background thread, so next block is
+ * ready when ACK arrives even if source is slow pipe
+*/
+class PrefetchSource : public UploadSource {
+public:
+    /**
+     * @brief Constructor starts prefetch thread
+     * @param fd File descriptor of source
+     * @param ownsFd true if file descriptor is closed by source
+    */
+    PrefetchSource(int fd, bool ownsFd);
+    ~PrefetchSource() override;
+    size_t read(char* buffer, size_t size) override;
+
+private:
+    int fd;
+    bool ownsFd;
+    std::thread prefetcher;
+    std::mutex mutex;
+    std::condition_variable chunkReady;
+    std::condition_variable chunkTaken;
+    std::deque<std::vector<char>> chunks;
+    size_t chunkOffset;
+    bool finished;
+    bool stopped;
+    int error;
+    /**
+     * @brief Function run by prefetch thread, reads chunks until end of source or stop
+    */
+    void prefetch();
+};
+
+#endif
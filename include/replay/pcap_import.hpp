@@ -0,0 +1,34 @@
+/**
+ * @file replay/pcap_import.hpp
+ * @brief Header file for import of workload from pcap, TFTP sessions are reconstructed from
+ * requests to port 69 and from packets of client ports which sent them
+ * @author Lukas Vecerka (xvecer30)
+*/
+#ifndef PCAP_IMPORT_HPP
+#define PCAP_IMPORT_HPP
+#define PCAP_MAGIC_USEC 0xa1b2c3d4
+#define PCAP_MAGIC_NSEC 0xa1b23c4d
+#define PCAP_TFTP_PORT 69
+
+#include <string>
+#include <vector>
+#include "common/capture.hpp"
+
+/**
+ * @brief Function for checking if file is pcap
+ * @param path Path of file
+ * @return true if file starts with pcap magic number in any byte order
+*/
+bool isPcap(const std::string& path);
+
+/**
+ * @brief Function for importing workload from pcap, supported link types are Ethernet, Linux cooked
+ * capture (v1, v2), BSD loopback and raw IP, only unfragmented IPv4 UDP is read
+ * @note Session is finished by ERROR or by short DATA, bytes are counted from DATA blocks received in order
+ * @param path Path of pcap file, pcapng is not supported
+ * @return Sessions ordered by arrival of request
+ * @throw std::runtime_error if file can't be read or its link type isn't supported
+*/
+std::vector<CapturedSession> importPcap(const std::string& path);
+
+#endif
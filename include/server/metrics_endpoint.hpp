@@ -0,0 +1,52 @@
+/**
+ * @file server/metrics_endpoint.hpp
+ * @brief Header file for HTTP endpoint which serves metrics in Prometheus text format
+ * @author Lukas Vecerka (xvecer30)
+*/
+#ifndef METRICS_ENDPOINT_HPP
+#define METRICS_ENDPOINT_HPP
+#define METRICS_REQUEST_SIZE 4096
+#define METRICS_POLL_MS 100
+#define METRICS_IO_TIMEOUT_MS 1000
+
+#include <string>
+#include <thread>
+#include <atomic>
+
+/**
+ * @class MetricsEndpoint
+ * @brief Endpoint answers GET /metrics on its own thread, one scrape at a time, so sessions
+ * only ever share their counters with it
+*/
+class MetricsEndpoint {
+public:
+    /**
+     * @brief Constructor which binds endpoint and starts its thread
+     * @param address Path of Unix socket when it starts with '/', otherwise [host:]port of TCP socket,
+     * host is 127.0.0.1 by default
+     * @throw std::runtime_error if address is invalid or socket can't be bound
+    */
+    explicit MetricsEndpoint(const std::string& address);
+    /**
+     * @brief Destructor which stops thread, Unix socket is removed
+    */
+    ~MetricsEndpoint();
+
+private:
+    /**
+     * @brief Function of endpoint thread, connections are accepted until endpoint is destroyed
+    */
+    void run();
+    /**
+     * @brief Function for reading request from connection and sending response
+     * @param fd The connection
+    */
+    void handleConnection(int fd);
+
+    int listenFd;
+    std::string unixPath;
+    std::atomic<bool> stopping;
+    std::thread thread;
+};
+
+#endif
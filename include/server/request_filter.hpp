@@ -0,0 +1,96 @@
+/**
+ * @file server/request_filter.hpp
+ * @brief Header file for filter of listener, it sheds floods and repeated requests before any
+ * session or thread is created for them
+ * @author Lukas Vecerka (xvecer30)
+*/
+#ifndef REQUEST_FILTER_HPP
+#define REQUEST_FILTER_HPP
+#define FILTER_MAX_SOURCES 65536
+
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <mutex>
+#include <chrono>
+#include <cstdint>
+#include <netinet/in.h>
+
+/**
+ * @brief Configuration of filter of listener
+ * @note rate - requests per second accepted from one source IP, 0 disables rate limiting
+ * @note burst - requests which one source IP can send at once, capacity of its token bucket
+ * @note kernelFilter - classic BPF program is attached to listener, datagrams which aren't RRQ/WRQ
+ * are dropped in kernel without ERROR reply
+*/
+struct FilterConfig {
+    double rate = 0;
+    double burst = 0;
+    bool kernelFilter = false;
+};
+
+/**
+ * @brief Function for attaching classic BPF program which drops datagrams with opcode other than RRQ/WRQ
+ * @param sockfd UDP socket of listener
+ * @return true if program was attached
+*/
+bool attachRequestFilter(int sockfd);
+
+/**
+ * @class RequestFilter
+ * @brief Token buckets of source IPs are used only by listener thread, pending requests are also
+ * released by session threads
+*/
+class RequestFilter {
+public:
+    explicit RequestFilter(FilterConfig config = FilterConfig());
+
+    /**
+     * @brief Function for taking token from bucket of source IP, it is called only by listener
+     * @param source Address of client
+     * @param now Time when datagram was received
+     * @return true if request can be processed, false if source exceeded its rate
+    */
+    bool admit(const sockaddr_in& source, std::chrono::steady_clock::time_point now);
+
+    /**
+     * @brief Function for marking request as pending until its session answers it, same request
+     * from same client port which arrives meanwhile is retransmission of client
+     * @param source Address of client
+     * @param request The request
+     * @param size Size of request
+     * @return false if same request is already pending
+    */
+    bool claim(const sockaddr_in& source, const char* request, size_t size);
+
+    /**
+     * @brief Function for releasing request claimed by claim, it is called once right after first packet
+     * of session is sent or right before request is refused, so client can reuse its port for same request
+     * right after transfer
+     * @param source Address of client
+     * @param request The request
+     * @param size Size of request
+    */
+    void release(const sockaddr_in& source, const char* request, size_t size);
+
+private:
+    /**
+     * @brief Token bucket of one source IP
+    */
+    struct Bucket {
+        double tokens;
+        std::chrono::steady_clock::time_point last;
+    };
+    /**
+     * @brief Function for removing buckets which refilled, so table doesn't grow with spoofed sources
+     * @param now Current time
+    */
+    void evictIdle(std::chrono::steady_clock::time_point now);
+
+    FilterConfig config;
+    std::unordered_map<in_addr_t, Bucket> buckets;
+    std::mutex pendingMutex;
+    std::unordered_set<std::string> pending;
+};
+
+#endif
@@ -7,6 +7,7 @@
 #define TFTPSERVER_HPP
 
 #include <string>
+#include <vector>
 #include <sys/socket.h>
 #include <netinet/in.h>
 #include <thread> 
@@ -14,6 +15,7 @@
 #include "common/packets.hpp"
 #include "common/session.hpp"
 #include "common/exceptions.hpp"
+#include "server/request_filter.hpp"
 #include <filesystem>
 #include <iostream>
 #include <cstring>
@@ -22,6 +24,9 @@
 #include <netinet/in.h>
 #include <unistd.h>
 #include <future>
+#include <chrono>
+#include <memory>
+#include <functional>
 
 /**
  * @class TFTPServer
@@ -32,9 +37,11 @@ public:
      * @brief TFTPServer constructor which bind socket on port and create root directory
      * @param port The port to listen on
      * @param rootDirPath The root directory path
+     * @param sessionConfig Configuration of client sessions
+     * @param filterConfig Configuration of filter of listener
      * 
     */
-    TFTPServer(int port, const std::string& rootDirPath);
+    TFTPServer(int port, const std::string& rootDirPath, SessionConfig sessionConfig = SessionConfig(), FilterConfig filterConfig = FilterConfig());
     /**
      * @brief method for start main loop of server and receive new clients
     */
@@ -44,19 +51,40 @@ public:
      * Method will gracefully exit all clients sessions and clean resources
     */
     void shutDown();
+    /**
+     * @brief method for validating request and creating session which serves it, ERROR is sent when request is refused
+     * @param transport Transport of listening socket and of new session
+     * @param clock Clock of new session
+     * @param listenSocket Socket which received request, unparsable requests are answered from it
+     * @param openSocket Function opening socket of new session
+     * @param clientAddr The address of client
+     * @param request The request packet
+     * @param size Size of request packet
+     * @param rootDirPath The root directory path
+     * @param sessionConfig Configuration of session
+     * @param onAnswered Function called right before refusal ERROR is sent, or after first packet of session
+     * was sent when session is created (it becomes onStarted of session), it may be empty
+     * @return Session which has to be started, nullptr if request was refused
+    */
+    static std::unique_ptr<ServerSession> createSession(Transport& transport, const Clock& clock, int listenSocket, const std::function<int()>& openSocket,
+        const sockaddr_in& clientAddr, const char* request, size_t size, const std::string& rootDirPath, const SessionConfig& sessionConfig,
+        const std::function<void()>& onAnswered = nullptr);
 
 private:
     int port;
     std::string rootDirPath;
     int sockfd;
+    SessionConfig sessionConfig;
+    std::atomic<unsigned> nextCpu;
+    RequestFilter filter;
     /**
      * @brief method to handle new request packet from client, if request is valid it starts new client session
      * @param clientAddr The address of client
-     * @param buffer The buffer received from socket
-     * @param bufferSize The size of buffer
-     * 
+     * @param request The request packet received from socket
+     * @param received Time when request was received, start of session in metrics
+     * @param stream Order of request, session uses this stream of network emulator
     */
-    void handleClientRequest(const sockaddr_in& clientAddr, const char* buffer, ssize_t bufferSize);
+    void handleClientRequest(const sockaddr_in& clientAddr, std::vector<char> request, std::chrono::steady_clock::time_point received, uint64_t stream);
     std::vector<std::future<void>> clientFutures;
 };
 
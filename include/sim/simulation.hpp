@@ -0,0 +1,212 @@
+/**
+ * @file sim/simulation.hpp
+ * @brief Header file for deterministic simulation, client and server sessions run in one thread
+ * over in-memory network on virtual time, so hours of timeouts take milliseconds
+ * @author Lukas Vecerka (xvecer30)
+*/
+#ifndef SIMULATION_HPP
+#define SIMULATION_HPP
+#define SIM_SOCKET_BASE (1 << 20)
+#define SIM_EPHEMERAL_PORT_MIN 1024
+#define SIM_SERVER_PORT 69
+#define SIM_DEFAULT_SESSIONS 1000
+#define SIM_DEFAULT_FILE_SIZE (64 * 1024)
+#define SIM_DOWNLOAD_FILE "sim-download"
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <queue>
+#include <random>
+#include <chrono>
+#include <optional>
+#include <unordered_map>
+#include <cstdint>
+#include "common/transport.hpp"
+#include "common/net_emulator.hpp"
+#include "common/options.hpp"
+#include "common/session.hpp"
+
+/**
+ * @brief In-memory network of simulation, it is transport and clock of all simulated sessions
+ * @note Sockets are numbers from SIM_SOCKET_BASE bound to ports of 127.0.0.1, they never collide with descriptors
+ * @note Every datagram is impaired by EmulatorConfig with own random generator, so same seed gives same run
+ * @note receive never blocks, it fails with EAGAIN when socket has no datagram, time only moves by advance
+*/
+class SimNetwork : public Transport, public Clock {
+public:
+    SimNetwork(const EmulatorConfig& config);
+    std::chrono::steady_clock::time_point now() const override { return current; }
+    ssize_t send(int socket, const char* data, size_t size, const sockaddr_in& addr) override;
+    ssize_t receive(int socket, char* buffer, size_t size, sockaddr_in& from, int flags) override;
+    bool setReceiveTimeout(int socket, int seconds) override;
+    bool localAddress(int socket, sockaddr_in& addr) override;
+    void close(int socket) override;
+    /**
+     * @brief Function for opening socket
+     * @param port Port to bind, 0 for ephemeral port
+     * @return Socket, -1 if port is used or no ephemeral port is free
+    */
+    int open(uint16_t port = 0);
+    /**
+     * @brief Function for getting time when next datagram arrives
+     * @return Time of next arrival, std::nullopt if no datagram is in flight
+    */
+    std::optional<std::chrono::steady_clock::time_point> nextArrival() const;
+    /**
+     * @brief Function for moving virtual time
+     * @param to New time, time never goes back
+    */
+    void advance(std::chrono::steady_clock::time_point to);
+    /**
+     * @brief Function for delivering datagrams which are due into their sockets
+     * @return Sockets which got datagram, each socket once
+    */
+    std::vector<int> deliver();
+    uint64_t datagramsSent;
+    uint64_t datagramsLost;
+    uint64_t bytesSent;
+
+private:
+    /**
+     * @brief Datagram waiting in socket
+    */
+    struct Datagram {
+        sockaddr_in from;
+        std::vector<char> data;
+    };
+    /**
+     * @brief Datagram travelling through network
+     * @note sequence - keeps order of datagrams which are due at the same time
+    */
+    struct InFlight {
+        std::chrono::steady_clock::time_point due;
+        uint64_t sequence;
+        uint16_t port;
+        Datagram datagram;
+        bool operator>(const InFlight& other) const {
+            return due != other.due ? due > other.due : sequence > other.sequence;
+        }
+    };
+    /**
+     * @brief Socket bound to port
+    */
+    struct Socket {
+        uint16_t port;
+        std::deque<Datagram> queue;
+    };
+
+    std::chrono::steady_clock::time_point current;
+    EmulatorConfig config;
+    std::mt19937_64 random;
+    std::unordered_map<int, Socket> sockets;
+    std::unordered_map<uint16_t, int> ports;
+    std::priority_queue<InFlight, std::vector<InFlight>, std::greater<InFlight>> inFlight;
+    uint64_t sequence;
+    int nextSocket;
+    uint16_t nextPort;
+};
+
+/**
+ * @brief Configuration of simulation
+ * @note uploadPercent - share of sessions which upload, others download SIM_DOWNLOAD_FILE
+ * @note arrivalUs - virtual time between starts of sessions, 0 starts all sessions at once
+ * @note rootDir - root directory of simulated server, it has to exist, downloaded file is created in it
+*/
+struct SimConfig {
+    uint64_t sessions = SIM_DEFAULT_SESSIONS;
+    uint64_t fileSize = SIM_DEFAULT_FILE_SIZE;
+    unsigned uploadPercent = 0;
+    uint64_t arrivalUs = 0;
+    OptionTable options;
+    DataMode mode = OCTET;
+    int maxRetries = MAX_RETRIES;
+    int backoffFactor = BACKOFF_FACTOR;
+    EmulatorConfig network;
+    std::string rootDir;
+};
+
+/**
+ * @brief Result of simulation, times are virtual
+ * @note durations - seconds from start to end of each completed client session
+*/
+struct SimResult {
+    uint64_t completed = 0;
+    uint64_t failed = 0;
+    uint64_t bytes = 0;
+    uint64_t datagramsSent = 0;
+    uint64_t datagramsLost = 0;
+    uint64_t timeouts = 0;
+    double seconds = 0;
+    std::vector<double> durations;
+};
+
+/**
+ * @brief Class for running simulation, listener and all sessions are driven by one event loop
+ * which jumps virtual time to next arrival of datagram or next timeout
+*/
+class Simulation {
+public:
+    Simulation(const SimConfig& config);
+    /**
+     * @brief Function for running all sessions until they finish
+     * @return Result of simulation
+     * @throw std::runtime_error if downloaded file can't be created
+    */
+    SimResult run();
+
+private:
+    /**
+     * @brief Client or server session with its timeout
+     * @note deadline - time when session times out, it is moved by every received datagram
+    */
+    struct Participant {
+        std::unique_ptr<ClientSession> client;
+        std::unique_ptr<ServerSession> server;
+        std::chrono::steady_clock::time_point deadline;
+        std::chrono::steady_clock::time_point started;
+    };
+    /**
+     * @brief Function for starting next client session
+    */
+    void startClient();
+    /**
+     * @brief Function for handling datagrams waiting in socket
+     * @param socket The socket
+    */
+    void handleSocket(int socket);
+    /**
+     * @brief Function for handling request received by listener
+     * @param from Address of client
+     * @param request The request
+     * @param size Size of request
+    */
+    void handleRequest(const sockaddr_in& from, const char* request, size_t size);
+    /**
+     * @brief Function for planning timeout of participant
+     * @param socket Socket of participant
+     * @param participant The participant
+    */
+    void schedule(int socket, Participant& participant);
+    /**
+     * @brief Function for removing finished participant, client result is recorded
+     * @param socket Socket of participant
+    */
+    void finish(int socket);
+
+    SimConfig config;
+    SimNetwork network;
+    SimResult result;
+    int listenSocket;
+    sockaddr_in serverAddr;
+    uint64_t started;
+    std::shared_ptr<const std::vector<char>> payload;
+    std::mt19937_64 random;
+    std::unordered_map<int, Participant> participants;
+    // deadlines are removed lazily, entry is stale when participant is gone or its deadline moved
+    std::priority_queue<std::pair<std::chrono::steady_clock::time_point, int>,
+        std::vector<std::pair<std::chrono::steady_clock::time_point, int>>,
+        std::greater<std::pair<std::chrono::steady_clock::time_point, int>>> deadlines;
+};
+
+#endif
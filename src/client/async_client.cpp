@@ -0,0 +1,196 @@
+/**
+ * @file client/async_client.cpp
+ * @brief Implementation of non-blocking TFTP client for embedding into other programs
+ * @author Lukas Vecerka (xvecer30)
+*/
+#include "client/async_client.hpp"
+#include "common/packets.hpp"
+#include "common/logger.hpp"
+#include <chrono>
+#include <cstring>
+#include <cerrno>
+#include <stdexcept>
+#include <netdb.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+
+AsyncClient::AsyncClient(const std::string& hostname, int port) : mode(DataMode::OCTET) {
+    struct addrinfo hints, *res;
+    std::memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_DGRAM;
+    if (getaddrinfo(hostname.c_str(), nullptr, &hints, &res) != 0) {
+        throw std::runtime_error("Could not resolve hostname");
+    }
+    server_addr = *(struct sockaddr_in*)res->ai_addr;
+    server_addr.sin_port = htons(port);
+    freeaddrinfo(res);
+
+    wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (wakeFd < 0) {
+        throw std::runtime_error("Failed to create eventfd");
+    }
+}
+
+AsyncClient::~AsyncClient(){
+    close(wakeFd);
+}
+
+void AsyncClient::setOptions(OptionTable options){
+    this->options = options;
+}
+
+void AsyncClient::setMode(DataMode mode){
+    this->mode = mode;
+}
+
+void AsyncClient::setSocketPool(std::shared_ptr<SocketPool> pool){
+    this->pool = pool;
+}
+
+std::future<TransferResult> AsyncClient::get(const std::string& remotePath, std::shared_ptr<DownloadSink> sink, Callback callback){
+    return enqueue({{SessionType::READ, "", remotePath}, options, mode, std::move(sink), nullptr, -1, std::move(callback), {}});
+}
+
+std::future<TransferResult> AsyncClient::put(const std::string& remotePath, std::unique_ptr<UploadSource> source, int64_t size, Callback callback){
+    return enqueue({{SessionType::WRITE, "", remotePath}, options, mode, nullptr, std::move(source), size, std::move(callback), {}});
+}
+
+std::future<TransferResult> AsyncClient::enqueue(Pending transfer){
+    std::future<TransferResult> future = transfer.promise.get_future();
+    {
+        std::lock_guard<std::mutex> lock(pendingMutex);
+        pending.push_back(std::move(transfer));
+    }
+    uint64_t one = 1;
+    if (write(wakeFd, &one, sizeof(one)) < 0 && errno != EAGAIN) {
+        Logger::instance().log("Failed to wake up client loop");
+    }
+    return future;
+}
+
+bool AsyncClient::idle(){
+    std::lock_guard<std::mutex> lock(pendingMutex);
+    return pending.empty() && loop.empty();
+}
+
+std::vector<pollfd> AsyncClient::pollFds() const {
+    std::vector<pollfd> fds = loop.pollFds();
+    fds.push_back({wakeFd, POLLIN, 0});
+    return fds;
+}
+
+int AsyncClient::timeoutMs(){
+    {
+        std::lock_guard<std::mutex> lock(pendingMutex);
+        if (!pending.empty()) {
+            return 0;
+        }
+    }
+    return loop.timeoutMs();
+}
+
+void AsyncClient::process(const std::vector<pollfd>& fds){
+    if (!fds.empty() && (fds.back().revents & POLLIN)) {
+        uint64_t count;
+        while (read(wakeFd, &count, sizeof(count)) > 0) {}
+    }
+
+    // Wake up descriptor is not passed to loop
+    std::vector<pollfd> sessionFds(fds.begin(), fds.empty() ? fds.end() : fds.end() - 1);
+    loop.process(sessionFds);
+    startPending();
+}
+
+void AsyncClient::runOnce(int maxWaitMs){
+    std::vector<pollfd> fds = pollFds();
+    int waitMs = timeoutMs();
+    if (maxWaitMs >= 0 && (waitMs < 0 || waitMs > maxWaitMs)) {
+        waitMs = maxWaitMs;
+    }
+    if (poll(fds.data(), fds.size(), waitMs) < 0 && errno != EINTR) {
+        Logger::instance().log("Failed to poll sessions");
+        return;
+    }
+    process(fds);
+}
+
+void AsyncClient::run(){
+    while (!idle()) {
+        runOnce();
+    }
+}
+
+void AsyncClient::startPending(){
+    std::deque<Pending> starting;
+    {
+        std::lock_guard<std::mutex> lock(pendingMutex);
+        starting.swap(pending);
+    }
+    for (auto& transfer : starting) {
+        start(std::move(transfer));
+    }
+}
+
+void AsyncClient::start(Pending transfer){
+    OptionTable requested = transfer.options;
+    // Client has to send tsize 0 in RRQ, in WRQ size of upload if it is known
+    if (requested.has(OptionId::TSIZE)) {
+        if (transfer.transfer.type == SessionType::READ) {
+            requested.set(OptionId::TSIZE, 0);
+        } else if (transfer.size >= 0) {
+            requested.set(OptionId::TSIZE, transfer.size);
+        } else {
+            requested.erase(OptionId::TSIZE);
+        }
+    }
+
+    auto fail = [&transfer]() {
+        TransferResult result{transfer.transfer, false, 0, 0};
+        if (transfer.callback) {
+            transfer.callback(result);
+        }
+        transfer.promise.set_value(result);
+    };
+
+    int socket;
+    try {
+        socket = pool ? pool->acquire() : bindClientSocket();
+    } catch (const std::runtime_error& e) {
+        Logger::instance().log(e.what());
+        fail();
+        return;
+    }
+
+    const std::string& remotePath = transfer.transfer.remotePath;
+    struct sockaddr_in from_addr{};
+    DataMode mode = transfer.mode;
+    auto session = std::make_unique<ClientSession>(socket, from_addr, remotePath, remotePath, mode, transfer.transfer.type, requested, "");
+    bool started;
+    if (transfer.transfer.type == SessionType::READ) {
+        session->sink = transfer.sink;
+        ReadRequestPacket packet(remotePath, mode, requested, server_addr);
+        started = session->start(packet);
+    } else {
+        session->source = std::move(transfer.source);
+        WriteRequestPacket packet(remotePath, mode, requested, server_addr);
+        started = session->start(packet);
+    }
+    if (!started) {
+        fail();
+        return;
+    }
+
+    // Promise is moved into shared state because std::function has to be copyable
+    auto state = std::make_shared<Pending>(std::move(transfer));
+    auto startTime = std::chrono::steady_clock::now();
+    loop.add(std::move(session), [state, startTime](ClientSession& finished) {
+        TransferResult result{state->transfer, false, finished.bytesTransferred, 0};
+        result.ok = finished.sessionState == SessionState::RRQ_END || finished.sessionState == SessionState::WRQ_END;
+        result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+        if (state->callback) {
+            state->callback(result);
+        }
+        state->promise.set_value(result);
+    });
+}
@@ -0,0 +1,312 @@
+/**
+ * @file client/fetch_daemon.cpp
+ * @brief Implementation of long-running client daemon accepting transfers over Unix domain socket
+ * @author Lukas Vecerka (xvecer30)
+*/
+#include "client/fetch_daemon.hpp"
+#include "common/logger.hpp"
+#include <sstream>
+#include <iomanip>
+#include <cstring>
+#include <cerrno>
+#include <filesystem>
+#include <stdexcept>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+/**
+ * @brief Function for filling address of Unix domain socket
+ * @param socketPath Path of socket
+ * @param addr Address to fill
+ * @return true if path fits into address, false otherwise
+*/
+static bool unixAddress(const std::string& socketPath, sockaddr_un& addr){
+    std::memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (socketPath.size() >= sizeof(addr.sun_path)) {
+        return false;
+    }
+    std::memcpy(addr.sun_path, socketPath.c_str(), socketPath.size());
+    return true;
+}
+
+FetchDaemon::FetchDaemon(const std::string& socketPath, OptionTable options)
+    : socketPath(socketPath), options(options), pool(std::make_shared<SocketPool>(DAEMON_SOCKET_POOL_SIZE)), nextConnectionId(0), nextTransferId(0) {
+        sockaddr_un addr;
+        if (!unixAddress(socketPath, addr)) {
+            throw std::runtime_error("Socket path is too long");
+        }
+        // Only stale socket is replaced, path can't be used to delete other file
+        struct stat status;
+        if (lstat(socketPath.c_str(), &status) == 0) {
+            if (!S_ISSOCK(status.st_mode)) {
+                throw std::runtime_error("Daemon socket path " + socketPath + " exists and is not a socket");
+            }
+            if (unlink(socketPath.c_str()) < 0) {
+                throw std::runtime_error("Failed to remove stale daemon socket " + socketPath + ": " + std::string(strerror(errno)));
+            }
+        }
+        listenFd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if (listenFd < 0) {
+            throw std::runtime_error("Failed to open daemon socket");
+        }
+        // Only owner can enqueue transfers which write into files of daemon user, socket is created
+        // with mode 0600 right away, so nobody can connect before permissions are set
+        mode_t previousMask = umask(0077);
+        int bound = bind(listenFd, (struct sockaddr*)&addr, sizeof(addr));
+        int bindError = errno;
+        umask(previousMask);
+        if (bound < 0 || listen(listenFd, SOMAXCONN) < 0) {
+            std::string message = strerror(bound < 0 ? bindError : errno);
+            close(listenFd);
+            throw std::runtime_error("Failed to bind daemon socket " + socketPath + ": " + message);
+        }
+    }
+
+FetchDaemon::~FetchDaemon(){
+    for (auto& connection : connections) {
+        close(connection.second.fd);
+    }
+    close(listenFd);
+    unlink(socketPath.c_str());
+}
+
+AsyncClient& FetchDaemon::clientFor(const std::string& host, int port){
+    std::string key = host + ":" + std::to_string(port);
+    auto it = clients.find(key);
+    if (it == clients.end()) {
+        auto client = std::make_unique<AsyncClient>(host, port);
+        client->setOptions(options);
+        client->setSocketPool(pool);
+        it = clients.emplace(key, std::move(client)).first;
+    }
+    return *it->second;
+}
+
+void FetchDaemon::run(){
+    Logger::instance().log("Fetch daemon listening on " + socketPath);
+    while (!stopFlagClient->load()) {
+        // Descriptors of daemon socket, connections and then all clients
+        std::vector<pollfd> fds;
+        fds.push_back({listenFd, POLLIN, 0});
+        std::vector<uint64_t> connectionIds;
+        for (auto& connection : connections) {
+            fds.push_back({connection.second.fd, (short)(POLLIN | (connection.second.output.empty() ? 0 : POLLOUT)), 0});
+            connectionIds.push_back(connection.first);
+        }
+        std::vector<std::pair<AsyncClient*, std::vector<pollfd>>> clientFds;
+        int waitMs = DAEMON_IDLE_POLL_MS;
+        for (auto& client : clients) {
+            clientFds.emplace_back(client.second.get(), client.second->pollFds());
+            fds.insert(fds.end(), clientFds.back().second.begin(), clientFds.back().second.end());
+            int clientWait = client.second->timeoutMs();
+            if (clientWait >= 0) {
+                waitMs = std::min(waitMs, clientWait);
+            }
+        }
+
+        if (poll(fds.data(), fds.size(), waitMs) < 0 && errno != EINTR) {
+            Logger::instance().log("Failed to poll daemon sockets");
+            break;
+        }
+
+        // Transfers first, so their completion events are sent in this round
+        size_t offset = 1 + connectionIds.size();
+        for (auto& client : clientFds) {
+            std::copy(fds.begin() + offset, fds.begin() + offset + client.second.size(), client.second.begin());
+            offset += client.second.size();
+            client.first->process(client.second);
+        }
+
+        for (size_t i = 0; i < connectionIds.size(); i++) {
+            auto it = connections.find(connectionIds[i]);
+            if (it == connections.end()) {
+                continue;
+            }
+            if (fds[i + 1].revents & (POLLIN | POLLHUP | POLLERR)) {
+                readConnection(it->first);
+            }
+            flush(it->second);
+            if (it->second.closed) {
+                close(it->second.fd);
+                connections.erase(it);
+            }
+        }
+
+        if (fds[0].revents & POLLIN) {
+            acceptConnections();
+        }
+
+        pool->refill();
+    }
+    Logger::instance().log("Fetch daemon is stopping");
+}
+
+void FetchDaemon::acceptConnections(){
+    while (true) {
+        int fd = accept4(listenFd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0) {
+            return;
+        }
+        connections[nextConnectionId++] = {fd, "", "", false};
+    }
+}
+
+void FetchDaemon::readConnection(uint64_t id){
+    Connection& connection = connections.at(id);
+    char buffer[4096];
+    while (true) {
+        ssize_t count = read(connection.fd, buffer, sizeof(buffer));
+        if (count < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            break;
+        }
+        if (count <= 0) {
+            // Transfers of closed connection still finish, only their events are dropped
+            connection.closed = true;
+            break;
+        }
+        connection.input.append(buffer, count);
+    }
+
+    size_t end;
+    while ((end = connection.input.find('\n')) != std::string::npos) {
+        std::string line = connection.input.substr(0, end);
+        connection.input.erase(0, end + 1);
+        handleRequest(id, line);
+    }
+}
+
+void FetchDaemon::handleRequest(uint64_t id, const std::string& line){
+    Connection& connection = connections.at(id);
+    std::istringstream stream(line);
+    std::string command, host, first, second;
+    int port;
+    // paths are quoted, so they can contain spaces
+    if (!(stream >> command >> host >> port >> std::quoted(first) >> std::quoted(second)) || (command != "get" && command != "put")) {
+        connection.output += "error invalid request\n";
+        return;
+    }
+
+    uint64_t transferId = nextTransferId++;
+    std::string localPath = command == "get" ? second : first;
+    auto onDone = [this, id, transferId, localPath](const TransferResult& result) {
+        if (!result.ok && result.transfer.type == SessionType::READ) {
+            std::remove(localPath.c_str());
+        }
+        Logger::instance().log("Transfer " + std::to_string(transferId) + (result.ok ? " finished" : " failed"));
+        auto it = connections.find(id);
+        if (it != connections.end()) {
+            it->second.output += "done " + std::to_string(transferId) + (result.ok ? " ok " : " failed ") + std::to_string(result.bytes) + " " + std::to_string(result.seconds) + "\n";
+        }
+    };
+
+    try {
+        AsyncClient& client = clientFor(host, port);
+        if (command == "get") {
+            int fd = open(localPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+            if (fd < 0) {
+                connection.output += "error failed to open " + localPath + "\n";
+                return;
+            }
+            connection.output += "queued " + std::to_string(transferId) + "\n";
+            client.get(first, std::make_shared<FdSink>(fd, true), onDone);
+        } else {
+            std::unique_ptr<UploadSource> source = UploadSource::open(localPath);
+            if (!source) {
+                connection.output += "error failed to open " + localPath + "\n";
+                return;
+            }
+            std::error_code error;
+            uintmax_t size = std::filesystem::file_size(localPath, error);
+            connection.output += "queued " + std::to_string(transferId) + "\n";
+            client.put(second, std::move(source), error ? -1 : (int64_t)size, onDone);
+        }
+    } catch (const std::runtime_error& e) {
+        connection.output += "error " + std::string(e.what()) + "\n";
+    }
+}
+
+void FetchDaemon::flush(Connection& connection){
+    while (!connection.output.empty()) {
+        ssize_t count = send(connection.fd, connection.output.data(), connection.output.size(), MSG_NOSIGNAL);
+        if (count < 0) {
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                connection.closed = true;
+            }
+            return;
+        }
+        connection.output.erase(0, count);
+    }
+}
+
+int enqueueTransfers(const std::string& socketPath, const std::string& hostname, int port, const std::vector<Transfer>& transfers){
+    sockaddr_un addr;
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0 || !unixAddress(socketPath, addr) || connect(fd, (struct sockaddr*)&addr, sizeof(addr)) < 0) {
+        Logger::instance().log("Failed to connect to daemon " + socketPath);
+        if (fd >= 0) {
+            close(fd);
+        }
+        return -1;
+    }
+
+    // Daemon has different working directory, so local paths are sent absolute, paths are quoted
+    // because of spaces, only line end can't be sent in line based protocol
+    std::ostringstream requests;
+    for (const auto& transfer : transfers) {
+        std::string localPath = std::filesystem::absolute(transfer.localPath).string();
+        if (localPath.find('\n') != std::string::npos || transfer.remotePath.find('\n') != std::string::npos) {
+            Logger::instance().log(LogLevel::ERROR, "Path with line end can't be enqueued into daemon: " + localPath);
+            close(fd);
+            return -1;
+        }
+        const std::string& source = transfer.type == SessionType::READ ? transfer.remotePath : localPath;
+        const std::string& destination = transfer.type == SessionType::READ ? localPath : transfer.remotePath;
+        requests << (transfer.type == SessionType::READ ? "get " : "put ") << hostname << " " << port << " "
+            << std::quoted(source) << " " << std::quoted(destination) << "\n";
+    }
+    std::string request = requests.str();
+    for (size_t sent = 0; sent < request.size();) {
+        ssize_t count = send(fd, request.data() + sent, request.size() - sent, MSG_NOSIGNAL);
+        if (count < 0) {
+            Logger::instance().log("Failed to send requests to daemon");
+            close(fd);
+            return -1;
+        }
+        sent += count;
+    }
+
+    // Every request is answered by error or by queued and later done event
+    size_t answered = 0;
+    int failed = 0;
+    std::string input;
+    char buffer[4096];
+    while (answered < transfers.size()) {
+        ssize_t count = read(fd, buffer, sizeof(buffer));
+        if (count <= 0) {
+            Logger::instance().log("Daemon closed connection");
+            failed += transfers.size() - answered;
+            break;
+        }
+        input.append(buffer, count);
+        size_t end;
+        while ((end = input.find('\n')) != std::string::npos) {
+            std::string line = input.substr(0, end);
+            input.erase(0, end + 1);
+            Logger::instance().log(line);
+            if (line.rfind("error", 0) == 0) {
+                answered++;
+                failed++;
+            } else if (line.rfind("done", 0) == 0) {
+                answered++;
+                failed += line.find(" ok ") == std::string::npos;
+            }
+        }
+    }
+    close(fd);
+    return failed;
+}
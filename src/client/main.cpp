@@ -7,8 +7,11 @@
 #include <string>
 #include <getopt.h>
 #include "client/tftp_client.hpp"
+#include "client/fetch_daemon.hpp"
 #include <csignal>
 #include "common/logger.hpp"
+#include "common/trace.hpp"
+#include "common/net_emulator.hpp"
 // include other necessary headers
 
 void signalHandler(int signal) {
@@ -19,12 +22,36 @@ void signalHandler(int signal) {
     
 }
 
+/**
+ * @brief Function for logging usage of client
+ * @param program Name of program
+*/
+void printUsage(const std::string& program) {
+    Logger::instance().log("Usage: " + program + " -h hostname [-p port] [-f filepath [-n stripes] | -i input_filepath] -t dest_filepath [-b blksize] [-o timeout] [-w windowsize] [-s] [-a] [-q daemon_socket] [-T trace_dir] [-E emulation] [-L log_level]\n"
+        + "       " + program + " -h hostname [-p port] -m manifest [-j parallel] [-b blksize] [-o timeout] [-w windowsize] [-s] [-a] [-q daemon_socket] [-T trace_dir] [-E emulation] [-L log_level]\n"
+        + "       " + program + " -d daemon_socket [-b blksize] [-o timeout] [-w windowsize] [-s] [-T trace_dir] [-E emulation] [-L log_level]");
+}
+
 // Define the long options
 static struct option long_options[] = {
     {"hostname", required_argument, 0, 'h'},
     {"file", optional_argument, 0, 'f'},
+    {"input", required_argument, 0, 'i'},
     {"dest", required_argument, 0, 't'},
     {"port", optional_argument, 0, 'p'},
+    {"blksize", required_argument, 0, 'b'},
+    {"timeout", required_argument, 0, 'o'},
+    {"windowsize", required_argument, 0, 'w'},
+    {"tsize", no_argument, 0, 's'},
+    {"auto", no_argument, 0, 'a'},
+    {"manifest", required_argument, 0, 'm'},
+    {"parallel", required_argument, 0, 'j'},
+    {"stripes", required_argument, 0, 'n'},
+    {"daemon", required_argument, 0, 'd'},
+    {"enqueue", required_argument, 0, 'q'},
+    {"trace", required_argument, 0, 'T'},
+    {"emulate", required_argument, 0, 'E'},
+    {"log-level", required_argument, 0, 'L'},
     {0, 0, 0, 0} // End of array need to be filled with 0s
 };
 
@@ -33,11 +60,19 @@ int main(int argc, char* argv[]) {
     int port = 69; // Default TFTP port
     std::string filepath;
     std::string dest_filepath;
+    std::string src_filepath = "stdin";
     bool upload = true;
+    bool autoOptions = false;
+    std::string manifest;
+    size_t parallel = DEFAULT_PARALLEL_TRANSFERS;
+    size_t stripes = 1;
+    std::string daemonSocket;
+    std::string enqueueSocket;
+    OptionTable options;
     int option_index = 0;
     int option;
 
-    while ((option = getopt_long(argc, argv, "h:p:f:t:", long_options, &option_index)) != -1) {
+    while ((option = getopt_long(argc, argv, "h:p:f:i:t:b:o:w:sam:j:n:d:q:T:E:L:", long_options, &option_index)) != -1) {
         switch (option) {
             case 'h':
                 hostname = optarg;
@@ -47,13 +82,13 @@ int main(int argc, char* argv[]) {
                     port = std::stoi(optarg);
                 } catch (const std::exception& e) {
                     Logger::instance().log("Invalid port number. Port should be between 1 and 65535.");
-                    Logger::instance().log("Usage: " + std::string(argv[0]) + " -h hostname [-p port] [-f filepath] -t dest_filepath");
+                    printUsage(argv[0]);
                     return 1;
                 }
                 
                 if (port <= 0 || port > 65535) {
                     Logger::instance().log("Invalid port number. Port should be between 1 and 65535.");
-                    Logger::instance().log("Usage: " + std::string(argv[0]) + " -h hostname [-p port] [-f filepath] -t dest_filepath");
+                    printUsage(argv[0]);
                     return 1;
                 }
                 break;
@@ -61,9 +96,91 @@ int main(int argc, char* argv[]) {
                 filepath = optarg;
                 upload = false;
                 break;
+            case 'i':
+                src_filepath = optarg;
+                break;
             case 't':
                 dest_filepath = optarg;
                 break;
+            case 'b':
+            case 'o':
+            case 'w':
+            {
+                OptionId id = option == 'b' ? OptionId::BLKSIZE : option == 'o' ? OptionId::TIMEOUT : OptionId::WINDOWSIZE;
+                std::string name(optionName(id));
+                uint64_t min = option == 'b' ? MIN_BLOCK_SIZE : option == 'o' ? MIN_TIMEOUT : MIN_WINDOW_SIZE;
+                uint64_t max = option == 'b' ? MAX_BLOCK_SIZE : option == 'o' ? MAX_TIMEOUT : MAX_WINDOW_SIZE;
+                uint64_t value;
+                try{
+                    value = std::stoull(optarg);
+                } catch (const std::exception& e) {
+                    value = 0;
+                }
+                if (value < min || value > max) {
+                    Logger::instance().log("Invalid " + name + " value. It should be between " + std::to_string(min) + " and " + std::to_string(max) + ".");
+                    return 1;
+                }
+                options.set(id, value);
+                break;
+            }
+            case 's':
+                // Real value is filled in by client based on type of transfer
+                options.set(OptionId::TSIZE, 0);
+                break;
+            case 'a':
+                autoOptions = true;
+                break;
+            case 'm':
+                manifest = optarg;
+                break;
+            case 'j':
+                try{
+                    parallel = std::stoul(optarg);
+                } catch (const std::exception& e) {
+                    parallel = 0;
+                }
+                if (parallel == 0) {
+                    Logger::instance().log("Invalid number of parallel transfers. It should be at least 1.");
+                    return 1;
+                }
+                break;
+            case 'n':
+                try{
+                    stripes = std::stoul(optarg);
+                } catch (const std::exception& e) {
+                    stripes = 0;
+                }
+                if (stripes == 0 || stripes > MAX_STRIPES) {
+                    Logger::instance().log("Invalid number of stripes. It should be between 1 and " + std::to_string(MAX_STRIPES) + ".");
+                    return 1;
+                }
+                break;
+            case 'd':
+                daemonSocket = optarg;
+                break;
+            case 'q':
+                enqueueSocket = optarg;
+                break;
+            case 'T':
+                if (!Tracer::instance().open(optarg)) {
+                    return 1;
+                }
+                break;
+            case 'E':
+                if (!NetworkEmulator::instance().configure(optarg)) {
+                    return 1;
+                }
+                break;
+            case 'L':
+            {
+                std::optional<LogLevel> level = Logger::parseLevel(optarg);
+                if (!level) {
+                    Logger::instance().log("Invalid log level, it should be error, info or debug.");
+                    return 1;
+                }
+                Logger::instance().setLevel(*level);
+                break;
+            }
             case '?': // Option not recognized
                 return 1;
             default:
@@ -71,24 +188,75 @@ int main(int argc, char* argv[]) {
         }
     }
 
-    if (hostname.empty() || dest_filepath.empty() || (!upload && filepath.empty())) {
+    std::signal(SIGINT, signalHandler);
+
+    // Daemon serves requests of any server, so hostname isn't required
+    if (!daemonSocket.empty()) {
+        try {
+            FetchDaemon daemon(daemonSocket, options);
+            daemon.run();
+        } catch (const std::exception& e) {
+            Logger::instance().log("Failed to start fetch daemon: " + std::string(e.what()));
+            return 1;
+        }
+        return 0;
+    }
+
+    if (hostname.empty() || (manifest.empty() && (dest_filepath.empty() || (!upload && filepath.empty())))) {
         Logger::instance().log("Missing required arguments.");
-        Logger::instance().log("Usage: " + std::string(argv[0]) + " -h hostname [-p port] [-f filepath] -t dest_filepath");
+        printUsage(argv[0]);
         return 1;
     }
 
-    std::signal(SIGINT, signalHandler);
+    // Transfers are only handed over to running daemon, stdin can't be passed so upload needs -i
+    if (!enqueueSocket.empty()) {
+        std::vector<Transfer> transfers;
+        try {
+            if (!manifest.empty()) {
+                transfers = readManifest(manifest);
+            } else if (upload) {
+                if (src_filepath == "stdin") {
+                    Logger::instance().log("Upload through daemon needs input file (-i).");
+                    return 1;
+                }
+                transfers.push_back({SessionType::WRITE, src_filepath, dest_filepath});
+            } else {
+                transfers.push_back({SessionType::READ, dest_filepath, filepath});
+            }
+        } catch (const std::exception& e) {
+            Logger::instance().log(e.what());
+            return 1;
+        }
+        return enqueueTransfers(enqueueSocket, hostname, port, transfers) == 0 ? 0 : 1;
+    }
 
     try {
         TFTPClient client(hostname, port); // Create an instance of the TFTPClient with the given host and port
+        client.setOptions(options);
+        if (autoOptions) {
+            client.enableAutoOptions();
+        }
         
-        // Check the operation mode based on the presence of the filepath
-        if (upload) {
-            // If no filepath is provided, assume data will come from stdin.
-            client.upload(dest_filepath);
+        // Check the operation mode based on the presence of the manifest and filepath
+        if (!manifest.empty()) {
+            std::vector<TransferResult> results = client.runBatch(readManifest(manifest), parallel);
+            for (const auto& result : results) {
+                if (!result.ok) {
+                    return 1;
+                }
+            }
+        } else if (upload) {
+            // If no input filepath is provided, data will come from stdin.
+            client.upload(dest_filepath, src_filepath);
         } else {
             // Otherwise, download the file from the given filepath.
-            client.download(filepath, dest_filepath);
+            if (stripes > 1) {
+                if (!client.downloadStriped(filepath, dest_filepath, stripes)) {
+                    return 1;
+                }
+            } else {
+                client.download(filepath, dest_filepath);
+            }
         }
     } catch (const std::exception& e) {
         Logger::instance().log("Failed to start TFTP client: " + std::string(e.what()));
@@ -0,0 +1,42 @@
+/**
+ * @file client/socket_pool.cpp
+ * @brief Implementation of pool of pre-bound client sockets
+ * @author Lukas Vecerka (xvecer30)
+*/
+#include "client/socket_pool.hpp"
+#include "client/tftp_client.hpp"
+#include "common/logger.hpp"
+#include <stdexcept>
+#include <unistd.h>
+
+SocketPool::SocketPool(size_t size)
+    : size(size) {
+        sockets.reserve(size);
+        refill();
+    }
+
+SocketPool::~SocketPool(){
+    for (int socket : sockets) {
+        close(socket);
+    }
+}
+
+int SocketPool::acquire(){
+    if (sockets.empty()) {
+        return bindClientSocket();
+    }
+    int socket = sockets.back();
+    sockets.pop_back();
+    return socket;
+}
+
+void SocketPool::refill(){
+    while (sockets.size() < size) {
+        try {
+            sockets.push_back(bindClientSocket());
+        } catch (const std::runtime_error& e) {
+            Logger::instance().log(e.what());
+            return;
+        }
+    }
+}
@@ -13,87 +13,392 @@
 #include <netinet/in.h>
 #include <netdb.h>
 #include <unistd.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <fstream>
+#include <chrono>
+#include <memory>
+#include <functional>
+#include <filesystem>
+#include "client/transfer_loop.hpp"
 #include "common/logger.hpp"
 
 TFTPClient::TFTPClient(std::string hostname, int port)
-    : hostname(std::move(hostname)), port(port) {
-        // Create socket
-        sockfd = socket(AF_INET, SOCK_DGRAM, 0);
-        if (sockfd < 0) {
-            throw std::runtime_error("Failed to open socket");
-        }
+    : hostname(std::move(hostname)), port(port), autoOptions(false) {
+        sockfd = bindClientSocket();
+    }
+
+int bindClientSocket(){
+    // Create socket
+    int sockfd = socket(AF_INET, SOCK_DGRAM, 0);
+    if (sockfd < 0) {
+        throw std::runtime_error("Failed to open socket");
+    }
 
-        // Initialize server address structure
-        sockaddr_in client_addr{};
-        client_addr.sin_family = AF_INET;
-        client_addr.sin_addr.s_addr = htonl(INADDR_ANY); // Listen on all interfaces
-        client_addr.sin_port = htons(0); // Let OS choose the port
+    // Initialize server address structure
+    sockaddr_in client_addr{};
+    client_addr.sin_family = AF_INET;
+    client_addr.sin_addr.s_addr = htonl(INADDR_ANY); // Listen on all interfaces
+    client_addr.sin_port = htons(0); // Let OS choose the port
 
-        // Bind socket to the server address
-        if (bind(sockfd, (const struct sockaddr *)&client_addr, sizeof(client_addr)) < 0) {
-            close(sockfd);
-            throw std::runtime_error("Failed to bind socket to port");
+    // Bind socket to the server address
+    if (bind(sockfd, (const struct sockaddr *)&client_addr, sizeof(client_addr)) < 0) {
+        close(sockfd);
+        throw std::runtime_error("Failed to bind socket to port");
+    }
+    return sockfd;
+}
+
+std::vector<Transfer> readManifest(const std::string& path){
+    std::ifstream manifest(path);
+    if (!manifest.is_open()) {
+        throw std::runtime_error("Failed to open manifest " + path);
+    }
+
+    std::vector<Transfer> transfers;
+    std::string line;
+    int lineNumber = 0;
+    while (std::getline(manifest, line)) {
+        lineNumber++;
+        std::istringstream stream(line);
+        std::string command, first, second, rest;
+        if (!(stream >> command) || command[0] == '#') {
+            continue;
+        }
+        if (!(stream >> first >> second) || (stream >> rest) || (command != "get" && command != "put")) {
+            throw std::runtime_error("Invalid manifest line " + std::to_string(lineNumber) + ": " + line);
+        }
+        if (command == "get") {
+            transfers.push_back({SessionType::READ, second, first});
+        } else {
+            transfers.push_back({SessionType::WRITE, first, second});
         }
     }
+    return transfers;
+}
+
+int probePathMTU(const sockaddr_in& server_addr){
+    int probeSock = socket(AF_INET, SOCK_DGRAM, 0);
+    if (probeSock < 0) {
+        return 0;
+    }
+
+    // Forbid fragmentation so kernel reports MTU of the route instead of interface default
+    int pmtuDiscover = IP_PMTUDISC_DO;
+    setsockopt(probeSock, IPPROTO_IP, IP_MTU_DISCOVER, &pmtuDiscover, sizeof(pmtuDiscover));
+
+    // Connecting UDP socket doesn't send anything, it only binds route to socket
+    if (connect(probeSock, (const struct sockaddr *)&server_addr, sizeof(server_addr)) < 0) {
+        close(probeSock);
+        return 0;
+    }
+
+    int mtu = 0;
+    socklen_t len = sizeof(mtu);
+    if (getsockopt(probeSock, IPPROTO_IP, IP_MTU, &mtu, &len) < 0) {
+        mtu = 0;
+    }
+    close(probeSock);
+    return mtu;
+}
+
+uint16_t blockSizeForMTU(int mtu){
+    int blockSize = mtu - IP_HEADER_SIZE - UDP_HEADER_SIZE - TFTP_DATA_HEADER_SIZE;
+    if (blockSize < INITIAL_BLOCK_SIZE) {
+        return INITIAL_BLOCK_SIZE;
+    }
+    if (blockSize > MAX_BLOCK_SIZE) {
+        return MAX_BLOCK_SIZE;
+    }
+    return blockSize;
+}
 
-void TFTPClient::upload(std::string dest_filepath) {
-    Logger::instance().log("Uploading file to " + hostname + ":" + std::to_string(port) + " with destination filepath: " + dest_filepath);
+void TFTPClient::setOptions(OptionTable options){
+    this->options = options;
+}
+
+void TFTPClient::enableAutoOptions(){
+    autoOptions = true;
+}
 
+bool TFTPClient::resolveServer(sockaddr_in& server_addr){
     // Initialize hints for getaddrinfo
     struct addrinfo hints, *res;
     std::memset(&hints, 0, sizeof(hints));
-    hints.ai_family = AF_INET;
-    hints.ai_socktype = SOCK_DGRAM;
+    hints.ai_family = AF_INET;      // AF_INET for IPv4
+    hints.ai_socktype = SOCK_DGRAM; // Datagram socket for UDP
 
     // Resolve hostname to IP address
     if (getaddrinfo(hostname.c_str(), nullptr, &hints, &res) != 0) {
         Logger::instance().log("Could not resolve hostname");
-        close(sockfd);
-        return;
+        return false;
     }
 
-    // Send the initial request to the server
-    struct sockaddr_in server_addr = *(struct sockaddr_in*)res->ai_addr;
+    server_addr = *(struct sockaddr_in*)res->ai_addr;
     server_addr.sin_port = htons(port);
+    freeaddrinfo(res);
+    return true;
+}
+
+OptionTable TFTPClient::requestOptions(const sockaddr_in& server_addr, SessionType sessionType, int64_t uploadSize){
+    OptionTable requested;
+    if (autoOptions) {
+        int mtu = probePathMTU(server_addr);
+        if (mtu > 0) {
+            requested.set(OptionId::BLKSIZE, blockSizeForMTU(mtu));
+            Logger::instance().log("Path MTU " + std::to_string(mtu) + ", requesting block size " + std::to_string(requested.get(OptionId::BLKSIZE)));
+        } else {
+            Logger::instance().log("Failed to determine path MTU, using default block size");
+        }
+        requested.set(OptionId::TIMEOUT, AUTO_TIMEOUT);
+        requested.set(OptionId::TSIZE, 0);
+    }
+
+    // Explicitly set options override automatically selected ones
+    options.forEach([&requested](OptionId id, uint64_t value) {
+        requested.set(id, value);
+    });
 
-    std::map<std::string, uint64_t> options;
+    // Client has to send tsize 0 in RRQ, in WRQ size of upload which is known only
+    // when source is regular file
+    if (requested.has(OptionId::TSIZE)) {
+        if (sessionType == SessionType::READ) {
+            requested.set(OptionId::TSIZE, 0);
+        } else if (uploadSize >= 0) {
+            requested.set(OptionId::TSIZE, uploadSize);
+        } else {
+            requested.erase(OptionId::TSIZE);
+        }
+    }
+    return requested;
+}
+
+void TFTPClient::upload(std::string dest_filepath, std::string src_filepath) {
+    Logger::instance().log("Uploading " + src_filepath + " to " + hostname + ":" + std::to_string(port) + " with destination filepath: " + dest_filepath);
+
+    // Send the initial request to the server
+    struct sockaddr_in server_addr;
+    if (!resolveServer(server_addr)) {
+        close(sockfd);
+        return;
+    }
+
+    // Size of upload is known only when source is regular file
+    struct stat st;
+    bool isRegular = src_filepath == "stdin" ? fstat(STDIN_FILENO, &st) == 0 && S_ISREG(st.st_mode) : stat(src_filepath.c_str(), &st) == 0 && S_ISREG(st.st_mode);
+    int64_t uploadSize = isRegular ? st.st_size : -1;
+    OptionTable options = requestOptions(server_addr, SessionType::WRITE, uploadSize);
     
     struct sockaddr_in from_addr;
 
-    ClientSession session(sockfd, from_addr, "stdin", dest_filepath, DataMode::OCTET, SessionType::WRITE, options, "");
+    ClientSession session(sockfd, from_addr, src_filepath, dest_filepath, DataMode::OCTET, SessionType::WRITE, options, "");
 
     WriteRequestPacket packet(dest_filepath, DataMode::OCTET, options, server_addr);
-    packet.send(&session, sockfd);
-
-    session.handleSession();
+    if (session.start(packet)) {
+        session.handleSession();
+    }
 }
 
 void TFTPClient::download(std::string filepath, std::string dest_filepath) {
     Logger::instance().log("Downloading file from " + hostname + ":" + std::to_string(port) + " with filepath: " + filepath + " to destination filepath: " + dest_filepath);
 
-    // Initialize hints for getaddrinfo
-    struct addrinfo hints, *res;
-    std::memset(&hints, 0, sizeof(hints));
-    hints.ai_family = AF_INET;      // AF_INET for IPv4
-    hints.ai_socktype = SOCK_DGRAM; // Datagram socket for UDP
-
-    // Resolve hostname to IP address
-    if (getaddrinfo(hostname.c_str(), nullptr, &hints, &res) != 0) {
-        Logger::instance().log("Could not resolve hostname");
+    // Send the initial request to the server
+    struct sockaddr_in server_addr;
+    if (!resolveServer(server_addr)) {
         close(sockfd);
         return;
     }
 
-    // Send the initial request to the server
-    struct sockaddr_in server_addr = *(struct sockaddr_in*)res->ai_addr;
-    server_addr.sin_port = htons(port);
-
-    std::map<std::string, uint64_t> options;
+    OptionTable options = requestOptions(server_addr, SessionType::READ, -1);
 
     struct sockaddr_in from_addr;
     ClientSession session(sockfd, from_addr, filepath, dest_filepath, DataMode::OCTET, SessionType::READ, options, "");
     ReadRequestPacket packet(filepath, DataMode::OCTET, options, server_addr);
-    packet.send(&session, sockfd);
+    if (session.start(packet)) {
+        session.handleSession();
+    }
+}
+
+bool TFTPClient::downloadStriped(std::string filepath, std::string dest_filepath, size_t stripes) {
+    Logger::instance().log("Downloading file from " + hostname + ":" + std::to_string(port) + " with filepath: " + filepath + " to destination filepath: " + dest_filepath + " in " + std::to_string(stripes) + " stripes");
+
+    struct sockaddr_in server_addr;
+    if (!resolveServer(server_addr)) {
+        close(sockfd);
+        return false;
+    }
+    OptionTable options = requestOptions(server_addr, SessionType::READ, -1);
+    options.erase(OptionId::TSIZE);
+
+    int fd = open(dest_filepath.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        Logger::instance().log("Failed to open file for writing");
+        close(sockfd);
+        return false;
+    }
+
+    // Empty range is used to learn size of file and whether server supports ranges
+    OptionTable probeOptions = options;
+    probeOptions.set(OptionId::TSIZE, 0);
+    probeOptions.set(OptionId::RANGESTART, 0);
+    probeOptions.set(OptionId::RANGESIZE, 0);
+    struct sockaddr_in from_addr{};
+    ClientSession probe(sockfd, from_addr, filepath, dest_filepath, DataMode::OCTET, SessionType::READ, probeOptions, "");
+    probe.sink = std::make_unique<FdSink>(fd, false, 0);
+    ReadRequestPacket probePacket(filepath, DataMode::OCTET, probeOptions, server_addr);
+    if (probe.start(probePacket)) {
+        probe.handleSession();
+    }
+    if (probe.sessionState != SessionState::RRQ_END || !probe.options.has(OptionId::TSIZE)) {
+        Logger::instance().log("Server didn't report size of file or doesn't support ranges, downloading in one session");
+        close(fd);
+        sockfd = bindClientSocket();
+        download(filepath, dest_filepath);
+        return true;
+    }
 
-    session.handleSession();
-}
\ No newline at end of file
+    // Stripes are aligned to blocks, so only last block of every stripe is short
+    uint64_t fileSize = probe.tsize;
+    uint64_t blockSize = probe.blockSize;
+    uint64_t stripeSize = (fileSize + stripes - 1) / stripes;
+    stripeSize = std::max<uint64_t>(blockSize, (stripeSize + blockSize - 1) / blockSize * blockSize);
+    int err = fileSize > 0 ? posix_fallocate(fd, 0, fileSize) : 0;
+    if (err != 0 && ftruncate(fd, fileSize) < 0) {
+        Logger::instance().log("Failed to preallocate file: " + std::string(strerror(err)));
+        close(fd);
+        std::remove(dest_filepath.c_str());
+        return false;
+    }
+
+    TransferLoop loop;
+    bool ok = true;
+    auto start = std::chrono::steady_clock::now();
+    for (uint64_t offset = 0; offset < fileSize || offset == 0; offset += stripeSize) {
+        uint64_t length = std::min(stripeSize, fileSize - offset);
+        OptionTable stripeOptions = options;
+        stripeOptions.set(OptionId::RANGESTART, offset);
+        stripeOptions.set(OptionId::RANGESIZE, length);
+
+        int socket;
+        try {
+            socket = bindClientSocket();
+        } catch (const std::runtime_error& e) {
+            Logger::instance().log(e.what());
+            ok = false;
+            break;
+        }
+        auto session = std::make_unique<ClientSession>(socket, from_addr, filepath, dest_filepath, DataMode::OCTET, SessionType::READ, stripeOptions, "");
+        session->sink = std::make_unique<FdSink>(fd, false, offset);
+        ReadRequestPacket packet(filepath, DataMode::OCTET, stripeOptions, server_addr);
+        if (!session->start(packet)) {
+            ok = false;
+            break;
+        }
+        loop.add(std::move(session), [&ok, offset, length](ClientSession& finished) {
+            bool complete = finished.sessionState == SessionState::RRQ_END && finished.bytesTransferred == length;
+            Logger::instance().log(std::string(complete ? "OK" : "FAILED") + " stripe " + std::to_string(offset) + "+" + std::to_string(length));
+            ok = ok && complete;
+        });
+        if (fileSize == 0) {
+            break;
+        }
+    }
+    loop.run();
+    close(fd);
+
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    if (!ok) {
+        Logger::instance().log("File was not correctly transfered, deleting file...");
+        std::remove(dest_filepath.c_str());
+        return false;
+    }
+    Logger::instance().log("Striped download finished: " + std::to_string(fileSize) + " B in " + std::to_string(seconds) + " s ("
+        + std::to_string(seconds > 0 ? (uint64_t)(fileSize / seconds) : 0) + " B/s)");
+    return true;
+}
+
+std::vector<TransferResult> TFTPClient::runBatch(const std::vector<Transfer>& transfers, size_t parallel) {
+    std::vector<TransferResult> results;
+    for (const auto& transfer : transfers) {
+        results.push_back({transfer, false, 0, 0});
+    }
+
+    // Resolve server and build options once for all transfers, only tsize of uploads differs
+    struct sockaddr_in server_addr;
+    close(sockfd); // Every transfer has its own socket
+    if (!resolveServer(server_addr)) {
+        return results;
+    }
+    OptionTable readOptions = requestOptions(server_addr, SessionType::READ, -1);
+
+    TransferLoop loop;
+    size_t next = 0;
+    size_t running = 0;
+    auto batchStart = std::chrono::steady_clock::now();
+
+    // Start transfers until limit of parallel transfers is reached
+    std::function<void()> fill = [&]() {
+        while (running < parallel && next < transfers.size()) {
+            size_t index = next++;
+            const Transfer& transfer = transfers[index];
+            OptionTable options = readOptions;
+            if (transfer.type == SessionType::WRITE) {
+                std::error_code error;
+                uintmax_t size = std::filesystem::file_size(transfer.localPath, error);
+                options = requestOptions(server_addr, SessionType::WRITE, error ? -1 : (int64_t)size);
+            }
+
+            int socket;
+            try {
+                socket = bindClientSocket();
+            } catch (const std::runtime_error& e) {
+                Logger::instance().log(e.what());
+                continue;
+            }
+
+            struct sockaddr_in from_addr{};
+            std::unique_ptr<ClientSession> session;
+            if (transfer.type == SessionType::READ) {
+                session = std::make_unique<ClientSession>(socket, from_addr, transfer.remotePath, transfer.localPath, DataMode::OCTET, SessionType::READ, options, "");
+                ReadRequestPacket packet(transfer.remotePath, DataMode::OCTET, options, server_addr);
+                if (!session->start(packet)) {
+                    continue;
+                }
+            } else {
+                session = std::make_unique<ClientSession>(socket, from_addr, transfer.localPath, transfer.remotePath, DataMode::OCTET, SessionType::WRITE, options, "");
+                WriteRequestPacket packet(transfer.remotePath, DataMode::OCTET, options, server_addr);
+                if (!session->start(packet)) {
+                    continue;
+                }
+            }
+
+            running++;
+            auto start = std::chrono::steady_clock::now();
+            loop.add(std::move(session), [&, index, start](ClientSession& finished) {
+                TransferResult& result = results[index];
+                result.ok = finished.sessionState == SessionState::RRQ_END || finished.sessionState == SessionState::WRQ_END;
+                result.bytes = finished.bytesTransferred;
+                result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+                running--;
+                fill();
+            });
+        }
+    };
+
+    fill();
+    loop.run();
+
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - batchStart).count();
+    uint64_t totalBytes = 0;
+    size_t failed = 0;
+    for (const auto& result : results) {
+        Logger::instance().log(std::string(result.ok ? "OK " : "FAILED ") + (result.transfer.type == SessionType::READ ? "get " : "put ")
+            + result.transfer.remotePath + " " + std::to_string(result.bytes) + " B in " + std::to_string(result.seconds) + " s");
+        totalBytes += result.bytes;
+        failed += !result.ok;
+    }
+    Logger::instance().log("Batch finished: " + std::to_string(transfers.size() - failed) + "/" + std::to_string(transfers.size())
+        + " transfers, " + std::to_string(totalBytes) + " B in " + std::to_string(seconds) + " s ("
+        + std::to_string(seconds > 0 ? (uint64_t)(totalBytes / seconds) : 0) + " B/s)");
+    return results;
+}
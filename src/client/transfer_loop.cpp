@@ -0,0 +1,131 @@
+/**
+ * @file client/transfer_loop.cpp
+ * @brief Implementation of event loop driving multiple client sessions at once
+ * @author Lukas Vecerka (xvecer30)
+*/
+#include "client/transfer_loop.hpp"
+#include "common/packets.hpp"
+#include "common/logger.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <sys/socket.h>
+
+void TransferLoop::add(std::unique_ptr<ClientSession> session, DoneCallback onDone){
+    entries.push_back({std::move(session), std::move(onDone), {}, false});
+    armDeadline(entries.back());
+}
+
+bool TransferLoop::empty() const {
+    return entries.empty();
+}
+
+void TransferLoop::armDeadline(Entry& entry){
+    entry.deadline = std::chrono::steady_clock::now() + std::chrono::seconds(entry.session->timeout);
+}
+
+std::vector<pollfd> TransferLoop::pollFds() const {
+    std::vector<pollfd> fds;
+    fds.reserve(entries.size());
+    for (const auto& entry : entries) {
+        fds.push_back({entry.session->sessionSockfd, POLLIN, 0});
+    }
+    return fds;
+}
+
+int TransferLoop::timeoutMs() const {
+    if (entries.empty()) {
+        return -1;
+    }
+    auto nearest = entries.front().deadline;
+    for (const auto& entry : entries) {
+        nearest = std::min(nearest, entry.deadline);
+    }
+    auto now = std::chrono::steady_clock::now();
+    return std::max<int64_t>(0, std::chrono::duration_cast<std::chrono::milliseconds>(nearest - now).count() + 1);
+}
+
+void TransferLoop::runOnce(int maxWaitMs){
+    if (entries.empty()) {
+        return;
+    }
+
+    // Wait at most until nearest retransmission deadline
+    std::vector<pollfd> fds = pollFds();
+    int waitMs = timeoutMs();
+    if (maxWaitMs >= 0) {
+        waitMs = std::min(waitMs, maxWaitMs);
+    }
+
+    if (poll(fds.data(), fds.size(), waitMs) < 0 && errno != EINTR) {
+        Logger::instance().log("Failed to poll sessions");
+        abortAll();
+        return;
+    }
+    process(fds);
+}
+
+void TransferLoop::process(const std::vector<pollfd>& fds){
+    // SIGINT termination of all sessions
+    if (stopFlagClient->load()) {
+        abortAll();
+        return;
+    }
+
+    auto now = std::chrono::steady_clock::now();
+    char buffer[BUFFER_SIZE];
+    for (size_t i = 0; i < entries.size() && i < fds.size(); i++) {
+        Entry& entry = entries[i];
+        ClientSession& session = *entry.session;
+
+        if (fds[i].revents & (POLLIN | POLLERR)) {
+            // Drain everything which is queued on socket, session can end in the middle
+            while (!entry.finished) {
+                ssize_t received_bytes = session.transport->receive(session.sessionSockfd, buffer, sizeof(buffer), session.dst_addr, MSG_DONTWAIT);
+                if (received_bytes < 0) {
+                    if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                        Logger::instance().log("Failed to receive data");
+                        session.sessionState = SessionState::ERROR;
+                        session.exit();
+                        entry.finished = true;
+                    }
+                    break;
+                }
+                entry.finished = !session.handleDatagram(buffer, received_bytes);
+                armDeadline(entry);
+            }
+        } else if (now >= entry.deadline) {
+            entry.finished = !session.handleTimeout();
+            armDeadline(entry);
+        }
+    }
+    reap();
+}
+
+void TransferLoop::abortAll(){
+    for (auto& entry : entries) {
+        entry.session->sessionState = SessionState::ERROR;
+        entry.session->exit();
+        entry.finished = true;
+    }
+    reap();
+}
+
+void TransferLoop::run(){
+    while (!entries.empty()) {
+        runOnce();
+    }
+}
+
+void TransferLoop::reap(){
+    std::vector<Entry> finished;
+    auto it = std::stable_partition(entries.begin(), entries.end(), [](const Entry& entry) { return !entry.finished; });
+    std::move(it, entries.end(), std::back_inserter(finished));
+    entries.erase(it, entries.end());
+
+    // Callbacks can add new sessions, so they are invoked after entries are consistent
+    for (auto& entry : finished) {
+        if (entry.onDone) {
+            entry.onDone(*entry.session);
+        }
+    }
+}
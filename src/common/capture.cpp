@@ -0,0 +1,228 @@
+/**
+ * @file common/capture.cpp
+ * @brief Implementation of capture of workload
+ * @author Lukas Vecerka (xvecer30)
+*/
+#include "common/capture.hpp"
+#include "common/packet_view.hpp"
+#include "common/logger.hpp"
+#include <fstream>
+#include <sstream>
+#include <unordered_map>
+#include <stdexcept>
+#include <algorithm>
+#include <arpa/inet.h>
+
+/**
+ * @brief Function for escaping field, so tabs and newlines of filename don't break line
+ * @param value Field
+ * @return Escaped field
+*/
+static std::string escapeField(std::string_view value){
+    std::string escaped;
+    escaped.reserve(value.size());
+    for (char c : value) {
+        switch (c) {
+            case '\t': escaped += "\\t"; break;
+            case '\n': escaped += "\\n"; break;
+            case '\r': escaped += "\\r"; break;
+            case '\\': escaped += "\\\\"; break;
+            default: escaped += c;
+        }
+    }
+    return escaped;
+}
+
+/**
+ * @brief Function for reverting escapeField
+ * @param value Escaped field
+ * @return Field
+*/
+static std::string unescapeField(const std::string& value){
+    std::string field;
+    field.reserve(value.size());
+    for (size_t i = 0; i < value.size(); i++) {
+        if (value[i] == '\\' && i + 1 < value.size()) {
+            char next = value[++i];
+            field += next == 't' ? '\t' : next == 'n' ? '\n' : next == 'r' ? '\r' : next;
+        } else {
+            field += value[i];
+        }
+    }
+    return field;
+}
+
+bool Capture::open(const std::string& path){
+    std::lock_guard<std::mutex> lock(mutex);
+    file = fopen(path.c_str(), "w");
+    if (file == nullptr) {
+        Logger::instance().log(LogLevel::ERROR, "Failed to create capture file " + path);
+        return false;
+    }
+    // Lines are flushed one by one, so capture of killed server stays readable
+    setvbuf(file, nullptr, _IOLBF, 0);
+    start = std::chrono::steady_clock::now();
+    fprintf(file, "%s\n", CAPTURE_HEADER);
+    enabled.store(true);
+    Logger::instance().log("Capturing requests into " + path);
+    return true;
+}
+
+uint64_t Capture::recordRequest(const sockaddr_in& client, const char* request, size_t size, std::chrono::steady_clock::time_point received){
+    PacketView packet;
+    try {
+        packet = PacketView::parse(request, size);
+    } catch (const std::exception& e) {
+        return 0;
+    }
+    if (packet.opcode != Opcode::RRQ && packet.opcode != Opcode::WRQ) {
+        return 0;
+    }
+    // Only supported options are kept, unknown options are ignored by server anyway
+    OptionTable options;
+    packet.forEachOption([&options](const OptionView& option) {
+        std::optional<OptionId> id = findOption(option.name);
+        std::optional<uint64_t> value = parseOptionValue(option.value);
+        if (id && value) {
+            options.set(*id, *value);
+        }
+    });
+
+    char ip[INET_ADDRSTRLEN];
+    inet_ntop(AF_INET, &client.sin_addr, ip, sizeof(ip));
+    uint64_t id = nextId.fetch_add(1, std::memory_order_relaxed);
+    uint64_t offsetUs = std::chrono::duration_cast<std::chrono::microseconds>(received - start).count();
+    std::ostringstream line;
+    line << "R\t" << id << "\t" << offsetUs << "\t" << ip << ":" << ntohs(client.sin_port) << "\t"
+         << (packet.opcode == Opcode::RRQ ? "RRQ" : "WRQ") << "\t" << escapeField(packet.mode) << "\t"
+         << formatCaptureOptions(options) << "\t" << escapeField(packet.filename);
+    write(line.str());
+    return id;
+}
+
+void Capture::recordEnd(uint64_t id, bool ok, uint64_t bytes, std::chrono::steady_clock::time_point received){
+    auto now = std::chrono::steady_clock::now();
+    std::ostringstream line;
+    line << "E\t" << id << "\t" << std::chrono::duration_cast<std::chrono::microseconds>(now - start).count() << "\t"
+         << (ok ? "ok" : "fail") << "\t" << bytes << "\t"
+         << std::chrono::duration_cast<std::chrono::microseconds>(now - received).count();
+    write(line.str());
+}
+
+void Capture::write(const std::string& line){
+    std::lock_guard<std::mutex> lock(mutex);
+    fprintf(file, "%s\n", line.c_str());
+}
+
+std::string formatCaptureOptions(const OptionTable& options){
+    std::string text;
+    options.forEach([&text](OptionId id, uint64_t value) {
+        if (!text.empty()) {
+            text += ",";
+        }
+        text += std::string(optionName(id)) + "=" + std::to_string(value);
+    });
+    return text.empty() ? "-" : text;
+}
+
+/**
+ * @brief Function for parsing options of capture
+ * @param text Options as name=value separated by commas, "-" if there is no option
+ * @return Parsed options
+ * @throw std::invalid_argument if option is invalid
+*/
+static OptionTable parseCaptureOptions(const std::string& text){
+    OptionTable options;
+    if (text == "-") {
+        return options;
+    }
+    std::stringstream stream(text);
+    std::string item;
+    while (std::getline(stream, item, ',')) {
+        size_t equals = item.find('=');
+        std::optional<OptionId> id = findOption(item.substr(0, equals));
+        std::optional<uint64_t> value = equals == std::string::npos ? std::nullopt : parseOptionValue(std::string_view(item).substr(equals + 1));
+        if (!id || !value) {
+            throw std::invalid_argument(item);
+        }
+        options.set(*id, *value);
+    }
+    return options;
+}
+
+std::vector<CapturedSession> loadCapture(const std::string& path){
+    std::ifstream file(path);
+    if (!file) {
+        throw std::runtime_error("Failed to open capture " + path);
+    }
+    std::string line;
+    if (!std::getline(file, line) || line != CAPTURE_HEADER) {
+        throw std::runtime_error(path + " is not capture of tftp-server");
+    }
+
+    std::vector<CapturedSession> sessions;
+    // Id of record to index of session, retransmitted requests point to -1 so their end is ignored
+    std::unordered_map<uint64_t, int64_t> records;
+    std::unordered_map<std::string, size_t> lastOfClient;
+    size_t number = 1;
+    while (std::getline(file, line)) {
+        number++;
+        if (line.empty()) {
+            continue;
+        }
+        std::vector<std::string> fields;
+        std::stringstream stream(line);
+        std::string field;
+        while (std::getline(stream, field, '\t')) {
+            fields.push_back(field);
+        }
+        try {
+            if (fields[0] == "R" && fields.size() == 8) {
+                CapturedSession session;
+                session.id = std::stoull(fields[1]);
+                session.offsetUs = std::stoull(fields[2]);
+                session.client = fields[3];
+                if (fields[4] != "RRQ" && fields[4] != "WRQ") {
+                    throw std::invalid_argument(fields[4]);
+                }
+                session.type = fields[4] == "RRQ" ? SessionType::READ : SessionType::WRITE;
+                session.mode = stringToMode(unescapeField(fields[5]));
+                session.options = parseCaptureOptions(fields[6]);
+                session.filename = unescapeField(fields[7]);
+
+                // Same request from same port while first session runs was retransmitted by client
+                auto last = lastOfClient.find(session.client);
+                if (last != lastOfClient.end()) {
+                    CapturedSession& previous = sessions[last->second];
+                    if (!previous.finished && previous.type == session.type && previous.filename == session.filename) {
+                        previous.requests++;
+                        records[session.id] = -1;
+                        continue;
+                    }
+                }
+                records[session.id] = sessions.size();
+                lastOfClient[session.client] = sessions.size();
+                sessions.push_back(session);
+            } else if (fields[0] == "E" && fields.size() == 6) {
+                auto record = records.find(std::stoull(fields[1]));
+                if (record == records.end() || record->second < 0) {
+                    continue;
+                }
+                CapturedSession& session = sessions[record->second];
+                session.finished = true;
+                session.ok = fields[3] == "ok";
+                session.bytes = std::stoull(fields[4]);
+                session.durationUs = std::stoull(fields[5]);
+            } else {
+                throw std::invalid_argument(fields[0]);
+            }
+        } catch (const std::exception& e) {
+            throw std::runtime_error("Invalid record on line " + std::to_string(number) + " of " + path);
+        }
+    }
+    // Sessions record their requests concurrently, so lines are not strictly ordered by arrival
+    std::stable_sort(sessions.begin(), sessions.end(), [](const CapturedSession& a, const CapturedSession& b) {
+        return a.offsetUs < b.offsetUs;
+    });
+    return sessions;
+}
@@ -0,0 +1,46 @@
+/**
+ * @file common/download_sink.cpp
+ * @brief Implementation of destinations of downloaded data
+ * @author Lukas Vecerka (xvecer30)
+*/
+#include "common/download_sink.hpp"
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <unistd.h>
+
+void MemorySink::write(const char* buffer, size_t size){
+    data.insert(data.end(), buffer, buffer + size);
+}
+
+void DiscardSink::write(const char* buffer, size_t size){
+    (void)buffer;
+    written += size;
+}
+
+FdSink::FdSink(int fd, bool ownsFd, int64_t offset)
+    : fd(fd), ownsFd(ownsFd), offset(offset) {}
+
+FdSink::~FdSink(){
+    if (ownsFd) {
+        close(fd);
+    }
+}
+
+void FdSink::write(const char* buffer, size_t size){
+    size_t written = 0;
+    while (written < size) {
+        ssize_t count = offset < 0 ? ::write(fd, buffer + written, size - written) : pwrite(fd, buffer + written, size - written, offset + written);
+        if (count < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            throw std::runtime_error("Failed to write data: " + std::string(strerror(errno)));
+        }
+        written += count;
+    }
+    if (offset >= 0) {
+        offset += written;
+    }
+}
@@ -0,0 +1,333 @@
+/**
+ * @file common/logger.cpp
+ * @brief Implementation of per-thread rings of logger and of background thread which writes them
+ * @author Lukas Vecerka (xvecer30)
+*/
+#include "common/logger.hpp"
+#include "common/session.hpp"
+#include <array>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <arpa/inet.h>
+
+static_assert((LOG_RING_SIZE & (LOG_RING_SIZE - 1)) == 0, "Size of log ring has to be power of two");
+
+/**
+ * @brief Enum for kinds of records in ring
+ * @note SKIP - rest of ring until its end is unused, next record starts at the beginning
+ * @note TEXT - formatted message
+ * @note PACKET - binary fields of packet, line is formatted when record is written
+*/
+enum class LogKind : uint8_t {
+    SKIP,
+    TEXT,
+    PACKET
+};
+
+/**
+ * @brief Fixed header of every record in ring, it is followed by text
+ * @note size - size of header with text rounded up to 8 bytes
+ * @note sequence - global order of record, records of all threads are written in this order
+*/
+struct LogRecord {
+    uint32_t size;
+    uint32_t textSize;
+    uint64_t sequence;
+    sockaddr_in addr;
+    uint16_t localPort;
+    uint16_t number;
+    LogKind kind;
+    LogLevel level;
+    LogDirection direction;
+    uint8_t opcode;
+};
+
+/**
+ * @brief Ring of records written by one thread and read by background thread, neither side locks
+*/
+class LogRing {
+public:
+    std::atomic<uint64_t> dropped{0};
+    std::atomic<bool> retired{false};
+
+    /**
+     * @brief Function for putting record into ring, called only by owning thread
+     * @param record The record, its size is filled in
+     * @param text Text stored after record
+     * @return false if there is not enough space and record was dropped
+    */
+    bool push(LogRecord& record, std::string_view text){
+        record.textSize = text.size();
+        record.size = (sizeof(LogRecord) + text.size() + 7) & ~static_cast<size_t>(7);
+        uint64_t current = head.load(std::memory_order_relaxed);
+        size_t offset = current % LOG_RING_SIZE;
+        size_t contiguous = LOG_RING_SIZE - offset;
+        // record is never split, rest of ring is skipped when record doesn't fit before its end
+        size_t skip = contiguous < record.size ? contiguous : 0;
+        if (current + skip + record.size - tail.load(std::memory_order_acquire) > LOG_RING_SIZE) {
+            dropped.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+        if (skip >= sizeof(LogRecord)) {
+            LogRecord marker{};
+            marker.size = skip;
+            marker.kind = LogKind::SKIP;
+            std::memcpy(buffer.data() + offset, &marker, sizeof(marker));
+        }
+        current += skip;
+        offset = current % LOG_RING_SIZE;
+        std::memcpy(buffer.data() + offset, &record, sizeof(record));
+        std::memcpy(buffer.data() + offset + sizeof(record), text.data(), text.size());
+        head.store(current + record.size, std::memory_order_release);
+        return true;
+    }
+
+    /**
+     * @brief Function for reading oldest record without removing it, called only by background thread
+     * @param record The record
+     * @return Text of record, nullptr if ring is empty
+    */
+    const char* peek(LogRecord& record){
+        uint64_t current = tail.load(std::memory_order_relaxed);
+        uint64_t end = head.load(std::memory_order_acquire);
+        while (current < end) {
+            size_t offset = current % LOG_RING_SIZE;
+            size_t contiguous = LOG_RING_SIZE - offset;
+            if (contiguous < sizeof(LogRecord)) {
+                // no header fits before end of ring, writer skipped it without marker
+                current += contiguous;
+                continue;
+            }
+            std::memcpy(&record, buffer.data() + offset, sizeof(record));
+            if (record.kind == LogKind::SKIP) {
+                current += record.size;
+                continue;
+            }
+            tail.store(current, std::memory_order_release);
+            return buffer.data() + offset + sizeof(record);
+        }
+        tail.store(current, std::memory_order_release);
+        return nullptr;
+    }
+
+    /**
+     * @brief Function for removing record returned by peek
+     * @param record The record
+    */
+    void pop(const LogRecord& record){
+        tail.store(tail.load(std::memory_order_relaxed) + record.size, std::memory_order_release);
+    }
+
+    bool empty() const {
+        return tail.load(std::memory_order_acquire) == head.load(std::memory_order_acquire);
+    }
+
+private:
+    alignas(64) std::atomic<uint64_t> head{0};
+    alignas(64) std::atomic<uint64_t> tail{0};
+    alignas(8) std::array<char, LOG_RING_SIZE> buffer;
+};
+
+/**
+ * @brief Owner of ring of thread, ring is retired when thread ends and background thread frees it once it is empty
+*/
+struct RingHolder {
+    std::shared_ptr<LogRing> ring;
+    ~RingHolder() {
+        if (ring) {
+            ring->retired.store(true, std::memory_order_release);
+        }
+    }
+};
+
+/**
+ * @brief Function for getting name of opcode
+ * @param opcode The opcode
+ * @return Name of packet
+*/
+static const char* opcodeName(uint8_t opcode){
+    switch (opcode) {
+        case Opcode::RRQ: return "RRQ";
+        case Opcode::WRQ: return "WRQ";
+        case Opcode::DATA: return "DATA";
+        case Opcode::ACK: return "ACK";
+        case Opcode::ERROR: return "ERROR";
+        case Opcode::OACK: return "OACK";
+        default: return "UNKNOWN";
+    }
+}
+
+/**
+ * @brief Function for formatting record into line
+ * @param record The record
+ * @param text Text of record
+ * @param line The line, it is cleared first
+*/
+static void formatRecord(const LogRecord& record, const char* text, std::string& line){
+    line.clear();
+    if (record.kind == LogKind::PACKET) {
+        char ip[INET_ADDRSTRLEN];
+        inet_ntop(AF_INET, &record.addr.sin_addr, ip, sizeof(ip));
+        if (record.direction == LogDirection::SENT) {
+            line += "=> ";
+        }
+        line += opcodeName(record.opcode);
+        line += ' ';
+        line += ip;
+        line += ':';
+        line += std::to_string(ntohs(record.addr.sin_port));
+        if (record.localPort != 0) {
+            line += ':';
+            line += std::to_string(record.localPort);
+        }
+        if (record.opcode == Opcode::DATA || record.opcode == Opcode::ACK || record.opcode == Opcode::ERROR) {
+            line += ' ';
+            line += std::to_string(record.number);
+        }
+        if (record.textSize > 0) {
+            line += ' ';
+        }
+    }
+    line.append(text, record.textSize);
+    line += '\n';
+}
+
+std::optional<LogLevel> Logger::parseLevel(std::string_view name){
+    if (name == "error") {
+        return LogLevel::ERROR;
+    }
+    if (name == "info") {
+        return LogLevel::INFO;
+    }
+    if (name == "debug") {
+        return LogLevel::DEBUG;
+    }
+    return std::nullopt;
+}
+
+void Logger::packet(LogDirection direction, uint8_t opcode, const sockaddr_in& addr, uint16_t localPort, uint16_t number, std::string_view detail){
+    if (!isEnabled(LogLevel::DEBUG)) {
+        return;
+    }
+    LogRecord record{};
+    record.kind = LogKind::PACKET;
+    record.level = LogLevel::DEBUG;
+    record.direction = direction;
+    record.opcode = opcode;
+    record.addr = addr;
+    record.localPort = localPort;
+    record.number = number;
+    push(record, detail);
+}
+
+void Logger::text(LogLevel level, bool toStderr, std::string_view message){
+    LogRecord record{};
+    record.kind = LogKind::TEXT;
+    record.level = level;
+    record.direction = toStderr ? LogDirection::RECEIVED : LogDirection::SENT;
+    push(record, message);
+}
+
+void Logger::push(LogRecord& record, std::string_view detail){
+    LogRing* ring = threadRing();
+    if (ring == nullptr) {
+        return;
+    }
+    record.sequence = sequence.fetch_add(1, std::memory_order_relaxed);
+    ring->push(record, detail.substr(0, LOG_MAX_MESSAGE_SIZE));
+}
+
+LogRing* Logger::threadRing(){
+    thread_local RingHolder holder;
+    if (!holder.ring) {
+        std::lock_guard<std::mutex> lock(ringsMutex);
+        {
+            std::lock_guard<std::mutex> wakeLock(wakeMutex);
+            if (stopping) {
+                return nullptr;
+            }
+        }
+        holder.ring = std::make_shared<LogRing>();
+        rings.push_back(holder.ring);
+        if (!writer.joinable()) {
+            writer = std::thread(&Logger::run, this);
+            std::atexit([]() { Logger::instance().shutdown(); });
+        }
+    }
+    return holder.ring.get();
+}
+
+void Logger::drain(){
+    std::lock_guard<std::mutex> drainLock(drainMutex);
+    std::vector<std::shared_ptr<LogRing>> current;
+    {
+        std::lock_guard<std::mutex> lock(ringsMutex);
+        current = rings;
+    }
+
+    std::string line;
+    while (true) {
+        // record with the lowest sequence among heads of rings is the oldest one
+        LogRing* oldest = nullptr;
+        LogRecord oldestRecord{};
+        const char* oldestText = nullptr;
+        for (const auto& ring : current) {
+            LogRecord record;
+            const char* text = ring->peek(record);
+            if (text != nullptr && (oldest == nullptr || record.sequence < oldestRecord.sequence)) {
+                oldest = ring.get();
+                oldestRecord = record;
+                oldestText = text;
+            }
+        }
+        if (oldest == nullptr) {
+            break;
+        }
+        formatRecord(oldestRecord, oldestText, line);
+        oldest->pop(oldestRecord);
+        std::fwrite(line.data(), 1, line.size(), oldestRecord.direction == LogDirection::SENT ? stdout : stderr);
+    }
+
+    uint64_t dropped = 0;
+    for (const auto& ring : current) {
+        dropped += ring->dropped.exchange(0, std::memory_order_relaxed);
+    }
+    if (dropped > 0) {
+        std::fprintf(stderr, "Logger dropped %llu messages\n", static_cast<unsigned long long>(dropped));
+    }
+    std::fflush(stdout);
+    std::fflush(stderr);
+
+    // rings of finished threads are freed once they are empty
+    std::lock_guard<std::mutex> lock(ringsMutex);
+    std::erase_if(rings, [](const std::shared_ptr<LogRing>& ring) {
+        return ring->retired.load(std::memory_order_acquire) && ring->empty();
+    });
+}
+
+void Logger::run(){
+    std::unique_lock<std::mutex> lock(wakeMutex);
+    while (!stopping) {
+        lock.unlock();
+        drain();
+        lock.lock();
+        wake.wait_for(lock, std::chrono::milliseconds(LOG_FLUSH_INTERVAL_MS), [this]() { return stopping; });
+    }
+}
+
+void Logger::shutdown(){
+    {
+        std::lock_guard<std::mutex> lock(wakeMutex);
+        if (stopping) {
+            return;
+        }
+        stopping = true;
+    }
+    wake.notify_one();
+    if (writer.joinable()) {
+        writer.join();
+    }
+    drain();
+}
@@ -0,0 +1,212 @@
+/**
+ * @file common/metrics.cpp
+ * @brief Implementation of metrics shards and their formatting into Prometheus text format
+ * @author Lukas Vecerka (xvecer30)
+*/
+#include "common/metrics.hpp"
+#include <bit>
+#include <algorithm>
+#include <cstdio>
+
+/**
+ * @brief Owner of shard of thread, shard is given back to metrics when thread ends
+*/
+struct MetricsShardHolder {
+    MetricsShard* shard = nullptr;
+    ~MetricsShardHolder() {
+        if (shard != nullptr) {
+            Metrics::instance().release(shard);
+        }
+    }
+};
+
+/**
+ * @brief Structure with metric name and help of histogram
+*/
+struct HistogramInfo {
+    const char* name;
+    const char* help;
+};
+
+static const HistogramInfo histogramInfo[] = {
+    {"tftp_time_to_first_block_seconds", "Time from request to first DATA sent (RRQ) or received (WRQ)"},
+    {"tftp_transfer_duration_seconds", "Time from request to end of completed transfer"},
+    {"tftp_window_rtt_seconds", "Time from sending window to its first ACK, retransmitted windows are skipped"},
+};
+static_assert(sizeof(histogramInfo) / sizeof(histogramInfo[0]) == static_cast<size_t>(Histogram::COUNT), "Every histogram needs its name");
+
+size_t Metrics::bucketIndex(uint64_t usec){
+    if (usec < METRICS_SUB_BUCKETS) {
+        return usec;
+    }
+    // exponent is at least 3, bits below the 3 highest ones select sub bucket
+    size_t exponent = std::bit_width(usec) - 1;
+    if (exponent > METRICS_MAX_EXPONENT) {
+        return METRICS_HISTOGRAM_BUCKETS - 1;
+    }
+    size_t sub = (usec >> (exponent - 3)) & (METRICS_SUB_BUCKETS - 1);
+    return (exponent - 2) * METRICS_SUB_BUCKETS + sub;
+}
+
+uint64_t Metrics::bucketUpperBound(size_t index){
+    if (index < METRICS_SUB_BUCKETS) {
+        return index;
+    }
+    size_t exponent = index / METRICS_SUB_BUCKETS + 2;
+    uint64_t sub = index % METRICS_SUB_BUCKETS;
+    return ((METRICS_SUB_BUCKETS + sub + 1) << (exponent - 3)) - 1;
+}
+
+static_assert(METRICS_SUB_BUCKETS == 8, "Bucket index assumes 3 bits of sub bucket");
+static_assert(METRICS_EXPORTED_MAX_EXPONENT < METRICS_MAX_EXPONENT, "Exported bounds have to end before last bucket");
+
+void Metrics::observe(Histogram histogram, std::chrono::steady_clock::duration duration){
+    uint64_t usec = std::max<int64_t>(std::chrono::duration_cast<std::chrono::microseconds>(duration).count(), 0);
+    MetricsShard* shard = threadShard();
+    size_t index = static_cast<size_t>(histogram);
+    increase(shard->buckets[index][bucketIndex(usec)], 1);
+    increase(shard->sumsUsec[index], usec);
+}
+
+void Metrics::release(MetricsShard* shard){
+    std::lock_guard<std::mutex> lock(shardsMutex);
+    freeShards.push_back(shard);
+}
+
+MetricsShard* Metrics::threadShard(){
+    thread_local MetricsShardHolder holder;
+    if (holder.shard == nullptr) {
+        std::lock_guard<std::mutex> lock(shardsMutex);
+        if (!freeShards.empty()) {
+            holder.shard = freeShards.back();
+            freeShards.pop_back();
+        } else {
+            // shards are never freed, their counters are part of totals
+            holder.shard = new MetricsShard();
+            shards.push_back(holder.shard);
+        }
+    }
+    return holder.shard;
+}
+
+/**
+ * @brief Function for appending HELP and TYPE lines of metric
+ * @param out The output
+ * @param name Name of metric
+ * @param type Type of metric
+ * @param help Description of metric
+*/
+static void header(std::string& out, const char* name, const char* type, const char* help){
+    out += "# HELP ";
+    out += name;
+    out += ' ';
+    out += help;
+    out += "\n# TYPE ";
+    out += name;
+    out += ' ';
+    out += type;
+    out += '\n';
+}
+
+/**
+ * @brief Function for appending one sample
+ * @param out The output
+ * @param name Name of metric with labels
+ * @param value Value of sample
+*/
+static void sample(std::string& out, const std::string& name, uint64_t value){
+    out += name;
+    out += ' ';
+    out += std::to_string(value);
+    out += '\n';
+}
+
+/**
+ * @brief Function for formatting microseconds as exact decimal number of seconds
+ * @param usec Time in microseconds
+ * @return Seconds with all 6 decimal places
+*/
+static std::string seconds(uint64_t usec){
+    char text[32];
+    std::snprintf(text, sizeof(text), "%llu.%06llu", static_cast<unsigned long long>(usec / 1000000), static_cast<unsigned long long>(usec % 1000000));
+    return text;
+}
+
+std::string Metrics::render(){
+    std::array<uint64_t, static_cast<size_t>(Counter::COUNT)> counters{};
+    std::array<uint64_t, METRICS_ERROR_CODES> errorsSent{};
+    std::vector<std::array<uint64_t, METRICS_HISTOGRAM_BUCKETS>> buckets(static_cast<size_t>(Histogram::COUNT));
+    std::array<uint64_t, static_cast<size_t>(Histogram::COUNT)> sumsUsec{};
+    {
+        // shards are only read, threads keep updating them while they are summed
+        std::lock_guard<std::mutex> lock(shardsMutex);
+        for (const MetricsShard* shard : shards) {
+            for (size_t i = 0; i < counters.size(); i++) {
+                counters[i] += shard->counters[i].load(std::memory_order_relaxed);
+            }
+            for (size_t i = 0; i < errorsSent.size(); i++) {
+                errorsSent[i] += shard->errorsSent[i].load(std::memory_order_relaxed);
+            }
+            for (size_t h = 0; h < buckets.size(); h++) {
+                for (size_t i = 0; i < METRICS_HISTOGRAM_BUCKETS; i++) {
+                    buckets[h][i] += shard->buckets[h][i].load(std::memory_order_relaxed);
+                }
+                sumsUsec[h] += shard->sumsUsec[h].load(std::memory_order_relaxed);
+            }
+        }
+    }
+    auto counter = [&counters](Counter id) { return counters[static_cast<size_t>(id)]; };
+
+    std::string out;
+    header(out, "tftp_sessions_active", "gauge", "Sessions which are running");
+    // gauge is increased and decreased in different shards, so sum is computed with wrap around
+    sample(out, "tftp_sessions_active{type=\"read\"}", counter(Counter::READ_SESSIONS_ACTIVE));
+    sample(out, "tftp_sessions_active{type=\"write\"}", counter(Counter::WRITE_SESSIONS_ACTIVE));
+    header(out, "tftp_sessions_total", "counter", "Sessions which ended");
+    sample(out, "tftp_sessions_total{type=\"read\",result=\"completed\"}", counter(Counter::READ_SESSIONS_COMPLETED));
+    sample(out, "tftp_sessions_total{type=\"read\",result=\"failed\"}", counter(Counter::READ_SESSIONS_FAILED));
+    sample(out, "tftp_sessions_total{type=\"write\",result=\"completed\"}", counter(Counter::WRITE_SESSIONS_COMPLETED));
+    sample(out, "tftp_sessions_total{type=\"write\",result=\"failed\"}", counter(Counter::WRITE_SESSIONS_FAILED));
+    header(out, "tftp_blocks_total", "counter", "DATA packets, sent ones include retransmissions");
+    sample(out, "tftp_blocks_total{direction=\"sent\"}", counter(Counter::BLOCKS_SENT));
+    sample(out, "tftp_blocks_total{direction=\"received\"}", counter(Counter::BLOCKS_RECEIVED));
+    header(out, "tftp_bytes_total", "counter", "Bytes of files served and stored");
+    sample(out, "tftp_bytes_total{direction=\"sent\"}", counter(Counter::BYTES_SENT));
+    sample(out, "tftp_bytes_total{direction=\"received\"}", counter(Counter::BYTES_RECEIVED));
+    header(out, "tftp_retransmissions_total", "counter", "Retransmissions of last packet or window after timeout");
+    sample(out, "tftp_retransmissions_total", counter(Counter::RETRANSMISSIONS));
+    header(out, "tftp_timeouts_total", "counter", "Receive timeouts of sessions");
+    sample(out, "tftp_timeouts_total", counter(Counter::TIMEOUTS));
+    header(out, "tftp_requests_filtered_total", "counter", "Datagrams of listener which were filtered before session was created");
+    sample(out, "tftp_requests_filtered_total{reason=\"malformed\"}", counter(Counter::REQUESTS_MALFORMED));
+    sample(out, "tftp_requests_filtered_total{reason=\"duplicate\"}", counter(Counter::REQUESTS_DUPLICATE));
+    sample(out, "tftp_requests_filtered_total{reason=\"rate_limited\"}", counter(Counter::REQUESTS_RATE_LIMITED));
+    header(out, "tftp_errors_sent_total", "counter", "ERROR packets sent by error code");
+    for (size_t code = 0; code < errorsSent.size(); code++) {
+        sample(out, "tftp_errors_sent_total{code=\"" + std::to_string(code) + "\"}", errorsSent[code]);
+    }
+
+    for (size_t h = 0; h < buckets.size(); h++) {
+        const char* name = histogramInfo[h].name;
+        header(out, name, "histogram", histogramInfo[h].help);
+        // every bound is listed in every scrape, so series of buckets don't appear and disappear and
+        // quantiles over rate() see same bounds in all samples, values are whole microseconds, so bound
+        // 2^k - 1 us ends fine bucket and its count is exact, longer values are reported only as +Inf
+        uint64_t cumulative = 0;
+        size_t i = 0;
+        for (size_t exponent = 1; exponent <= METRICS_EXPORTED_MAX_EXPONENT; exponent++) {
+            uint64_t bound = (uint64_t(1) << exponent) - 1;
+            for (; bucketUpperBound(i) <= bound; i++) {
+                cumulative += buckets[h][i];
+            }
+            sample(out, std::string(name) + "_bucket{le=\"" + seconds(bound) + "\"}", cumulative);
+        }
+        for (; i < METRICS_HISTOGRAM_BUCKETS; i++) {
+            cumulative += buckets[h][i];
+        }
+        sample(out, std::string(name) + "_bucket{le=\"+Inf\"}", cumulative);
+        out += std::string(name) + "_sum " + seconds(sumsUsec[h]) + "\n";
+        sample(out, std::string(name) + "_count", cumulative);
+    }
+    return out;
+}
@@ -0,0 +1,160 @@
+/**
+ * @file common/net_emulator.cpp
+ * @brief Implementation of network emulator
+ * @author Lukas Vecerka (xvecer30)
+*/
+#include "common/net_emulator.hpp"
+#include "common/logger.hpp"
+#include <sstream>
+#include <cstdio>
+#include <fcntl.h>
+#include <unistd.h>
+
+int EmulatorConfig::fate(std::mt19937_64& random, int64_t delaysMs[2]) const{
+    std::uniform_real_distribution<double> percent(0, 100);
+    // dropped datagram looks sent to sender, just like datagram lost in network
+    if (percent(random) < loss) {
+        return 0;
+    }
+    int copies = percent(random) < duplicate ? 2 : 1;
+    for (int i = 0; i < copies; i++) {
+        delaysMs[i] = delayMs;
+        if (jitterMs > 0) {
+            delaysMs[i] += std::uniform_int_distribution<int64_t>(-static_cast<int64_t>(jitterMs), jitterMs)(random);
+        }
+        if (reorder > 0 && percent(random) < reorder) {
+            delaysMs[i] += reorderGapMs;
+        }
+    }
+    return copies;
+}
+
+bool parseEmulatorSpec(const std::string& spec, EmulatorConfig& config){
+    EmulatorConfig parsed;
+    std::stringstream stream(spec);
+    std::string item;
+    while (std::getline(stream, item, ',')) {
+        size_t equals = item.find('=');
+        std::string key = item.substr(0, equals);
+        std::string value = equals == std::string::npos ? "" : item.substr(equals + 1);
+        try {
+            size_t used = 0;
+            if (key == "loss" || key == "duplicate" || key == "reorder") {
+                double percent = std::stod(value, &used);
+                if (percent < 0 || percent > 100) {
+                    throw std::out_of_range(key);
+                }
+                (key == "loss" ? parsed.loss : key == "duplicate" ? parsed.duplicate : parsed.reorder) = percent;
+            } else if (key == "delay" || key == "jitter" || key == "gap") {
+                unsigned long ms = std::stoul(value, &used);
+                (key == "delay" ? parsed.delayMs : key == "jitter" ? parsed.jitterMs : parsed.reorderGapMs) = ms;
+            } else if (key == "seed") {
+                parsed.seed = std::stoull(value, &used);
+            } else {
+                throw std::invalid_argument(key);
+            }
+            if (used != value.size()) {
+                throw std::invalid_argument(value);
+            }
+        } catch (const std::exception& e) {
+            Logger::instance().log(LogLevel::ERROR, "Invalid network emulation \"" + item + "\", expected loss, duplicate, reorder (percent), delay, jitter, gap (ms) or seed");
+            return false;
+        }
+    }
+    config = parsed;
+    return true;
+}
+
+bool NetworkEmulator::configure(const std::string& spec){
+    EmulatorConfig parsed;
+    if (!parseEmulatorSpec(spec, parsed)) {
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+    config = parsed;
+    if (!sender.joinable() && (config.delayMs > 0 || config.jitterMs > 0 || config.reorder > 0)) {
+        sender = std::thread(&NetworkEmulator::run, this);
+    }
+    enabled.store(true);
+    char summary[256];
+    std::snprintf(summary, sizeof(summary), "Emulating network: loss %g%%, delay %u ms, jitter %u ms, duplicate %g%%, reorder %g%% by %u ms, seed %llu",
+        config.loss, config.delayMs, config.jitterMs, config.duplicate, config.reorder, config.reorderGapMs, static_cast<unsigned long long>(config.seed));
+    Logger::instance().log(summary);
+    return true;
+}
+
+EmulatedTransport::EmulatedTransport(const EmulatorConfig& config, uint64_t stream) : config(config) {
+    // seed_seq spreads bits of both numbers, so neighbouring streams aren't correlated
+    std::seed_seq sequence{static_cast<uint32_t>(config.seed), static_cast<uint32_t>(config.seed >> 32),
+        static_cast<uint32_t>(stream), static_cast<uint32_t>(stream >> 32)};
+    random.seed(sequence);
+}
+
+ssize_t EmulatedTransport::send(int socket, const char* data, size_t size, const sockaddr_in& addr){
+    int64_t delaysMs[2];
+    int copies = config.fate(random, delaysMs);
+    if (copies == 0) {
+        return size;
+    }
+    ssize_t result = NetworkEmulator::instance().emit(socket, data, size, addr, delaysMs[0]);
+    if (result >= 0 && copies > 1) {
+        NetworkEmulator::instance().emit(socket, data, size, addr, delaysMs[1]);
+    }
+    return result;
+}
+
+std::unique_ptr<Transport> NetworkEmulator::openTransport(uint64_t stream){
+    if (!isEnabled()) {
+        return nullptr;
+    }
+    std::lock_guard<std::mutex> lock(mutex);
+    return std::make_unique<EmulatedTransport>(config, stream);
+}
+
+std::unique_ptr<Transport> NetworkEmulator::openTransport(){
+    return openTransport(nextStream.fetch_add(1, std::memory_order_relaxed));
+}
+
+ssize_t NetworkEmulator::emit(int socket, const char* data, size_t size, const sockaddr_in& addr, int64_t delayMs){
+    // only delayed copies take lock, datagram sent right away doesn't wait for other sessions
+    if (delayMs <= 0) {
+        return sendto(socket, data, size, 0, (const struct sockaddr*)&addr, sizeof(addr));
+    }
+
+    // socket is duplicated, session can close it or its number can be reused before datagram is due
+    int copy = fcntl(socket, F_DUPFD_CLOEXEC, 0);
+    if (copy < 0) {
+        return -1;
+    }
+    auto due = std::chrono::steady_clock::now() + std::chrono::milliseconds(delayMs);
+    std::lock_guard<std::mutex> lock(mutex);
+    bool earliest = delayed.empty() || due < delayed.top().due;
+    delayed.push({due, sequence++, copy, addr, std::vector<char>(data, data + size)});
+    if (earliest) {
+        wake.notify_one();
+    }
+    return size;
+}
+
+void NetworkEmulator::run(){
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true) {
+        if (delayed.empty()) {
+            wake.wait(lock);
+            continue;
+        }
+        if (wake.wait_until(lock, delayed.top().due) != std::cv_status::timeout && std::chrono::steady_clock::now() < delayed.top().due) {
+            continue;
+        }
+        // sending doesn't block, so it is done under mutex and order of due datagrams is kept
+        while (!delayed.empty() && delayed.top().due <= std::chrono::steady_clock::now()) {
+            const Delayed& datagram = delayed.top();
+            if (sendto(datagram.socket, datagram.data.data(), datagram.data.size(), 0, (const struct sockaddr*)&datagram.addr, sizeof(datagram.addr)) < 0) {
+                Logger::instance().log(LogLevel::ERROR, "Failed to send delayed datagram");
+            }
+            close(datagram.socket);
+            delayed.pop();
+        }
+    }
+}
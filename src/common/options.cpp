@@ -0,0 +1,26 @@
+/**
+ * @file common/options.cpp
+ * @brief Implementation of lookup and parsing of TFTP options
+ * @author Lukas Vecerka (xvecer30)
+*/
+#include "common/options.hpp"
+#include <charconv>
+#include <strings.h>
+
+std::optional<OptionId> findOption(std::string_view name){
+    for (size_t i = 0; i < OPTION_COUNT; i++) {
+        if (name.size() == optionNames[i].size() && strncasecmp(name.data(), optionNames[i].data(), name.size()) == 0) {
+            return static_cast<OptionId>(i);
+        }
+    }
+    return std::nullopt;
+}
+
+std::optional<uint64_t> parseOptionValue(std::string_view value){
+    uint64_t result;
+    auto [end, error] = std::from_chars(value.data(), value.data() + value.size(), result);
+    if (error != std::errc() || end != value.data() + value.size()) {
+        return std::nullopt;
+    }
+    return result;
+}
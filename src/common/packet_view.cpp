@@ -0,0 +1,158 @@
+/**
+ * @file common/packet_view.cpp
+ * @brief Implementation of non-owning view of received packet
+ * @author Lukas Vecerka (xvecer30)
+*/
+#include "common/packet_view.hpp"
+#include "common/exceptions.hpp"
+#include <algorithm>
+#include <strings.h>
+
+/**
+ * @brief Function for finding end of zero terminated string in buffer
+ * @param current Start of string
+ * @param end End of buffer
+ * @return Position of terminating zero, end if string isn't terminated
+*/
+static const char* stringEnd(const char* current, const char* end){
+    return std::find(current, end, '\0');
+}
+
+/**
+ * @brief Function for checking that options consist of terminated name and value pairs
+ * @param current Start of options
+ * @param end End of buffer
+ * @return Error message if name or value is empty or not terminated, nullptr otherwise
+*/
+static const char* checkOptions(const char* current, const char* end){
+    while (current < end) {
+        const char* nameEnd = stringEnd(current, end);
+        if (nameEnd == current || nameEnd == end) {
+            return "Invalid option name";
+        }
+        current = nameEnd + 1;
+        const char* valueEnd = stringEnd(current, end);
+        if (valueEnd == current || valueEnd == end) {
+            return "Invalid option value";
+        }
+        current = valueEnd + 1;
+    }
+    return nullptr;
+}
+
+/**
+ * @brief Function for checking that options consist of terminated name and value pairs
+ * @param current Start of options
+ * @param end End of buffer
+ * @throws OptionError if name or value is empty or not terminated
+*/
+static void validateOptions(const char* current, const char* end){
+    if (const char* message = checkOptions(current, end)) {
+        throw OptionError(message);
+    }
+}
+
+/**
+ * @brief Function for checking mode of RRQ/WRQ, it is compared case insensitively
+ * @param mode Mode as it was sent
+ * @return true if mode is netascii or octet
+*/
+static bool validMode(std::string_view mode){
+    return strncasecmp(mode.data(), "netascii", mode.size() + 1) == 0 || strncasecmp(mode.data(), "octet", mode.size() + 1) == 0;
+}
+
+std::optional<RequestRejection> PacketView::validateRequest(const char* buffer, size_t size){
+    if (size < 4) {
+        return RequestRejection{ErrorCode::ILLEGAL_OPERATION, "Buffer too short for request"};
+    }
+    uint16_t opcode = (static_cast<uint8_t>(buffer[0]) << 8) | static_cast<uint8_t>(buffer[1]);
+    if (opcode != Opcode::RRQ && opcode != Opcode::WRQ) {
+        return RequestRejection{ErrorCode::ILLEGAL_OPERATION, "Illegal TFTP operation"};
+    }
+    const char* end = buffer + size;
+    const char* filenameEnd = stringEnd(buffer + 2, end);
+    if (filenameEnd == buffer + 2 || filenameEnd == end) {
+        return RequestRejection{ErrorCode::ILLEGAL_OPERATION, "Invalid filename"};
+    }
+    const char* modeEnd = stringEnd(filenameEnd + 1, end);
+    if (modeEnd == end || !validMode(std::string_view(filenameEnd + 1, modeEnd - filenameEnd - 1))) {
+        return RequestRejection{ErrorCode::ILLEGAL_OPERATION, "Invalid mode"};
+    }
+    if (const char* message = checkOptions(modeEnd + 1, end)) {
+        return RequestRejection{ErrorCode::INVALID_OPTIONS, message};
+    }
+    return std::nullopt;
+}
+
+PacketView PacketView::parse(const char* buffer, size_t size){
+    if (size < 2) {
+        throw ParsingError("Buffer too short to determine opcode");
+    }
+
+    PacketView view{};
+    const char* end = buffer + size;
+    uint16_t opcode = (static_cast<uint8_t>(buffer[0]) << 8) | static_cast<uint8_t>(buffer[1]);
+
+    switch (opcode) {
+        case Opcode::DATA:
+            if (size < 4) {
+                throw ParsingError("Buffer too short for DATA packet");
+            }
+            view.blockNumber = (static_cast<uint8_t>(buffer[2]) << 8) | static_cast<uint8_t>(buffer[3]);
+            view.payload = std::span<const char>(buffer + 4, size - 4);
+            break;
+        case Opcode::ACK:
+            if (size != 4) {
+                throw ParsingError("Buffer size for ACK packet must be 4");
+            }
+            view.blockNumber = (static_cast<uint8_t>(buffer[2]) << 8) | static_cast<uint8_t>(buffer[3]);
+            break;
+        case Opcode::RRQ:
+        case Opcode::WRQ:
+        {
+            if (size < 4) {
+                throw ParsingError("Buffer too short for WRQ packet");
+            }
+            const char* filenameEnd = stringEnd(buffer + 2, end);
+            if (filenameEnd == buffer + 2 || filenameEnd == end) {
+                throw ParsingError("Invalid filename");
+            }
+            view.filename = std::string_view(buffer + 2, filenameEnd - buffer - 2);
+            const char* modeEnd = stringEnd(filenameEnd + 1, end);
+            view.mode = std::string_view(filenameEnd + 1, modeEnd - filenameEnd - 1);
+            if (modeEnd == end || !validMode(view.mode)) {
+                throw ParsingError("Invalid mode");
+            }
+            validateOptions(modeEnd + 1, end);
+            view.options = std::span<const char>(modeEnd + 1, end);
+            break;
+        }
+        case Opcode::ERROR:
+        {
+            if (size < 5) {
+                throw ParsingError("Buffer too short for ERROR packet");
+            }
+            view.blockNumber = (static_cast<uint8_t>(buffer[2]) << 8) | static_cast<uint8_t>(buffer[3]);
+            if (view.blockNumber > ErrorCode::INVALID_OPTIONS) {
+                throw ParsingError("Invalid error code");
+            }
+            const char* messageEnd = stringEnd(buffer + 4, end);
+            if (messageEnd == end) {
+                throw ParsingError("Invalid error message");
+            }
+            view.payload = std::span<const char>(buffer + 4, messageEnd);
+            break;
+        }
+        case Opcode::OACK:
+            if (size < 4) {
+                throw ParsingError("Buffer too short for OACK packet");
+            }
+            validateOptions(buffer + 2, end);
+            view.options = std::span<const char>(buffer + 2, end);
+            break;
+        default:
+            throw ParsingError("Unknown or unhandled TFTP opcode");
+    }
+    view.opcode = static_cast<Opcode>(opcode);
+    return view;
+}
@@ -5,10 +5,15 @@
 */
 
 #include "common/packets.hpp"
+#include "common/packet_view.hpp"
 #include "common/session.hpp"
 #include "common/exceptions.hpp"
 #include "common/logger.hpp"
+#include "common/metrics.hpp"
+#include "common/probes.hpp"
+#include "common/transport.hpp"
 #include <vector>
+#include <array>
 #include <memory>
 #include <stdexcept>
 #include <iostream>
@@ -17,28 +22,31 @@
 #include <netinet/in.h>
 #include <arpa/inet.h>
 #include <sys/statvfs.h>
+#include <algorithm>
+#include <cstring>
+#include <charconv>
 
-/**
- * @brief Function for filter options, remove options with invalid values
- * @param options The map of options
- * @return The map of options without invalid values
-*/
-std::map<std::string, uint64_t> filterOptions(std::map<std::string, uint64_t> options){
-    if (options.find("blksize") != options.end()){
-        if (options["blksize"] < MIN_BLOCK_SIZE){
-            options.erase("blksize");
-        } else if (options["blksize"] > MAX_BLOCK_SIZE){
-            options["blksize"] = MAX_BLOCK_SIZE;
+OptionTable filterOptions(OptionTable options){
+    if (options.has(OptionId::BLKSIZE)){
+        if (options.get(OptionId::BLKSIZE) < MIN_BLOCK_SIZE){
+            options.erase(OptionId::BLKSIZE);
+        } else if (options.get(OptionId::BLKSIZE) > MAX_BLOCK_SIZE){
+            options.set(OptionId::BLKSIZE, MAX_BLOCK_SIZE);
+        }
+    }
+    if (options.has(OptionId::TIMEOUT)){
+        if (options.get(OptionId::TIMEOUT) < MIN_TIMEOUT || options.get(OptionId::TIMEOUT) > MAX_TIMEOUT){
+            options.erase(OptionId::TIMEOUT);
         }
     }
-    if (options.find("timeout") != options.end()){
-        if (options["timeout"] < MIN_TIMEOUT || options["timeout"] > MAX_TIMEOUT){
-            options.erase("timeout");
+    if (options.has(OptionId::TSIZE)){
+        if (options.get(OptionId::TSIZE) < MIN_TSIZE || options.get(OptionId::TSIZE) > MAX_TSIZE){
+            options.erase(OptionId::TSIZE);
         }
     }
-    if (options.find("tsize") != options.end()){
-        if (options["tsize"] < MIN_TSIZE || options["tsize"] > MAX_TSIZE){
-            options.erase("tsize");
+    if (options.has(OptionId::WINDOWSIZE)){
+        if (options.get(OptionId::WINDOWSIZE) < MIN_WINDOW_SIZE || options.get(OptionId::WINDOWSIZE) > MAX_WINDOW_SIZE){
+            options.erase(OptionId::WINDOWSIZE);
         }
     }
     return options;
@@ -72,7 +80,91 @@ std::pair<std::string, const char*> parseNetasciiString(const char* buffer, cons
     return {result, current};
 }
 
-std::unique_ptr<Packet> Packet::parse(sockaddr_in addr, const char* buffer, size_t bufferSize) {
+/**
+ * @brief Function for writing fixed header of packet, opcode and block number or error code in network order
+ * @param out The buffer to write into
+ * @param end End of buffer
+ * @param opcode Opcode of packet
+ * @param value Block number or error code
+ * @return Position after header
+ * @throws std::length_error if header doesn't fit into buffer
+*/
+static char* putHeader(char* out, const char* end, Opcode opcode, uint16_t value){
+    if (end - out < 4) {
+        throw std::length_error("Packet doesn't fit into buffer");
+    }
+    out[0] = 0;
+    out[1] = static_cast<char>(opcode);
+    out[2] = static_cast<char>(value >> 8);
+    out[3] = static_cast<char>(value & 0xFF);
+    return out + 4;
+}
+
+/**
+ * @brief Function for writing zero terminated string
+ * @param out The buffer to write into
+ * @param end End of buffer
+ * @param value The string
+ * @return Position after terminating zero
+ * @throws std::length_error if string doesn't fit into buffer
+*/
+static char* putString(char* out, const char* end, std::string_view value){
+    if (static_cast<size_t>(end - out) < value.size() + 1) {
+        throw std::length_error("Packet doesn't fit into buffer");
+    }
+    out = std::copy(value.begin(), value.end(), out);
+    *out = '\0';
+    return out + 1;
+}
+
+/**
+ * @brief Function for writing options as zero terminated name and decimal value pairs
+ * @param out The buffer to write into
+ * @param end End of buffer
+ * @param options The options
+ * @return Position after last option
+ * @throws std::length_error if options don't fit into buffer
+*/
+static char* putOptions(char* out, char* end, const OptionTable& options){
+    options.forEach([&out, end](OptionId id, uint64_t value) {
+        out = putString(out, end, optionName(id));
+        auto [valueEnd, error] = std::to_chars(out, end, value);
+        if (error != std::errc() || valueEnd == end) {
+            throw std::length_error("Packet doesn't fit into buffer");
+        }
+        *valueEnd = '\0';
+        out = valueEnd + 1;
+    });
+    return out;
+}
+
+/**
+ * @brief Function for describing options in log
+ * @param options The options
+ * @return name=value pairs separated by space
+*/
+static std::string optionsToString(const OptionTable& options){
+    std::string optMessage = "";
+    options.forEach([&optMessage](OptionId id, uint64_t value) {
+        optMessage += std::string(optionName(id)) + "=" + std::to_string(value) + " ";
+    });
+    return optMessage;
+}
+
+/**
+ * @brief Function for describing options of received packet in log, options are shown as they were sent
+ * @param packet View of packet
+ * @return name=value pairs separated by space
+*/
+static std::string optionsToString(const PacketView& packet){
+    std::string optMessage = "";
+    packet.forEachOption([&optMessage](const OptionView& option) {
+        optMessage += std::string(option.name) + "=" + std::string(option.value) + " ";
+    });
+    return optMessage;
+}
+
+PacketVariant Packet::parse(sockaddr_in addr, const char* buffer, size_t bufferSize) {
     if (bufferSize < 2) {
         throw ParsingError("Buffer too short to determine opcode");
     }
@@ -84,237 +176,172 @@ std::unique_ptr<Packet> Packet::parse(sockaddr_in addr, const char* buffer, size
         case Opcode::WRQ:
             return RequestPacket::parse(addr, buffer, bufferSize);
         case Opcode::DATA:
-            return std::make_unique<DataPacket>(DataPacket::parse(addr, buffer, bufferSize));
+            return DataPacket::parse(addr, buffer, bufferSize);
         case Opcode::ACK:
-            return std::make_unique<ACKPacket>(ACKPacket::parse(addr, buffer, bufferSize));
+            return ACKPacket::parse(addr, buffer, bufferSize);
         case Opcode::ERROR:
-            return std::make_unique<ErrorPacket>(ErrorPacket::parse(addr, buffer, bufferSize));
+            return ErrorPacket::parse(addr, buffer, bufferSize);
         case Opcode::OACK:
-            return std::make_unique<OACKPacket>(OACKPacket::parse(addr, buffer, bufferSize));
+            return OACKPacket::parse(addr, buffer, bufferSize);
         default:
             throw ParsingError("Unknown or unhandled TFTP opcode");
     }
 }
 
+std::vector<char> Packet::serialize() const {
+    std::vector<char> buffer(BUFFER_SIZE);
+    buffer.resize(serializeInto(buffer));
+    return buffer;
+}
+
 /**
- * @brief Function for create unique pointer of Packet class based on opcode
- * @param packet The packet
- * @param opcode The opcode
+ * @brief Function for firing packet_send probe of sent packet
+ * @param session The session, nullptr for packets sent by listener
+ * @param message Serialized packet
+ * @param size Size of packet
 */
-std::unique_ptr<Packet> createPacket(Packet& packet, Opcode opcode) {
-    switch (opcode) {
-        case Opcode::RRQ: return std::make_unique<ReadRequestPacket>(dynamic_cast<ReadRequestPacket&>(packet));
-        case Opcode::WRQ: return std::make_unique<WriteRequestPacket>(dynamic_cast<WriteRequestPacket&>(packet));
-        case Opcode::DATA: return std::make_unique<DataPacket>(dynamic_cast<DataPacket&>(packet));
-        case Opcode::ACK: return std::make_unique<ACKPacket>(dynamic_cast<ACKPacket&>(packet));
-        case Opcode::ERROR: return std::make_unique<ErrorPacket>(dynamic_cast<ErrorPacket&>(packet));
-        case Opcode::OACK: return std::make_unique<OACKPacket>(dynamic_cast<OACKPacket&>(packet));
-        default: return nullptr;
-    }
+static void probeSent(const Session* session, const char* message, size_t size){
+    uint8_t opcode = message[1];
+    uint16_t block = (static_cast<uint8_t>(message[2]) << 8) | static_cast<uint8_t>(message[3]);
+    TFTP_PROBE4(packet_send, session != nullptr ? session->sessionId : 0, opcode, block, opcode == Opcode::DATA ? size - 4 : 0);
 }
 
-void Packet::send(Session* session, int socket) {
-    std::vector<char> message = this->serialize();
-    ssize_t sentBytes = sendto(socket, message.data(), message.size(), 0, (struct sockaddr*)&addr, sizeof(addr));
+void Packet::send(Session* session, int socket, Transport& transport) {
+    if (Logger::instance().isEnabled(LogLevel::DEBUG)) {
+        logSent();
+    }
 
-    if (sentBytes < 0) {
-        Logger::instance().log("Failed to send data");
+    uint64_t sentNs = session != nullptr && Tracer::instance().isEnabled() ? Tracer::now() : 0;
+    // serialized packet is kept for retransmission, so it is serialized directly into buffer of session
+    if (session != nullptr && this->getOpcode() != Opcode::ERROR){
+        if (session->lastMessage.size() < BUFFER_SIZE) {
+            session->lastMessage.resize(BUFFER_SIZE);
+        }
+        session->lastMessageSize = serializeInto(session->lastMessage);
+        session->lastAddr = addr;
+        if (transport.send(socket, session->lastMessage.data(), session->lastMessageSize, addr) < 0) {
+            Logger::instance().log(LogLevel::ERROR, "Failed to send data");
+        } else {
+            session->traceSent(session->lastMessage.data(), session->lastMessageSize, sentNs);
+            probeSent(session, session->lastMessage.data(), session->lastMessageSize);
+        }
         return;
     }
 
-    if (session != nullptr){
-        if (this->getOpcode() != Opcode::ERROR){
-            session->lastPacket = createPacket(*this, this->getOpcode());    
+    // ERROR ends session and isn't retransmitted, it is serialized on stack, so malformed datagrams
+    // answered by listener don't allocate and clear buffer of the largest datagram
+    std::array<char, ERROR_PACKET_BUFFER_SIZE> errorMessage;
+    std::vector<char> otherMessage;
+    std::span<const char> message;
+    if (this->getOpcode() == Opcode::ERROR) {
+        message = std::span<const char>(errorMessage.data(), serializeInto(errorMessage));
+        Metrics::instance().errorSent((static_cast<uint8_t>(message[2]) << 8) | static_cast<uint8_t>(message[3]));
+    } else {
+        otherMessage = this->serialize();
+        message = otherMessage;
+    }
+    if (transport.send(socket, message.data(), message.size(), addr) < 0) {
+        Logger::instance().log(LogLevel::ERROR, "Failed to send data");
+    } else {
+        if (session != nullptr) {
+            session->traceSent(message.data(), message.size(), sentNs);
         }
+        probeSent(session, message.data(), message.size());
     }
 }
 
 
 // REQUEST PACKET
 // Constructor for TFTPRequestPacket
-RequestPacket::RequestPacket(const std::string& filename, DataMode mode, std::map<std::string, uint64_t> options, sockaddr_in addr)
+RequestPacket::RequestPacket(const std::string& filename, DataMode mode, OptionTable options, sockaddr_in addr)
     : filename(filename), mode(mode), options(options) {
         this->addr = addr;
     }
 
-const std::set<std::string> RequestPacket::supportedOptions = {"blksize", "timeout", "tsize"};
-
-std::unique_ptr<RequestPacket> RequestPacket::parse(sockaddr_in addr, const char* buffer, size_t bufferSize) {
-    // parsing write request packet
-    if (bufferSize < 4){
-        throw ParsingError("Buffer too short for WRQ packet");
-    }
-    uint16_t opcode = (static_cast<uint8_t>(buffer[0]) << 8) | static_cast<uint8_t>(buffer[1]);
-    const char* current = buffer + 2;
-
-    // Parse filename
-    const char* filenameEnd = std::find(current, buffer + bufferSize, '\0');
-    std::string filename(current, filenameEnd);
-    if (filename.empty() || filenameEnd == buffer + bufferSize) {
-        throw ParsingError("Invalid filename");
-    }
-    current = filenameEnd+1;
-
-    // Prase mode
-    const char* modeEnd = std::find(current, buffer + bufferSize, '\0');
-    std::string modeStr(current, modeEnd);
-    if (modeStr.empty() || modeEnd == buffer + bufferSize) {
-        throw ParsingError("Invalid mode");
+PacketVariant RequestPacket::parse(sockaddr_in addr, const char* buffer, size_t bufferSize) {
+    // filename and mode are validated in place, only filename is copied
+    PacketView packet = PacketView::parse(buffer, bufferSize);
+    if (packet.opcode != Opcode::RRQ && packet.opcode != Opcode::WRQ) {
+        throw ParsingError("Unknown or unhandled TFTP opcode");
     }
-    current = modeEnd + 1;
-    DataMode mode = stringToMode(modeStr);
+    bool readRequest = packet.opcode == Opcode::RRQ;
+    std::string filename(packet.filename);
+    DataMode mode = packet.mode.size() == 5 ? DataMode::OCTET : DataMode::NETASCII;
 
     // Parse options
-    std::map<std::string, uint64_t> options;
-    std::string optMessage = "";
-    while (current < buffer + bufferSize) {
-
-        // parse option name
-        const char* optionEnd = std::find(current, buffer + bufferSize, '\0');
-        std::string optionName(current, optionEnd);
-        std::transform(optionName.begin(), optionName.end(), optionName.begin(), ::tolower);
-
-        if (optionName.empty() || optionEnd == buffer + bufferSize) {
-            throw OptionError("Invalid option name");
+    OptionTable options;
+    packet.forEachOption([&options, readRequest](const OptionView& option) {
+        std::optional<OptionId> id = findOption(option.name);
+        // filter unsupported options
+        if (!id) {
+            options.unknownOptions++;
+            return;
         }
 
         // Check if the option already exists
-        if (options.find(optionName) != options.end()) {
+        if (options.has(*id)) {
             throw OptionError("Option occurs multiple times");
         }
-        current = optionEnd + 1;
 
-        // parse option value
-        const char* valueEnd = std::find(current, buffer + bufferSize, '\0');
-        std::string optionValueStr(current, valueEnd);
-        if (optionValueStr.empty() || valueEnd == buffer + bufferSize) {
-            throw OptionError("Invalid option value");
+        std::optional<uint64_t> value = parseOptionValue(option.value);
+        if (!value) {
+            return;
         }
-        current = valueEnd + 1;
 
-        optMessage += optionName + "=" + optionValueStr + " ";
-
-        // filter unsupported options
-        if (supportedOptions.find(optionName) == supportedOptions.end()) {
-            continue;
+        // if client send RRQ with tsize option but value is not 0, remove tsize option
+        if (*id == OptionId::TSIZE && readRequest && *value != 0){
+            return;
         }
 
-        // convert option value to uint64_t
-        uint64_t optionValue;
-        try{
-            optionValue = std::stoull(optionValueStr);
-        } catch (const std::exception& e){
-            options.erase(optionName);
-            continue;
+        // byte range can be requested only for download
+        if ((*id == OptionId::RANGESTART || *id == OptionId::RANGESIZE) && !readRequest){
+            return;
         }
 
-        // if client send RRQ with tsize option but value is not 0, remove tsize option
-        if (optionName == "tsize" && opcode == 1 && optionValue != 0){
-            options.erase("tsize");
-            continue;
-        }
-
-        options[optionName] = optionValue;
-    }
+        options.set(*id, *value);
+    });
 
     options = filterOptions(options);
 
-    
-    if (opcode == 1){
-        std::string message = "RRQ " + std::string(inet_ntoa(addr.sin_addr)) + ":" + std::to_string(ntohs(addr.sin_port)) + " \"" + filename + "\" " + modeStr + " " + optMessage;
-        Logger::instance().error(message);
-        return std::make_unique<ReadRequestPacket>(filename, mode, options, addr);
-    } else {
-        std::string message = "WRQ " + std::string(inet_ntoa(addr.sin_addr)) + ":" + std::to_string(ntohs(addr.sin_port)) + " \"" + filename + "\" " + modeStr + " " + optMessage;
-        Logger::instance().error(message);
-        return std::make_unique<WriteRequestPacket>(filename, mode, options, addr);
+    if (Logger::instance().isEnabled(LogLevel::DEBUG)) {
+        std::string detail = "\"" + filename + "\" " + std::string(packet.mode) + " " + optionsToString(packet);
+        Logger::instance().packet(LogDirection::RECEIVED, packet.opcode, addr, 0, 0, detail);
+    }
+    if (readRequest){
+        return ReadRequestPacket(filename, mode, options, addr);
     }
+    return WriteRequestPacket(filename, mode, options, addr);
 }
 
 // Serialize method for TFTPRequestPacket
-std::vector<char> RequestPacket::serialize() const {
-    std::vector<char> buffer;
-    // Add opcode
-    uint16_t opcode = getOpcode();
-    buffer.push_back(0);
-    buffer.push_back(opcode);
-
-    // Add filename
-    buffer.insert(buffer.end(), filename.begin(), filename.end());
-    buffer.push_back('\0');
-
-    // Add mode
-    std::string modeStr = modeToString(mode);
-    buffer.insert(buffer.end(), modeStr.begin(), modeStr.end());
-    buffer.push_back('\0');
-
-    // Add options
-    std::string optMessage = "";
-    for (const auto& option : options) {
-        buffer.insert(buffer.end(), option.first.begin(), option.first.end());
-        buffer.push_back('\0');
-        std::string optionValueStr = std::to_string(option.second);
-        buffer.insert(buffer.end(), optionValueStr.begin(), optionValueStr.end());
-        buffer.push_back('\0');
-        optMessage += option.first + "=" + optionValueStr + " ";
-    }
-
-    switch (opcode){
-        case 1:
-        {
-            std::string message = "=> RRQ " + std::string(inet_ntoa(addr.sin_addr)) + ":" + std::to_string(ntohs(addr.sin_port)) + " " + filename + " " + modeStr + " " + optMessage;
-            Logger::instance().log(message);
-            break;
-        }
-        case 2:
-        {
-            std::string message = "=> WRQ " + std::string(inet_ntoa(addr.sin_addr)) + ":" + std::to_string(ntohs(addr.sin_port)) + " " + filename + " " + modeStr + " " + optMessage;
-            Logger::instance().log(message);
-            break;
-        }
-    }
+size_t RequestPacket::serializeInto(std::span<char> buffer) const {
+    char* end = buffer.data() + buffer.size();
+    // opcode without block number, filename starts right after it
+    if (buffer.size() < 2) {
+        throw std::length_error("Packet doesn't fit into buffer");
+    }
+    buffer[0] = 0;
+    buffer[1] = static_cast<char>(getOpcode());
+    char* out = putString(buffer.data() + 2, end, filename);
+    out = putString(out, end, mode == DataMode::NETASCII ? "netascii" : "octet");
+    out = putOptions(out, end, options);
+    return out - buffer.data();
+}
 
-    return buffer;
+void RequestPacket::logSent() const {
+    Logger::instance().packet(LogDirection::SENT, getOpcode(), addr, 0, 0, filename + " " + modeToString(mode) + " " + optionsToString(options));
 }
 
 // WRITE REQUEST PACKET
 // Constructor
-WriteRequestPacket::WriteRequestPacket(const std::string& filename, DataMode mode, std::map<std::string, uint64_t> options, sockaddr_in addr)
+WriteRequestPacket::WriteRequestPacket(const std::string& filename, DataMode mode, OptionTable options, sockaddr_in addr)
     : RequestPacket(filename, mode, options, addr) {}
 
-// When client receives WRQ packet, it sends error packet with error code 4
-void WriteRequestPacket::handleClient(ClientSession* session) const {
-    ErrorPacket errorPacket(ErrorCode::ILLEGAL_OPERATION, "Illegal TFTP operation", session->dst_addr);
-    errorPacket.send(session, session->sessionSockfd);
-    session->sessionState = SessionState::ERROR;
-}
-
-// When server receives WRQ packet during the session not on the start, it sends error packet with error code 4
-void WriteRequestPacket::handleServer(ServerSession* session) const {
-    ErrorPacket errorPacket(ErrorCode::ILLEGAL_OPERATION, "Illegal TFTP operation", session->dst_addr);
-    errorPacket.send(session, session->sessionSockfd);
-    session->sessionState = SessionState::ERROR;
-}
-
 // READ REQUEST PACKET
 // Constructor
-ReadRequestPacket::ReadRequestPacket(const std::string& filename, DataMode mode, std::map<std::string, uint64_t> options, sockaddr_in addr)
+ReadRequestPacket::ReadRequestPacket(const std::string& filename, DataMode mode, OptionTable options, sockaddr_in addr)
     : RequestPacket(filename, mode, options, addr) {}
 
-// When client receives RRQ packet, it sends error packet with error code 4
-void ReadRequestPacket::handleClient(ClientSession* session) const {
-    ErrorPacket errorPacket(ErrorCode::ILLEGAL_OPERATION, "Illegal TFTP operation", session->dst_addr);
-    errorPacket.send(session, session->sessionSockfd);
-    session->sessionState = SessionState::ERROR;
-}
-
-// When server receives RRQ packet during the session not on the start, it sends error packet with error code 4
-void ReadRequestPacket::handleServer(ServerSession* session) const {
-    ErrorPacket errorPacket(ErrorCode::ILLEGAL_OPERATION, "Illegal TFTP operation", session->dst_addr);
-    errorPacket.send(session, session->sessionSockfd);
-    session->sessionState = SessionState::ERROR;
-}
-
 // DATA PACKET
 // Constructor
 DataPacket::DataPacket(uint16_t blockNumber, const std::vector<char>& data, sockaddr_in addr)
@@ -337,257 +364,61 @@ DataPacket DataPacket::parse(sockaddr_in addr, const char* buffer, size_t buffer
 }
 
 // Serialize method for TFTPDataPacket
-std::vector<char> DataPacket::serialize() const {
-    std::vector<char> buffer;
-    // Add opcode
-    buffer.push_back(0);
-    buffer.push_back(Opcode::DATA);
-
-    // Add block number
-    buffer.push_back((blockNumber >> 8) & 0xFF);
-    buffer.push_back(blockNumber & 0xFF);
-
-    // Add data
-    buffer.insert(buffer.end(), data.begin(), data.end());
-
-    std::string message = "=> DATA " + std::string(inet_ntoa(addr.sin_addr)) + ":" + std::to_string(ntohs(addr.sin_port)) + " " + std::to_string(blockNumber);
-    Logger::instance().log(message);
-    return buffer;
+size_t DataPacket::serializeInto(std::span<char> buffer) const {
+    char* end = buffer.data() + buffer.size();
+    char* out = putHeader(buffer.data(), end, Opcode::DATA, blockNumber);
+    if (static_cast<size_t>(end - out) < data.size()) {
+        throw std::length_error("Packet doesn't fit into buffer");
+    }
+    out = std::copy(data.begin(), data.end(), out);
+    return out - buffer.data();
 }
 
-void DataPacket::handleClient(ClientSession* session) const {
-    std::string message = "DATA " + std::string(inet_ntoa(addr.sin_addr)) + ":" + std::to_string(ntohs(addr.sin_port)) + ":" + std::to_string(ntohs(session->src_addr.sin_port)) +  " " + std::to_string(blockNumber);
-    Logger::instance().error(message);
-    switch(session->sessionState){
-        // Client state: Client sent RRQ and waiting for first DATA packet, Received packet: DATA => normal operation
-        // if everything is okay, send ACK and write data to file
-        case SessionState::INITIAL:
-        {
-            // check if size of data in packet is greater than negotiated block size
-            if (data.size() > session->blockSize){
-                ErrorPacket errorPacket(ErrorCode::ILLEGAL_OPERATION, "Illegal TFTP operation", session->dst_addr);
-                errorPacket.send(session, session->sessionSockfd);
-                session->sessionState = SessionState::ERROR;
-                break;
-            }
-
-            // check block number
-            if (session->blockNumber == this->blockNumber){
-                // write to file
-                try {
-                    session->writeDataBlock(data);
-                } catch (const std::exception& e) {
-                    ErrorPacket errorPacket(ErrorCode::DISK_FULL, "Disk full or allocation exceeded", session->dst_addr);
-                    errorPacket.send(session, session->sessionSockfd);
-                    session->sessionState = SessionState::ERROR;
-                    break;
-                }
-                // if client successfully wrote first data block, send ACK and change state to WAITING_DATA
-                session->sessionState = SessionState::WAITING_DATA;
-
-                // if the packet is last, change state to RRQ_END
-                if (data.size() < session->blockSize){
-                    session->sessionState = SessionState::RRQ_END;
-                }
+void DataPacket::logSent() const {
+    Logger::instance().packet(LogDirection::SENT, Opcode::DATA, addr, 0, blockNumber);
+}
 
-                // send ACK
-                ACKPacket ackPacket(session->blockNumber, session->dst_addr);
-                ackPacket.send(session, session->sessionSockfd);
-                session->blockNumber++;
-            } else {
-                ErrorPacket errorPacket(ErrorCode::ILLEGAL_OPERATION, "Illegal TFTP operation", session->dst_addr);
-                errorPacket.send(session, session->sessionSockfd);
-                session->sessionState = SessionState::ERROR;
-            }
-            break;
-        }
-        // Client state: Waiting Data, Received packet: DATA => normal operation
-        // if everything is okay, send ACK and write data to file
-        case SessionState::WAITING_DATA:
-        {
-            // check if size of data in packet is greater than negotiated block size
-            if (data.size() > session->blockSize){
-                ErrorPacket errorPacket(ErrorCode::ILLEGAL_OPERATION, "Illegal TFTP operation", session->dst_addr);
-                errorPacket.send(session, session->sessionSockfd);
-                session->sessionState = SessionState::ERROR;
+std::atomic<bool> DataPacket::gsoEnabled(true);
+
+void DataPacket::sendBurst(int socket, const sockaddr_in& addr, uint16_t firstBlock, const BlockWindow& blocks, std::vector<char>& burst, Transport& transport){
+    if (burst.size() < GSO_MAX_BURST_SIZE) {
+        burst.resize(GSO_MAX_BURST_SIZE);
+    }
+    size_t i = 0;
+    while (i < blocks.size()) {
+        // frames in one segmented send must have same size, only the last one can be shorter
+        size_t segmentSize = blocks[i].size() + 4;
+        size_t maxSegments = std::min<size_t>(GSO_MAX_SEGMENTS, GSO_MAX_BURST_SIZE / segmentSize);
+        size_t count = 1;
+        while (i + count < blocks.size() && count < maxSegments && blocks[i + count].size() + 4 <= segmentSize) {
+            bool shorter = blocks[i + count].size() + 4 < segmentSize;
+            count++;
+            if (shorter) {
                 break;
             }
-            // check block number
-            if (session->blockNumber == this->blockNumber){
-                // write to file
-                try {
-                    session->writeDataBlock(data);
-                } catch (const std::exception& e) {
-                    ErrorPacket errorPacket(ErrorCode::DISK_FULL, "Disk full or allocation exceeded", session->dst_addr);
-                    errorPacket.send(session, session->sessionSockfd);
-                    session->sessionState = SessionState::ERROR;
-                    break;
-                }
-                
-                // check if last packet
-                if (data.size() < session->blockSize){
-                    session->writeStream.close();
-                    session->sessionState = SessionState::RRQ_END;
-                }
-
-                // send ACK
-                ACKPacket ackPacket(session->blockNumber, session->dst_addr);
-                ackPacket.send(session, session->sessionSockfd);
-                session->blockNumber++;
-            } else {
-                ErrorPacket errorPacket(ErrorCode::ILLEGAL_OPERATION, "Illegal TFTP operation", session->dst_addr);
-                errorPacket.send(session, session->sessionSockfd);
-                session->sessionState = SessionState::ERROR;
-            }
-            break;
         }
-        // Client state: Client sent RRQ with options and now waiting on OACK,
-        // Received packet: DATA => server doesn't support options,
-        // if everything is okay, send ACK and write data to file
-        case SessionState::WAITING_OACK: 
-        {
-            // check if size of data in packet is greater than negotiated block size
-            if (data.size() > session->blockSize){
-                ErrorPacket errorPacket(ErrorCode::ILLEGAL_OPERATION, "Illegal TFTP operation", session->dst_addr);
-                errorPacket.send(session, session->sessionSockfd);
-                session->sessionState = SessionState::ERROR;
-                break;
-            }
-            // check block number
-            if (session->blockNumber == this->blockNumber){
-                // write to file
-                try{
-                    session->writeDataBlock(data);
-                } catch (const std::exception& e) {
-                    ErrorPacket errorPacket(ErrorCode::DISK_FULL, "Disk full or allocation exceeded", session->dst_addr);
-                    errorPacket.send(session, session->sessionSockfd);
-                    session->sessionState = SessionState::ERROR;
-                    break;
-                }
-                session->sessionState = SessionState::WAITING_DATA;
-                
-                // check for last packet
-                if (data.size() < session->blockSize){
-                    session->sessionState = SessionState::RRQ_END;
-                }
 
-                // send ACK
-                ACKPacket ackPacket(session->blockNumber, session->dst_addr);
-                ackPacket.send(session, session->sessionSockfd);
-                session->blockNumber++;
-                
-            } else {
-                ErrorPacket errorPacket(ErrorCode::ILLEGAL_OPERATION, "Illegal TFTP operation", session->dst_addr);
-                errorPacket.send(session, session->sessionSockfd);
-                session->sessionState = SessionState::ERROR;
-            }
-            break;
-        }
-        default:
-        {
-            ErrorPacket errorPacket(ErrorCode::ILLEGAL_OPERATION, "Illegal TFTP operation", session->dst_addr);
-            errorPacket.send(session, session->sessionSockfd);
-            session->sessionState = SessionState::ERROR;
+        // frames are serialized directly into scratch buffer, every frame but the last one has segment size
+        size_t burstSize = 0;
+        for (size_t j = 0; j < count; j++) {
+            uint16_t block = firstBlock + i + j;
+            const std::vector<char>& data = blocks[i + j];
+            char* frame = putHeader(burst.data() + burstSize, burst.data() + burst.size(), Opcode::DATA, block);
+            std::copy(data.begin(), data.end(), frame);
+            burstSize += data.size() + 4;
+            Logger::instance().packet(LogDirection::SENT, Opcode::DATA, addr, 0, block);
         }
-    
-    }
-}
-
-void DataPacket::handleServer(ServerSession* session) const {
-    std::string message = "DATA " + std::string(inet_ntoa(addr.sin_addr)) + ":" + std::to_string(ntohs(addr.sin_port)) + ":" + std::to_string(ntohs(session->src_addr.sin_port)) +  " " + std::to_string(blockNumber);
-    Logger::instance().error(message);
-
-    // handle state
-    switch(session->sessionState){
-        // Server state: Client sent WRQ, server sent ACK and waiting for first DATA packet
-        // Received packet: DATA => normal operation
-        // if everything is okay, send ACK and write data to file
-        case SessionState::WAITING_DATA:
-        {
-            // check if size of data in packet is greater than negotiated block size
-            if (data.size() > session->blockSize){
-                ErrorPacket errorPacket(ErrorCode::ILLEGAL_OPERATION, "Illegal TFTP operation", session->dst_addr);
-                errorPacket.send(session, session->sessionSockfd);
-                session->sessionState = SessionState::ERROR;
-                break;
-            }
-            // check block number
-            if (session->blockNumber == this->blockNumber){
-                // write to file
-                try{
-                    session->writeDataBlock(data);
-                } catch (const std::exception& e) {
-                    ErrorPacket errorPacket(ErrorCode::DISK_FULL, "Disk full or allocation exceeded", session->dst_addr);
-                    errorPacket.send(session, session->sessionSockfd);
-                    session->sessionState = SessionState::ERROR;
-                    break;
-                }
-                
-                // check for last packet
-                if (data.size() < session->blockSize){
-                    session->writeStream.close();
-                    session->sessionState = SessionState::WRQ_END;
-                }
 
-                // send ACK
-                ACKPacket ackPacket(session->blockNumber, session->dst_addr);
-                ackPacket.send(session, session->sessionSockfd);
-                session->blockNumber++;
-            } else {
-                ErrorPacket errorPacket(ErrorCode::ILLEGAL_OPERATION, "Illegal TFTP operation", session->dst_addr);
-                errorPacket.send(session, session->sessionSockfd);
-                session->sessionState = SessionState::ERROR;
-            }
-            break;
-        }
-        // Server state: Client sent WRQ with options, server sent OACK and waiting for first DATA packet
-        // Received packet: DATA => normal operation
-        // if everything is okay, server set negotiated options, write data to file and send ACK
-        case SessionState::WAITING_AFTER_OACK:
-        {
-            session->setOptions();
-            // check if size of data in packet is greater than negotiated block size
-            if (data.size() > session->blockSize){
-                ErrorPacket errorPacket(ErrorCode::ILLEGAL_OPERATION, "Illegal TFTP operation", session->dst_addr);
-                errorPacket.send(session, session->sessionSockfd);
-                session->sessionState = SessionState::ERROR;
-                break;
-            }
-            // check block number
-            if (session->blockNumber == this->blockNumber){
-                // write to file
-                try{
-                    session->writeDataBlock(data);
-                } catch (const std::exception& e) {
-                    ErrorPacket errorPacket(ErrorCode::DISK_FULL, "Disk full or allocation exceeded", session->dst_addr);
-                    errorPacket.send(session, session->sessionSockfd);
-                    session->sessionState = SessionState::ERROR;
-                    break;
-                }
-                
-                // check for last packet
-                if (data.size() < session->blockSize){
-                    session->writeStream.close();
-                    session->sessionState = SessionState::WRQ_END;
+        if (count == 1 || !transport.sendSegmented(socket, burst.data(), burstSize, segmentSize, addr)) {
+            // send each frame separately
+            for (size_t offset = 0; offset < burstSize; offset += segmentSize) {
+                size_t frameSize = std::min(segmentSize, burstSize - offset);
+                if (transport.send(socket, burst.data() + offset, frameSize, addr) < 0) {
+                    Logger::instance().log(LogLevel::ERROR, "Failed to send data");
                 }
-
-                // send ACK
-                ACKPacket ackPacket(session->blockNumber, session->dst_addr);
-                ackPacket.send(session, session->sessionSockfd);
-                session->blockNumber++;
-            } else {
-                ErrorPacket errorPacket(ErrorCode::ILLEGAL_OPERATION, "Illegal TFTP operation", session->dst_addr);
-                errorPacket.send(session, session->sessionSockfd);
-                session->sessionState = SessionState::ERROR;
             }
-            break;
-        }
-        default:
-        {
-            ErrorPacket errorPacket(ErrorCode::ILLEGAL_OPERATION, "Illegal TFTP operation", session->dst_addr);
-            errorPacket.send(session, session->sessionSockfd);
-            session->sessionState = SessionState::ERROR;
         }
+        i += count;
     }
 }
 
@@ -599,19 +430,12 @@ ACKPacket::ACKPacket(uint16_t blockNumber, sockaddr_in addr) : blockNumber(block
 }
 
 // Serialize method
-std::vector<char> ACKPacket::serialize() const {
-    std::vector<char> buffer;
-    // Add opcode
-    buffer.push_back(0);
-    buffer.push_back(Opcode::ACK);
-
-    // Add block number
-    buffer.push_back((blockNumber >> 8) & 0xFF);
-    buffer.push_back(blockNumber & 0xFF);
-
-    std::string message = "=> ACK " + std::string(inet_ntoa(addr.sin_addr)) + ":" + std::to_string(ntohs(addr.sin_port)) + " " + std::to_string(blockNumber);
-    Logger::instance().log(message);
-    return buffer;
+size_t ACKPacket::serializeInto(std::span<char> buffer) const {
+    return putHeader(buffer.data(), buffer.data() + buffer.size(), Opcode::ACK, blockNumber) - buffer.data();
+}
+
+void ACKPacket::logSent() const {
+    Logger::instance().packet(LogDirection::SENT, Opcode::ACK, addr, 0, blockNumber);
 }
 
 // Static parse method implementation
@@ -623,188 +447,9 @@ ACKPacket ACKPacket::parse(sockaddr_in addr, const char* buffer, size_t bufferSi
     // Get block number
     uint16_t blockNumber = (static_cast<uint8_t>(buffer[2]) << 8) | static_cast<uint8_t>(buffer[3]);
 
-    std::string message = "ACK " + std::string(inet_ntoa(addr.sin_addr)) + ":" + std::to_string(ntohs(addr.sin_port)) + " " + std::to_string(blockNumber);
-    Logger::instance().error(message);
     return ACKPacket(blockNumber, addr);
 }
 
-void ACKPacket::handleClient(ClientSession* session) const {
-    switch(session->sessionState){
-        // Client state: Client sent WRQ and waiting for first ACK packet,
-        // Received packet: ACK => normal operation
-        // if everything is okay, read data from file and send DATA,
-        // if the packet is last, change state to WAITING_LAST_ACK if not change state to WAITING_ACK
-        case SessionState::INITIAL:
-        {
-            // read first data block
-            session->blockNumber = 1;
-            std::vector<char> data = session->readDataBlock();
-            DataPacket dataPacket(session->blockNumber, data, session->dst_addr);
-            dataPacket.send(session, session->sessionSockfd);
-
-            // if the packet is last, change state to WAITING_LAST_ACK
-            if (data.size() < session->blockSize){
-                session->sessionState = SessionState::WAITING_LAST_ACK;
-                break;
-            }
-            session->sessionState = SessionState::WAITING_ACK;
-            break;
-        }
-        // Client state: Client sent first data block and data block was not last and waiting for ACK packet,
-        // Received packet: ACK => normal operation
-        // if everything is okay, read data from file and send DATA,
-        case SessionState::WAITING_ACK:
-        {
-            // check block number
-            if (session->blockNumber == this->blockNumber){
-                // read data block and send DATA packet
-                session->blockNumber++;
-                std::vector<char> data = session->readDataBlock();
-                DataPacket dataPacket(session->blockNumber, data, session->dst_addr);
-                dataPacket.send(session, session->sessionSockfd);
-
-                // check for last data block
-                if (data.size() < session->blockSize){
-                    session->sessionState = SessionState::WAITING_LAST_ACK;
-                }
-            } else {
-                ErrorPacket errorPacket(ErrorCode::ILLEGAL_OPERATION, "Illegal TFTP operation", session->dst_addr);
-                errorPacket.send(session, session->sessionSockfd);
-                session->sessionState = SessionState::ERROR;
-            }
-            break;
-        }
-        // Client state: Client sent last data block and waiting for last ACK packet,
-        // Received packet: ACK => normal operation
-        // if everything is okay, change state to WRQ_END
-        case SessionState::WAITING_LAST_ACK:
-        {
-            // check block number
-            if (session->blockNumber == this->blockNumber){
-                Logger::instance().log("File transfer complete");
-                session->sessionState = SessionState::WRQ_END;
-            } else {
-                ErrorPacket errorPacket(ErrorCode::ILLEGAL_OPERATION, "Invalid block number", session->dst_addr);
-                errorPacket.send(session, session->sessionSockfd);
-                session->sessionState = SessionState::ERROR;
-            }
-            break;
-        }
-        // Client state: Client sent WRQ with options and waiting for OACK packet,
-        // Received packet: ACK => server doesn't support options,
-        // if everything is okay, read data from file and send DATA,
-        case SessionState::WAITING_OACK:
-        {
-            // read first data block
-            if (session->blockNumber == this->blockNumber){
-                // read data block and send DATA packet
-                session->blockNumber = 1;
-                std::vector<char> data = session->readDataBlock();
-                DataPacket dataPacket(session->blockNumber, data, session->dst_addr);
-                dataPacket.send(session, session->sessionSockfd);
-
-                // check for last data block
-                if (data.size() < session->blockSize){
-                    session->sessionState = SessionState::WAITING_LAST_ACK;
-                    break;
-                }
-                session->sessionState = SessionState::WAITING_ACK;
-            } else {
-                ErrorPacket errorPacket(ErrorCode::ILLEGAL_OPERATION, "Illegal TFTP operation", session->dst_addr);
-                errorPacket.send(session, session->sessionSockfd);
-                session->sessionState = SessionState::ERROR;
-            }
-            break;
-        }
-        default:
-        {
-            ErrorPacket errorPacket(ErrorCode::ILLEGAL_OPERATION, "Illegal TFTP operation", session->dst_addr);
-            errorPacket.send(session, session->sessionSockfd);
-            session->sessionState = SessionState::ERROR;
-        }
-    }
-}
-
-void ACKPacket::handleServer(ServerSession* session) const {
-    switch(session->sessionState){
-        // Server state: Client sent RRQ, server sent DATA block and now waiting on ACK packet,
-        // Received packet: ACK => normal operation
-        // if everything is okay, read data from file and send DATA,
-        case SessionState::WAITING_ACK:
-        {
-            // check block number
-            if (session->blockNumber == this->blockNumber){
-                // read data block and send DATA packet
-                session->blockNumber++;
-                std::vector<char> data = session->readDataBlock();
-                DataPacket dataPacket(session->blockNumber, data, session->dst_addr);
-                dataPacket.send(session, session->sessionSockfd);
-
-                // check for last data block
-                if (data.size() < session->blockSize){
-                    session->sessionState = SessionState::WAITING_LAST_ACK;
-                    break;
-                }
-            } else {
-                ErrorPacket errorPacket(ErrorCode::ILLEGAL_OPERATION, "Illegal TFTP operation", session->dst_addr);
-                errorPacket.send(session, session->sessionSockfd);
-                session->sessionState = SessionState::ERROR;
-            }
-            break;
-        }
-        // Server state: Server sent last data block and waiting for last ACK packet,
-        // Received packet: ACK => normal operation
-        // if everything is okay, change state to RRQ_END
-        case SessionState::WAITING_LAST_ACK:
-        {
-            // check block number
-            if (session->blockNumber == this->blockNumber){
-                Logger::instance().log("File transfer complete");
-                session->sessionState = SessionState::RRQ_END;
-            } else {
-                ErrorPacket errorPacket(ErrorCode::ILLEGAL_OPERATION, "Illegal TFTP operation", session->dst_addr);
-                errorPacket.send(session, session->sessionSockfd);
-                session->sessionState = SessionState::ERROR;
-            }
-            break;
-        }
-        // Server state: Client sent RRQ with options, server sent OACK and waiting for first ACK packet,
-        // Received packet: ACK => normal operation
-        // if everything is okay, server set negotiated options, read data from file and send DATA,
-        case SessionState::WAITING_AFTER_OACK:
-        {
-            session->setOptions();
-            // check block number
-            if (session->blockNumber == this->blockNumber){
-                // read data block and send DATA packet
-                session->blockNumber++;
-                std::vector<char> data = session->readDataBlock();
-                DataPacket dataPacket(session->blockNumber, data, session->dst_addr);
-                dataPacket.send(session, session->sessionSockfd);
-
-                // check for last data block
-                if (data.size() < session->blockSize){
-                    session->sessionState = SessionState::WAITING_LAST_ACK;
-                    break;
-                }
-                session->sessionState = SessionState::WAITING_ACK;
-            } else {
-                ErrorPacket errorPacket(ErrorCode::ILLEGAL_OPERATION, "Illegal TFTP operation", session->dst_addr);
-                errorPacket.send(session, session->sessionSockfd);
-                session->sessionState = SessionState::ERROR;
-            }
-            break;
-        }
-        default:
-        {
-            ErrorPacket errorPacket(ErrorCode::ILLEGAL_OPERATION, "Illegal TFTP operation", session->dst_addr);
-            errorPacket.send(session, session->sessionSockfd);
-            session->sessionState = SessionState::ERROR;
-        }
-    }
-}
-
-
 // ERROR PACKET
 // Constructor for ErrorPacket
 ErrorPacket::ErrorPacket(ErrorCode errorCode, const std::string& errorMessage, sockaddr_in addr)
@@ -838,200 +483,67 @@ ErrorPacket ErrorPacket::parse(sockaddr_in addr, const char* buffer, size_t buff
 }
 
 // Serialize method for TFTPErrorPacket
-std::vector<char> ErrorPacket::serialize() const {
-    std::vector<char> buffer;
-    // Add opcode
-    buffer.push_back(0);
-    buffer.push_back(Opcode::ERROR); // Opcode for ERROR
-
-    // Add error code
-    buffer.push_back((errorCode >> 8) & 0xFF);
-    buffer.push_back(errorCode & 0xFF);
-
-    // Add error message
-    buffer.insert(buffer.end(), errorMessage.begin(), errorMessage.end());
-    buffer.push_back('\0');
-
-    std::string message = "=> ERROR " + std::string(inet_ntoa(addr.sin_addr)) + ":" + std::to_string(ntohs(addr.sin_port)) + " " + std::to_string(errorCode) + " " + errorMessage;
-    Logger::instance().log(message);
-    return buffer;
-}
-
-void ErrorPacket::handleClient(ClientSession* session) const {
-    std::string message = "ERROR " + std::string(inet_ntoa(addr.sin_addr)) + ":" + std::to_string(ntohs(addr.sin_port)) + ":" + std::to_string(htons(session->src_addr.sin_port)) + " " + std::to_string(errorCode) + " \"" + errorMessage+"\"";
-    Logger::instance().error(message);
-    if (session->sessionState == SessionState::WAITING_OACK){
-        // Client is waiting on OACK packet but received an error packet
-        // So client will resend the request packet with cleared options
-        auto requestPacket = dynamic_cast<RequestPacket*>(session->lastPacket.get());
-        if (requestPacket) {
-            requestPacket->options.clear();  // Clear the options
-            requestPacket->send(session, session->sessionSockfd); // Resend the request packet
-            session->TIDisSet = false;
-        }
-        if (session->sessionType == SessionType::READ){
-            session->sessionState = SessionState::WAITING_DATA;
-        } else {
-            session->sessionState = SessionState::WAITING_ACK;
-        }
-    } else {
-        session->sessionState = SessionState::ERROR;
-    }
+size_t ErrorPacket::serializeInto(std::span<char> buffer) const {
+    char* end = buffer.data() + buffer.size();
+    char* out = putHeader(buffer.data(), end, Opcode::ERROR, errorCode);
+    size_t space = out < end ? end - out - 1 : 0;
+    out = putString(out, end, std::string_view(errorMessage).substr(0, space));
+    return out - buffer.data();
 }
 
-void ErrorPacket::handleServer(ServerSession* session) const {
-    std::string message = "ERROR " + std::string(inet_ntoa(addr.sin_addr)) + ":" + std::to_string(ntohs(addr.sin_port)) + ":" + std::to_string(htons(session->src_addr.sin_port)) + " " + std::to_string(errorCode) + " " + errorMessage;
-    Logger::instance().error(message);
-    session->sessionState = SessionState::ERROR;
+void ErrorPacket::logSent() const {
+    Logger::instance().packet(LogDirection::SENT, Opcode::ERROR, addr, 0, errorCode, errorMessage);
 }
 
-OACKPacket::OACKPacket(std::map<std::string, uint64_t> options, sockaddr_in addr)
+OACKPacket::OACKPacket(OptionTable options, sockaddr_in addr)
     : options(options) {
         this->addr = addr;
     }
 
-std::vector<char> OACKPacket::serialize() const {
-    std::vector<char> buffer;
-    // Add opcode
-    buffer.push_back(0);
-    buffer.push_back(Opcode::OACK); // Opcode for OACK
-
-    // Add options
-    std::string optMessage = "";
-    for (const auto& option : options) {
-        buffer.insert(buffer.end(), option.first.begin(), option.first.end());
-        buffer.push_back('\0');
-        std::string optionValueStr = std::to_string(option.second);
-        buffer.insert(buffer.end(), optionValueStr.begin(), optionValueStr.end());
-        buffer.push_back('\0');
-        optMessage += option.first + "=" + std::to_string(option.second) + " ";
+size_t OACKPacket::serializeInto(std::span<char> buffer) const {
+    if (buffer.size() < 2) {
+        throw std::length_error("Packet doesn't fit into buffer");
     }
-    std::string message = "=> OACK " + std::string(inet_ntoa(addr.sin_addr)) + ":" + std::to_string(ntohs(addr.sin_port)) + " " + optMessage;
-    Logger::instance().log(message);
-    return buffer;
+    buffer[0] = 0;
+    buffer[1] = static_cast<char>(Opcode::OACK);
+    char* out = putOptions(buffer.data() + 2, buffer.data() + buffer.size(), options);
+    return out - buffer.data();
 }
 
-OACKPacket OACKPacket::parse(sockaddr_in addr, const char* buffer, size_t bufferSize) {
-    // parsing OACK packet
-    if (bufferSize < 4){
-        throw ParsingError("Buffer too short for OACK packet");
-    }
-
-    const char* current = buffer + 2;
-
-    // Parse options
-    std::map<std::string, uint64_t> options;
-    std::string optMessage = "";
-    while (current < buffer + bufferSize) {
-        // Get option name
-        const char* optionEnd = std::find(current, buffer + bufferSize, '\0');
-        std::string optionName(current, optionEnd);
+void OACKPacket::logSent() const {
+    Logger::instance().packet(LogDirection::SENT, Opcode::OACK, addr, 0, 0, optionsToString(options));
+}
 
-        std::transform(optionName.begin(), optionName.end(), optionName.begin(), ::tolower);
+OACKPacket OACKPacket::parse(sockaddr_in addr, const char* buffer, size_t bufferSize) {
+    return fromView(addr, PacketView::parse(buffer, bufferSize));
+}
 
-        if (optionName.empty() || optionEnd == buffer + bufferSize) {
-            throw OptionError("Invalid option name");
+OACKPacket OACKPacket::fromView(sockaddr_in addr, const PacketView& packet) {
+    OptionTable options;
+    packet.forEachOption([&options](const OptionView& option) {
+        std::optional<OptionId> id = findOption(option.name);
+        // filter unsupported options
+        if (!id) {
+            options.unknownOptions++;
+            return;
         }
+
         // Check if the option already exists
-        if (options.find(optionName) != options.end()) {
+        if (options.has(*id)) {
             throw OptionError("Option occurs multiple times");
         }
 
-        current = optionEnd + 1;
-
-        // Get option value
-        const char* valueEnd = std::find(current, buffer + bufferSize, '\0');
-        std::string optionValueStr(current, valueEnd);
-        if (optionValueStr.empty() || valueEnd == buffer + bufferSize) {
-            throw OptionError("Invalid option value");
-        }
-        current = valueEnd + 1;
-
-        optMessage += optionName + "=" + optionValueStr + " ";
-
-        // filter unsupported options
-        if (RequestPacket::supportedOptions.find(optionName) == RequestPacket::supportedOptions.end()) {
-            continue;
-        }
-
-        // convert option value to uint64_t
-        uint64_t optionValue;
-        try{
-            optionValue = std::stoull(optionValueStr);
-        } catch (const std::exception& e){
+        std::optional<uint64_t> value = parseOptionValue(option.value);
+        if (!value) {
             throw OptionError("Invalid option value");
         }
-        options[optionName] = optionValue;
-    }
+        options.set(*id, *value);
+    });
 
     options = filterOptions(options);
 
-    std::string message = "OACK " + std::string(inet_ntoa(addr.sin_addr)) + ":" + std::to_string(ntohs(addr.sin_port)) + " " + optMessage;
-    Logger::instance().error(message);
-    return OACKPacket(options, addr);
-}
-
-void OACKPacket::handleClient(ClientSession* session) const {
-    if (session->sessionState == SessionState::WAITING_OACK){
-        // Check if options matches requested options
-        for (const auto& option : options) {
-            // if server add option that client didn't request, send error packet
-            if (session->options.find(option.first) == session->options.end()) {
-                ErrorPacket errorPacket(ErrorCode::INVALID_OPTIONS, "Unknown transfer option", session->dst_addr);
-                errorPacket.send(session, session->sessionSockfd);
-                session->sessionState = SessionState::ERROR;
-            }
-        }
-        session->setOptions(options);
-        switch(session->sessionType){
-            // if RRQ sent first ACK packet
-            case SessionType::READ:
-            {
-                // if tsize option is set check if there is enough space on disk
-                if (options.find("tsize") != options.end()){
-                    if (!hasEnoughSpace(options.at("tsize"), "/")){
-                        ErrorPacket errorPacket(ErrorCode::DISK_FULL, "Disk full or allocation exceeded", session->dst_addr);
-                        errorPacket.send(session, session->sessionSockfd);
-                        session->sessionState = SessionState::ERROR;
-                        return;
-                    }
-                }
-
-                // send ACK
-                ACKPacket ackPacket(0, session->dst_addr);
-                ackPacket.send(session, session->sessionSockfd);
-                session->sessionState = SessionState::WAITING_DATA;
-                break;
-            }
-            // if WRQ sent first DATA packet
-            case SessionType::WRITE:
-            {
-                // read first data block and send DATA packet
-                session->blockNumber++;
-                std::vector<char> data = session->readDataBlock();
-                DataPacket dataPacket(session->blockNumber, data, session->dst_addr);
-                dataPacket.send(session, session->sessionSockfd);
-
-                // check for last data block
-                if (data.size() < session->blockSize){
-                    session->sessionState = SessionState::WAITING_LAST_ACK;
-                    break;
-                }
-
-                session->sessionState = SessionState::WAITING_ACK;
-                break;
-            }
-        }
-    } else {
-        ErrorPacket errorPacket(ErrorCode::ILLEGAL_OPERATION, "Illegal TFTP operation", session->dst_addr);
-        errorPacket.send(session, session->sessionSockfd);
-        session->sessionState = SessionState::ERROR;
+    if (Logger::instance().isEnabled(LogLevel::DEBUG)) {
+        Logger::instance().packet(LogDirection::RECEIVED, Opcode::OACK, addr, 0, 0, optionsToString(packet));
     }
+    return OACKPacket(options, addr);
 }
-
-// Server doesn't support OACK packet
-void OACKPacket::handleServer(ServerSession* session) const {
-    ErrorPacket errorPacket(ErrorCode::ILLEGAL_OPERATION, "Illegal TFTP operation", session->dst_addr);
-    errorPacket.send(session, session->sessionSockfd);
-    session->sessionState = SessionState::ERROR;
-}
\ No newline at end of file
@@ -5,8 +5,14 @@
 */
 #include "common/session.hpp"
 #include "common/packets.hpp"
+#include "common/packet_view.hpp"
+#include "common/session_fsm.hpp"
+#include "common/session_policies.hpp"
 #include "common/exceptions.hpp"
 #include "common/logger.hpp"
+#include "common/metrics.hpp"
+#include "common/probes.hpp"
+#include "common/net_emulator.hpp"
 #include <sys/statvfs.h>
 #include <iostream>
 #include <fstream>
@@ -14,6 +20,9 @@
 #include <unistd.h>
 #include <algorithm>
 #include <filesystem>
+#include <cstring>
+#include <netinet/udp.h>
+#include <chrono>
 
 // Define stopFlag
 std::shared_ptr<std::atomic<bool>> stopFlagServer = std::make_shared<std::atomic<bool>>(false);
@@ -50,7 +59,8 @@ bool hasEnoughSpace(uint64_t size, std::string rootDir){
     return freeSpace >= size;
 }
 
-Session::Session(int socket, const sockaddr_in& dst_addr, const std::string src_filename, const std::string dst_filename, DataMode dataMode, SessionType sessionType, std::string rootDir)
+Session::Session(int socket, const sockaddr_in& dst_addr, const std::string src_filename, const std::string dst_filename, DataMode dataMode, SessionType sessionType, std::string rootDir,
+    Transport& transport, const Clock& clock)
 : dst_addr(dst_addr),
 srcTID(ntohs(dst_addr.sin_port)),
 sessionSockfd(socket),
@@ -67,24 +77,47 @@ dst_filename(dst_filename),
 sessionState(SessionState::INITIAL),
 fileOpen(false),
 retries(0),
-lastPacket(nullptr)
+maxRetries(MAX_RETRIES),
+backoffFactor(BACKOFF_FACTOR),
+transport(&transport),
+clock(&clock),
+lastMessageSize(0),
+lastAddr(dst_addr),
+windowSize(INITIAL_WINDOW_SIZE),
+lastBlockRead(false),
+blocksSinceAck(0),
+strayAcknowledged(false),
+lastStrayBlock(0),
+windowResent(false),
+repeatedAckExpected(false),
+bytesTransferred(0),
+sessionId(Tracer::instance().nextSessionId()),
+startTime(clock.now()),
+windowTimed(false),
+firstBlockDone(false)
 {
-    struct sockaddr_in sin;
-    socklen_t len = sizeof(sin);
-    if (getsockname(sessionSockfd, (struct sockaddr *)&sin, &len) == -1) {
+    Metrics::instance().add(sessionType == SessionType::READ ? Counter::READ_SESSIONS_ACTIVE : Counter::WRITE_SESSIONS_ACTIVE);
+    if (!transport.localAddress(sessionSockfd, src_addr)) {
         Logger::instance().log("Failed to get socket name");
+    }
+}
+
+Session::~Session(){
+    TFTP_PROBE4(session_exit, sessionId, static_cast<int>(sessionType), static_cast<int>(sessionState), bytesTransferred);
+    Metrics& metrics = Metrics::instance();
+    bool read = sessionType == SessionType::READ;
+    metrics.add(read ? Counter::READ_SESSIONS_ACTIVE : Counter::WRITE_SESSIONS_ACTIVE, -1);
+    if (sessionState == SessionState::RRQ_END || sessionState == SessionState::WRQ_END) {
+        metrics.add(read ? Counter::READ_SESSIONS_COMPLETED : Counter::WRITE_SESSIONS_COMPLETED);
+        metrics.observe(Histogram::TRANSFER_DURATION, clock->now() - startTime);
     } else {
-        src_addr = sin;
+        metrics.add(read ? Counter::READ_SESSIONS_FAILED : Counter::WRITE_SESSIONS_FAILED);
     }
 }
 
 void Session::setTimeout(){
-    struct timeval tv;
-    tv.tv_sec = timeout;
-    tv.tv_usec = 0;
-    if (setsockopt(sessionSockfd, SOL_SOCKET, SO_RCVTIMEO, (const char*)&tv, sizeof tv) < 0) {
+    if (!transport->setReceiveTimeout(sessionSockfd, timeout)) {
         Logger::instance().log("Failed to set timeout");
-        return;
     }
 }
 
@@ -96,33 +129,256 @@ bool Session::openFileForWrite(){
     } else {
         fileOpen = true;
     }
+    blockWriter = makeBlockWriter(dataMode, StreamWriter(writeStream));
     return true;
 }
 
-ClientSession::ClientSession(int socket, const sockaddr_in& dst_addr, const std::string src_filename, const std::string dst_filename, DataMode dataMode, SessionType sessionType, std::map<std::string, uint64_t> options, std::string rootDir)
-    : Session(socket, dst_addr, src_filename, dst_filename, dataMode, sessionType, rootDir) {
+std::vector<char>& BlockWindow::push(){
+    if (count == slots.size()) {
+        // ring is full, it is unrolled so new slot can be appended after the last block
+        std::rotate(slots.begin(), slots.begin() + head, slots.end());
+        head = 0;
+        slots.emplace_back();
+    }
+    return slots[(head + count++) % slots.size()];
+}
+
+void BlockWindow::popFront(size_t count){
+    if (count == 0) {
+        return;
+    }
+    head = (head + count) % slots.size();
+    this->count -= count;
+}
+
+void Session::sendWindow(){
+    SessionState from = sessionState;
+    // Read new blocks until the window is full or the last block was read
+    uint64_t bytesRead = 0;
+    while (unackedBlocks.size() < windowSize && !lastBlockRead){
+        std::vector<char>& data = unackedBlocks.push();
+        readDataBlock(data);
+        if (data.size() < blockSize){
+            lastBlockRead = true;
+        }
+        bytesRead += data.size();
+        blockNumber++;
+    }
+    bytesTransferred += bytesRead;
+
+    // Send all unacknowledged blocks, starting with the oldest one
+    uint16_t firstBlock = blockNumber - unackedBlocks.size() + 1;
+    // other side can answer before send call returns, so time is taken before it
+    uint64_t sentNs = Tracer::instance().isEnabled() ? Tracer::now() : 0;
+    windowSentTime = clock->now();
+    windowTimed = true;
+    DataPacket::sendBurst(sessionSockfd, dst_addr, firstBlock, unackedBlocks, burstBuffer, *transport);
+
+    Metrics& metrics = Metrics::instance();
+    metrics.add(Counter::BLOCKS_SENT, unackedBlocks.size());
+    metrics.add(Counter::BYTES_SENT, bytesRead);
+    if (!firstBlockDone){
+        metrics.observe(Histogram::TIME_TO_FIRST_BLOCK, windowSentTime - startTime);
+        firstBlockDone = true;
+    }
+
+    if (lastBlockRead){
+        sessionState = SessionState::WAITING_LAST_ACK;
+    } else {
+        sessionState = SessionState::WAITING_ACK;
+    }
+    for (size_t i = 0; i < unackedBlocks.size(); i++){
+        TFTP_PROBE4(packet_send, sessionId, Opcode::DATA, static_cast<uint16_t>(firstBlock + i), unackedBlocks[i].size());
+        trace(TraceEvent::SENT, Opcode::DATA, firstBlock + i, unackedBlocks[i].size(), from, sentNs);
+    }
+}
+
+int Session::acknowledgeBlocks(uint16_t ackBlock){
+    // Block numbers can wrap around, so the distance is computed in 16 bit arithmetic
+    uint16_t lastAcked = blockNumber - unackedBlocks.size();
+    uint16_t acked = ackBlock - lastAcked;
+    if (acked >= 0x8000){
+        // block is behind the window, delayed duplicate of older ACK
+        return 0;
+    }
+    if (acked > unackedBlocks.size()){
+        return -1;
+    }
+    unackedBlocks.popFront(acked);
+    if (acked > 0){
+        // ACK of resent window can come once for each copy
+        repeatedAckExpected = windowResent;
+        windowResent = false;
+    }
+    // RTT of retransmitted window is ambiguous (Karn), only window sent once is measured
+    if (acked > 0 && windowTimed){
+        Metrics::instance().observe(Histogram::WINDOW_RTT, clock->now() - windowSentTime);
+        windowTimed = false;
+    }
+    return acked;
+}
+
+bool Session::retransmitOnRepeatedAck(uint16_t ackBlock){
+    // without window there is no gap to report, repeated ACK is only duplicate
+    uint16_t lastAcked = blockNumber - unackedBlocks.size();
+    if (windowSize <= 1 || ackBlock != lastAcked || unackedBlocks.empty() || windowResent){
+        return false;
+    }
+    if (repeatedAckExpected){
+        repeatedAckExpected = false;
+        return false;
+    }
+    Metrics::instance().add(Counter::RETRANSMISSIONS);
+    duplicateStats.earlyRetransmits++;
+    sendWindow();
+    windowTimed = false;
+    windowResent = true;
+    return true;
+}
+
+bool Session::isDuplicateData(uint16_t dataBlock) const {
+    // Block numbers can wrap around, blocks up to half of the sequence space behind are old
+    uint16_t behind = blockNumber - dataBlock;
+    return behind >= 1 && behind < 0x8000;
+}
+
+void Session::logDuplicateStats() const {
+    if (duplicateStats.staleAcks == 0 && duplicateStats.duplicateData == 0 && duplicateStats.outOfOrderData == 0
+        && duplicateStats.earlyRetransmits == 0){
+        return;
+    }
+    Logger::instance().log("Ignored " + std::to_string(duplicateStats.staleAcks) + " stale ACKs, received "
+        + std::to_string(duplicateStats.duplicateData) + " duplicate and " + std::to_string(duplicateStats.outOfOrderData)
+        + " out of order DATA packets, resent " + std::to_string(duplicateStats.earlyRetransmits) + " windows before timeout");
+}
+
+void Session::acknowledgeData(bool lastBlock){
+    // send ACK after whole window was received or when the block is last
+    if (++blocksSinceAck >= windowSize || lastBlock){
+        ACKPacket ackPacket(blockNumber, dst_addr);
+        ackPacket.send(this, sessionSockfd);
+        blocksSinceAck = 0;
+    }
+    strayAcknowledged = false;
+    blockNumber++;
+}
+
+void Session::reacknowledgeData(){
+    ACKPacket ackPacket(blockNumber - 1, dst_addr);
+    ackPacket.send(this, sessionSockfd);
+    blocksSinceAck = 0;
+}
+
+void Session::reacknowledgeStrayData(uint16_t dataBlock){
+    // retransmitted window starts again from its first block, so block not after previous one starts new burst
+    uint16_t ahead = dataBlock - lastStrayBlock;
+    bool newBurst = ahead == 0 || ahead >= 0x8000;
+    lastStrayBlock = dataBlock;
+    if (strayAcknowledged && !newBurst){
+        return;
+    }
+    strayAcknowledged = true;
+    reacknowledgeData();
+}
+
+void Session::retransmit(){
+    trace(TraceEvent::TIMEOUT, 0, blockNumber, 0, sessionState);
+    TFTP_PROBE3(retransmit, sessionId, retries, blockNumber);
+    Metrics::instance().add(Counter::RETRANSMISSIONS);
+    if (!unackedBlocks.empty()){
+        sendWindow();
+        windowTimed = false;
+        windowResent = true;
+    } else if (windowSize > 1 && sessionState == SessionState::WAITING_DATA){
+        reacknowledgeData();
+    } else {
+        uint64_t sentNs = Tracer::instance().isEnabled() ? Tracer::now() : 0;
+        if (transport->send(sessionSockfd, lastMessage.data(), lastMessageSize, lastAddr) < 0) {
+            Logger::instance().log(LogLevel::ERROR, "Failed to send data");
+        } else {
+            traceSent(lastMessage.data(), lastMessageSize, sentNs);
+        }
+    }
+}
+
+void Session::traceSent(const char* message, size_t size, uint64_t timestampNs) const {
+    if (!Tracer::instance().isEnabled() || size < 4){
+        return;
+    }
+    uint8_t opcode = message[1];
+    // requests and OACK have no block number
+    uint16_t block = 0;
+    if (opcode == Opcode::DATA || opcode == Opcode::ACK || opcode == Opcode::ERROR){
+        block = (static_cast<uint8_t>(message[2]) << 8) | static_cast<uint8_t>(message[3]);
+    }
+    trace(TraceEvent::SENT, opcode, block, opcode == Opcode::DATA ? size - 4 : 0, sessionState, timestampNs);
+}
+
+void Session::traceRecord(TraceEvent event, uint8_t opcode, uint16_t block, size_t bytes, SessionState from, uint64_t timestampNs) const {
+    TraceRecord record{};
+    record.timestampNs = timestampNs;
+    record.sessionId = sessionId;
+    record.bytes = bytes;
+    record.block = block;
+    record.opcode = opcode;
+    record.event = event;
+    record.fromState = static_cast<uint8_t>(from);
+    record.toState = static_cast<uint8_t>(sessionState);
+    record.retries = std::min(retries, 255);
+    Tracer::instance().record(record);
+}
+
+ClientSession::ClientSession(int socket, const sockaddr_in& dst_addr, const std::string src_filename, const std::string dst_filename, DataMode dataMode, SessionType sessionType, OptionTable options, std::string rootDir,
+    Transport& transport, const Clock& clock)
+    : Session(socket, dst_addr, src_filename, dst_filename, dataMode, sessionType, rootDir, transport, clock) {
         this->options = options;
         this->TIDisSet = false;
+        // Client sessions are created by one thread, so order of creation numbers their streams
+        if (&transport == &Transport::system()) {
+            emulatedTransport = NetworkEmulator::instance().openTransport();
+            if (emulatedTransport) {
+                this->transport = emulatedTransport.get();
+            }
+        }
     }
 
-void ClientSession::handleSession() {
-    
+bool ClientSession::start(RequestPacket& request) {
     if (sessionType == SessionType::READ){
-        if (!openFileForWrite()){
+        // Sink is opened by caller
+        if (sink) {
+            blockWriter = makeBlockWriter(dataMode, SinkWriter(*sink));
+        } else if (!openFileForWrite()){
             Logger::instance().log("Failed to open file for writing");
             sessionState = SessionState::ERROR;
             this->exit();
-            return;
+            return false;
         }
         blockNumber = 1;
+    } else {
+        if (!source && !openSource()){
+            Logger::instance().log("Failed to open file for reading: " + src_filename);
+            sessionState = SessionState::ERROR;
+            this->exit();
+            return false;
+        }
+        blockReader = makeBlockReader(dataMode, SourceReader(*source));
     }
 
     if (!options.empty()){
         sessionState = SessionState::WAITING_OACK;
     }
 
+    request.send(this, sessionSockfd);
+    return true;
+}
+
+bool ClientSession::openSource() {
+    source = UploadSource::open(src_filename);
+    return source != nullptr;
+}
+
+void ClientSession::handleSession() {
     char buffer[BUFFER_SIZE];
-    socklen_t dst_len = sizeof(dst_addr);
     while(true){
         // SIGINT termination
         if(stopFlagClient->load()){
@@ -133,27 +389,14 @@ void ClientSession::handleSession() {
 
         setTimeout();
         // Receive data from server
-        ssize_t received_bytes = recvfrom(sessionSockfd, buffer, sizeof(buffer), 0, (struct sockaddr *)&dst_addr, &dst_len);
-
+        ssize_t received_bytes = transport->receive(sessionSockfd, buffer, sizeof(buffer), dst_addr, 0);
 
         if (received_bytes < 0) {
             // Timeouted
             if (errno == EAGAIN || errno == EWOULDBLOCK) {
-                // Check if the number of retries is exceeded
-                if (++retries > MAX_RETRIES) {
-                    Logger::instance().log("Max retries reached, giving up.");
-                    sessionState = SessionState::ERROR;
-                    this->exit();
+                if (!handleTimeout()){
                     return;
                 }
-
-                Logger::instance().log("Timeout, retransmitting (attempt " + std::to_string(retries) + ").");
-
-                // Retransmit the last packet
-                lastPacket->send(this, sessionSockfd);
-
-                // Implement exponential backoff
-                timeout *= BACKOFF_FACTOR;
                 continue;
             } else {
                 Logger::instance().log("Failed to receive data");
@@ -162,151 +405,152 @@ void ClientSession::handleSession() {
                 return;
             }
         }
-        // Reset the number of retries
-        retries = 0;
-        timeout = initialTimeout;
-
-        // First packet received, set the TID
-        if (!TIDisSet){
-            this->srcTID = ntohs(dst_addr.sin_port);
-            TIDisSet = true;
-        }
 
-        // Check if the TID matches
-        int srcTID = ntohs(dst_addr.sin_port);
-        if (srcTID != this->srcTID){
-            ErrorPacket errorPacket(ErrorCode::UNKNOWN_TID, "Unknown transfer ID", dst_addr);
-            errorPacket.send(this, sessionSockfd);
-            continue;
-        }
-
-        // Try to parse the packet
-        std::unique_ptr<Packet> packet;
-        try {
-            packet = Packet::parse(dst_addr, buffer, received_bytes);
-        } catch (const ParsingError& e) {
-            ErrorCode err = static_cast<ErrorCode>(ParsingError::errorCode);
-            ErrorPacket errorPacket(err, e.what(), dst_addr);
-            errorPacket.send(this, sessionSockfd);
-            sessionState = SessionState::ERROR;
-            this->exit();
-            return;
-        }
-        catch (const OptionError& e) {
-            ErrorCode err = static_cast<ErrorCode>(OptionError::errorCode);
-            ErrorPacket errorPacket(err, e.what(), dst_addr);
-            errorPacket.send(this, sessionSockfd);
-            sessionState = SessionState::ERROR;
-            this->exit();
+        if (!handleDatagram(buffer, received_bytes)){
             return;
         }
-        catch (const std::exception& e) {
-            ErrorPacket errorPacket(ErrorCode::NOT_DEFINED, e.what(), dst_addr);
-            errorPacket.send(this, sessionSockfd);
-            sessionState = SessionState::ERROR;
-            this->exit();
-            return;
-        }
-
-        // hanndle the packet
-        packet->handleClient(this);
+    }
+}
 
-        // Check if the session is finished
-        if (sessionState == SessionState::RRQ_END || sessionState == SessionState::WRQ_END || sessionState == SessionState::ERROR){
-            this->exit();
-            return;
-        }
+bool ClientSession::handleTimeout() {
+    Metrics::instance().add(Counter::TIMEOUTS);
+    // Check if the number of retries is exceeded
+    if (++retries > maxRetries) {
+        Logger::instance().log("Max retries reached, giving up.");
+        sessionState = SessionState::ERROR;
+        this->exit();
+        return false;
     }
+
+    Logger::instance().log("Timeout, retransmitting (attempt " + std::to_string(retries) + ").");
+
+    // Retransmit the last packet or window
+    retransmit();
+
+    // Implement exponential backoff
+    timeout *= backoffFactor;
+    return true;
 }
 
-std::vector<char> ClientSession::readDataBlock() {
-    std::vector<char> data;
-    switch (dataMode) {
-        case DataMode::NETASCII:
-            {
-                char ch;
-                while(std::cin.get(ch) && data.size() ){
-                    if (std::cin.fail()){
-                        throw std::runtime_error("Failed to read data from stdin");
-                    }
-                    if (ch == '\n'){
-                        data.push_back('\r');
-                        if (data.size() < blockSize){
-                            data.push_back('\n');
-                        }
-                    } else if (ch == '\r'){
-                        data.push_back('\r');
-                        if (data.size() < blockSize){
-                            data.push_back('\0');
-                        }
-                    } else {
-                        data.push_back(ch);
-                    }
-                    break;
-                }
-            }
-        case DataMode::OCTET:
-            data.resize(blockSize);
-            std::cin.read(data.data(), blockSize);
-            ssize_t bytesRead = std::cin.gcount();
-            
-            if (bytesRead < 0) {
-                throw std::runtime_error("Failed to read data from stdin");
-            }
+bool ClientSession::handleDatagram(const char* buffer, size_t size) {
+    // Reset the number of retries
+    retries = 0;
+    timeout = initialTimeout;
+
+    // First packet received, set the TID
+    if (!TIDisSet){
+        this->srcTID = ntohs(dst_addr.sin_port);
+        TIDisSet = true;
+    }
+
+    // Check if the TID matches
+    int srcTID = ntohs(dst_addr.sin_port);
+    if (srcTID != this->srcTID){
+        ErrorPacket errorPacket(ErrorCode::UNKNOWN_TID, "Unknown transfer ID", dst_addr);
+        errorPacket.send(this, sessionSockfd);
+        return true;
+    }
+
+    // Try to parse the packet, it is handled directly from received buffer
+    PacketView packet;
+    try {
+        packet = PacketView::parse(buffer, size);
+    } catch (const ParsingError& e) {
+        ErrorCode err = static_cast<ErrorCode>(ParsingError::errorCode);
+        ErrorPacket errorPacket(err, e.what(), dst_addr);
+        errorPacket.send(this, sessionSockfd);
+        sessionState = SessionState::ERROR;
+        this->exit();
+        return false;
+    }
+    catch (const OptionError& e) {
+        ErrorCode err = static_cast<ErrorCode>(OptionError::errorCode);
+        ErrorPacket errorPacket(err, e.what(), dst_addr);
+        errorPacket.send(this, sessionSockfd);
+        sessionState = SessionState::ERROR;
+        this->exit();
+        return false;
+    }
+    catch (const std::exception& e) {
+        ErrorPacket errorPacket(ErrorCode::NOT_DEFINED, e.what(), dst_addr);
+        errorPacket.send(this, sessionSockfd);
+        sessionState = SessionState::ERROR;
+        this->exit();
+        return false;
+    }
 
-            data.resize(bytesRead);
-            break;
+    // hanndle the packet, reading of source can fail during handling
+    try {
+        handlePacket(this, packet);
+    } catch (const OptionError& e) {
+        ErrorPacket errorPacket(static_cast<ErrorCode>(OptionError::errorCode), e.what(), dst_addr);
+        errorPacket.send(this, sessionSockfd);
+        sessionState = SessionState::ERROR;
+    } catch (const std::runtime_error& e) {
+        ErrorPacket errorPacket(ErrorCode::NOT_DEFINED, e.what(), dst_addr);
+        errorPacket.send(this, sessionSockfd);
+        sessionState = SessionState::ERROR;
     }
 
-    return data;
+    // Check if the session is finished
+    if (sessionState == SessionState::RRQ_END || sessionState == SessionState::WRQ_END || sessionState == SessionState::ERROR){
+        this->exit();
+        return false;
+    }
+    return true;
 }
 
-void Session::writeDataBlock(std::vector<char> data) {
-    switch (dataMode) {
-        case DataMode::NETASCII:
-            {
-                auto [convertedData, _ ] = parseNetasciiString(data.data(), data.data(), data.data() + data.size());
+void Session::readDataBlock(std::vector<char>& data) {
+    // buffer of reused block already has capacity for whole block
+    data.resize(blockSize);
+    data.resize(blockReader->read(data.data(), blockSize));
+}
 
-                writeStream.write(convertedData.data(), convertedData.size());
-                if (writeStream.fail()) {
-                    throw std::runtime_error("Failed to write data to file");
-                }
-            }
-            break;
-        case DataMode::OCTET:
-            {
-                writeStream.write(data.data(), data.size());
-                if (writeStream.fail()) {
-                    throw std::runtime_error("Failed to write data to file");
-                }
-            }
-            break;
+void Session::writeDataBlock(const char* data, size_t size, bool lastBlock) {
+    blockWriter->write(data, size);
+    if (lastBlock){
+        blockWriter->finish();
+    }
+    bytesTransferred += size;
+    Metrics& metrics = Metrics::instance();
+    metrics.add(Counter::BLOCKS_RECEIVED);
+    metrics.add(Counter::BYTES_RECEIVED, size);
+    if (!firstBlockDone){
+        metrics.observe(Histogram::TIME_TO_FIRST_BLOCK, clock->now() - startTime);
+        firstBlockDone = true;
     }
 }
 
-void ClientSession::setOptions(std::map<std::string, uint64_t> newOptions){
+void ClientSession::setOptions(OptionTable newOptions){
     options = newOptions;
 
-    // Check if the options map contains the "blksize" option
-    if (options.find("blksize") != options.end()) {
+    // Check if the options table contains the "blksize" option
+    if (options.has(OptionId::BLKSIZE)) {
         // Set the blockSize member variable to its value
-        Logger::instance().log("Setting block size to " + std::to_string(options.at("blksize")));
-        this->blockSize = options.at("blksize");
+        Logger::instance().log("Setting block size to " + std::to_string(options.get(OptionId::BLKSIZE)));
+        this->blockSize = options.get(OptionId::BLKSIZE);
     }
 
-    // Check if the options map contains the "timeout" option
-    if (options.find("timeout") != options.end()) {
+    // Check if the options table contains the "timeout" option
+    if (options.has(OptionId::TIMEOUT)) {
         // Set the timeout to its value
-        Logger::instance().log("Setting timeout to " + std::to_string(options.at("timeout")));
-        this->initialTimeout = options.at("timeout");
-        this->timeout = options.at("timeout");
+        Logger::instance().log("Setting timeout to " + std::to_string(options.get(OptionId::TIMEOUT)));
+        this->initialTimeout = options.get(OptionId::TIMEOUT);
+        this->timeout = options.get(OptionId::TIMEOUT);
     }
 
-    // Check if the options map contains the "tsize" option
-    if (options.find("tsize") != options.end()) {
+    // Check if the options table contains the "tsize" option
+    if (options.has(OptionId::TSIZE)) {
         // Set the tsize to its value
-        Logger::instance().log("Setting tsize to " + std::to_string(options.at("tsize")));
-        this->tsize = options.at("tsize");
+        Logger::instance().log("Setting tsize to " + std::to_string(options.get(OptionId::TSIZE)));
+        this->tsize = options.get(OptionId::TSIZE);
+    }
+
+    // Check if the options table contains the "windowsize" option
+    if (options.has(OptionId::WINDOWSIZE)) {
+        // Set the windowSize to its value
+        Logger::instance().log("Setting window size to " + std::to_string(options.get(OptionId::WINDOWSIZE)));
+        this->windowSize = options.get(OptionId::WINDOWSIZE);
     }
 }
 
@@ -319,36 +563,30 @@ void ClientSession::exit(){
             Logger::instance().log("File deleted");
         }
     }
+    logDuplicateStats();
+    trace(TraceEvent::END, 0, blockNumber, 0, sessionState);
     Logger::instance().log("Exiting client session");
     writeStream.close();
-    close(sessionSockfd);
+    blockReader.reset();
+    source.reset();
+    transport->close(sessionSockfd);
 }
 
-ServerSession::ServerSession(int socket, const sockaddr_in& dst_addr, const std::string src_filename, const std::string dst_filename, DataMode dataMode, SessionType sessionType, std::map<std::string, uint64_t> options, std::string rootDir)
-    : Session(socket, dst_addr, src_filename, dst_filename, dataMode, sessionType, rootDir) {
+ServerSession::ServerSession(int socket, const sockaddr_in& dst_addr, const std::string src_filename, const std::string dst_filename, DataMode dataMode, SessionType sessionType, OptionTable options, std::string rootDir,
+    Transport& transport, const Clock& clock)
+    : Session(socket, dst_addr, src_filename, dst_filename, dataMode, sessionType, rootDir, transport, clock) {
         this->options = options;
+        this->groEnabled = false;
+        this->receiveCalls = 0;
+        this->packetsReceived = 0;
     }
 
 void ServerSession::handleSession() {
-    char buffer[BUFFER_SIZE];
-    if (sessionType == SessionType::WRITE){
-        if (!handleWriteRequest()){
-            Logger::instance().log("Failed to handle write request");
-            sessionState = SessionState::ERROR;
-            this->exit();
-            return;
-        }
-
-    } else if (sessionType == SessionType::READ){
-        if (!handleReadRequest()){
-            Logger::instance().log("Failed to handle read request");
-            sessionState = SessionState::ERROR;
-            this->exit();
-            return;
-        }
+    if (!start()){
+        return;
     }
 
-    socklen_t dst_len = sizeof(dst_addr);
+    char buffer[BUFFER_SIZE];
     while(true){
         // SIGINT termination
         if(stopFlagServer->load()){
@@ -361,25 +599,15 @@ void ServerSession::handleSession() {
 
         setTimeout();
         // Receive data from client
-        ssize_t received_bytes = recvfrom(sessionSockfd, buffer, sizeof(buffer), 0, (struct sockaddr *)&dst_addr, &dst_len);
+        size_t segmentSize;
+        ssize_t received_bytes = receiveDatagram(buffer, sizeof(buffer), segmentSize);
 
         if (received_bytes < 0) {
             // Timeouted
             if (errno == EAGAIN || errno == EWOULDBLOCK) {
-                // Check if the number of retries is exceeded
-                if (++retries > 3) {
-                    Logger::instance().log("Max retries reached, giving up.");
-                    sessionState = SessionState::ERROR;
-                    this->exit();
+                if (!handleTimeout()){
                     return;
                 }
-
-                Logger::instance().log("Timeout, retransmitting (attempt " + std::to_string(retries) + ").");
-
-                lastPacket->send(this, sessionSockfd);
-
-                // Implement exponential backoff
-                timeout *= 2;
                 continue;
             } else {
                 Logger::instance().log("Failed to receive data");
@@ -388,61 +616,186 @@ void ServerSession::handleSession() {
                 return;
             }
         }
-        // Reset the number of retries
-        retries = 0;
-        timeout = initialTimeout;
-
-        // Check if the TID matches
-        int srcTID = ntohs(dst_addr.sin_port);
-        if (srcTID != this->srcTID){
-            ErrorPacket errorPacket(ErrorCode::UNKNOWN_TID, "Unknown transfer ID", dst_addr);
-            errorPacket.send(this, sessionSockfd);
-            continue;
-        }
 
-        // Try to parse the packet
-        std::unique_ptr<Packet> packet;
-        try {
-            packet = Packet::parse(dst_addr, buffer, received_bytes);
-        } catch (const ParsingError& e) {
-            ErrorCode err = static_cast<ErrorCode>(ParsingError::errorCode);
-            ErrorPacket errorPacket(err, e.what(), dst_addr);
-            errorPacket.send(this, sessionSockfd);
-            sessionState = SessionState::ERROR;
-            this->exit();
-            return;
-        }
-        catch (const OptionError& e) {
-            ErrorCode err = static_cast<ErrorCode>(OptionError::errorCode);
-            ErrorPacket errorPacket(err, e.what(), dst_addr);
-            errorPacket.send(this, sessionSockfd);
-            sessionState = SessionState::ERROR;
-            this->exit();
+        if (!handleReceived(buffer, received_bytes, segmentSize)){
             return;
         }
-        catch (const std::exception& e) {
-            ErrorPacket errorPacket(ErrorCode::NOT_DEFINED, e.what(), dst_addr);
-            errorPacket.send(this, sessionSockfd);
-            sessionState = SessionState::ERROR;
+    }
+}
+
+bool ServerSession::start(){
+    enableBusyPoll();
+    // Blocks of window are kept until they are acknowledged, so larger window is lowered like blksize
+    if (options.has(OptionId::WINDOWSIZE) && options.get(OptionId::WINDOWSIZE) > config.maxWindowSize){
+        options.set(OptionId::WINDOWSIZE, config.maxWindowSize);
+    }
+    bool answered = true;
+    if (sessionType == SessionType::WRITE){
+        enableGro();
+        answered = handleWriteRequest();
+    } else if (sessionType == SessionType::READ){
+        answered = handleReadRequest();
+    }
+    // first packet, or ERROR of request which failed, was sent
+    if (onStarted){
+        onStarted();
+        onStarted = nullptr;
+    }
+    if (!answered){
+        Logger::instance().log(sessionType == SessionType::WRITE ? "Failed to handle write request" : "Failed to handle read request");
+        sessionState = SessionState::ERROR;
+        this->exit();
+        return false;
+    }
+    return true;
+}
+
+bool ServerSession::handleTimeout(){
+    Metrics::instance().add(Counter::TIMEOUTS);
+    // Check if the number of retries is exceeded
+    if (++retries > maxRetries) {
+        Logger::instance().log("Max retries reached, giving up.");
+        sessionState = SessionState::ERROR;
+        this->exit();
+        return false;
+    }
+
+    Logger::instance().log("Timeout, retransmitting (attempt " + std::to_string(retries) + ").");
+
+    retransmit();
+
+    // Implement exponential backoff
+    timeout *= backoffFactor;
+    return true;
+}
+
+bool ServerSession::handleReceived(const char* buffer, size_t size, size_t segmentSize){
+    // Reset the number of retries
+    retries = 0;
+    timeout = initialTimeout;
+
+    // Check if the TID matches
+    int srcTID = ntohs(dst_addr.sin_port);
+    if (srcTID != this->srcTID){
+        ErrorPacket errorPacket(ErrorCode::UNKNOWN_TID, "Unknown transfer ID", dst_addr);
+        errorPacket.send(this, sessionSockfd);
+        return true;
+    }
+
+    // Handle each packet of coalesced datagram in order
+    size_t offset = 0;
+    do {
+        size_t packetSize = std::min(segmentSize, size - offset);
+        if (!handleDatagram(buffer + offset, packetSize)){
             this->exit();
-            return;
+            return false;
         }
+        offset += packetSize;
+    } while (offset < size);
+    return true;
+}
 
-        // handle the packet
-        packet->handleServer(this);
+void ServerSession::enableGro(){
+    if (!config.udpGro){
+        return;
+    }
+    if (!transport->setOption(sessionSockfd, SOL_UDP, UDP_GRO, 1)) {
+        Logger::instance().log("Failed to enable UDP GRO, receiving packets separately");
+        return;
+    }
+    groEnabled = true;
+}
 
-        // Check if the session is finished
-        if (sessionState == SessionState::WRQ_END || sessionState == SessionState::RRQ_END || sessionState == SessionState::ERROR){
-            this->exit();
-            return;
+void ServerSession::enableBusyPoll(){
+    if (config.busyPollUsec <= 0){
+        return;
+    }
+    if (!transport->setOption(sessionSockfd, SOL_SOCKET, SO_BUSY_POLL, config.busyPollUsec)) {
+        Logger::instance().log("Failed to set SO_BUSY_POLL: " + std::string(strerror(errno)));
+        return;
+    }
+#ifdef SO_PREFER_BUSY_POLL
+    if (!transport->setOption(sessionSockfd, SOL_SOCKET, SO_PREFER_BUSY_POLL, 1)) {
+        Logger::instance().log("Failed to set SO_PREFER_BUSY_POLL: " + std::string(strerror(errno)));
+    }
+#endif
+}
+
+ssize_t ServerSession::receiveDatagram(char* buffer, size_t size, size_t& segmentSize){
+    // Spin on socket for a while, most of packets arrive before the thread would be woken up
+    if (config.spinUsec > 0){
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::microseconds(config.spinUsec);
+        do {
+            ssize_t received_bytes = receiveOnce(buffer, size, segmentSize, MSG_DONTWAIT);
+            if (received_bytes >= 0 || (errno != EAGAIN && errno != EWOULDBLOCK)){
+                return received_bytes;
+            }
+        } while (std::chrono::steady_clock::now() < deadline);
+    }
+    return receiveOnce(buffer, size, segmentSize, 0);
+}
+
+ssize_t ServerSession::receiveOnce(char* buffer, size_t size, size_t& segmentSize, int flags){
+    receiveCalls++;
+    if (!groEnabled){
+        ssize_t received_bytes = transport->receive(sessionSockfd, buffer, size, dst_addr, flags);
+        segmentSize = received_bytes;
+        if (received_bytes >= 0){
+            packetsReceived++;
         }
+        return received_bytes;
     }
+
+    ssize_t received_bytes = transport->receiveSegmented(sessionSockfd, buffer, size, dst_addr, flags, segmentSize);
+    if (received_bytes < 0){
+        return received_bytes;
+    }
+    if (segmentSize > 0){
+        packetsReceived += (received_bytes + segmentSize - 1) / segmentSize;
+    }
+    return received_bytes;
+}
+
+bool ServerSession::handleDatagram(const char* buffer, size_t size){
+    // Try to parse the packet, it is handled directly from received buffer
+    PacketView packet;
+    try {
+        packet = PacketView::parse(buffer, size);
+    } catch (const ParsingError& e) {
+        ErrorCode err = static_cast<ErrorCode>(ParsingError::errorCode);
+        ErrorPacket errorPacket(err, e.what(), dst_addr);
+        errorPacket.send(this, sessionSockfd);
+        sessionState = SessionState::ERROR;
+        return false;
+    }
+    catch (const OptionError& e) {
+        ErrorCode err = static_cast<ErrorCode>(OptionError::errorCode);
+        ErrorPacket errorPacket(err, e.what(), dst_addr);
+        errorPacket.send(this, sessionSockfd);
+        sessionState = SessionState::ERROR;
+        return false;
+    }
+    catch (const std::exception& e) {
+        ErrorPacket errorPacket(ErrorCode::NOT_DEFINED, e.what(), dst_addr);
+        errorPacket.send(this, sessionSockfd);
+        sessionState = SessionState::ERROR;
+        return false;
+    }
+
+    // handle the packet
+    handlePacket(this, packet);
+
+    // Check if the session is finished
+    if (sessionState == SessionState::WRQ_END || sessionState == SessionState::RRQ_END || sessionState == SessionState::ERROR){
+        return false;
+    }
+    return true;
 }
 
 bool ServerSession::handleWriteRequest(){
     // If "tsize" is set, check if there is enough disk space
-    if (options.find("tsize") != options.end()) {
-        if (!hasEnoughSpace(options.at("tsize"), rootDir)){
+    if (options.has(OptionId::TSIZE)) {
+        if (!hasEnoughSpace(options.get(OptionId::TSIZE), rootDir)){
             // Not enough disk space
             ErrorPacket errorPacket(ErrorCode::DISK_FULL, "Disk full or allocation exceeded", dst_addr);
             errorPacket.send(this, sessionSockfd);
@@ -484,10 +837,10 @@ bool ServerSession::openFileForRead(){
 }
 
 bool ServerSession::handleReadRequest(){
-        if (options.find("tsize") != options.end()) {
+        if (options.has(OptionId::TSIZE)) {
             // Set the tsize to the actual file size
             this->tsize = std::filesystem::file_size(src_filename);
-            options["tsize"] = tsize;
+            options.set(OptionId::TSIZE, tsize);
         }
 
         // try open file for read
@@ -496,29 +849,41 @@ bool ServerSession::handleReadRequest(){
             errorPacket.send(this, sessionSockfd);
             return false;
         }
+
+        // Serve only requested byte range, range is clamped to size of file and
+        // actual values are confirmed in OACK
+        uint64_t rangeSize = UINT64_MAX;
+        if (options.has(OptionId::RANGESTART) || options.has(OptionId::RANGESIZE)) {
+            if (dataMode == DataMode::NETASCII) {
+                // Offsets in netascii don't match offsets in file
+                options.erase(OptionId::RANGESTART);
+                options.erase(OptionId::RANGESIZE);
+            } else {
+                uint64_t fileSize = std::filesystem::file_size(src_filename);
+                uint64_t start = std::min(options.has(OptionId::RANGESTART) ? options.get(OptionId::RANGESTART) : 0, fileSize);
+                rangeSize = std::min(options.has(OptionId::RANGESIZE) ? options.get(OptionId::RANGESIZE) : UINT64_MAX, fileSize - start);
+                options.set(OptionId::RANGESTART, start);
+                if (options.has(OptionId::RANGESIZE)) {
+                    options.set(OptionId::RANGESIZE, rangeSize);
+                }
+                readStream.seekg(start);
+                Logger::instance().log("Serving range " + std::to_string(start) + "+" + std::to_string(rangeSize));
+            }
+        }
+        // Block at the end of range is short, so client sees end of transfer
+        blockReader = makeBlockReader(dataMode, StreamReader(readStream, rangeSize));
         
         // if options not presented, send first data block
         if (options.empty()){
-            std::vector<char> data;
             // read first data block and send DATA packet
             try {
-            data = readDataBlock();
+                sendWindow();
             } 
             catch (const std::runtime_error& e) {
                 ErrorPacket errorPacket(ErrorCode::DISK_FULL, "Disk full or allocation exceeded", dst_addr);
                 errorPacket.send(this, sessionSockfd);
                 return false;
             }
-            DataPacket dataPacket(1, data, dst_addr);
-            dataPacket.send(this, sessionSockfd);
-            blockNumber++;
-
-            // check for last data block
-            if (data.size() < blockSize){
-                sessionState = SessionState::WAITING_LAST_ACK;
-            } else {
-                sessionState = SessionState::WAITING_ACK;
-            }
         } else {
             OACKPacket oackPacket(options, dst_addr);
             oackPacket.send(this, sessionSockfd);
@@ -528,44 +893,43 @@ bool ServerSession::handleReadRequest(){
 }
 
 void ServerSession::setOptions(){
-        // Check if the options map contains the "blksize" option
-    if (options.find("blksize") != options.end()) {
+        // Check if the options table contains the "blksize" option
+    if (options.has(OptionId::BLKSIZE)) {
         // Set the blockSize member variable to its value
-        Logger::instance().log("Setting block size to " + std::to_string(options.at("blksize")));
-        this->blockSize = options.at("blksize");
+        Logger::instance().log("Setting block size to " + std::to_string(options.get(OptionId::BLKSIZE)));
+        this->blockSize = options.get(OptionId::BLKSIZE);
     }
 
-    // Check if the options map contains the "timeout" option
-    if (options.find("timeout") != options.end()) {
+    // Check if the options table contains the "timeout" option
+    if (options.has(OptionId::TIMEOUT)) {
         // Set the timeout to its value
-        Logger::instance().log("Setting timeout to " + std::to_string(options.at("timeout")));
-        this->initialTimeout = options.at("timeout");
-        this->timeout = options.at("timeout");
+        Logger::instance().log("Setting timeout to " + std::to_string(options.get(OptionId::TIMEOUT)));
+        this->initialTimeout = options.get(OptionId::TIMEOUT);
+        this->timeout = options.get(OptionId::TIMEOUT);
     }
 
-    // Check if the options map contains the "tsize" option
-    if (options.find("tsize") != options.end()) {
+    // Check if the options table contains the "tsize" option
+    if (options.has(OptionId::TSIZE)) {
         // Set the tsize to its value
-        Logger::instance().log("Setting tsize to " + std::to_string(options.at("tsize")));
-        this->tsize = options.at("tsize");
+        Logger::instance().log("Setting tsize to " + std::to_string(options.get(OptionId::TSIZE)));
+        this->tsize = options.get(OptionId::TSIZE);
     }
-}
 
-std::vector<char> ServerSession::readDataBlock() {
-    std::vector<char> data(blockSize);
-    readStream.read(data.data(), blockSize);
-    ssize_t bytesRead = readStream.gcount();
-    if (bytesRead <= 0) {
-        throw std::runtime_error("Failed to read data from file");
+    // Check if the options table contains the "windowsize" option
+    if (options.has(OptionId::WINDOWSIZE)) {
+        // Set the windowSize to its value
+        Logger::instance().log("Setting window size to " + std::to_string(options.get(OptionId::WINDOWSIZE)));
+        this->windowSize = options.get(OptionId::WINDOWSIZE);
     }
-
-    data.resize(bytesRead);
-
-    return data;
 }
 
 void ServerSession::exit(){
+    logDuplicateStats();
+    trace(TraceEvent::END, 0, blockNumber, 0, sessionState);
     Logger::instance().log("Exiting server session");
+    if (groEnabled) {
+        Logger::instance().log("Received " + std::to_string(packetsReceived) + " packets in " + std::to_string(receiveCalls) + " receive calls");
+    }
     if (sessionState == SessionState::ERROR && fileOpen && sessionType == SessionType::WRITE) {
         Logger::instance().log("File was not correctly transfered, deleting file...");
         if (std::remove(dst_filename.c_str())){
@@ -576,5 +940,5 @@ void ServerSession::exit(){
     }
     writeStream.close();
     readStream.close();
-    close(sessionSockfd);
+    transport->close(sessionSockfd);
 }
@@ -0,0 +1,272 @@
+/**
+ * @file common/session_fsm.cpp
+ * @brief Implementation of actions of session transition table
+ * @author Lukas Vecerka (xvecer30)
+*/
+#include "common/session_fsm.hpp"
+#include "common/packets.hpp"
+#include "common/logger.hpp"
+#include "common/probes.hpp"
+#include <string>
+#include <type_traits>
+#include <arpa/inet.h>
+
+/**
+ * @brief Function for ending session with error sent to other side
+ * @param session The session
+ * @param errorCode Code of error
+ * @param message Message of error
+*/
+static void fail(Session* session, ErrorCode errorCode, const std::string& message){
+    ErrorPacket errorPacket(errorCode, message, session->dst_addr);
+    errorPacket.send(session, session->sessionSockfd);
+    session->sessionState = SessionState::ERROR;
+}
+
+/**
+ * @brief Function for getting final state of session, it depends only on direction of transfer
+ * @param session The session
+ * @return RRQ_END for download, WRQ_END for upload
+*/
+static SessionState endState(const Session* session){
+    return session->sessionType == SessionType::READ ? SessionState::RRQ_END : SessionState::WRQ_END;
+}
+
+/**
+ * @brief Function for logging received packet
+ * @param session The session
+ * @param packet The packet
+*/
+static void logPacket(const Session* session, const PacketView& packet){
+    Logger& logger = Logger::instance();
+    switch (packet.opcode) {
+        case Opcode::DATA:
+            logger.packet(LogDirection::RECEIVED, Opcode::DATA, session->dst_addr, ntohs(session->src_addr.sin_port), packet.blockNumber);
+            break;
+        case Opcode::ACK:
+            logger.packet(LogDirection::RECEIVED, Opcode::ACK, session->dst_addr, 0, packet.blockNumber);
+            break;
+        case Opcode::ERROR:
+            if (logger.isEnabled(LogLevel::DEBUG)) {
+                std::string message = "\"" + std::string(packet.payload.begin(), packet.payload.end()) + "\"";
+                logger.packet(LogDirection::RECEIVED, Opcode::ERROR, session->dst_addr, ntohs(session->src_addr.sin_port), packet.blockNumber, message);
+            }
+            break;
+        default:
+            // requests and OACK are logged by their parsers
+            break;
+    }
+}
+
+/**
+ * @brief Function for applying options negotiated by OACK, server applies them when first DATA/ACK confirms OACK
+ * @param session The session
+*/
+static void negotiate(ServerSession* session){
+    session->setOptions();
+}
+
+/**
+ * @brief Client applies options when OACK is received, so there is nothing left to do
+*/
+static void negotiate(ClientSession*){}
+
+/**
+ * @brief Function for receiving DATA block
+ * @param session The session
+ * @param packet DATA packet
+ * @param firstBlock true if only expected block can be accepted
+*/
+static void receiveData(Session* session, const PacketView& packet, bool firstBlock){
+    // check if size of data in packet is greater than negotiated block size
+    if (packet.payload.size() > session->blockSize){
+        fail(session, ErrorCode::ILLEGAL_OPERATION, "Illegal TFTP operation");
+        return;
+    }
+
+    if (session->blockNumber == packet.blockNumber){
+        // short block ends transfer
+        bool lastBlock = packet.payload.size() < session->blockSize;
+        try {
+            session->writeDataBlock(packet.payload.data(), packet.payload.size(), lastBlock);
+        } catch (const std::exception& e) {
+            fail(session, ErrorCode::DISK_FULL, "Disk full or allocation exceeded");
+            return;
+        }
+
+        session->sessionState = SessionState::WAITING_DATA;
+        if (lastBlock){
+            session->writeStream.close();
+            session->sessionState = endState(session);
+        }
+        session->acknowledgeData(lastBlock);
+    } else if (!firstBlock && session->isDuplicateData(packet.blockNumber)) {
+        // block was already written, its ACK was probably lost, so acknowledge it again
+        session->duplicateStats.duplicateData++;
+        session->reacknowledgeStrayData(packet.blockNumber);
+    } else if (!firstBlock && session->windowSize > 1) {
+        // window is broken, acknowledge last block received in order so sender continues from it
+        session->duplicateStats.outOfOrderData++;
+        session->reacknowledgeStrayData(packet.blockNumber);
+    } else {
+        fail(session, ErrorCode::ILLEGAL_OPERATION, "Illegal TFTP operation");
+    }
+}
+
+/**
+ * @brief Function for receiving ACK of request or OACK, first window is sent
+ * @param session The session
+ * @param packet ACK packet
+*/
+static void receiveFirstAck(Session* session, const PacketView& packet){
+    if (session->blockNumber == packet.blockNumber){
+        session->sendWindow();
+    } else {
+        fail(session, ErrorCode::ILLEGAL_OPERATION, "Illegal TFTP operation");
+    }
+}
+
+/**
+ * @brief Function for receiving ACK inside transfer
+ * @param session The session
+ * @param packet ACK packet
+*/
+static void receiveAck(Session* session, const PacketView& packet){
+    int acked = session->acknowledgeBlocks(packet.blockNumber);
+    if (acked < 0){
+        fail(session, ErrorCode::ILLEGAL_OPERATION, "Illegal TFTP operation");
+    } else if (acked == 0) {
+        // ACK repeating start of window means lost block, window is sent again once without waiting
+        // for timeout, other duplicate or delayed ACK is ignored, answering it would send every following
+        // block twice (Sorcerer's Apprentice)
+        if (!session->retransmitOnRepeatedAck(packet.blockNumber)){
+            session->duplicateStats.staleAcks++;
+        }
+    } else if (session->lastBlockRead && session->unackedBlocks.empty()) {
+        Logger::instance().log("File transfer complete");
+        session->sessionState = endState(session);
+    } else {
+        session->sendWindow();
+    }
+}
+
+/**
+ * @brief Function for receiving OACK, confirmed options have to be subset of requested ones
+ * @param session The session
+ * @param packet OACK packet
+ * @throw OptionError if value of option is not a number
+*/
+static void receiveOack(ClientSession* session, const PacketView& packet){
+    OACKPacket oack = OACKPacket::fromView(session->dst_addr, packet);
+
+    // if server add option that client didn't request, send error packet
+    if (!session->options.includes(oack.options)) {
+        fail(session, ErrorCode::INVALID_OPTIONS, "Unknown transfer option");
+        return;
+    }
+    // Ignored range can't be accepted, data would be written at wrong offset
+    if (session->options.has(OptionId::RANGESTART) && (!oack.options.has(OptionId::RANGESTART) || oack.options.get(OptionId::RANGESTART) != session->options.get(OptionId::RANGESTART))){
+        fail(session, ErrorCode::INVALID_OPTIONS, "Range not supported");
+        return;
+    }
+    session->setOptions(oack.options);
+
+    if (session->sessionType == SessionType::READ){
+        // if tsize option is set check if there is enough space on disk
+        if (oack.options.has(OptionId::TSIZE) && !hasEnoughSpace(oack.options.get(OptionId::TSIZE), "/")){
+            fail(session, ErrorCode::DISK_FULL, "Disk full or allocation exceeded");
+            return;
+        }
+        ACKPacket ackPacket(0, session->dst_addr);
+        ackPacket.send(session, session->sessionSockfd);
+        session->sessionState = SessionState::WAITING_DATA;
+    } else {
+        session->sendWindow();
+    }
+}
+
+/**
+ * @brief Function for handling ERROR sent instead of OACK, request is sent again without options
+ * and session continues as if options were never requested
+ * @param session The session
+*/
+static void rejectOptions(ClientSession* session){
+    // last sent packet is the request
+    PacketView request = PacketView::parse(session->lastMessage.data(), session->lastMessageSize);
+    std::string filename(request.filename);
+    DataMode mode = stringToMode(std::string(request.mode));
+    if (request.opcode == Opcode::RRQ) {
+        ReadRequestPacket(filename, mode, {}, session->lastAddr).send(session, session->sessionSockfd);
+    } else {
+        WriteRequestPacket(filename, mode, {}, session->lastAddr).send(session, session->sessionSockfd);
+    }
+    session->TIDisSet = false;
+    session->sessionState = SessionState::INITIAL;
+}
+
+/**
+ * @brief Function for looking up action of received packet and running it
+ * @param session The session
+ * @param packet The packet
+*/
+template <Role role, typename SessionT>
+static void dispatch(SessionT* session, const PacketView& packet){
+    constexpr const TransitionTable& table = role == Role::CLIENT ? clientTransitions : serverTransitions;
+    logPacket(session, packet);
+    // packet is traced after it is handled, so state after it is known, but with time of its arrival
+    SessionState from = session->sessionState;
+    uint64_t receivedNs = Tracer::instance().isEnabled() ? Tracer::now() : 0;
+    TFTP_PROBE4(packet_receive, session->sessionId, static_cast<int>(packet.opcode), packet.blockNumber, packet.opcode == Opcode::DATA ? packet.payload.size() : 0);
+
+    switch (table[static_cast<size_t>(session->sessionState)][packet.opcode]) {
+        case Action::FIRST_DATA:
+            receiveData(session, packet, true);
+            break;
+        case Action::DATA_AFTER_OACK:
+            negotiate(session);
+            [[fallthrough]];
+        case Action::DATA:
+            receiveData(session, packet, false);
+            break;
+        case Action::ACK_AFTER_OACK:
+            negotiate(session);
+            [[fallthrough]];
+        case Action::FIRST_ACK:
+            receiveFirstAck(session, packet);
+            break;
+        case Action::ACK:
+            receiveAck(session, packet);
+            break;
+        case Action::OACK:
+            if constexpr (role == Role::CLIENT) {
+                receiveOack(session, packet);
+            }
+            break;
+        case Action::OPTIONS_REJECTED:
+            // only refused options are worth retrying, missing file or denied access would be refused again
+            if (packet.blockNumber != ErrorCode::INVALID_OPTIONS) {
+                session->sessionState = SessionState::ERROR;
+            } else if constexpr (role == Role::CLIENT) {
+                rejectOptions(session);
+            }
+            break;
+        case Action::PEER_ERROR:
+            session->sessionState = SessionState::ERROR;
+            break;
+        case Action::ILLEGAL:
+            fail(session, ErrorCode::ILLEGAL_OPERATION, "Illegal TFTP operation");
+            break;
+    }
+    if (session->sessionState != from) {
+        TFTP_PROBE3(state_change, session->sessionId, static_cast<int>(from), static_cast<int>(session->sessionState));
+    }
+    session->trace(TraceEvent::RECEIVED, packet.opcode, packet.blockNumber, packet.opcode == Opcode::DATA ? packet.payload.size() : 0, from, receivedNs);
+}
+
+void handlePacket(ClientSession* session, const PacketView& packet){
+    dispatch<Role::CLIENT>(session, packet);
+}
+
+void handlePacket(ServerSession* session, const PacketView& packet){
+    dispatch<Role::SERVER>(session, packet);
+}
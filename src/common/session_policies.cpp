@@ -0,0 +1,26 @@
+/**
+ * @file common/session_policies.cpp
+ * @brief Implementation of file backends of session data path
+ * @author Lukas Vecerka (xvecer30)
+*/
+#include "common/session_policies.hpp"
+#include <algorithm>
+#include <stdexcept>
+
+void StreamWriter::write(const char* data, size_t size){
+    stream.write(data, size);
+    if (stream.fail()) {
+        throw std::runtime_error("Failed to write data to file");
+    }
+}
+
+size_t StreamReader::read(char* data, size_t size){
+    stream.read(data, std::min<uint64_t>(size, remaining));
+    size_t bytesRead = stream.gcount();
+    remaining -= bytesRead;
+    // End of file sets failbit too, only bad stream is an error
+    if (stream.bad()) {
+        throw std::runtime_error("Failed to read data from file");
+    }
+    return bytesRead;
+}
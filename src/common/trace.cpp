@@ -0,0 +1,143 @@
+/**
+ * @file common/trace.cpp
+ * @brief Implementation of trace rings mapped from files
+ * @author Lukas Vecerka (xvecer30)
+*/
+#include "common/trace.hpp"
+#include "common/logger.hpp"
+#include <ctime>
+#include <cstring>
+#include <new>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+/**
+ * @brief Ring of one trace file, header and records are mapped shared, so they reach file even if process crashes
+*/
+struct TraceRing {
+    TraceFileHeader* header;
+    TraceRecord* records;
+};
+
+/**
+ * @brief Owner of ring of thread, ring is given back to tracer when thread ends
+*/
+struct TraceRingHolder {
+    TraceRing* ring = nullptr;
+    bool failed = false;
+    ~TraceRingHolder() {
+        if (ring != nullptr) {
+            Tracer::instance().release(ring);
+        }
+    }
+};
+
+/**
+ * @brief Function for reading clock in nanoseconds
+ * @param clock The clock
+ * @return Time in nanoseconds
+*/
+static uint64_t clockNs(clockid_t clock){
+    struct timespec now;
+    clock_gettime(clock, &now);
+    return static_cast<uint64_t>(now.tv_sec) * 1000000000 + now.tv_nsec;
+}
+
+uint64_t Tracer::now(){
+    return clockNs(CLOCK_MONOTONIC);
+}
+
+bool Tracer::open(const std::string& directory){
+    if (access(directory.c_str(), W_OK | X_OK) != 0) {
+        Logger::instance().log(LogLevel::ERROR, "Trace directory " + directory + " is not writable: " + std::string(strerror(errno)));
+        return false;
+    }
+    {
+        std::lock_guard<std::mutex> lock(ringsMutex);
+        this->directory = directory;
+    }
+    enabled.store(true);
+    return true;
+}
+
+void Tracer::record(TraceRecord& record){
+    TraceRing* ring = threadRing();
+    if (ring == nullptr) {
+        return;
+    }
+    if (record.timestampNs == 0) {
+        record.timestampNs = now();
+    }
+    // only owning thread writes into ring, head is published after record is complete
+    uint64_t index = ring->header->head.load(std::memory_order_relaxed);
+    ring->records[index % TRACE_RING_RECORDS] = record;
+    ring->header->head.store(index + 1, std::memory_order_release);
+}
+
+void Tracer::release(TraceRing* ring){
+    std::lock_guard<std::mutex> lock(ringsMutex);
+    freeRings.push_back(ring);
+}
+
+TraceRing* Tracer::threadRing(){
+    thread_local TraceRingHolder holder;
+    if (holder.ring == nullptr && !holder.failed) {
+        {
+            std::lock_guard<std::mutex> lock(ringsMutex);
+            if (!freeRings.empty()) {
+                holder.ring = freeRings.back();
+                freeRings.pop_back();
+                return holder.ring;
+            }
+        }
+        holder.ring = createRing();
+        // thread which failed to create file doesn't try it again for every record
+        holder.failed = holder.ring == nullptr;
+    }
+    return holder.ring;
+}
+
+TraceRing* Tracer::createRing(){
+    std::string path;
+    uint32_t index;
+    {
+        std::lock_guard<std::mutex> lock(ringsMutex);
+        index = ringCount++;
+        path = directory + "/tftp-" + std::to_string(getpid()) + "-" + std::to_string(index) + ".trace";
+    }
+
+    size_t size = sizeof(TraceFileHeader) + sizeof(TraceRecord) * TRACE_RING_RECORDS;
+    int fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        Logger::instance().log(LogLevel::ERROR, "Failed to create trace file " + path + ": " + std::string(strerror(errno)));
+        return nullptr;
+    }
+    // file is sparse, only pages of written records take space
+    if (ftruncate(fd, size) < 0) {
+        Logger::instance().log(LogLevel::ERROR, "Failed to resize trace file " + path + ": " + std::string(strerror(errno)));
+        close(fd);
+        return nullptr;
+    }
+    void* mapping = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED) {
+        Logger::instance().log(LogLevel::ERROR, "Failed to map trace file " + path + ": " + std::string(strerror(errno)));
+        return nullptr;
+    }
+
+    TraceRing* ring = new TraceRing();
+    ring->header = new (mapping) TraceFileHeader();
+    ring->header->magic = TRACE_MAGIC;
+    ring->header->version = TRACE_VERSION;
+    ring->header->recordSize = sizeof(TraceRecord);
+    ring->header->capacity = TRACE_RING_RECORDS;
+    ring->header->monotonicNs = clockNs(CLOCK_MONOTONIC);
+    ring->header->realtimeNs = clockNs(CLOCK_REALTIME);
+    ring->header->pid = getpid();
+    ring->header->ring = index;
+    ring->header->head.store(0, std::memory_order_release);
+    ring->records = reinterpret_cast<TraceRecord*>(static_cast<char*>(mapping) + sizeof(TraceFileHeader));
+    Logger::instance().log("Tracing into " + path);
+    return ring;
+}
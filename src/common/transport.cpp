@@ -0,0 +1,124 @@
+/**
+ * @file common/transport.cpp
+ * @brief Implementation of transport of kernel sockets and of steady clock
+ * @author Lukas Vecerka (xvecer30)
+*/
+#include "common/transport.hpp"
+#include "common/packets.hpp"
+#include "common/logger.hpp"
+#include <cstring>
+#include <cerrno>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/udp.h>
+
+Clock& Clock::system(){
+    static Clock clock;
+    return clock;
+}
+
+Transport& Transport::system(){
+    // Transport is never destroyed, sessions of threads still running at exit can use it
+    static SocketTransport* transport = new SocketTransport();
+    return *transport;
+}
+
+ssize_t SocketTransport::send(int socket, const char* data, size_t size, const sockaddr_in& addr){
+    return sendto(socket, data, size, 0, (const struct sockaddr*)&addr, sizeof(addr));
+}
+
+bool SocketTransport::sendSegmented(int socket, const char* burst, size_t size, uint16_t segmentSize, const sockaddr_in& addr){
+    if (!DataPacket::gsoEnabled.load()) {
+        return false;
+    }
+
+    struct iovec iov;
+    iov.iov_base = const_cast<char*>(burst);
+    iov.iov_len = size;
+
+    char control[CMSG_SPACE(sizeof(uint16_t))] = {};
+    struct msghdr msg = {};
+    msg.msg_name = (void*)&addr;
+    msg.msg_namelen = sizeof(addr);
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+
+    struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_UDP;
+    cmsg->cmsg_type = UDP_SEGMENT;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+    std::memcpy(CMSG_DATA(cmsg), &segmentSize, sizeof(segmentSize));
+
+    if (sendmsg(socket, &msg, 0) < 0) {
+        if (errno == EIO || errno == EINVAL || errno == ENOPROTOOPT || errno == EOPNOTSUPP) {
+            // kernel or device doesn't support segmentation offload, don't try it again
+            DataPacket::gsoEnabled.store(false);
+            Logger::instance().log("UDP GSO is not supported, sending DATA packets separately");
+            return false;
+        }
+        if (errno == EMSGSIZE) {
+            return false;
+        }
+        Logger::instance().log(LogLevel::ERROR, "Failed to send data");
+    }
+    return true;
+}
+
+ssize_t SocketTransport::receive(int socket, char* buffer, size_t size, sockaddr_in& from, int flags){
+    socklen_t fromLen = sizeof(from);
+    return recvfrom(socket, buffer, size, flags, (struct sockaddr*)&from, &fromLen);
+}
+
+ssize_t SocketTransport::receiveSegmented(int socket, char* buffer, size_t size, sockaddr_in& from, int flags, size_t& segmentSize){
+    struct iovec iov;
+    iov.iov_base = buffer;
+    iov.iov_len = size;
+    char control[CMSG_SPACE(sizeof(int))] = {};
+    struct msghdr msg = {};
+    msg.msg_name = &from;
+    msg.msg_namelen = sizeof(from);
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+
+    ssize_t received = recvmsg(socket, &msg, flags);
+    if (received < 0){
+        return received;
+    }
+
+    // Kernel reports size of coalesced segments in control message
+    segmentSize = received;
+    for (struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg); cmsg != nullptr; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+        if (cmsg->cmsg_level == SOL_UDP && cmsg->cmsg_type == UDP_GRO) {
+            int gsoSize;
+            std::memcpy(&gsoSize, CMSG_DATA(cmsg), sizeof(gsoSize));
+            if (gsoSize > 0) {
+                segmentSize = gsoSize;
+            }
+        }
+    }
+    return received;
+}
+
+bool SocketTransport::setOption(int socket, int level, int name, int value){
+    return setsockopt(socket, level, name, &value, sizeof(value)) == 0;
+}
+
+bool SocketTransport::setReceiveTimeout(int socket, int seconds){
+    struct timeval tv;
+    tv.tv_sec = seconds;
+    tv.tv_usec = 0;
+    return setsockopt(socket, SOL_SOCKET, SO_RCVTIMEO, (const char*)&tv, sizeof tv) == 0;
+}
+
+bool SocketTransport::localAddress(int socket, sockaddr_in& addr){
+    socklen_t len = sizeof(addr);
+    return getsockname(socket, (struct sockaddr*)&addr, &len) == 0;
+}
+
+void SocketTransport::close(int socket){
+    ::close(socket);
+}
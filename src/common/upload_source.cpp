@@ -0,0 +1,180 @@
+/**
+ * @file common/upload_source.cpp
+ * @brief Implementation of sources of uploaded data
+ * @author Lukas Vecerka (xvecer30)
+*/
+#include "common/upload_source.hpp"
+#include "common/logger.hpp"
+#include <algorithm>
+#include <cstring>
+#include <cerrno>
+#include <stdexcept>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+std::unique_ptr<UploadSource> UploadSource::open(const std::string& path){
+    bool isStdin = path.empty() || path == "stdin";
+    int fd = isStdin ? STDIN_FILENO : ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return nullptr;
+    }
+    return fromFd(fd, !isStdin);
+}
+
+std::unique_ptr<UploadSource> UploadSource::fromFd(int fd, bool ownsFd){
+    struct stat st;
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode)) {
+        try {
+            auto source = std::make_unique<MappedSource>(fd, st.st_size);
+            // Mapping stays valid after descriptor is closed
+            if (ownsFd) {
+                close(fd);
+            }
+            return source;
+        } catch (const std::runtime_error& e) {
+            Logger::instance().log(std::string(e.what()) + ", falling back to prefetching");
+        }
+    }
+    return std::make_unique<PrefetchSource>(fd, ownsFd);
+}
+
+MemorySource::MemorySource(std::vector<char> data)
+    : data(std::move(data)), offset(0) {}
+
+size_t MemorySource::read(char* buffer, size_t size){
+    size_t count = std::min(size, data.size() - offset);
+    std::memcpy(buffer, data.data() + offset, count);
+    offset += count;
+    return count;
+}
+
+SharedSource::SharedSource(std::shared_ptr<const std::vector<char>> data)
+    : data(std::move(data)), offset(0) {}
+
+size_t SharedSource::read(char* buffer, size_t size){
+    size_t count = std::min(size, data->size() - offset);
+    std::memcpy(buffer, data->data() + offset, count);
+    offset += count;
+    return count;
+}
+
+MappedSource::MappedSource(int fd, size_t size)
+    : mapping(nullptr), size(size), offset(0) {
+        // Empty file can't be mapped, there is nothing to read anyway
+        if (size == 0) {
+            return;
+        }
+        void* address = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (address == MAP_FAILED) {
+            throw std::runtime_error("Failed to map file: " + std::string(strerror(errno)));
+        }
+        mapping = static_cast<char*>(address);
+        madvise(mapping, size, MADV_SEQUENTIAL);
+        madvise(mapping, size, MADV_WILLNEED);
+    }
+
+MappedSource::~MappedSource(){
+    if (mapping != nullptr) {
+        munmap(mapping, size);
+    }
+}
+
+size_t MappedSource::read(char* buffer, size_t size){
+    size_t count = std::min(size, this->size - offset);
+    std::memcpy(buffer, mapping + offset, count);
+    offset += count;
+    return count;
+}
+
+PrefetchSource::PrefetchSource(int fd, bool ownsFd)
+    : fd(fd), ownsFd(ownsFd), chunkOffset(0), finished(false), stopped(false), error(0) {
+        prefetcher = std::thread(&PrefetchSource::prefetch, this);
+    }
+
+PrefetchSource::~PrefetchSource(){
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopped = true;
+    }
+    chunkTaken.notify_all();
+    prefetcher.join();
+    if (ownsFd) {
+        close(fd);
+    }
+}
+
+void PrefetchSource::prefetch(){
+    std::vector<char> chunk(PREFETCH_CHUNK_SIZE);
+    size_t filled = 0;
+    while (true) {
+        // Poll with timeout so thread notices stop even when writer of pipe is stuck
+        pollfd pfd = {fd, POLLIN, 0};
+        int ready = poll(&pfd, 1, PREFETCH_POLL_MS);
+        int readError = 0;
+        bool end = false;
+        if (ready < 0 && errno != EINTR) {
+            readError = errno;
+        } else if (ready > 0) {
+            ssize_t count = ::read(fd, chunk.data() + filled, chunk.size() - filled);
+            if (count < 0 && errno != EINTR && errno != EAGAIN) {
+                readError = errno;
+            }
+            end = count == 0;
+            filled += std::max<ssize_t>(count, 0);
+        }
+
+        std::unique_lock<std::mutex> lock(mutex);
+        if (stopped) {
+            return;
+        }
+        // Chunk is handed over when it is full, when reader has nothing to read or at the end,
+        // so slow pipe doesn't delay transfer until whole chunk is filled
+        bool last = end || readError != 0;
+        if (filled > 0 && (filled == chunk.size() || chunks.empty() || last)) {
+            chunkTaken.wait(lock, [this]() { return stopped || chunks.size() < PREFETCH_MAX_CHUNKS; });
+            if (stopped) {
+                return;
+            }
+            chunk.resize(filled);
+            chunks.push_back(std::move(chunk));
+            chunk = std::vector<char>(PREFETCH_CHUNK_SIZE);
+            filled = 0;
+            chunkReady.notify_one();
+        }
+        if (last) {
+            error = readError;
+            finished = true;
+            chunkReady.notify_one();
+            return;
+        }
+    }
+}
+
+size_t PrefetchSource::read(char* buffer, size_t size){
+    size_t copied = 0;
+    std::unique_lock<std::mutex> lock(mutex);
+    while (copied < size) {
+        chunkReady.wait(lock, [this]() { return !chunks.empty() || finished; });
+        if (chunks.empty()) {
+            if (error != 0) {
+                throw std::runtime_error("Failed to read data from source: " + std::string(strerror(error)));
+            }
+            break;
+        }
+
+        std::vector<char>& chunk = chunks.front();
+        size_t count = std::min(size - copied, chunk.size() - chunkOffset);
+        std::memcpy(buffer + copied, chunk.data() + chunkOffset, count);
+        copied += count;
+        chunkOffset += count;
+        if (chunkOffset == chunk.size()) {
+            chunks.pop_front();
+            chunkOffset = 0;
+            chunkTaken.notify_one();
+        }
+    }
+    return copied;
+}
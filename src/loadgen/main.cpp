@@ -0,0 +1,484 @@
+/**
+ * @file loadgen/main.cpp
+ * @brief Entrypoint for load generator, many concurrent transfers are driven from one event loop
+ * against running server and their throughput, completion latency and failures are reported
+ * @author Lukas Vecerka (xvecer30)
+*/
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <memory>
+#include <random>
+#include <chrono>
+#include <optional>
+#include <algorithm>
+#include <filesystem>
+#include <cstring>
+#include <getopt.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include "client/async_client.hpp"
+#include "common/metrics.hpp"
+#include "common/logger.hpp"
+#include "common/net_emulator.hpp"
+
+#define DEFAULT_SESSIONS 1000
+#define DEFAULT_CONCURRENCY 100
+#define DEFAULT_SEED 1
+#define SCRAPE_TIMEOUT_MS 1000
+
+/**
+ * @brief One kind of transfer of file mix
+ * @note size - size of uploaded data, unused for downloads
+ * @note weight - relative frequency of transfer in mix
+*/
+struct MixEntry {
+    SessionType type;
+    std::string path;
+    uint64_t size;
+    unsigned weight;
+    uint64_t completed = 0;
+    uint64_t failed = 0;
+    std::shared_ptr<const std::vector<char>> payload;
+};
+
+/**
+ * @brief Function for parsing entry of file mix
+ * @param spec Entry as get:remote_path[:weight] or put:remote_name:size[:weight]
+ * @return Parsed entry, std::nullopt if entry is invalid
+*/
+static std::optional<MixEntry> parseMixEntry(const std::string& spec){
+    std::vector<std::string> parts;
+    size_t start = 0;
+    while (true) {
+        size_t colon = spec.find(':', start);
+        parts.push_back(spec.substr(start, colon - start));
+        if (colon == std::string::npos) {
+            break;
+        }
+        start = colon + 1;
+    }
+
+    MixEntry entry{SessionType::READ, "", 0, 1};
+    size_t weightIndex;
+    try {
+        if (parts[0] == "get" && (parts.size() == 2 || parts.size() == 3)) {
+            weightIndex = 2;
+        } else if (parts[0] == "put" && (parts.size() == 3 || parts.size() == 4)) {
+            entry.type = SessionType::WRITE;
+            entry.size = std::stoull(parts[2]);
+            weightIndex = 3;
+        } else {
+            return std::nullopt;
+        }
+        if (parts.size() > weightIndex) {
+            entry.weight = std::stoul(parts[weightIndex]);
+        }
+    } catch (const std::exception& e) {
+        return std::nullopt;
+    }
+    entry.path = parts[1];
+    if (entry.path.empty() || entry.weight == 0) {
+        return std::nullopt;
+    }
+    return entry;
+}
+
+/**
+ * @brief Function for reading value of counter from metrics in Prometheus text format
+ * @param text The metrics
+ * @param name Name of sample with labels
+ * @return Value of sample, std::nullopt if it isn't present
+*/
+static std::optional<uint64_t> findSample(const std::string& text, const std::string& name){
+    size_t pos = 0;
+    while ((pos = text.find(name + " ", pos)) != std::string::npos) {
+        if (pos == 0 || text[pos - 1] == '\n') {
+            return std::stoull(text.substr(pos + name.size() + 1));
+        }
+        pos += name.size();
+    }
+    return std::nullopt;
+}
+
+/**
+ * @brief Function for downloading metrics of server from its endpoint
+ * @param address Address of endpoint in same form as -M of server
+ * @return Body of response, std::nullopt if endpoint can't be reached
+*/
+static std::optional<std::string> scrapeMetrics(const std::string& address){
+    int fd;
+    if (!address.empty() && address[0] == '/') {
+        sockaddr_un addr{};
+        addr.sun_family = AF_UNIX;
+        if (address.size() >= sizeof(addr.sun_path)) {
+            return std::nullopt;
+        }
+        std::strcpy(addr.sun_path, address.c_str());
+        fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (fd < 0 || connect(fd, (struct sockaddr*)&addr, sizeof(addr)) < 0) {
+            close(fd);
+            return std::nullopt;
+        }
+    } else {
+        sockaddr_in addr{};
+        addr.sin_family = AF_INET;
+        std::string host = "127.0.0.1";
+        std::string port = address;
+        size_t colon = address.rfind(':');
+        if (colon != std::string::npos) {
+            host = address.substr(0, colon);
+            port = address.substr(colon + 1);
+        }
+        try {
+            addr.sin_port = htons(std::stoi(port));
+        } catch (const std::exception& e) {
+            return std::nullopt;
+        }
+        if (inet_pton(AF_INET, host.c_str(), &addr.sin_addr) != 1) {
+            return std::nullopt;
+        }
+        fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (fd < 0 || connect(fd, (struct sockaddr*)&addr, sizeof(addr)) < 0) {
+            close(fd);
+            return std::nullopt;
+        }
+    }
+    struct timeval tv;
+    tv.tv_sec = SCRAPE_TIMEOUT_MS / 1000;
+    tv.tv_usec = SCRAPE_TIMEOUT_MS % 1000 * 1000;
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+
+    const char request[] = "GET /metrics HTTP/1.0\r\n\r\n";
+    std::string response;
+    if (send(fd, request, sizeof(request) - 1, MSG_NOSIGNAL) == sizeof(request) - 1) {
+        char buffer[4096];
+        ssize_t received;
+        while ((received = recv(fd, buffer, sizeof(buffer), 0)) > 0) {
+            response.append(buffer, received);
+        }
+    }
+    close(fd);
+    size_t body = response.find("\r\n\r\n");
+    if (response.rfind("HTTP/1.0 200", 0) != 0 || body == std::string::npos) {
+        return std::nullopt;
+    }
+    return response.substr(body + 4);
+}
+
+/**
+ * @brief Function for reading retransmissions counter of server
+ * @param address Address of metrics endpoint, empty if server isn't scraped
+ * @return Value of counter, std::nullopt if it can't be read
+*/
+static std::optional<uint64_t> serverRetransmissions(const std::string& address){
+    if (address.empty()) {
+        return std::nullopt;
+    }
+    std::optional<std::string> metrics = scrapeMetrics(address);
+    if (!metrics) {
+        return std::nullopt;
+    }
+    return findSample(*metrics, "tftp_retransmissions_total");
+}
+
+/**
+ * @brief Function for removing directory with files uploaded by this run
+ * @param uploadDir Directory of uploads inside root directory of server
+ * @return Number of removed files
+*/
+static size_t removeUploads(const std::string& uploadDir){
+    std::error_code error;
+    std::uintmax_t removed = std::filesystem::remove_all(uploadDir, error);
+    // directory itself is counted too
+    return error || removed == 0 ? 0 : removed - 1;
+}
+
+/**
+ * @brief Function for raising limit of open descriptors, every running session needs its socket
+*/
+static void raiseDescriptorLimit(){
+    struct rlimit limit;
+    if (getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur < limit.rlim_max) {
+        limit.rlim_cur = limit.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &limit);
+    }
+}
+
+/**
+ * @brief Function for logging usage of load generator
+ * @param program Name of program
+*/
+static void printUsage(const std::string& program){
+    std::cerr << "Usage: " << program << " [-h hostname] [-p port] -f get:path[:weight] | put:name:size[:weight] ... [-n sessions] [-c concurrency] [-r rate]"
+              << " [-b blksize] [-w windowsize] [-o timeout] [-m netascii|octet] [-S seed] [-M server_metrics] [-E emulation] [-d root_dir] [-v]" << std::endl;
+}
+
+// Define the long options
+static struct option long_options[] = {
+    {"hostname", required_argument, 0, 'h'},
+    {"port", required_argument, 0, 'p'},
+    {"file", required_argument, 0, 'f'},
+    {"sessions", required_argument, 0, 'n'},
+    {"concurrency", required_argument, 0, 'c'},
+    {"rate", required_argument, 0, 'r'},
+    {"blksize", required_argument, 0, 'b'},
+    {"windowsize", required_argument, 0, 'w'},
+    {"timeout", required_argument, 0, 'o'},
+    {"mode", required_argument, 0, 'm'},
+    {"seed", required_argument, 0, 'S'},
+    {"metrics", required_argument, 0, 'M'},
+    {"emulate", required_argument, 0, 'E'},
+    {"root", required_argument, 0, 'd'},
+    {"verbose", no_argument, 0, 'v'},
+    {0, 0, 0, 0} // End of array need to be filled with 0s
+};
+
+/**
+ * Entrypoint for load generator
+ * @param argc The number of arguments
+ * @param argv The arguments
+ * @return 0 if all sessions completed, 1 otherwise
+*/
+int main(int argc, char* argv[]) {
+    std::string hostname = "127.0.0.1";
+    int port = 69;
+    std::vector<MixEntry> mix;
+    uint64_t sessions = DEFAULT_SESSIONS;
+    uint64_t concurrency = DEFAULT_CONCURRENCY;
+    double rate = 0;
+    DataMode mode = DataMode::OCTET;
+    uint64_t seed = DEFAULT_SEED;
+    std::string metricsAddress;
+    std::string rootDir;
+    bool verbose = false;
+    OptionTable options;
+    int option_index = 0;
+    int option;
+
+    while ((option = getopt_long(argc, argv, "h:p:f:n:c:r:b:w:o:m:S:M:E:d:v", long_options, &option_index)) != -1) {
+        try {
+            switch (option) {
+                case 'h':
+                    hostname = optarg;
+                    break;
+                case 'p':
+                    port = std::stoi(optarg);
+                    if (port <= 0 || port > 65535) {
+                        throw std::invalid_argument("port");
+                    }
+                    break;
+                case 'f': {
+                    std::optional<MixEntry> entry = parseMixEntry(optarg);
+                    if (!entry) {
+                        std::cerr << "Invalid file mix entry " << optarg << std::endl;
+                        printUsage(argv[0]);
+                        return 1;
+                    }
+                    mix.push_back(*entry);
+                    break;
+                }
+                case 'n':
+                    sessions = std::stoull(optarg);
+                    break;
+                case 'c':
+                    concurrency = std::stoull(optarg);
+                    if (concurrency == 0) {
+                        throw std::invalid_argument("concurrency");
+                    }
+                    break;
+                case 'r':
+                    rate = std::stod(optarg);
+                    if (rate < 0) {
+                        throw std::invalid_argument("rate");
+                    }
+                    break;
+                case 'b':
+                case 'w':
+                case 'o': {
+                    OptionId id = option == 'b' ? OptionId::BLKSIZE : option == 'o' ? OptionId::TIMEOUT : OptionId::WINDOWSIZE;
+                    uint64_t min = option == 'b' ? MIN_BLOCK_SIZE : option == 'o' ? MIN_TIMEOUT : MIN_WINDOW_SIZE;
+                    uint64_t max = option == 'b' ? MAX_BLOCK_SIZE : option == 'o' ? MAX_TIMEOUT : MAX_WINDOW_SIZE;
+                    uint64_t value = std::stoull(optarg);
+                    if (value < min || value > max) {
+                        std::cerr << "Invalid " << optionName(id) << " value. It should be between " << min << " and " << max << "." << std::endl;
+                        return 1;
+                    }
+                    options.set(id, value);
+                    break;
+                }
+                case 'm':
+                    mode = stringToMode(optarg);
+                    break;
+                case 'S':
+                    seed = std::stoull(optarg);
+                    break;
+                case 'M':
+                    metricsAddress = optarg;
+                    break;
+                case 'E':
+                    if (!NetworkEmulator::instance().configure(optarg)) {
+                        return 1;
+                    }
+                    break;
+                case 'd':
+                    rootDir = optarg;
+                    break;
+                case 'v':
+                    verbose = true;
+                    break;
+                default:
+                    printUsage(argv[0]);
+                    return 1;
+            }
+        } catch (const std::exception& e) {
+            std::cerr << "Invalid value of -" << static_cast<char>(option) << ": " << optarg << std::endl;
+            printUsage(argv[0]);
+            return 1;
+        }
+    }
+    if (mix.empty() || sessions == 0) {
+        printUsage(argv[0]);
+        return 1;
+    }
+
+    // Packets of thousands of sessions would be logged otherwise
+    Logger::instance().setEnabled(verbose);
+    raiseDescriptorLimit();
+
+    // Upload payload is text, so it is valid in netascii as well
+    std::mt19937_64 random(seed);
+    for (auto& entry : mix) {
+        if (entry.type == SessionType::WRITE) {
+            auto payload = std::make_shared<std::vector<char>>(entry.size);
+            for (size_t i = 0; i < payload->size(); i++) {
+                (*payload)[i] = (i % 64 == 63) ? '\n' : static_cast<char>('a' + random() % 26);
+            }
+            entry.payload = payload;
+        }
+    }
+    std::vector<unsigned> weights;
+    for (const auto& entry : mix) {
+        weights.push_back(entry.weight);
+    }
+    std::discrete_distribution<size_t> pickEntry(weights.begin(), weights.end());
+    std::exponential_distribution<double> interArrival(rate > 0 ? rate : 1);
+
+    std::unique_ptr<AsyncClient> client;
+    try {
+        client = std::make_unique<AsyncClient>(hostname, port);
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+    client->setOptions(options);
+    client->setMode(mode);
+
+    std::optional<uint64_t> retransmissionsBefore = serverRetransmissions(metricsAddress);
+    if (!metricsAddress.empty() && !retransmissionsBefore) {
+        std::cerr << "Failed to read metrics of server from " << metricsAddress << std::endl;
+    }
+
+    using Clock = std::chrono::steady_clock;
+    std::vector<double> latencies;
+    latencies.reserve(sessions);
+    uint64_t issued = 0, finished = 0, inFlight = 0, bytes = 0;
+    Clock::time_point start = Clock::now();
+    Clock::time_point nextArrival = start;
+    // When root of server is known, uploads of run go into its own directory which is removed at once,
+    // otherwise they share root directory and only their names tell runs apart
+    std::string prefix = "bench-" + std::to_string(getpid()) + "-";
+    std::string uploadDir;
+    if (!rootDir.empty()) {
+        uploadDir = rootDir + "/bench-" + std::to_string(getpid());
+        std::error_code error;
+        if (!std::filesystem::create_directory(uploadDir, error)) {
+            std::cerr << "Failed to create directory for uploads " << uploadDir << (error ? ": " + error.message() : "") << std::endl;
+            return 1;
+        }
+        prefix = "bench-" + std::to_string(getpid()) + "/";
+    }
+
+    while (finished < sessions) {
+        Clock::time_point now = Clock::now();
+        // Open loop arrivals wait for free slot, latency is measured from arrival so waiting counts
+        while (issued < sessions && inFlight < concurrency && nextArrival <= now) {
+            MixEntry& entry = mix[pickEntry(random)];
+            Clock::time_point arrival = rate > 0 ? nextArrival : now;
+            auto done = [&, arrival, entryPtr = &entry](const TransferResult& result) {
+                inFlight--;
+                finished++;
+                if (result.ok) {
+                    entryPtr->completed++;
+                    bytes += result.bytes;
+                    latencies.push_back(std::chrono::duration<double>(Clock::now() - arrival).count());
+                } else {
+                    entryPtr->failed++;
+                }
+            };
+            inFlight++;
+            issued++;
+            if (entry.type == SessionType::READ) {
+                client->get(entry.path, std::make_shared<DiscardSink>(), done);
+            } else {
+                // Server refuses to overwrite files, so every upload gets its own name
+                client->put(prefix + std::to_string(issued) + "-" + entry.path, std::make_unique<SharedSource>(entry.payload), entry.size, done);
+            }
+            if (rate > 0) {
+                nextArrival += std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(interArrival(random)));
+            }
+        }
+
+        int waitMs = -1;
+        if (issued < sessions && inFlight < concurrency) {
+            waitMs = std::max<int64_t>(0, std::chrono::duration_cast<std::chrono::milliseconds>(nextArrival - Clock::now()).count());
+        }
+        client->runOnce(waitMs);
+    }
+    double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+    // Server acknowledges last block only after file is written, so all uploads are complete now
+    size_t removedUploads = uploadDir.empty() ? 0 : removeUploads(uploadDir);
+
+    std::optional<uint64_t> retransmissionsAfter = serverRetransmissions(metricsAddress);
+    // Client sessions of this process count into its own metrics
+    std::string ownMetrics = Metrics::instance().render();
+    uint64_t clientRetransmissions = findSample(ownMetrics, "tftp_retransmissions_total").value_or(0);
+    uint64_t clientTimeouts = findSample(ownMetrics, "tftp_timeouts_total").value_or(0);
+
+    uint64_t failed = 0;
+    for (const auto& entry : mix) {
+        failed += entry.failed;
+    }
+    std::sort(latencies.begin(), latencies.end());
+    auto percentile = [&latencies](double p) {
+        return latencies[std::min(latencies.size() - 1, static_cast<size_t>(latencies.size() * p))] * 1e3;
+    };
+
+    std::cout << std::fixed << std::setprecision(3);
+    std::cout << "sessions " << sessions << " completed " << sessions - failed << " failed " << failed
+              << " in " << seconds << " s (" << (sessions - failed) / seconds << " sessions/s)" << std::endl;
+    std::cout << "throughput " << bytes / seconds / 1e6 << " MB/s (" << bytes << " B)" << std::endl;
+    if (!latencies.empty()) {
+        std::cout << "latency ms min=" << latencies.front() * 1e3 << " p50=" << percentile(0.5) << " p90=" << percentile(0.9)
+                  << " p99=" << percentile(0.99) << " p999=" << percentile(0.999) << " max=" << latencies.back() * 1e3 << std::endl;
+    }
+    std::cout << "client retransmissions " << clientRetransmissions << " timeouts " << clientTimeouts << std::endl;
+    if (retransmissionsBefore && retransmissionsAfter) {
+        std::cout << "server retransmissions " << *retransmissionsAfter - *retransmissionsBefore << std::endl;
+    } else {
+        std::cout << "server retransmissions unknown" << (metricsAddress.empty() ? " (server metrics not given, see -M)" : "") << std::endl;
+    }
+    for (const auto& entry : mix) {
+        std::cout << "  " << (entry.type == SessionType::READ ? "get " : "put ") << entry.path
+                  << " completed " << entry.completed << " failed " << entry.failed << std::endl;
+    }
+    if (!rootDir.empty()) {
+        std::cout << "removed " << removedUploads << " uploaded files from " << uploadDir << std::endl;
+    }
+    return failed == 0 ? 0 : 1;
+}
@@ -0,0 +1,316 @@
+/**
+ * @file replay/main.cpp
+ * @brief Entrypoint for replay tool, workload captured by server or imported from pcap is reissued
+ * against server with recorded arrivals, files, options and modes and compared with the recording
+ * @author Lukas Vecerka (xvecer30)
+*/
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <memory>
+#include <chrono>
+#include <algorithm>
+#include <filesystem>
+#include <unordered_map>
+#include <getopt.h>
+#include <unistd.h>
+#include "client/async_client.hpp"
+#include "common/capture.hpp"
+#include "common/logger.hpp"
+#include "common/net_emulator.hpp"
+#include "replay/pcap_import.hpp"
+
+#define DEFAULT_SPEED 1.0
+
+/**
+ * @brief Result of replayed session
+ * @note lagUs - how much later than scheduled the session was issued
+*/
+struct Replayed {
+    bool done = false;
+    bool ok = false;
+    uint64_t bytes = 0;
+    uint64_t durationUs = 0;
+    uint64_t lagUs = 0;
+};
+
+/**
+ * @brief Function for printing usage of replay tool
+ * @param program Name of program
+*/
+static void printUsage(const char* program){
+    std::cerr << "Usage: " << program << " [-h host] [-p port] [-x speed] [-c concurrency] [-d root_dir] [-E emulation] [-v] <capture|pcap>" << std::endl;
+}
+
+/**
+ * @brief Function for getting size of data of session, recorded transfer size is preferred over tsize
+ * @param session The session
+ * @return Size of data, -1 if it is unknown
+*/
+static int64_t sessionSize(const CapturedSession& session){
+    if (session.finished && session.ok) {
+        return session.bytes;
+    }
+    if (session.options.has(OptionId::TSIZE) && (session.type == SessionType::WRITE || session.options.get(OptionId::TSIZE) > 0)) {
+        return session.options.get(OptionId::TSIZE);
+    }
+    return -1;
+}
+
+/**
+ * @brief Function for creating files which downloads of workload need and which are missing in root directory
+ * @param sessions Sessions of workload
+ * @param rootDir Root directory of server
+ * @return Number of created files
+*/
+static size_t prepareFiles(const std::vector<CapturedSession>& sessions, const std::string& rootDir){
+    size_t created = 0;
+    for (const auto& session : sessions) {
+        int64_t size = sessionSize(session);
+        if (session.type != SessionType::READ || size < 0) {
+            continue;
+        }
+        std::filesystem::path path = std::filesystem::path(rootDir) / std::filesystem::path(session.filename).relative_path();
+        if (std::filesystem::exists(path)) {
+            continue;
+        }
+        std::filesystem::create_directories(path.parent_path());
+        // Text content is valid in netascii as well
+        std::ofstream file(path, std::ios::binary);
+        std::string line(63, 'x');
+        line += '\n';
+        for (int64_t written = 0; written < size; written += line.size()) {
+            file.write(line.data(), std::min<int64_t>(line.size(), size - written));
+        }
+        created++;
+    }
+    return created;
+}
+
+/**
+ * @brief Function for getting percentile of sorted values
+ * @param values Sorted values in microseconds
+ * @param p Percentile in range 0-1
+ * @return Percentile in milliseconds, 0 if there is no value
+*/
+static double percentileMs(const std::vector<uint64_t>& values, double p){
+    if (values.empty()) {
+        return 0;
+    }
+    return values[std::min(values.size() - 1, static_cast<size_t>(values.size() * p))] / 1e3;
+}
+
+int main(int argc, char* argv[]){
+    std::string hostname = "localhost";
+    int port = 69;
+    double speed = DEFAULT_SPEED;
+    uint64_t concurrency = 0;
+    std::string rootDir;
+    bool verbose = false;
+
+    static struct option longOptions[] = {
+        {"host", required_argument, nullptr, 'h'},
+        {"port", required_argument, nullptr, 'p'},
+        {"speed", required_argument, nullptr, 'x'},
+        {"concurrency", required_argument, nullptr, 'c'},
+        {"root", required_argument, nullptr, 'd'},
+        {"emulate", required_argument, nullptr, 'E'},
+        {"verbose", no_argument, nullptr, 'v'},
+        {nullptr, 0, nullptr, 0}
+    };
+
+    int option;
+    while ((option = getopt_long(argc, argv, "h:p:x:c:d:E:v", longOptions, nullptr)) != -1) {
+        try {
+            switch (option) {
+                case 'h':
+                    hostname = optarg;
+                    break;
+                case 'p':
+                    port = std::stoi(optarg);
+                    if (port <= 0 || port > 65535) {
+                        throw std::invalid_argument("port");
+                    }
+                    break;
+                case 'x':
+                    speed = std::stod(optarg);
+                    if (speed < 0) {
+                        throw std::invalid_argument("speed");
+                    }
+                    break;
+                case 'c':
+                    concurrency = std::stoull(optarg);
+                    break;
+                case 'd':
+                    rootDir = optarg;
+                    break;
+                case 'E':
+                    if (!NetworkEmulator::instance().configure(optarg)) {
+                        return 1;
+                    }
+                    break;
+                case 'v':
+                    verbose = true;
+                    break;
+                default:
+                    printUsage(argv[0]);
+                    return 1;
+            }
+        } catch (const std::exception& e) {
+            std::cerr << "Invalid value of -" << static_cast<char>(option) << ": " << optarg << std::endl;
+            printUsage(argv[0]);
+            return 1;
+        }
+    }
+    if (optind != argc - 1) {
+        printUsage(argv[0]);
+        return 1;
+    }
+    std::string path = argv[optind];
+
+    std::vector<CapturedSession> sessions;
+    try {
+        sessions = isPcap(path) ? importPcap(path) : loadCapture(path);
+        if (!rootDir.empty()) {
+            size_t created = prepareFiles(sessions, rootDir);
+            std::cout << "created " << created << " missing files in " << rootDir << std::endl;
+        }
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+    if (sessions.empty()) {
+        std::cerr << "No session in " << path << std::endl;
+        return 1;
+    }
+
+    // Packets of thousands of sessions would be logged otherwise
+    Logger::instance().setEnabled(verbose);
+
+    std::unique_ptr<AsyncClient> client;
+    try {
+        client = std::make_unique<AsyncClient>(hostname, port);
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+
+    // Payloads of uploads are generated once per size
+    std::unordered_map<int64_t, std::shared_ptr<const std::vector<char>>> payloads;
+    auto payloadOf = [&payloads](int64_t size) {
+        auto& payload = payloads[size];
+        if (!payload) {
+            auto data = std::make_shared<std::vector<char>>(size);
+            for (int64_t i = 0; i < size; i++) {
+                (*data)[i] = (i % 64 == 63) ? '\n' : 'x';
+            }
+            payload = data;
+        }
+        return payload;
+    };
+
+    using Clock = std::chrono::steady_clock;
+    std::vector<Replayed> results(sessions.size());
+    size_t issued = 0, finished = 0, inFlight = 0;
+    Clock::time_point start = Clock::now();
+    Clock::time_point lastEnd = start;
+    std::string prefix = "replay-" + std::to_string(getpid()) + "-";
+
+    while (finished < sessions.size()) {
+        Clock::time_point now = Clock::now();
+        auto due = [&](size_t index) {
+            if (speed == 0) {
+                return start;
+            }
+            return start + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double, std::micro>(sessions[index].offsetUs / speed));
+        };
+        while (issued < sessions.size() && (concurrency == 0 || inFlight < concurrency) && due(issued) <= now) {
+            const CapturedSession& session = sessions[issued];
+            results[issued].lagUs = std::chrono::duration_cast<std::chrono::microseconds>(now - due(issued)).count();
+            auto done = [&, index = issued, issuedAt = now](const TransferResult& transfer) {
+                Clock::time_point end = Clock::now();
+                Replayed& result = results[index];
+                inFlight--;
+                finished++;
+                result.done = true;
+                result.ok = transfer.ok;
+                result.bytes = transfer.bytes;
+                result.durationUs = std::chrono::duration_cast<std::chrono::microseconds>(end - issuedAt).count();
+                lastEnd = std::max(lastEnd, end);
+            };
+            client->setOptions(session.options);
+            client->setMode(session.mode);
+            inFlight++;
+            if (session.type == SessionType::READ) {
+                client->get(session.filename, std::make_shared<DiscardSink>(), done);
+            } else {
+                // Server refuses to overwrite files, so every upload gets its own name
+                int64_t size = std::max<int64_t>(0, sessionSize(session));
+                std::string name = prefix + std::to_string(issued) + "-" + std::filesystem::path(session.filename).filename().string();
+                client->put(name, std::make_unique<SharedSource>(payloadOf(size)), size, done);
+            }
+            issued++;
+        }
+
+        int waitMs = -1;
+        if (issued < sessions.size() && (concurrency == 0 || inFlight < concurrency)) {
+            waitMs = std::max<int64_t>(0, std::chrono::duration_cast<std::chrono::milliseconds>(due(issued) - Clock::now()).count());
+        }
+        client->runOnce(waitMs);
+    }
+    double replaySeconds = std::chrono::duration<double>(lastEnd - start).count();
+
+    // Recording is summarized only from sessions whose end was recorded
+    uint64_t recordedOk = 0, recordedFailed = 0, recordedBytes = 0, recordedEndUs = 0, retransmittedRequests = 0;
+    uint64_t replayOk = 0, replayFailed = 0, replayBytes = 0, mismatches = 0, downloads = 0;
+    std::vector<uint64_t> recordedDurations, replayDurations, lags;
+    for (size_t i = 0; i < sessions.size(); i++) {
+        const CapturedSession& session = sessions[i];
+        const Replayed& result = results[i];
+        downloads += session.type == SessionType::READ;
+        retransmittedRequests += session.requests - 1;
+        if (session.finished) {
+            (session.ok ? recordedOk : recordedFailed)++;
+            recordedEndUs = std::max(recordedEndUs, session.offsetUs + session.durationUs);
+            if (session.ok) {
+                recordedBytes += session.bytes;
+                recordedDurations.push_back(session.durationUs);
+            }
+            mismatches += session.ok != result.ok;
+        }
+        (result.ok ? replayOk : replayFailed)++;
+        if (result.ok) {
+            replayBytes += result.bytes;
+            replayDurations.push_back(result.durationUs);
+        }
+        lags.push_back(result.lagUs);
+    }
+    std::sort(recordedDurations.begin(), recordedDurations.end());
+    std::sort(replayDurations.begin(), replayDurations.end());
+    std::sort(lags.begin(), lags.end());
+    double recordedSeconds = recordedEndUs / 1e6;
+
+    auto row = [](const std::string& name, auto recorded, auto replayed) {
+        std::cout << std::left << std::setw(20) << name << std::right << std::setw(14) << recorded << std::setw(14) << replayed << std::endl;
+    };
+    std::cout << std::fixed << std::setprecision(3);
+    std::cout << "sessions: " << sessions.size() << " (" << downloads << " downloads, " << sessions.size() - downloads << " uploads), "
+              << retransmittedRequests << " retransmitted requests in recording, speed " << speed << "x" << std::endl;
+    row("", "recorded", "replay");
+    row("completed", recordedOk, replayOk);
+    row("failed", recordedFailed, replayFailed);
+    row("bytes", recordedBytes, replayBytes);
+    row("span s", recordedSeconds, replaySeconds);
+    row("throughput MiB/s", recordedSeconds > 0 ? recordedBytes / recordedSeconds / (1024 * 1024) : 0.0,
+        replaySeconds > 0 ? replayBytes / replaySeconds / (1024 * 1024) : 0.0);
+    row("duration p50 ms", percentileMs(recordedDurations, 0.5), percentileMs(replayDurations, 0.5));
+    row("duration p90 ms", percentileMs(recordedDurations, 0.9), percentileMs(replayDurations, 0.9));
+    row("duration p99 ms", percentileMs(recordedDurations, 0.99), percentileMs(replayDurations, 0.99));
+    row("duration max ms", recordedDurations.empty() ? 0.0 : recordedDurations.back() / 1e3, replayDurations.empty() ? 0.0 : replayDurations.back() / 1e3);
+    std::cout << "outcome differs from recording: " << mismatches << std::endl;
+    std::cout << "start lag ms: p50 " << percentileMs(lags, 0.5) << ", p99 " << percentileMs(lags, 0.99)
+              << ", max " << (lags.empty() ? 0.0 : lags.back() / 1e3) << std::endl;
+    return mismatches > 0 ? 1 : 0;
+}
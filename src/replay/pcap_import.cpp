@@ -0,0 +1,304 @@
+/**
+ * @file replay/pcap_import.cpp
+ * @brief Implementation of import of workload from pcap
+ * @author Lukas Vecerka (xvecer30)
+*/
+#include "replay/pcap_import.hpp"
+#include "common/packet_view.hpp"
+#include <fstream>
+#include <unordered_map>
+#include <algorithm>
+#include <stdexcept>
+#include <arpa/inet.h>
+
+// Link types of pcap header (LINKTYPE_*)
+#define LINK_NULL 0
+#define LINK_ETHERNET 1
+#define LINK_RAW_OPENBSD 12
+#define LINK_RAW_OPENBSD_ALT 14
+#define LINK_RAW 101
+#define LINK_LINUX_SLL 113
+#define LINK_IPV4 228
+#define LINK_LINUX_SLL2 276
+#define ETHERTYPE_IPV4 0x0800
+#define ETHERTYPE_VLAN 0x8100
+#define ETHERTYPE_QINQ 0x88a8
+// Largest snapshot length written by tcpdump and wireshark
+#define PCAP_MAX_RECORD_SIZE 262144
+
+/**
+ * @brief State of session reconstructed from packets
+ * @note nextBlock - next DATA block counted into bytes, retransmitted and reordered blocks are skipped
+ * @note startUs, lastUs - time of first request and of last packet of session
+*/
+struct Flow {
+    size_t index;
+    uint16_t blockSize;
+    uint16_t nextBlock;
+    bool dataSeen;
+    bool done;
+    uint64_t startUs;
+    uint64_t lastUs;
+};
+
+static uint16_t readBig16(const unsigned char* data){
+    return static_cast<uint16_t>((data[0] << 8) | data[1]);
+}
+
+static uint32_t readUnsigned32(const unsigned char* data, bool bigEndian){
+    if (bigEndian) {
+        return (uint32_t(data[0]) << 24) | (uint32_t(data[1]) << 16) | (uint32_t(data[2]) << 8) | data[3];
+    }
+    return (uint32_t(data[3]) << 24) | (uint32_t(data[2]) << 16) | (uint32_t(data[1]) << 8) | data[0];
+}
+
+/**
+ * @brief Function for finding start of IPv4 header behind link layer header
+ * @param linkType Link type of pcap
+ * @param frame Captured frame
+ * @param size Captured size of frame
+ * @return Offset of IPv4 header, -1 if frame doesn't carry IPv4
+*/
+static int64_t ipv4Offset(uint32_t linkType, const unsigned char* frame, size_t size){
+    uint16_t etherType;
+    size_t offset;
+    switch (linkType) {
+        case LINK_ETHERNET:
+            if (size < 14) {
+                return -1;
+            }
+            etherType = readBig16(frame + 12);
+            offset = 14;
+            while ((etherType == ETHERTYPE_VLAN || etherType == ETHERTYPE_QINQ) && size >= offset + 4) {
+                etherType = readBig16(frame + offset + 2);
+                offset += 4;
+            }
+            break;
+        case LINK_LINUX_SLL:
+            if (size < 16) {
+                return -1;
+            }
+            etherType = readBig16(frame + 14);
+            offset = 16;
+            break;
+        case LINK_LINUX_SLL2:
+            if (size < 20) {
+                return -1;
+            }
+            etherType = readBig16(frame);
+            offset = 20;
+            break;
+        case LINK_NULL:
+            // Address family is in byte order of capturing host, AF_INET is 2 everywhere
+            if (size < 4 || (frame[0] != 2 && frame[3] != 2)) {
+                return -1;
+            }
+            etherType = ETHERTYPE_IPV4;
+            offset = 4;
+            break;
+        default:
+            etherType = size > 0 && (frame[0] >> 4) == 4 ? ETHERTYPE_IPV4 : 0;
+            offset = 0;
+    }
+    return etherType == ETHERTYPE_IPV4 ? static_cast<int64_t>(offset) : -1;
+}
+
+/**
+ * @brief Function for reading supported options of request or OACK
+ * @param packet Parsed packet
+ * @return Options with valid values
+*/
+static OptionTable readOptions(const PacketView& packet){
+    OptionTable options;
+    packet.forEachOption([&options](const OptionView& option) {
+        std::optional<OptionId> id = findOption(option.name);
+        std::optional<uint64_t> value = parseOptionValue(option.value);
+        if (id && value) {
+            options.set(*id, *value);
+        }
+    });
+    return options;
+}
+
+bool isPcap(const std::string& path){
+    std::ifstream file(path, std::ios::binary);
+    unsigned char magic[4];
+    if (!file.read(reinterpret_cast<char*>(magic), sizeof(magic))) {
+        return false;
+    }
+    uint32_t little = readUnsigned32(magic, false);
+    uint32_t big = readUnsigned32(magic, true);
+    return little == PCAP_MAGIC_USEC || little == PCAP_MAGIC_NSEC || big == PCAP_MAGIC_USEC || big == PCAP_MAGIC_NSEC;
+}
+
+std::vector<CapturedSession> importPcap(const std::string& path){
+    std::ifstream file(path, std::ios::binary);
+    unsigned char header[24];
+    if (!file.read(reinterpret_cast<char*>(header), sizeof(header))) {
+        throw std::runtime_error("Failed to read pcap header of " + path);
+    }
+    bool bigEndian = readUnsigned32(header, true) == PCAP_MAGIC_USEC || readUnsigned32(header, true) == PCAP_MAGIC_NSEC;
+    uint32_t magic = readUnsigned32(header, bigEndian);
+    if (magic != PCAP_MAGIC_USEC && magic != PCAP_MAGIC_NSEC) {
+        throw std::runtime_error(path + " is not pcap file");
+    }
+    bool nanoseconds = magic == PCAP_MAGIC_NSEC;
+    uint32_t snapLength = readUnsigned32(header + 16, bigEndian);
+    if (snapLength == 0 || snapLength > PCAP_MAX_RECORD_SIZE) {
+        snapLength = PCAP_MAX_RECORD_SIZE;
+    }
+    uint32_t linkType = readUnsigned32(header + 20, bigEndian) & 0xffff;
+    if (linkType != LINK_NULL && linkType != LINK_ETHERNET && linkType != LINK_RAW && linkType != LINK_RAW_OPENBSD
+        && linkType != LINK_RAW_OPENBSD_ALT && linkType != LINK_LINUX_SLL && linkType != LINK_IPV4 && linkType != LINK_LINUX_SLL2) {
+        throw std::runtime_error("Unsupported link type " + std::to_string(linkType) + " of " + path);
+    }
+
+    std::vector<CapturedSession> sessions;
+    std::vector<Flow> flows;
+    // Client address to index of its latest flow
+    std::unordered_map<std::string, size_t> clients;
+    std::vector<unsigned char> frame;
+    unsigned char recordHeader[16];
+    while (file.read(reinterpret_cast<char*>(recordHeader), sizeof(recordHeader))) {
+        uint64_t seconds = readUnsigned32(recordHeader, bigEndian);
+        uint64_t fraction = readUnsigned32(recordHeader + 4, bigEndian);
+        uint64_t timeUs = seconds * 1000000 + (nanoseconds ? fraction / 1000 : fraction);
+        uint32_t captured = readUnsigned32(recordHeader + 8, bigEndian);
+        // Corrupted length would make whole rest of file one record, or allocation of up to 4 GiB
+        if (captured > snapLength) {
+            throw std::runtime_error("Record of " + std::to_string(captured) + " bytes exceeds snapshot length "
+                + std::to_string(snapLength) + " in " + path);
+        }
+        frame.resize(captured);
+        if (!file.read(reinterpret_cast<char*>(frame.data()), captured)) {
+            break;
+        }
+
+        int64_t ip = ipv4Offset(linkType, frame.data(), captured);
+        if (ip < 0 || captured < static_cast<size_t>(ip) + 20) {
+            continue;
+        }
+        const unsigned char* ipHeader = frame.data() + ip;
+        size_t ipHeaderSize = (ipHeader[0] & 0x0f) * 4;
+        // Fragments are skipped, TFTP packets fit into one datagram
+        bool fragment = (readBig16(ipHeader + 6) & 0x3fff) != 0;
+        if ((ipHeader[0] >> 4) != 4 || ipHeader[9] != IPPROTO_UDP || fragment || ipHeaderSize < 20
+            || captured < ip + ipHeaderSize + 8) {
+            continue;
+        }
+        const unsigned char* udp = ipHeader + ipHeaderSize;
+        uint16_t sourcePort = readBig16(udp);
+        uint16_t destinationPort = readBig16(udp + 2);
+        uint16_t udpSize = readBig16(udp + 4);
+        if (udpSize < 12) {
+            continue;
+        }
+        const char* payload = reinterpret_cast<const char*>(udp + 8);
+        size_t payloadCaptured = std::min<size_t>(captured - (ip + ipHeaderSize + 8), udpSize - 8);
+        char source[INET_ADDRSTRLEN], destination[INET_ADDRSTRLEN];
+        inet_ntop(AF_INET, ipHeader + 12, source, sizeof(source));
+        inet_ntop(AF_INET, ipHeader + 16, destination, sizeof(destination));
+        std::string sourceAddress = std::string(source) + ":" + std::to_string(sourcePort);
+        std::string destinationAddress = std::string(destination) + ":" + std::to_string(destinationPort);
+
+        if (destinationPort == PCAP_TFTP_PORT) {
+            // Truncated request can't be parsed, its filename would be wrong
+            if (payloadCaptured < static_cast<size_t>(udpSize - 8)) {
+                continue;
+            }
+            PacketView packet;
+            try {
+                packet = PacketView::parse(payload, payloadCaptured);
+            } catch (const std::exception& e) {
+                continue;
+            }
+            if (packet.opcode != Opcode::RRQ && packet.opcode != Opcode::WRQ) {
+                continue;
+            }
+            CapturedSession session;
+            session.client = sourceAddress;
+            session.type = packet.opcode == Opcode::RRQ ? SessionType::READ : SessionType::WRITE;
+            session.filename = std::string(packet.filename);
+            try {
+                session.mode = stringToMode(std::string(packet.mode));
+            } catch (const std::exception& e) {
+                continue;
+            }
+            session.options = readOptions(packet);
+
+            auto client = clients.find(sourceAddress);
+            if (client != clients.end()) {
+                Flow& flow = flows[client->second];
+                CapturedSession& previous = sessions[flow.index];
+                // Request repeated before any data flowed was retransmitted by client
+                if (!flow.done && !flow.dataSeen && previous.type == session.type && previous.filename == session.filename) {
+                    previous.requests++;
+                    flow.lastUs = timeUs;
+                    continue;
+                }
+            }
+            session.id = sessions.size() + 1;
+            session.offsetUs = timeUs;
+            clients[sourceAddress] = flows.size();
+            flows.push_back({sessions.size(), INITIAL_BLOCK_SIZE, 1, false, false, timeUs, timeUs});
+            sessions.push_back(session);
+            continue;
+        }
+
+        // Other packets belong to session of client port, in either direction
+        auto client = clients.find(sourceAddress);
+        if (client == clients.end() || sourcePort == PCAP_TFTP_PORT) {
+            client = clients.find(destinationAddress);
+        }
+        if (client == clients.end() || payloadCaptured < 4) {
+            continue;
+        }
+        Flow& flow = flows[client->second];
+        CapturedSession& session = sessions[flow.index];
+        flow.lastUs = timeUs;
+        uint16_t opcode = readBig16(reinterpret_cast<const unsigned char*>(payload));
+        if (opcode == static_cast<uint16_t>(Opcode::DATA)) {
+            flow.dataSeen = true;
+            uint16_t block = readBig16(reinterpret_cast<const unsigned char*>(payload) + 2);
+            size_t dataSize = udpSize - 12;
+            if (!flow.done && block == flow.nextBlock) {
+                session.bytes += dataSize;
+                flow.nextBlock++;
+                if (dataSize < flow.blockSize) {
+                    flow.done = true;
+                    session.ok = true;
+                }
+            }
+        } else if (opcode == static_cast<uint16_t>(Opcode::OACK) && payloadCaptured == static_cast<size_t>(udpSize - 8)) {
+            try {
+                OptionTable accepted = readOptions(PacketView::parse(payload, payloadCaptured));
+                if (accepted.has(OptionId::BLKSIZE)) {
+                    flow.blockSize = accepted.get(OptionId::BLKSIZE);
+                }
+            } catch (const std::exception& e) {
+                continue;
+            }
+        } else if (opcode == static_cast<uint16_t>(Opcode::ERROR) && !flow.done) {
+            flow.done = true;
+            session.ok = false;
+        }
+    }
+
+    if (sessions.empty()) {
+        return sessions;
+    }
+    // Packets of capture don't have to be ordered by time
+    uint64_t firstUs = std::min_element(sessions.begin(), sessions.end(), [](const CapturedSession& a, const CapturedSession& b) {
+        return a.offsetUs < b.offsetUs;
+    })->offsetUs;
+    for (const Flow& flow : flows) {
+        CapturedSession& session = sessions[flow.index];
+        session.offsetUs -= firstUs;
+        session.finished = flow.done || flow.dataSeen;
+        session.durationUs = flow.lastUs - flow.startUs;
+    }
+    std::stable_sort(sessions.begin(), sessions.end(), [](const CapturedSession& a, const CapturedSession& b) {
+        return a.offsetUs < b.offsetUs;
+    });
+    return sessions;
+}
@@ -7,9 +7,15 @@
 #include <string>
 #include <getopt.h>
 #include "server/tftp_server.hpp"
+#include "server/metrics_endpoint.hpp"
 #include "common/session.hpp"
 #include "common/logger.hpp"
+#include "common/trace.hpp"
+#include "common/net_emulator.hpp"
+#include "common/capture.hpp"
 #include <csignal>
+#include <sstream>
+#include <memory>
 
 /**
  * Signal handler for SIGINT
@@ -26,6 +32,17 @@ void signalHandler(int signal) {
 // Define the long options
 static struct option long_options[] = {
     {"port", optional_argument, 0, 'p'},
+    {"gro", no_argument, 0, 'g'},
+    {"low-latency", required_argument, 0, 'l'},
+    {"cpus", required_argument, 0, 'c'},
+    {"max-window", required_argument, 0, 'w'},
+    {"trace", required_argument, 0, 'T'},
+    {"metrics", required_argument, 0, 'M'},
+    {"emulate", required_argument, 0, 'E'},
+    {"capture", required_argument, 0, 'C'},
+    {"kernel-filter", no_argument, 0, 'F'},
+    {"rate-limit", required_argument, 0, 'r'},
+    {"log-level", required_argument, 0, 'L'},
     {0, 0, 0, 0} // End of array need to be filled with 0s
 };
 
@@ -37,26 +54,130 @@ static struct option long_options[] = {
 */
 int main(int argc, char* argv[]) {
     int port = 69;
+    SessionConfig sessionConfig;
+    FilterConfig filterConfig;
     std::string root_dirpath;
+    std::string metricsAddress;
     int option_index = 0;
     int option;
+    // Line of every packet of every session would flood output of busy server, packets are logged only with -L debug
+    Logger::instance().setLevel(LogLevel::INFO);
 
-    while ((option = getopt_long(argc, argv, "p:", long_options, &option_index)) != -1) {
+    while ((option = getopt_long(argc, argv, "p:gl:c:w:T:M:E:C:Fr:L:", long_options, &option_index)) != -1) {
         switch (option) {
             case 'p':
                 try{
                     port = std::stoi(optarg);
                 } catch (const std::exception& e) {
                     Logger::instance().log("Invalid port number. Port should be between 1 and 65535.");
-                    Logger ::instance().log("Usage: " + std::string(argv[0]) + " [-p port] root_dirpath");
+                    Logger ::instance().log("Usage: " + std::string(argv[0]) + " [-p port] [-g] [-l usec] [-c cpus] [-w max_window] [-T trace_dir] [-M metrics_address] [-E emulation] [-C capture_file] [-F] [-r rate[:burst]] [-L log_level] root_dirpath");
                     return 1;
                 }
                 if (port <= 0 || port > 65535) {
                     Logger::instance().log("Invalid port number. Port should be between 1 and 65535.");
-                    Logger ::instance().log("Usage: " + std::string(argv[0]) + " [-p port] root_dirpath");
+                    Logger ::instance().log("Usage: " + std::string(argv[0]) + " [-p port] [-g] [-l usec] [-c cpus] [-w max_window] [-T trace_dir] [-M metrics_address] [-E emulation] [-C capture_file] [-F] [-r rate[:burst]] [-L log_level] root_dirpath");
                     return 1;
                 }
                 break;
+            case 'g':
+                sessionConfig.udpGro = true;
+                break;
+            case 'l':
+            {
+                // Low latency mode, sockets are busy polled and session spins before blocking
+                int usec;
+                try{
+                    usec = std::stoi(optarg);
+                } catch (const std::exception& e) {
+                    usec = -1;
+                }
+                if (usec <= 0) {
+                    Logger::instance().log("Invalid low latency spin time, it should be positive number of microseconds.");
+                    return 1;
+                }
+                sessionConfig.busyPollUsec = usec;
+                sessionConfig.spinUsec = usec;
+                break;
+            }
+            case 'c':
+            {
+                // Comma separated list of CPUs
+                std::stringstream cpuList(optarg);
+                std::string cpu;
+                while (std::getline(cpuList, cpu, ',')) {
+                    try{
+                        sessionConfig.cpus.push_back(std::stoi(cpu));
+                    } catch (const std::exception& e) {
+                        Logger::instance().log("Invalid CPU list, it should be comma separated list of CPU numbers.");
+                        return 1;
+                    }
+                }
+                break;
+            }
+            case 'w':
+            {
+                // Window is buffered whole by session, so its size is bounded by memory of server
+                int window;
+                try{
+                    window = std::stoi(optarg);
+                } catch (const std::exception& e) {
+                    window = 0;
+                }
+                if (window < MIN_WINDOW_SIZE || window > MAX_WINDOW_SIZE) {
+                    Logger::instance().log("Invalid maximal window size, it should be between 1 and 65535.");
+                    return 1;
+                }
+                sessionConfig.maxWindowSize = window;
+                break;
+            }
+            case 'T':
+                if (!Tracer::instance().open(optarg)) {
+                    return 1;
+                }
+                break;
+            case 'E':
+                if (!NetworkEmulator::instance().configure(optarg)) {
+                    return 1;
+                }
+                break;
+            case 'M':
+                metricsAddress = optarg;
+                break;
+            case 'C':
+                if (!Capture::instance().open(optarg)) {
+                    return 1;
+                }
+                break;
+            case 'F':
+                filterConfig.kernelFilter = true;
+                break;
+            case 'r':
+            {
+                // Requests per second of one source IP, optionally followed by burst
+                std::string limit(optarg);
+                size_t colon = limit.find(':');
+                try{
+                    filterConfig.rate = std::stod(limit.substr(0, colon));
+                    filterConfig.burst = colon == std::string::npos ? 0 : std::stod(limit.substr(colon + 1));
+                } catch (const std::exception& e) {
+                    filterConfig.rate = -1;
+                }
+                if (filterConfig.rate <= 0 || filterConfig.burst < 0) {
+                    Logger::instance().log("Invalid rate limit, it should be positive number of requests per second, optionally followed by :burst.");
+                    return 1;
+                }
+                break;
+            }
+            case 'L':
+            {
+                std::optional<LogLevel> level = Logger::parseLevel(optarg);
+                if (!level) {
+                    Logger::instance().log("Invalid log level, it should be error, info or debug.");
+                    return 1;
+                }
+                Logger::instance().setLevel(*level);
+                break;
+            }
             case '?': // Option not recognized
                 return 1;
             default:
@@ -71,7 +192,7 @@ int main(int argc, char* argv[]) {
         Logger::instance().log("Root directory path: " + root_dirpath);
     } else {
         Logger::instance().log("Root directory path is not specified.");
-        Logger ::instance().log("Usage: " + std::string(argv[0]) + " [-p port] root_dirpath");
+        Logger ::instance().log("Usage: " + std::string(argv[0]) + " [-p port] [-g] [-l usec] [-c cpus] [-w max_window] [-T trace_dir] [-M metrics_address] [-E emulation] [-C capture_file] [-F] [-r rate[:burst]] [-L log_level] root_dirpath");
         return 1;
     }
 
@@ -79,7 +200,12 @@ int main(int argc, char* argv[]) {
     std::signal(SIGINT, signalHandler);
     // Initialize and start the TFTP server
     try {
-        TFTPServer tftpServer(port, root_dirpath);
+        // Endpoint only reads counters of sessions, it runs on its own thread until server stops
+        std::unique_ptr<MetricsEndpoint> metricsEndpoint;
+        if (!metricsAddress.empty()) {
+            metricsEndpoint = std::make_unique<MetricsEndpoint>(metricsAddress);
+        }
+        TFTPServer tftpServer(port, root_dirpath, sessionConfig, filterConfig);
         tftpServer.start();
     } catch (const std::exception& e) {
         Logger::instance().log("Failed to start TFTP server: " + std::string(e.what()));
@@ -0,0 +1,165 @@
+/**
+ * @file server/metrics_endpoint.cpp
+ * @brief Implementation of HTTP endpoint with metrics
+ * @author Lukas Vecerka (xvecer30)
+*/
+#include "server/metrics_endpoint.hpp"
+#include "common/metrics.hpp"
+#include "common/logger.hpp"
+#include <stdexcept>
+#include <cstring>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/stat.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+/**
+ * @brief Function for writing whole buffer into connection
+ * @param fd The connection
+ * @param data The data
+ * @return false if connection failed
+*/
+static bool writeAll(int fd, const std::string& data){
+    size_t written = 0;
+    while (written < data.size()) {
+        ssize_t result = send(fd, data.data() + written, data.size() - written, MSG_NOSIGNAL);
+        if (result < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        written += result;
+    }
+    return true;
+}
+
+MetricsEndpoint::MetricsEndpoint(const std::string& address) : listenFd(-1), stopping(false) {
+    if (!address.empty() && address[0] == '/') {
+        sockaddr_un addr{};
+        addr.sun_family = AF_UNIX;
+        if (address.size() >= sizeof(addr.sun_path)) {
+            throw std::runtime_error("Metrics socket path is too long");
+        }
+        std::strcpy(addr.sun_path, address.c_str());
+        listenFd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (listenFd < 0) {
+            throw std::runtime_error("Failed to open metrics socket");
+        }
+        // socket left by previous run would make bind fail, other file at path is never removed
+        struct stat status;
+        if (lstat(address.c_str(), &status) == 0) {
+            if (!S_ISSOCK(status.st_mode)) {
+                close(listenFd);
+                throw std::runtime_error("Metrics socket path " + address + " exists and is not a socket");
+            }
+            unlink(address.c_str());
+        }
+        if (bind(listenFd, (struct sockaddr*)&addr, sizeof(addr)) < 0) {
+            close(listenFd);
+            throw std::runtime_error("Failed to bind metrics socket " + address + ": " + strerror(errno));
+        }
+        unixPath = address;
+    } else {
+        sockaddr_in addr{};
+        addr.sin_family = AF_INET;
+        std::string host = "127.0.0.1";
+        std::string port = address;
+        size_t colon = address.rfind(':');
+        if (colon != std::string::npos) {
+            host = address.substr(0, colon);
+            port = address.substr(colon + 1);
+        }
+        int portNumber;
+        try {
+            portNumber = std::stoi(port);
+        } catch (const std::exception& e) {
+            portNumber = -1;
+        }
+        if (portNumber <= 0 || portNumber > 65535 || inet_pton(AF_INET, host.c_str(), &addr.sin_addr) != 1) {
+            throw std::runtime_error("Invalid metrics address " + address);
+        }
+        addr.sin_port = htons(portNumber);
+        listenFd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (listenFd < 0) {
+            throw std::runtime_error("Failed to open metrics socket");
+        }
+        int reuse = 1;
+        setsockopt(listenFd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+        if (bind(listenFd, (struct sockaddr*)&addr, sizeof(addr)) < 0) {
+            close(listenFd);
+            throw std::runtime_error("Failed to bind metrics socket " + address + ": " + strerror(errno));
+        }
+    }
+    if (listen(listenFd, SOMAXCONN) < 0) {
+        close(listenFd);
+        throw std::runtime_error("Failed to listen on metrics socket");
+    }
+    Logger::instance().log("Serving metrics on " + address);
+    thread = std::thread(&MetricsEndpoint::run, this);
+}
+
+MetricsEndpoint::~MetricsEndpoint(){
+    stopping.store(true);
+    if (thread.joinable()) {
+        thread.join();
+    }
+    close(listenFd);
+    if (!unixPath.empty()) {
+        unlink(unixPath.c_str());
+    }
+}
+
+void MetricsEndpoint::run(){
+    while (!stopping.load()) {
+        // endpoint wakes up periodically to see that it should stop
+        pollfd pfd{listenFd, POLLIN, 0};
+        if (poll(&pfd, 1, METRICS_POLL_MS) <= 0) {
+            continue;
+        }
+        int fd = accept4(listenFd, nullptr, nullptr, SOCK_CLOEXEC);
+        if (fd < 0) {
+            continue;
+        }
+        // slow client can't block endpoint for long
+        struct timeval tv;
+        tv.tv_sec = METRICS_IO_TIMEOUT_MS / 1000;
+        tv.tv_usec = METRICS_IO_TIMEOUT_MS % 1000 * 1000;
+        setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+        setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+        handleConnection(fd);
+        close(fd);
+    }
+}
+
+void MetricsEndpoint::handleConnection(int fd){
+    // only request line is needed, rest of headers is read so client doesn't get reset
+    std::string request;
+    char buffer[METRICS_REQUEST_SIZE];
+    while (request.size() < METRICS_REQUEST_SIZE && request.find("\r\n\r\n") == std::string::npos) {
+        ssize_t received = recv(fd, buffer, sizeof(buffer), 0);
+        if (received <= 0) {
+            break;
+        }
+        request.append(buffer, received);
+    }
+
+    std::string status = "200 OK";
+    std::string body;
+    if (request.rfind("GET /metrics ", 0) == 0 || request.rfind("GET / ", 0) == 0) {
+        body = Metrics::instance().render();
+    } else if (request.rfind("GET ", 0) == 0) {
+        status = "404 Not Found";
+        body = "Metrics are served on /metrics\n";
+    } else {
+        status = "405 Method Not Allowed";
+        body = "Only GET is supported\n";
+    }
+    writeAll(fd, "HTTP/1.0 " + status + "\r\n"
+        + "Content-Type: text/plain; version=0.0.4\r\n"
+        + "Content-Length: " + std::to_string(body.size()) + "\r\n"
+        + "Connection: close\r\n\r\n" + body);
+}
@@ -0,0 +1,105 @@
+/**
+ * @file server/request_filter.cpp
+ * @brief Implementation of filter of listener
+ * @author Lukas Vecerka (xvecer30)
+*/
+#include "server/request_filter.hpp"
+#include "common/session.hpp"
+#include "common/logger.hpp"
+#include <algorithm>
+#include <cstring>
+#include <sys/socket.h>
+#include <linux/filter.h>
+
+// Filter of UDP socket sees datagram from start of UDP header
+#define UDP_HEADER_SIZE 8
+
+bool attachRequestFilter(int sockfd){
+    struct sock_filter program[] = {
+        // Too short datagram fails the load, which drops it
+        BPF_STMT(BPF_LD | BPF_H | BPF_ABS, UDP_HEADER_SIZE),
+        BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, Opcode::RRQ, 2, 0),
+        BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, Opcode::WRQ, 1, 0),
+        BPF_STMT(BPF_RET | BPF_K, 0),
+        BPF_STMT(BPF_RET | BPF_K, 0xffffffff),
+    };
+    struct sock_fprog filter;
+    filter.len = sizeof(program) / sizeof(program[0]);
+    filter.filter = program;
+    if (setsockopt(sockfd, SOL_SOCKET, SO_ATTACH_FILTER, &filter, sizeof(filter)) < 0) {
+        Logger::instance().log(LogLevel::ERROR, "Failed to attach request filter: " + std::string(strerror(errno)));
+        return false;
+    }
+    return true;
+}
+
+RequestFilter::RequestFilter(FilterConfig config) : config(config) {
+    if (this->config.burst < 1) {
+        this->config.burst = std::max(1.0, this->config.rate);
+    }
+}
+
+bool RequestFilter::admit(const sockaddr_in& source, std::chrono::steady_clock::time_point now){
+    if (config.rate <= 0) {
+        return true;
+    }
+    auto bucket = buckets.find(source.sin_addr.s_addr);
+    if (bucket == buckets.end()) {
+        if (buckets.size() >= FILTER_MAX_SOURCES) {
+            evictIdle(now);
+        }
+        bucket = buckets.emplace(source.sin_addr.s_addr, Bucket{config.burst, now}).first;
+    } else {
+        double elapsed = std::chrono::duration<double>(now - bucket->second.last).count();
+        bucket->second.tokens = std::min(config.burst, bucket->second.tokens + elapsed * config.rate);
+        bucket->second.last = now;
+    }
+    if (bucket->second.tokens < 1) {
+        return false;
+    }
+    bucket->second.tokens -= 1;
+    return true;
+}
+
+void RequestFilter::evictIdle(std::chrono::steady_clock::time_point now){
+    // Bucket which would be full again behaves same as missing one
+    auto refill = std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(config.burst / config.rate));
+    for (auto bucket = buckets.begin(); bucket != buckets.end();) {
+        if (now - bucket->second.last >= refill) {
+            bucket = buckets.erase(bucket);
+        } else {
+            ++bucket;
+        }
+    }
+    // Flood from more sources than table holds can't be told apart, so table is reset rather than grown
+    if (buckets.size() >= FILTER_MAX_SOURCES) {
+        buckets.clear();
+    }
+}
+
+/**
+ * @brief Function for creating key of pending request
+ * @param source Address of client
+ * @param request The request
+ * @param size Size of request
+ * @return Address and port of client followed by request
+*/
+static std::string pendingKey(const sockaddr_in& source, const char* request, size_t size){
+    std::string key(sizeof(source.sin_addr.s_addr) + sizeof(source.sin_port) + size, '\0');
+    memcpy(key.data(), &source.sin_addr.s_addr, sizeof(source.sin_addr.s_addr));
+    memcpy(key.data() + sizeof(source.sin_addr.s_addr), &source.sin_port, sizeof(source.sin_port));
+    memcpy(key.data() + sizeof(source.sin_addr.s_addr) + sizeof(source.sin_port), request, size);
+    return key;
+}
+
+bool RequestFilter::claim(const sockaddr_in& source, const char* request, size_t size){
+    std::string key = pendingKey(source, request, size);
+    std::lock_guard<std::mutex> lock(pendingMutex);
+    return pending.insert(std::move(key)).second;
+}
+
+void RequestFilter::release(const sockaddr_in& source, const char* request, size_t size){
+    std::string key = pendingKey(source, request, size);
+    std::lock_guard<std::mutex> lock(pendingMutex);
+    pending.erase(key);
+}
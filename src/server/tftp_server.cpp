@@ -8,6 +8,11 @@
 #include "common/session.hpp"
 #include "common/exceptions.hpp"
 #include "common/logger.hpp"
+#include "common/probes.hpp"
+#include "common/capture.hpp"
+#include "common/packet_view.hpp"
+#include "common/metrics.hpp"
+#include "common/net_emulator.hpp"
 #include <filesystem>
 #include <iostream>
 #include <cstring>
@@ -16,6 +21,10 @@
 #include <netinet/in.h>
 #include <unistd.h>
 #include <future>
+#include <pthread.h>
+#include <algorithm>
+#include <optional>
+#include <variant>
 
 /**
  * @brief Function for creating new socket and bind it to new address and set initial timeout
@@ -49,6 +58,20 @@ int bind_new_socket(){
     return sockfd;
 }
 
+/**
+ * @brief Function for pinning calling thread on one CPU
+ * @param cpu The CPU number
+*/
+void pinThread(int cpu){
+    cpu_set_t cpuset;
+    CPU_ZERO(&cpuset);
+    CPU_SET(cpu, &cpuset);
+    int err = pthread_setaffinity_np(pthread_self(), sizeof(cpuset), &cpuset);
+    if (err != 0) {
+        Logger::instance().log("Failed to pin session thread on CPU " + std::to_string(cpu) + ": " + std::string(strerror(err)));
+    }
+}
+
 void TFTPServer::shutDown() {
     // Wait for all client threads to finish
     for (auto& future : clientFutures) {
@@ -67,9 +90,11 @@ void TFTPServer::shutDown() {
     return;
 }
 
-TFTPServer::TFTPServer(int port, const std::string& rootDirPath){
+TFTPServer::TFTPServer(int port, const std::string& rootDirPath, SessionConfig sessionConfig, FilterConfig filterConfig) : filter(filterConfig) {
         this->port = port;
         this->rootDirPath = rootDirPath;
+        this->sessionConfig = sessionConfig;
+        this->nextCpu = 0;
         // Create socket
         sockfd = socket(AF_INET, SOCK_DGRAM, 0);
         if (sockfd < 0) {
@@ -97,6 +122,11 @@ TFTPServer::TFTPServer(int port, const std::string& rootDirPath){
             std::cout << "Socket timeout set" << std::endl;
         }
 
+        if (filterConfig.kernelFilter && !attachRequestFilter(sockfd)) {
+            close(sockfd);
+            throw std::runtime_error("Failed to attach request filter");
+        }
+
         struct stat st = {0};
 
         if (stat(rootDirPath.c_str(), &st) == -1) {
@@ -115,12 +145,14 @@ void TFTPServer::start() {
 
     // Main loop of TFTP Server which is receiving requests from clients
     struct sockaddr_in client_addr;
-    socklen_t client_len = sizeof(client_addr);
     char buffer[BUFFER_SIZE];
+    // Listener has stream 0 of network emulator, sessions get streams in order in which their requests arrived
+    std::unique_ptr<Transport> emulated = NetworkEmulator::instance().openTransport(0);
+    Transport& listenerTransport = emulated ? *emulated : Transport::system();
+    uint64_t accepted = 0;
     while (true) {
         // Receive initial request from a clients
-        ssize_t received_bytes = recvfrom(sockfd, buffer, sizeof(buffer), 0,
-                                          (struct sockaddr *)&client_addr, &client_len);
+        ssize_t received_bytes = listenerTransport.receive(sockfd, buffer, sizeof(buffer), client_addr, 0);
         if (received_bytes < 0) {
             // If SIGINT was received, stop the server
             if (stopFlagServer->load()){
@@ -130,9 +162,29 @@ void TFTPServer::start() {
             }
             continue;
         }
+        std::chrono::steady_clock::time_point received = std::chrono::steady_clock::now();
+
+        // Flood is shed before anything else, so it doesn't even get ERROR replies
+        if (!filter.admit(client_addr, received)) {
+            Metrics::instance().add(Counter::REQUESTS_RATE_LIMITED);
+            continue;
+        }
+        // Malformed request is answered by listener, thread of session would only send ERROR, ERROR is
+        // serialized on stack, so flood of malformed datagrams doesn't allocate
+        if (std::optional<RequestRejection> rejection = PacketView::validateRequest(buffer, received_bytes)) {
+            Metrics::instance().add(Counter::REQUESTS_MALFORMED);
+            ErrorPacket errorPacket(rejection->code, rejection->message, client_addr);
+            errorPacket.send(nullptr, sockfd, listenerTransport);
+            continue;
+        }
+        // Client retransmitted request which wasn't answered yet, its session is already being created
+        if (!filter.claim(client_addr, buffer, received_bytes)) {
+            Metrics::instance().add(Counter::REQUESTS_DUPLICATE);
+            continue;
+        }
 
-        // Create new feature with handleClientRequest
-        auto future = std::async(std::launch::async, &TFTPServer::handleClientRequest, this, client_addr, buffer, received_bytes);
+        // Create new feature with handleClientRequest, request is copied because buffer is reused by next receive
+        auto future = std::async(std::launch::async, &TFTPServer::handleClientRequest, this, client_addr, std::vector<char>(buffer, buffer + received_bytes), received, ++accepted);
         clientFutures.push_back(std::move(future));
 
         // Remove finished futures
@@ -142,66 +194,100 @@ void TFTPServer::start() {
     }
 }
 
-void TFTPServer::handleClientRequest(const sockaddr_in& clientAddr, const char* buffer, ssize_t bufferSize) {
+void TFTPServer::handleClientRequest(const sockaddr_in& clientAddr, std::vector<char> request, std::chrono::steady_clock::time_point received, uint64_t stream) {
+    // Request is recorded by session thread, so capture doesn't slow down listener
+    Capture& capture = Capture::instance();
+    uint64_t captureId = capture.isEnabled() ? capture.recordRequest(clientAddr, request.data(), request.size(), received) : 0;
+    // Claim is released right before refusal ERROR or right after first packet of session is sent, so retransmission
+    // of request is dropped until it is answered and client which got answer can send same request again right away
+    auto release = [this, &clientAddr, &request]() { filter.release(clientAddr, request.data(), request.size()); };
+    // Emulated transport outlives session, which keeps reference to it
+    std::unique_ptr<Transport> emulated = NetworkEmulator::instance().openTransport(stream);
+    std::unique_ptr<ServerSession> session;
+    try {
+        session = createSession(emulated ? *emulated : Transport::system(), Clock::system(), sockfd, bind_new_socket, clientAddr, request.data(), request.size(), rootDirPath, sessionConfig, release);
+    } catch (const std::exception& e) {
+        // socket of session wasn't opened, nothing was sent
+        release();
+        throw;
+    }
+    if (!session) {
+        if (captureId != 0) {
+            capture.recordEnd(captureId, false, 0, received);
+        }
+        return;
+    }
+
+    // Pin session thread, CPUs are assigned in round robin
+    if (!sessionConfig.cpus.empty()) {
+        pinThread(sessionConfig.cpus[nextCpu++ % sessionConfig.cpus.size()]);
+    }
+    session->startTime = received;
+    session->handleSession();
+    if (captureId != 0) {
+        capture.recordEnd(captureId, session->sessionState == SessionState::RRQ_END || session->sessionState == SessionState::WRQ_END, session->bytesTransferred, received);
+    }
+}
+
+std::unique_ptr<ServerSession> TFTPServer::createSession(Transport& transport, const Clock& clock, int listenSocket, const std::function<int()>& openSocket,
+    const sockaddr_in& clientAddr, const char* request, size_t size, const std::string& rootDirPath, const SessionConfig& sessionConfig,
+    const std::function<void()>& onAnswered) {
+    // Every refusal is announced before its ERROR is sent
+    auto refuse = [&](ErrorCode code, const std::string& message, int socket) {
+        if (onAnswered) {
+            onAnswered();
+        }
+        ErrorPacket errorPacket(code, message, clientAddr);
+        errorPacket.send(nullptr, socket, transport);
+    };
+
     // Parse the first packet
-    std::unique_ptr<Packet> packet;
+    std::optional<PacketVariant> packet;
     try {
-        packet = Packet::parse(clientAddr, buffer, bufferSize);
+        packet = Packet::parse(clientAddr, request, size);
     }
     catch (const ParsingError& e) {
-        ErrorCode err = static_cast<ErrorCode>(ParsingError::errorCode);
-        ErrorPacket errorPacket(err, e.what(), clientAddr);
-        errorPacket.send(nullptr, sockfd);
-        return;
+        refuse(static_cast<ErrorCode>(ParsingError::errorCode), e.what(), listenSocket);
+        return nullptr;
     }
     catch (const OptionError& e) {
-        ErrorCode err = static_cast<ErrorCode>(OptionError::errorCode);
-        ErrorPacket errorPacket(err, e.what(), clientAddr);
-        errorPacket.send(nullptr, sockfd);
-        return;
+        refuse(static_cast<ErrorCode>(OptionError::errorCode), e.what(), listenSocket);
+        return nullptr;
     }
     catch (const std::exception& e) {
-        ErrorPacket errorPacket(ErrorCode::NOT_DEFINED, e.what(), clientAddr);
-        errorPacket.send(nullptr, sockfd);
-        return;
+        refuse(ErrorCode::NOT_DEFINED, e.what(), listenSocket);
+        return nullptr;
     }
 
-    // Handle the packet
-    switch (packet->getOpcode()){
-        case Opcode::RRQ: // RRQ
-        {
-            int sockfd = bind_new_socket();
-            ReadRequestPacket* readPacket = dynamic_cast<ReadRequestPacket*>(packet.get());
-            readPacket->filename = rootDirPath + "/" + readPacket->filename;
-            if (!std::filesystem::exists(readPacket->filename)){
-                ErrorPacket errorPacket(ErrorCode::FILE_NOT_FOUND, "File not found", clientAddr);
-                errorPacket.send(nullptr, sockfd);
-                close(sockfd);
-                break;
-            }
-            ServerSession readSession(sockfd, clientAddr, readPacket->filename, "", readPacket->mode, SessionType::READ, readPacket->options, rootDirPath);
-            readSession.handleSession();
-            break;
+    // Only RRQ and WRQ start session
+    ReadRequestPacket* readPacket = std::get_if<ReadRequestPacket>(&*packet);
+    WriteRequestPacket* writePacket = std::get_if<WriteRequestPacket>(&*packet);
+    if (readPacket == nullptr && writePacket == nullptr) {
+        refuse(ErrorCode::ILLEGAL_OPERATION, "Illegal TFTP operation", listenSocket);
+        return nullptr;
+    }
+
+    int sessionSockfd = openSocket();
+    std::unique_ptr<ServerSession> session;
+    if (readPacket != nullptr) {
+        readPacket->filename = rootDirPath + "/" + readPacket->filename;
+        if (!std::filesystem::exists(readPacket->filename)){
+            refuse(ErrorCode::FILE_NOT_FOUND, "File not found", sessionSockfd);
+            transport.close(sessionSockfd);
+            return nullptr;
         }
-        case Opcode::WRQ: // WRQ
-        {
-            int sockfd = bind_new_socket();
-            WriteRequestPacket* writePacket = dynamic_cast<WriteRequestPacket*>(packet.get());
-            writePacket->filename = rootDirPath + "/" + writePacket->filename;
-            if (std::filesystem::exists(writePacket->filename)){
-                ErrorPacket errorPacket(ErrorCode::FILE_ALREADY_EXISTS, "File already exists", clientAddr);
-                errorPacket.send(nullptr, sockfd);
-                close(sockfd);
-                break;
-            }
-            ServerSession writeSession(sockfd, clientAddr, "", writePacket->filename, writePacket->mode, SessionType::WRITE, writePacket->options, rootDirPath);
-            writeSession.handleSession();
-            break;
+        session = std::make_unique<ServerSession>(sessionSockfd, clientAddr, readPacket->filename, "", readPacket->mode, SessionType::READ, readPacket->options, rootDirPath, transport, clock);
+    } else {
+        writePacket->filename = rootDirPath + "/" + writePacket->filename;
+        if (std::filesystem::exists(writePacket->filename)){
+            refuse(ErrorCode::FILE_ALREADY_EXISTS, "File already exists", sessionSockfd);
+            transport.close(sessionSockfd);
+            return nullptr;
         }
-        default:
-            ErrorPacket errorPacket(ErrorCode::ILLEGAL_OPERATION, "Illegal TFTP operation", clientAddr);
-            errorPacket.send(nullptr, sockfd);
-            break;
+        session = std::make_unique<ServerSession>(sessionSockfd, clientAddr, "", writePacket->filename, writePacket->mode, SessionType::WRITE, writePacket->options, rootDirPath, transport, clock);
     }
-    return;
+    session->config = sessionConfig;
+    session->onStarted = onAnswered;
+    TFTP_PROBE4(session_create, session->sessionId, static_cast<int>(session->sessionType), ntohl(clientAddr.sin_addr.s_addr), ntohs(clientAddr.sin_port));
+    return session;
 }
@@ -0,0 +1,209 @@
+/**
+ * @file sim/main.cpp
+ * @brief Entrypoint for simulator, client and server sessions run in one process on virtual time
+ * and throughput, completion time and retransmissions of the run are reported
+ * @author Lukas Vecerka (xvecer30)
+*/
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <algorithm>
+#include <filesystem>
+#include <optional>
+#include <cstdlib>
+#include <getopt.h>
+#include <sys/resource.h>
+#include "sim/simulation.hpp"
+#include "common/logger.hpp"
+
+#define DEFAULT_EMULATION "delay=1"
+
+/**
+ * @brief Function for getting CPU time used by process
+ * @return User and system time in seconds
+*/
+static double cpuSeconds(){
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_utime.tv_sec + usage.ru_stime.tv_sec + (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1e6;
+}
+
+/**
+ * @brief Function for printing usage of simulator
+ * @param program Name of program
+*/
+static void printUsage(const char* program){
+    std::cerr << "Usage: " << program << " [-n sessions] [-s file_size] [-u upload_percent] [-a arrival_us]"
+              << " [-b blksize] [-w windowsize] [-o timeout] [-T] [-m mode] [-E emulation] [-R max_retries] [-B backoff]"
+              << " [-S seed] [-d root_dir] [-v]" << std::endl;
+}
+
+int main(int argc, char* argv[]){
+    SimConfig config;
+    std::string emulation = DEFAULT_EMULATION;
+    std::optional<uint64_t> seed;
+    std::string rootDir;
+    bool verbose = false;
+
+    static struct option longOptions[] = {
+        {"sessions", required_argument, nullptr, 'n'},
+        {"size", required_argument, nullptr, 's'},
+        {"upload", required_argument, nullptr, 'u'},
+        {"arrival", required_argument, nullptr, 'a'},
+        {"blksize", required_argument, nullptr, 'b'},
+        {"windowsize", required_argument, nullptr, 'w'},
+        {"timeout", required_argument, nullptr, 'o'},
+        {"tsize", no_argument, nullptr, 'T'},
+        {"mode", required_argument, nullptr, 'm'},
+        {"emulate", required_argument, nullptr, 'E'},
+        {"retries", required_argument, nullptr, 'R'},
+        {"backoff", required_argument, nullptr, 'B'},
+        {"seed", required_argument, nullptr, 'S'},
+        {"root", required_argument, nullptr, 'd'},
+        {"verbose", no_argument, nullptr, 'v'},
+        {nullptr, 0, nullptr, 0}
+    };
+
+    int option;
+    while ((option = getopt_long(argc, argv, "n:s:u:a:b:w:o:Tm:E:R:B:S:d:v", longOptions, nullptr)) != -1) {
+        try {
+            switch (option) {
+                case 'n':
+                    config.sessions = std::stoull(optarg);
+                    break;
+                case 's':
+                    config.fileSize = std::stoull(optarg);
+                    break;
+                case 'u':
+                    config.uploadPercent = std::stoul(optarg);
+                    if (config.uploadPercent > 100) {
+                        throw std::invalid_argument("upload");
+                    }
+                    break;
+                case 'a':
+                    config.arrivalUs = std::stoull(optarg);
+                    break;
+                case 'b':
+                case 'w':
+                case 'o': {
+                    OptionId id = option == 'b' ? OptionId::BLKSIZE : option == 'o' ? OptionId::TIMEOUT : OptionId::WINDOWSIZE;
+                    uint64_t min = option == 'b' ? MIN_BLOCK_SIZE : option == 'o' ? MIN_TIMEOUT : MIN_WINDOW_SIZE;
+                    uint64_t max = option == 'b' ? MAX_BLOCK_SIZE : option == 'o' ? MAX_TIMEOUT : MAX_WINDOW_SIZE;
+                    uint64_t value = std::stoull(optarg);
+                    if (value < min || value > max) {
+                        std::cerr << "Invalid " << optionName(id) << " value. It should be between " << min << " and " << max << "." << std::endl;
+                        return 1;
+                    }
+                    config.options.set(id, value);
+                    break;
+                }
+                case 'T':
+                    config.options.set(OptionId::TSIZE, 0);
+                    break;
+                case 'm':
+                    config.mode = stringToMode(optarg);
+                    break;
+                case 'E':
+                    emulation = optarg;
+                    break;
+                case 'R':
+                    config.maxRetries = std::stoi(optarg);
+                    if (config.maxRetries < 0) {
+                        throw std::invalid_argument("retries");
+                    }
+                    break;
+                case 'B':
+                    config.backoffFactor = std::stoi(optarg);
+                    if (config.backoffFactor < 1) {
+                        throw std::invalid_argument("backoff");
+                    }
+                    break;
+                case 'S':
+                    seed = std::stoull(optarg);
+                    break;
+                case 'd':
+                    rootDir = optarg;
+                    break;
+                case 'v':
+                    verbose = true;
+                    break;
+                default:
+                    printUsage(argv[0]);
+                    return 1;
+            }
+        } catch (const std::exception& e) {
+            std::cerr << "Invalid value of -" << static_cast<char>(option) << ": " << optarg << std::endl;
+            printUsage(argv[0]);
+            return 1;
+        }
+    }
+    if (config.sessions == 0) {
+        printUsage(argv[0]);
+        return 1;
+    }
+    if (!parseEmulatorSpec(emulation, config.network)) {
+        return 1;
+    }
+    if (seed) {
+        config.network.seed = *seed;
+    }
+
+    // Packets of thousands of sessions would be logged otherwise
+    Logger::instance().setEnabled(verbose);
+
+    // Server of simulation still reads and writes files, so it gets its own directory
+    bool temporary = rootDir.empty();
+    if (temporary) {
+        char dirTemplate[] = "/tmp/tftp-sim-XXXXXX";
+        if (mkdtemp(dirTemplate) == nullptr) {
+            std::cerr << "Failed to create root directory" << std::endl;
+            return 1;
+        }
+        rootDir = dirTemplate;
+    }
+    config.rootDir = rootDir;
+
+    SimResult result;
+    auto wallStart = std::chrono::steady_clock::now();
+    double cpuStart = cpuSeconds();
+    try {
+        Simulation simulation(config);
+        result = simulation.run();
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << std::endl;
+        if (temporary) {
+            std::filesystem::remove_all(rootDir);
+        }
+        return 1;
+    }
+    double wallSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - wallStart).count();
+    double cpuSecondsUsed = cpuSeconds() - cpuStart;
+    if (temporary) {
+        std::filesystem::remove_all(rootDir);
+    }
+
+    std::sort(result.durations.begin(), result.durations.end());
+    auto percentile = [&result](double p) {
+        if (result.durations.empty()) {
+            return 0.0;
+        }
+        return result.durations[std::min(result.durations.size() - 1, static_cast<size_t>(result.durations.size() * p))] * 1e3;
+    };
+
+    std::cout << std::fixed << std::setprecision(3);
+    std::cout << "sessions: " << result.completed << " completed, " << result.failed << " failed" << std::endl;
+    std::cout << "virtual time: " << result.seconds << " s" << std::endl;
+    if (result.seconds > 0) {
+        std::cout << "throughput: " << result.bytes / result.seconds / (1024 * 1024) << " MiB/s, "
+                  << result.completed / result.seconds << " sessions/s" << std::endl;
+    }
+    std::cout << "duration ms: p50 " << percentile(0.5) << ", p90 " << percentile(0.9) << ", p99 " << percentile(0.99)
+              << ", max " << (result.durations.empty() ? 0.0 : result.durations.back() * 1e3) << std::endl;
+    std::cout << "datagrams: " << result.datagramsSent << " sent, " << result.datagramsLost << " lost" << std::endl;
+    std::cout << "timeouts: " << result.timeouts << std::endl;
+    // Simulation never waits, wall time above CPU time is time when process didn't get CPU
+    std::cout << "wall time: " << wallSeconds << " s, cpu time: " << cpuSecondsUsed << " s" << std::endl;
+    return result.failed > 0 ? 1 : 0;
+}
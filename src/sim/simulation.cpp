@@ -0,0 +1,348 @@
+/**
+ * @file sim/simulation.cpp
+ * @brief Implementation of in-memory network and simulation loop
+ * @author Lukas Vecerka (xvecer30)
+*/
+#include "sim/simulation.hpp"
+#include "server/tftp_server.hpp"
+#include "common/packets.hpp"
+#include "common/download_sink.hpp"
+#include "common/upload_source.hpp"
+#include <fstream>
+#include <algorithm>
+#include <stdexcept>
+#include <cstring>
+#include <cerrno>
+#include <arpa/inet.h>
+
+SimNetwork::SimNetwork(const EmulatorConfig& config)
+    : datagramsSent(0), datagramsLost(0), bytesSent(0), current(), config(config), random(config.seed),
+      sequence(0), nextSocket(SIM_SOCKET_BASE), nextPort(SIM_EPHEMERAL_PORT_MIN) {}
+
+int SimNetwork::open(uint16_t port){
+    if (port == 0) {
+        // Ephemeral ports are assigned in cycle, ports of open sockets are skipped
+        for (uint32_t tried = 0; tried <= 65535 - SIM_EPHEMERAL_PORT_MIN && port == 0; tried++) {
+            uint16_t candidate = nextPort;
+            nextPort = nextPort == 65535 ? SIM_EPHEMERAL_PORT_MIN : nextPort + 1;
+            if (ports.find(candidate) == ports.end()) {
+                port = candidate;
+            }
+        }
+    }
+    if (port == 0 || ports.find(port) != ports.end()) {
+        errno = EADDRINUSE;
+        return -1;
+    }
+    int socket = nextSocket++;
+    sockets[socket] = Socket{port, {}};
+    ports[port] = socket;
+    return socket;
+}
+
+ssize_t SimNetwork::send(int socket, const char* data, size_t size, const sockaddr_in& addr){
+    auto it = sockets.find(socket);
+    if (it == sockets.end()) {
+        errno = EBADF;
+        return -1;
+    }
+    datagramsSent++;
+    bytesSent += size;
+
+    int64_t delaysMs[2];
+    int copies = config.fate(random, delaysMs);
+    if (copies == 0) {
+        datagramsLost++;
+        return size;
+    }
+    sockaddr_in from{};
+    from.sin_family = AF_INET;
+    from.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    from.sin_port = htons(it->second.port);
+    for (int i = 0; i < copies; i++) {
+        auto due = current + std::chrono::milliseconds(std::max<int64_t>(0, delaysMs[i]));
+        inFlight.push({due, sequence++, ntohs(addr.sin_port), Datagram{from, std::vector<char>(data, data + size)}});
+    }
+    return size;
+}
+
+ssize_t SimNetwork::receive(int socket, char* buffer, size_t size, sockaddr_in& from, int flags){
+    (void)flags;
+    auto it = sockets.find(socket);
+    if (it == sockets.end()) {
+        errno = EBADF;
+        return -1;
+    }
+    if (it->second.queue.empty()) {
+        errno = EAGAIN;
+        return -1;
+    }
+    Datagram& datagram = it->second.queue.front();
+    size_t count = std::min(size, datagram.data.size());
+    std::memcpy(buffer, datagram.data.data(), count);
+    from = datagram.from;
+    it->second.queue.pop_front();
+    return count;
+}
+
+bool SimNetwork::setReceiveTimeout(int socket, int seconds){
+    // Timeouts are planned by simulation loop from timeout of session
+    (void)seconds;
+    return sockets.find(socket) != sockets.end();
+}
+
+bool SimNetwork::localAddress(int socket, sockaddr_in& addr){
+    auto it = sockets.find(socket);
+    if (it == sockets.end()) {
+        return false;
+    }
+    addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = htons(it->second.port);
+    return true;
+}
+
+void SimNetwork::close(int socket){
+    auto it = sockets.find(socket);
+    if (it != sockets.end()) {
+        ports.erase(it->second.port);
+        sockets.erase(it);
+    }
+}
+
+std::optional<std::chrono::steady_clock::time_point> SimNetwork::nextArrival() const{
+    if (inFlight.empty()) {
+        return std::nullopt;
+    }
+    return inFlight.top().due;
+}
+
+void SimNetwork::advance(std::chrono::steady_clock::time_point to){
+    current = std::max(current, to);
+}
+
+std::vector<int> SimNetwork::deliver(){
+    std::vector<int> ready;
+    while (!inFlight.empty() && inFlight.top().due <= current) {
+        // Datagram is moved out, it is popped right away and data don't take part in ordering
+        InFlight& arriving = const_cast<InFlight&>(inFlight.top());
+        auto port = ports.find(arriving.port);
+        // Datagram for closed port is dropped like on real host
+        if (port != ports.end()) {
+            Socket& socket = sockets[port->second];
+            if (socket.queue.empty()) {
+                ready.push_back(port->second);
+            }
+            socket.queue.push_back(std::move(arriving.datagram));
+        }
+        inFlight.pop();
+    }
+    return ready;
+}
+
+Simulation::Simulation(const SimConfig& config)
+    : config(config), network(config.network), listenSocket(-1), serverAddr{}, started(0), random(config.network.seed) {}
+
+SimResult Simulation::run(){
+    // Text payload is valid in netascii as well
+    auto data = std::make_shared<std::vector<char>>(config.fileSize);
+    for (size_t i = 0; i < data->size(); i++) {
+        (*data)[i] = (i % 64 == 63) ? '\n' : static_cast<char>('a' + random() % 26);
+    }
+    payload = data;
+    if (config.uploadPercent < 100) {
+        std::ofstream file(config.rootDir + "/" + SIM_DOWNLOAD_FILE, std::ios::binary | std::ios::trunc);
+        file.write(data->data(), data->size());
+        if (!file) {
+            throw std::runtime_error("Failed to create " + config.rootDir + "/" + SIM_DOWNLOAD_FILE);
+        }
+    }
+
+    listenSocket = network.open(SIM_SERVER_PORT);
+    network.localAddress(listenSocket, serverAddr);
+
+    auto nextStart = network.now();
+    while (true) {
+        auto now = network.now();
+        while (started < config.sessions && nextStart <= now) {
+            startClient();
+            nextStart += std::chrono::microseconds(config.arrivalUs);
+        }
+
+        // Datagrams sent without delay arrive at the same time, so loop runs again before time moves
+        std::vector<int> ready = network.deliver();
+        for (int socket : ready) {
+            handleSocket(socket);
+        }
+        if (!ready.empty()) {
+            continue;
+        }
+
+        bool expired = false;
+        while (!deadlines.empty() && deadlines.top().first <= now) {
+            auto [deadline, socket] = deadlines.top();
+            deadlines.pop();
+            auto it = participants.find(socket);
+            if (it == participants.end() || it->second.deadline != deadline) {
+                continue;
+            }
+            expired = true;
+            result.timeouts++;
+            Participant& participant = it->second;
+            bool running = participant.client ? participant.client->handleTimeout() : participant.server->handleTimeout();
+            if (running) {
+                schedule(socket, participant);
+            } else {
+                finish(socket);
+            }
+        }
+        if (expired) {
+            continue;
+        }
+
+        // Jump to next event, nothing happens in between
+        std::optional<std::chrono::steady_clock::time_point> next = network.nextArrival();
+        if (!deadlines.empty() && (!next || deadlines.top().first < *next)) {
+            next = deadlines.top().first;
+        }
+        if (started < config.sessions && (!next || nextStart < *next)) {
+            next = nextStart;
+        }
+        if (!next) {
+            break;
+        }
+        network.advance(*next);
+    }
+
+    result.datagramsSent = network.datagramsSent;
+    result.datagramsLost = network.datagramsLost;
+    return result;
+}
+
+void Simulation::startClient(){
+    uint64_t number = started++;
+    bool upload = std::uniform_int_distribution<unsigned>(0, 99)(random) < config.uploadPercent;
+    int socket = network.open();
+    if (socket < 0) {
+        result.failed++;
+        return;
+    }
+
+    // Server refuses to overwrite files, so every upload gets its own name
+    std::string path = upload ? "sim-upload-" + std::to_string(number) : SIM_DOWNLOAD_FILE;
+    OptionTable requested = config.options;
+    if (requested.has(OptionId::TSIZE)) {
+        requested.set(OptionId::TSIZE, upload ? config.fileSize : 0);
+    }
+    sockaddr_in from{};
+    auto session = std::make_unique<ClientSession>(socket, from, path, path, config.mode, upload ? SessionType::WRITE : SessionType::READ, requested, "", network, network);
+    session->maxRetries = config.maxRetries;
+    session->backoffFactor = config.backoffFactor;
+    bool ok;
+    if (upload) {
+        session->source = std::make_unique<SharedSource>(payload);
+        WriteRequestPacket packet(path, config.mode, requested, serverAddr);
+        ok = session->start(packet);
+    } else {
+        session->sink = std::make_shared<DiscardSink>();
+        ReadRequestPacket packet(path, config.mode, requested, serverAddr);
+        ok = session->start(packet);
+    }
+    if (!ok) {
+        result.failed++;
+        return;
+    }
+    Participant& participant = participants[socket];
+    participant.client = std::move(session);
+    participant.started = network.now();
+    schedule(socket, participant);
+}
+
+void Simulation::handleSocket(int socket){
+    char buffer[BUFFER_SIZE];
+    if (socket == listenSocket) {
+        sockaddr_in from;
+        ssize_t size;
+        while ((size = network.receive(socket, buffer, sizeof(buffer), from, 0)) >= 0) {
+            handleRequest(from, buffer, size);
+        }
+        return;
+    }
+
+    while (true) {
+        auto it = participants.find(socket);
+        if (it == participants.end()) {
+            return;
+        }
+        Participant& participant = it->second;
+        // Sender is received into session like on socket
+        Session& session = participant.client ? static_cast<Session&>(*participant.client) : *participant.server;
+        ssize_t size = network.receive(socket, buffer, sizeof(buffer), session.dst_addr, 0);
+        if (size < 0) {
+            return;
+        }
+        bool running = participant.client ? participant.client->handleDatagram(buffer, size) : participant.server->handleReceived(buffer, size, size);
+        if (!running) {
+            finish(socket);
+            return;
+        }
+        schedule(socket, participant);
+    }
+}
+
+void Simulation::handleRequest(const sockaddr_in& from, const char* request, size_t size){
+    auto openSocket = [this]() {
+        int socket = network.open();
+        if (socket < 0) {
+            throw std::runtime_error("No free port for session");
+        }
+        return socket;
+    };
+    std::unique_ptr<ServerSession> session;
+    try {
+        session = TFTPServer::createSession(network, network, listenSocket, openSocket, from, request, size, config.rootDir, SessionConfig());
+    } catch (const std::runtime_error& e) {
+        return;
+    }
+    if (!session) {
+        return;
+    }
+    session->maxRetries = config.maxRetries;
+    session->backoffFactor = config.backoffFactor;
+    int socket = session->sessionSockfd;
+    if (!session->start()) {
+        return;
+    }
+    Participant& participant = participants[socket];
+    participant.server = std::move(session);
+    participant.started = network.now();
+    schedule(socket, participant);
+}
+
+void Simulation::schedule(int socket, Participant& participant){
+    int timeout = participant.client ? participant.client->timeout : participant.server->timeout;
+    participant.deadline = network.now() + std::chrono::seconds(timeout);
+    deadlines.push({participant.deadline, socket});
+}
+
+void Simulation::finish(int socket){
+    auto it = participants.find(socket);
+    if (it == participants.end()) {
+        return;
+    }
+    Participant& participant = it->second;
+    if (participant.client) {
+        SessionState state = participant.client->sessionState;
+        if (state == SessionState::RRQ_END || state == SessionState::WRQ_END) {
+            result.completed++;
+            result.bytes += participant.client->bytesTransferred;
+            double seconds = std::chrono::duration<double>(network.now() - participant.started).count();
+            result.durations.push_back(seconds);
+        } else {
+            result.failed++;
+        }
+        result.seconds = std::chrono::duration<double>(network.now().time_since_epoch()).count();
+    }
+    participants.erase(it);
+}
@@ -0,0 +1,338 @@
+/**
+ * @file trace/main.cpp
+ * @brief Entrypoint for decoder of trace files, records of all files are grouped by session
+ * and every session gets its timeline, RTT and gap statistics
+ * @author Lukas Vecerka (xvecer30)
+*/
+#include <iostream>
+#include <fstream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <map>
+#include <unordered_map>
+#include <algorithm>
+#include <ctime>
+#include <getopt.h>
+#include "common/trace.hpp"
+#include "common/session.hpp"
+
+#define DEFAULT_STALL_MS 1000
+
+/**
+ * @brief Record with time converted to wall clock of process which wrote it
+*/
+struct TimedRecord {
+    uint64_t realtimeNs;
+    TraceRecord record;
+};
+
+/**
+ * @brief Session is identified by process and id of session in it
+*/
+using SessionKey = std::pair<uint32_t, uint32_t>;
+
+static const char* stateNames[] = {"INITIAL", "WAITING_OACK", "WAITING_AFTER_OACK", "WAITING_ACK", "WAITING_LAST_ACK", "WAITING_DATA", "WRQ_END", "RRQ_END", "ERROR"};
+static_assert(sizeof(stateNames) / sizeof(stateNames[0]) == static_cast<size_t>(SessionState::ERROR) + 1, "Every session state needs its name");
+
+/**
+ * @brief Function for getting name of state
+ * @param state State from record
+ * @return Name of state
+*/
+static const char* stateName(uint8_t state){
+    return state <= static_cast<uint8_t>(SessionState::ERROR) ? stateNames[state] : "UNKNOWN";
+}
+
+/**
+ * @brief Function for getting name of opcode
+ * @param opcode Opcode from record
+ * @return Name of packet
+*/
+static const char* opcodeName(uint8_t opcode){
+    switch (opcode) {
+        case Opcode::RRQ: return "RRQ";
+        case Opcode::WRQ: return "WRQ";
+        case Opcode::DATA: return "DATA";
+        case Opcode::ACK: return "ACK";
+        case Opcode::ERROR: return "ERROR";
+        case Opcode::OACK: return "OACK";
+        default: return "-";
+    }
+}
+
+/**
+ * @brief Function for getting name of event
+ * @param event Event from record
+ * @return Name of event
+*/
+static const char* eventName(TraceEvent event){
+    switch (event) {
+        case TraceEvent::SENT: return "sent";
+        case TraceEvent::RECEIVED: return "recv";
+        case TraceEvent::TIMEOUT: return "timeout";
+        case TraceEvent::END: return "end";
+        default: return "unknown";
+    }
+}
+
+/**
+ * @brief Function for reading all records of trace file, oldest records of full ring are already overwritten
+ * @param path Path of file
+ * @param sessions Records are appended to their sessions
+ * @return false if file isn't valid trace file
+*/
+static bool readTraceFile(const std::string& path, std::map<SessionKey, std::vector<TimedRecord>>& sessions){
+    std::ifstream file(path, std::ios::binary);
+    TraceFileHeader header;
+    if (!file.read(reinterpret_cast<char*>(&header), sizeof(header))) {
+        std::cerr << path << ": file is too short" << std::endl;
+        return false;
+    }
+    if (header.magic != TRACE_MAGIC || header.version != TRACE_VERSION || header.recordSize != sizeof(TraceRecord) || header.capacity == 0) {
+        std::cerr << path << ": not a trace file of this version" << std::endl;
+        return false;
+    }
+
+    std::vector<TraceRecord> ring(header.capacity);
+    file.read(reinterpret_cast<char*>(ring.data()), ring.size() * sizeof(TraceRecord));
+    uint64_t head = header.head.load();
+    uint64_t count = std::min<uint64_t>(head, header.capacity);
+    for (uint64_t i = head - count; i < head; i++) {
+        const TraceRecord& record = ring[i % header.capacity];
+        uint64_t realtimeNs = header.realtimeNs + (record.timestampNs - header.monotonicNs);
+        sessions[{header.pid, record.sessionId}].push_back({realtimeNs, record});
+    }
+    return true;
+}
+
+/**
+ * @brief Function for formatting wall clock time
+ * @param realtimeNs Time in nanoseconds since epoch
+ * @return Time as HH:MM:SS.uuuuuu
+*/
+static std::string wallTime(uint64_t realtimeNs){
+    time_t seconds = realtimeNs / 1000000000;
+    struct tm local;
+    localtime_r(&seconds, &local);
+    char buffer[32];
+    strftime(buffer, sizeof(buffer), "%H:%M:%S", &local);
+    char micro[16];
+    snprintf(micro, sizeof(micro), ".%06llu", static_cast<unsigned long long>(realtimeNs % 1000000000 / 1000));
+    return std::string(buffer) + micro;
+}
+
+/**
+ * @brief Function for printing percentiles of samples in milliseconds
+ * @param name Name of statistic
+ * @param samples Samples in nanoseconds, they are sorted
+*/
+static void printStats(const std::string& name, std::vector<uint64_t>& samples){
+    std::cout << "  " << name << " n=" << samples.size();
+    if (samples.empty()) {
+        std::cout << std::endl;
+        return;
+    }
+    std::sort(samples.begin(), samples.end());
+    auto ms = [](uint64_t ns) { return ns / 1e6; };
+    std::cout << std::fixed << std::setprecision(3)
+              << " min=" << ms(samples.front())
+              << " p50=" << ms(samples[samples.size() / 2])
+              << " p99=" << ms(samples[std::min(samples.size() - 1, samples.size() * 99 / 100)])
+              << " max=" << ms(samples.back()) << " ms" << std::endl;
+}
+
+/**
+ * @brief Function for printing one record of timeline
+ * @param start Time of first record of session
+ * @param timed The record
+*/
+static void printRecord(uint64_t start, const TimedRecord& timed){
+    const TraceRecord& record = timed.record;
+    std::cout << "  " << std::fixed << std::setprecision(3) << std::setw(12) << (record.timestampNs - start) / 1e6 << " ms  "
+              << std::left << std::setw(8) << eventName(record.event) << std::setw(6) << opcodeName(record.opcode)
+              << std::right << std::setw(6) << record.block << std::setw(8) << record.bytes << " B  "
+              << stateName(record.fromState);
+    if (record.toState != record.fromState) {
+        std::cout << " -> " << stateName(record.toState);
+    }
+    if (record.retries > 0) {
+        std::cout << "  retries " << static_cast<int>(record.retries);
+    }
+    std::cout << std::endl;
+}
+
+/**
+ * @brief Function for printing summary of session and optionally its timeline
+ * @param key Process and id of session
+ * @param records Records of session sorted by time
+ * @param timeline true if every record is printed
+ * @param stallNs Gaps longer than this are listed as stalls
+*/
+static void printSession(const SessionKey& key, const std::vector<TimedRecord>& records, bool timeline, uint64_t stallNs){
+    uint64_t start = records.front().record.timestampNs;
+    uint64_t end = records.back().record.timestampNs;
+    uint64_t sent = 0, received = 0, timeouts = 0, sentBytes = 0, receivedBytes = 0;
+    const char* finalState = "RUNNING";
+
+    // Reply expected to every sent packet, RTT is measured only to replies of packets sent once (Karn)
+    struct Pending {
+        uint64_t sentNs;
+        bool retransmitted;
+    };
+    std::unordered_map<uint32_t, Pending> pending;
+    auto replyKey = [](uint8_t opcode, uint16_t block) { return (static_cast<uint32_t>(opcode) << 16) | block; };
+    const uint32_t anyReply = 0xffffffff;
+    std::vector<uint64_t> rtts;
+    std::vector<uint64_t> gaps;
+    std::vector<std::pair<uint64_t, const TimedRecord*>> stalls;
+    uint64_t lastReceived = 0;
+
+    for (const auto& timed : records) {
+        const TraceRecord& record = timed.record;
+        switch (record.event) {
+            case TraceEvent::SENT: {
+                sent++;
+                sentBytes += record.bytes;
+                // DATA is answered by ACK of same block, ACK by following DATA, request and OACK by anything
+                uint32_t expected = anyReply;
+                if (record.opcode == Opcode::DATA) {
+                    expected = replyKey(Opcode::ACK, record.block);
+                } else if (record.opcode == Opcode::ACK) {
+                    expected = replyKey(Opcode::DATA, record.block + 1);
+                } else if (record.opcode == Opcode::ERROR) {
+                    break;
+                }
+                auto [it, inserted] = pending.try_emplace(expected, Pending{record.timestampNs, false});
+                if (!inserted) {
+                    it->second.retransmitted = true;
+                }
+                break;
+            }
+            case TraceEvent::RECEIVED: {
+                received++;
+                receivedBytes += record.bytes;
+                if (lastReceived != 0) {
+                    gaps.push_back(record.timestampNs - lastReceived);
+                }
+                lastReceived = record.timestampNs;
+                auto it = pending.find(replyKey(record.opcode, record.block));
+                if (it == pending.end()) {
+                    it = pending.find(anyReply);
+                }
+                if (it != pending.end()) {
+                    if (!it->second.retransmitted) {
+                        rtts.push_back(record.timestampNs - it->second.sentNs);
+                    }
+                    pending.erase(it);
+                }
+                if (record.opcode == Opcode::ACK) {
+                    // ACK acknowledges whole window, DATA blocks before it won't get their own ACK
+                    std::erase_if(pending, [&](const auto& entry) {
+                        return (entry.first >> 16) == Opcode::ACK && static_cast<uint16_t>(record.block - (entry.first & 0xffff)) < 0x8000;
+                    });
+                }
+                break;
+            }
+            case TraceEvent::TIMEOUT:
+                timeouts++;
+                break;
+            case TraceEvent::END:
+                finalState = stateName(record.toState);
+                break;
+        }
+    }
+    for (size_t i = 1; i < records.size(); i++) {
+        uint64_t gap = records[i].record.timestampNs - records[i - 1].record.timestampNs;
+        if (gap >= stallNs) {
+            stalls.push_back({gap, &records[i]});
+        }
+    }
+
+    std::cout << "session " << key.first << "/" << key.second << " start " << wallTime(records.front().realtimeNs)
+              << std::fixed << std::setprecision(3) << " duration " << (end - start) / 1e6 << " ms"
+              << " final " << finalState << std::endl;
+    std::cout << "  sent " << sent << " received " << received << " timeouts " << timeouts
+              << " data sent " << sentBytes << " B received " << receivedBytes << " B" << std::endl;
+    printStats("rtt", rtts);
+    printStats("gap", gaps);
+    for (const auto& [gap, timed] : stalls) {
+        std::cout << "  stall " << std::fixed << std::setprecision(3) << gap / 1e6 << " ms before" << std::endl;
+        printRecord(start, *timed);
+    }
+    if (timeline) {
+        std::cout << "  timeline" << std::endl;
+        for (const auto& timed : records) {
+            printRecord(start, timed);
+        }
+    }
+    std::cout << std::endl;
+}
+
+/**
+ * @brief Function for logging usage of decoder
+ * @param program Name of program
+*/
+static void printUsage(const std::string& program){
+    std::cerr << "Usage: " << program << " [-v] [-s pid/session] [-g stall_ms] trace_file..." << std::endl;
+}
+
+/**
+ * Entrypoint for trace decoder
+ * @param argc The number of arguments
+ * @param argv The arguments
+ * @return 0 if successful, 1 otherwise
+*/
+int main(int argc, char* argv[]) {
+    bool timeline = false;
+    std::string selected;
+    uint64_t stallNs = static_cast<uint64_t>(DEFAULT_STALL_MS) * 1000000;
+    int option;
+
+    while ((option = getopt(argc, argv, "vs:g:")) != -1) {
+        switch (option) {
+            case 'v':
+                timeline = true;
+                break;
+            case 's':
+                // timeline of one session is what is usually wanted
+                selected = optarg;
+                timeline = true;
+                break;
+            case 'g':
+                try {
+                    stallNs = static_cast<uint64_t>(std::stod(optarg) * 1e6);
+                } catch (const std::exception& e) {
+                    printUsage(argv[0]);
+                    return 1;
+                }
+                break;
+            default:
+                printUsage(argv[0]);
+                return 1;
+        }
+    }
+    if (optind >= argc) {
+        printUsage(argv[0]);
+        return 1;
+    }
+
+    std::map<SessionKey, std::vector<TimedRecord>> sessions;
+    for (int i = optind; i < argc; i++) {
+        if (!readTraceFile(argv[i], sessions)) {
+            return 1;
+        }
+    }
+
+    for (auto& [key, records] : sessions) {
+        if (!selected.empty() && selected != std::to_string(key.first) + "/" + std::to_string(key.second)) {
+            continue;
+        }
+        // records of one session can come from more rings, stable sort keeps order of records with same time
+        std::stable_sort(records.begin(), records.end(), [](const TimedRecord& a, const TimedRecord& b) {
+            return a.record.timestampNs < b.record.timestampNs;
+        });
+        printSession(key, records, timeline, stallNs);
+    }
+    return 0;
+}
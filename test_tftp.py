@@ -1,9 +1,13 @@
+import os
 import socket
+import subprocess
 import time
 import struct
 import pytest
 
 server_address = ('127.0.0.1', 69)
+client_path = os.path.join(os.path.dirname(os.path.abspath(__file__)), 'tftp-client')
+sim_path = os.path.join(os.path.dirname(os.path.abspath(__file__)), 'tftp-sim')
 
 def send_rrq(sock, filename, mode, server_address):
     rrq_packet = struct.pack('!H', 1)
@@ -91,6 +95,8 @@ correct_options_test_cases = [
     (b'\x00\x01' + b'test\x00' + b'octet\x00' + b'TIMEOUT\x00255\x00', 6),  # RRQ for 'test' in octet mode with TIMEOUT option
     (b'\x00\x01' + b'test\x00' + b'octet\x00' + b'TSIZE\x000\x00', 6),  # RRQ for 'test' in octet mode with TSIZE option
     (b'\x00\x01test\x00octet\x00blksize\x0065467\x00', 6), # Block size exceed 65464 but server should accept it and set it to 65464
+    (b'\x00\x01' + b'test\x00' + b'octet\x00' + b'windowsize\x004\x00', 6),  # RRQ for 'test' in octet mode with windowsize option
+    (b'\x00\x01test\x00octet\x00windowsize\x0065535\x00', 6), # Window size exceed limit of server but server should accept it and lower it
 ]
 
 @pytest.mark.parametrize('data,expected_opcode', correct_options_test_cases)
@@ -112,6 +118,7 @@ options_out_of_range_test_cases = [
     (b'\x00\x01test\x00octet\x00tsize\x004290183241\x00', 3), # 65464*65535 + 1 Tsize too big
     (b'\x00\x01test\x00octet\x00tsize\x0030\x00', 3), # Read request with tsize not 0
     (b'\x00\x01test\x00octet\x00blksize\x00aaaa\x00', 3), # Block size not a number
+    (b'\x00\x01test\x00octet\x00windowsize\x000\x00', 3), # Window size under 1
 ]
 
 @pytest.mark.parametrize('data,expected_opcode', options_out_of_range_test_cases)
@@ -302,4 +309,272 @@ def test_exceed_blksize_option():
         data, _ = sock.recvfrom(1024)
         opcode, block_number = struct.unpack('!HH', data[:4])
         assert opcode == 5
-        assert block_number == 4
\ No newline at end of file
+        assert block_number == 4
+
+"""
+Client send RRQ with windowsize 2 and blksize 8, obtain OACK, send ACK with #0
+and obtain two DATA packets before sending ACK with #2
+"""
+def test_windowsize_option():
+    with socket.socket(socket.AF_INET, socket.SOCK_DGRAM) as sock:
+        initial_data = b'\x00\x01' + b'test\x00' + b'octet\x00' + b'blksize\x008\x00' + b'windowsize\x002\x00'
+        sock.sendto(initial_data, server_address)
+        data, next_address = sock.recvfrom(1024)
+
+        opcode = struct.unpack('!H', data[:2])[0]
+        assert opcode == 6
+
+        send_ack(sock, 0, next_address)
+
+        for expected_block in (1, 2):
+            data, _ = sock.recvfrom(1024)
+            opcode, block_number = struct.unpack('!HH', data[:4])
+            assert opcode == 3
+            assert block_number == expected_block
+
+        send_ack(sock, 2, next_address)
+
+        exit_test(sock, next_address)
+
+"""
+Client send RRQ with windowsize 65535, obtain OACK with windowsize lowered to limit of server 64
+"""
+def test_windowsize_above_server_limit():
+    with socket.socket(socket.AF_INET, socket.SOCK_DGRAM) as sock:
+        initial_data = b'\x00\x01' + b'test\x00' + b'octet\x00' + b'windowsize\x0065535\x00'
+        sock.sendto(initial_data, server_address)
+        data, next_address = sock.recvfrom(1024)
+
+        opcode = struct.unpack('!H', data[:2])[0]
+        assert opcode == 6
+        assert b'windowsize\x0064\x00' in data
+
+        exit_test(sock, next_address)
+
+"""
+Client send RRQ, obtain Data packet with #1, send ACK with #1 twice and
+obtain Data packet with #2 only once, duplicate ACK is ignored
+"""
+def test_duplicate_ack():
+    with socket.socket(socket.AF_INET, socket.SOCK_DGRAM) as sock:
+        send_rrq(sock, b'test', b'octet', server_address)
+        data, next_address = sock.recvfrom(1024)
+
+        opcode, block_number = struct.unpack('!HH', data[:4])
+        assert opcode == 3
+        assert block_number == 1
+
+        send_ack(sock, 1, next_address)
+        send_ack(sock, 1, next_address)
+
+        data, _ = sock.recvfrom(1024)
+        opcode, block_number = struct.unpack('!HH', data[:4])
+        assert opcode == 3
+        assert block_number == 2
+
+        sock.settimeout(2)
+        try:
+            data, _ = sock.recvfrom(1024)
+        except socket.timeout:
+            data = None
+
+        assert not data
+
+        send_ack(sock, 2, next_address)
+
+        exit_test(sock, next_address)
+
+"""
+Client send WRQ, obtain ACK with #0, send Data packet with #1 twice and
+obtain ACK with #1 for each of them
+"""
+def test_duplicate_data():
+    with socket.socket(socket.AF_INET, socket.SOCK_DGRAM) as sock:
+        sock.sendto(b'\x00\x02duplicate\x00octet\x00', server_address)
+        data, next_address = sock.recvfrom(1024)
+
+        opcode, block_number = struct.unpack('!HH', data[:4])
+        assert opcode == 4
+        assert block_number == 0
+
+        for _ in range(2):
+            send_data(sock, 1, b'a' * 512, next_address)
+
+            data, _ = sock.recvfrom(1024)
+            opcode, block_number = struct.unpack('!HH', data[:4])
+            assert opcode == 4
+            assert block_number == 1
+
+        exit_test(sock, next_address)
+
+"""
+Client send WRQ with windowsize 4, loses DATA #1 and sends only #2, #3 and #4, server
+acknowledges block before the gap only once, not for every block after it
+"""
+def test_out_of_order_data_acknowledged_once():
+    with socket.socket(socket.AF_INET, socket.SOCK_DGRAM) as sock:
+        sock.sendto(b'\x00\x02out_of_order\x00octet\x00windowsize\x004\x00', server_address)
+        data, next_address = sock.recvfrom(1024)
+        assert struct.unpack('!H', data[:2])[0] == 6
+
+        for block_number in (2, 3, 4):
+            send_data(sock, block_number, b'a' * 512, next_address)
+
+        data, _ = sock.recvfrom(1024)
+        assert struct.unpack('!HH', data[:4]) == (4, 0)
+
+        sock.settimeout(0.5)
+        with pytest.raises(socket.timeout):
+            sock.recvfrom(1024)
+
+        exit_test(sock, next_address)
+
+"""
+Client send RRQ with windowsize 4, acknowledges first window and then repeats that ACK
+as if first block of second window was lost, server sends second window again right away
+"""
+def test_repeated_ack_resends_window():
+    with socket.socket(socket.AF_INET, socket.SOCK_DGRAM) as sock:
+        initial_data = b'\x00\x01' + b'test\x00' + b'octet\x00' + b'blksize\x008\x00' + b'windowsize\x004\x00'
+        sock.sendto(initial_data, server_address)
+        data, next_address = sock.recvfrom(1024)
+        assert struct.unpack('!H', data[:2])[0] == 6
+
+        send_ack(sock, 0, next_address)
+        for expected_block in (1, 2, 3, 4):
+            data, _ = sock.recvfrom(1024)
+            assert struct.unpack('!HH', data[:4]) == (3, expected_block)
+        send_ack(sock, 4, next_address)
+        for expected_block in (5, 6, 7, 8):
+            data, _ = sock.recvfrom(1024)
+            assert struct.unpack('!HH', data[:4]) == (3, expected_block)
+
+        # default timeout of server is longer, so window can come back only as answer to ACK
+        send_ack(sock, 4, next_address)
+        sock.settimeout(0.5)
+        for expected_block in (5, 6, 7, 8):
+            data, _ = sock.recvfrom(1024)
+            assert struct.unpack('!HH', data[:4]) == (3, expected_block)
+
+        exit_test(sock, next_address)
+
+"""
+Client send RRQ with rangestart 4 and rangesize 10, obtain OACK with confirmed range,
+send ACK with #0 and obtain only DATA packet #1 with 10 bytes of range
+"""
+def test_range_option():
+    with socket.socket(socket.AF_INET, socket.SOCK_DGRAM) as sock:
+        initial_data = b'\x00\x01' + b'test\x00' + b'octet\x00' + b'rangestart\x004\x00' + b'rangesize\x0010\x00'
+        sock.sendto(initial_data, server_address)
+        data, next_address = sock.recvfrom(1024)
+
+        opcode = struct.unpack('!H', data[:2])[0]
+        assert opcode == 6
+        assert b'rangestart\x004\x00' in data
+        assert b'rangesize\x0010\x00' in data
+
+        send_ack(sock, 0, next_address)
+
+        data, _ = sock.recvfrom(1024)
+        opcode, block_number = struct.unpack('!HH', data[:4])
+        assert opcode == 3
+        assert block_number == 1
+        assert len(data) == 4 + 10
+
+        send_ack(sock, 1, next_address)
+
+"""
+Client uploads file in netascii mode with CR LF split by end of block, server stores it with
+native line ends, then client downloads it in netascii mode and obtains same encoded blocks
+"""
+def test_netascii_round_trip():
+    filename = b'netascii_' + str(time.time_ns()).encode()
+    blocks = [b'a' * 511 + b'\r', b'\nb\r\x00c']
+    with socket.socket(socket.AF_INET, socket.SOCK_DGRAM) as sock:
+        sock.sendto(b'\x00\x02' + filename + b'\x00netascii\x00', server_address)
+        data, next_address = sock.recvfrom(1024)
+        assert struct.unpack('!HH', data[:4]) == (4, 0)
+        for block_number, block in enumerate(blocks, 1):
+            send_data(sock, block_number, block, next_address)
+            data, _ = sock.recvfrom(1024)
+            assert struct.unpack('!HH', data[:4]) == (4, block_number)
+
+    time.sleep(0.5)
+    with socket.socket(socket.AF_INET, socket.SOCK_DGRAM) as sock:
+        send_rrq(sock, filename, b'netascii', server_address)
+        for block_number, block in enumerate(blocks, 1):
+            data, next_address = sock.recvfrom(1024)
+            assert struct.unpack('!HH', data[:4]) == (3, block_number)
+            assert data[4:] == block
+            send_ack(sock, block_number, next_address)
+
+"""
+Client uploads netascii file whose last block ends with bare CR, server keeps the CR
+at the end of stored file instead of waiting for its pair
+"""
+def test_netascii_trailing_cr():
+    filename = b'netascii_cr_' + str(time.time_ns()).encode()
+    with socket.socket(socket.AF_INET, socket.SOCK_DGRAM) as sock:
+        sock.sendto(b'\x00\x02' + filename + b'\x00netascii\x00', server_address)
+        data, next_address = sock.recvfrom(1024)
+        assert struct.unpack('!HH', data[:4]) == (4, 0)
+        send_data(sock, 1, b'abc\r', next_address)
+        data, _ = sock.recvfrom(1024)
+        assert struct.unpack('!HH', data[:4]) == (4, 1)
+
+    time.sleep(0.5)
+    with socket.socket(socket.AF_INET, socket.SOCK_DGRAM) as sock:
+        send_rrq(sock, filename, b'octet', server_address)
+        data, next_address = sock.recvfrom(1024)
+        assert struct.unpack('!HH', data[:4]) == (3, 1)
+        assert data[4:] == b'abc\r'
+        send_ack(sock, 1, next_address)
+
+"""
+Client send RRQ with blksize to server which answers ERROR, only ERROR 8 (refused options)
+makes client send request again without options, other error ends transfer after one request
+"""
+@pytest.mark.parametrize('error_code, retried', [(8, True), (1, False)])
+def test_client_error_during_option_negotiation(tmp_path, error_code, retried):
+    with socket.socket(socket.AF_INET, socket.SOCK_DGRAM) as sock:
+        sock.bind(('127.0.0.1', 0))
+        sock.settimeout(5)
+        client = subprocess.Popen([client_path, '-h', '127.0.0.1', '-p', str(sock.getsockname()[1]), '-f', 'test',
+                                   '-t', str(tmp_path / 'test'), '-b', '1024'], stdout=subprocess.DEVNULL, stderr=subprocess.DEVNULL)
+        try:
+            data, client_address = sock.recvfrom(1024)
+            assert struct.unpack('!H', data[:2])[0] == 1
+            assert b'blksize\x001024\x00' in data
+
+            sock.sendto(struct.pack('!HH', 5, error_code) + b'Error\x00', client_address)
+
+            sock.settimeout(2)
+            try:
+                data, _ = sock.recvfrom(1024)
+            except socket.timeout:
+                data = None
+
+            if retried:
+                assert data == b'\x00\x01test\x00octet\x00'
+            else:
+                assert not data
+                client.wait(timeout=5)
+        finally:
+            client.kill()
+            client.wait()
+
+"""
+Simulator jumps over timeouts in virtual time, so run with 50 times longer timeouts lasts
+50 times longer in virtual time but not in wall time
+"""
+def test_simulation_wall_time_independent_of_timeouts():
+    def run(timeout):
+        output = subprocess.run([sim_path, '-n', '100', '-E', 'loss=10', '-o', str(timeout)],
+                                capture_output=True, text=True, timeout=60).stdout
+        lines = dict(line.split(': ', 1) for line in output.splitlines() if ': ' in line)
+        return float(lines['virtual time'].split()[0]), float(lines['wall time'].split()[0])
+
+    short_virtual, short_wall = run(1)
+    long_virtual, long_wall = run(50)
+    assert long_virtual > 10 * short_virtual
+    assert long_wall < 3 * short_wall + 0.5